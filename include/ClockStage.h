@@ -0,0 +1,123 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref ClockStage Singleton class
+ * which moves the external time forward on a thread of its own
+ * instead of on the packet processors.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef CLOCKSTAGE_H_INCLUDED
+#define CLOCKSTAGE_H_INCLUDED
+
+#include "common/Constants.h"
+#include "common/Nanoseconds.h"
+#include "common/SpinThenParkWaiter.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief A Singleton stage between the packet processors and
+ * the Common::ExternalTime.
+ *
+ * The processors only @ref publish the newest arrival time they
+ * have seen, which is a compare and swap. A tick thread moves
+ * the external time to the newest published one; so the time
+ * subscriptions (i.e. the timer wheels of the
+ * PeriodicJobController) and the onNewTime of
+ * g_ptr_periodic_class_controller_instance on each new second
+ * run on that thread instead of holding up the packet loop.
+ *
+ * A processor publishing a time more than
+ * Common::kClockStageMaxSkewNanoseconds ahead of the external
+ * time waits for the tick thread to catch up, so the
+ * processors never run away from the jobs.
+ *
+ * While the tick thread is not running (see @ref start), the
+ * published times are applied by the publishing thread itself
+ * like before.
+ */
+class ClockStage
+{
+  private:
+    /**
+     * @brief The newest time published by the processors.
+     */
+    std::atomic<Common::Nanoseconds> m_published_time_ns{0};
+
+    std::atomic<bool> m_is_running{false};
+    std::atomic<bool> m_should_stop_running{false};
+
+    /**
+     * @brief Parks the tick thread while nothing new is
+     * published.
+     */
+    Common::SpinThenParkWaiter m_waiter;
+
+    /**
+     * @brief Guards starting and stopping the tick thread.
+     */
+    std::mutex m_mutex;
+    std::thread m_tick_thread;
+
+    /**
+     * @brief Move the external time to the given one and let
+     * the controller add the jobs of a new second.
+     */
+    static void advance(Common::Nanoseconds time_ns);
+
+    void runTicks();
+
+  // SINGLETON STUFF BEGIN //
+  public:
+    /**
+     * @brief Get Singleton instance
+     */
+    static ClockStage& getInstance();
+    ClockStage(ClockStage const&)     = delete;
+    void operator=(ClockStage const&) = delete;
+  private:
+    ClockStage() = default;
+
+    /**
+     * @brief Stops the tick thread if it is still running.
+     */
+    ~ClockStage();
+  // SINGLETON STUFF END // CLASS-SPECIFIC METHODS BEGIN //
+  public:
+    /**
+     * @brief Fire up the tick thread; does nothing if it is
+     * already running.
+     */
+    void start();
+
+    /**
+     * @brief Apply the last published time and join the tick
+     * thread; e.g. after the processors are joined.
+     */
+    void stop();
+
+    /**
+     * @brief Let the tick thread move the external time to the
+     * given one if it is newer than the published ones.
+     *
+     * Waits while the time is more than
+     * Common::kClockStageMaxSkewNanoseconds ahead of the
+     * external time.
+     *
+     * @note Thread-safe; called by every packet processor.
+     */
+    void publish(Common::Nanoseconds time_ns);
+
+    Common::Nanoseconds get_published_time_ns() const
+    {
+      return m_published_time_ns.load(std::memory_order_acquire);
+    }
+
+    bool is_running() const { return m_is_running; }
+};
+
+#endif // CLOCKSTAGE_H_INCLUDED
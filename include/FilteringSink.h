@@ -0,0 +1,100 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref FilteringSink class which
+ * drops the packets not matching any @ref PacketFilter before
+ * they reach the queues.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef FILTERINGSINK_H_INCLUDED
+#define FILTERINGSINK_H_INCLUDED
+
+#include "common/IPacketSink.h"
+#include "PacketFilter.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief A @ref Common::IPacketSink in front of another sink
+ * (e.g. the @ref PacketDispatcher) which only passes the
+ * packets matching at least one of its filters.
+ *
+ * The headers are decoded in bursts (see decodePackets) on the
+ * writer thread and every filter sees every packet, so each
+ * keeps its own match count. The packets passing are pushed
+ * with their decoded headers (e.g. the dispatcher hashes their
+ * flows from them). Without any filter, every packet is passed
+ * without being decoded.
+ *
+ * Dropping the packets at ingest saves the queues, the
+ * dispatching and the processors from the traffic nobody
+ * asked for.
+ *
+ * @note The push methods must only be called by one writer
+ * thread at a time.
+ */
+class FilteringSink : public Common::IPacketSink
+{
+  private:
+    Common::IPacketSink& m_next_sink;
+    std::vector<PacketFilter> m_filters;
+
+    uint64_t m_number_of_packets = 0;
+    uint64_t m_number_of_passed_packets = 0;
+
+    /**
+     * @brief The headers of the packets of the batch being
+     * pushed; handed to the next sink with the packets passing
+     * (see Common::IPacketSink::pushDecodedPackets), so that
+     * it does not decode them again. The capacity is kept for
+     * the next batches.
+     */
+    std::vector<DecodedPacket> m_decoded_packets;
+
+    bool matches(const Common::PcapPacket& packet,
+                 const DecodedPacket& decoded);
+
+  public:
+    FilteringSink(Common::IPacketSink& next_sink,
+                  std::vector<PacketFilter> filters);
+
+    void pushPacket(Common::PcapPacket&& packet) override;
+
+    /**
+     * @brief Filter the packets and push the ones passing to the
+     * next sink in a single batch; the dropped packets are
+     * released.
+     */
+    void pushPackets(Common::PcapPacket* packets,
+                     std::size_t number_of_packets) override;
+
+    void closeQueue() override;
+
+    std::size_t get_number_of_filters() const
+    {
+      return m_filters.size();
+    }
+    const PacketFilter& get_filter(std::size_t filter_index) const
+    {
+      return m_filters[filter_index];
+    }
+
+    uint64_t get_number_of_packets() const
+    {
+      return m_number_of_packets;
+    }
+
+    /**
+     * @brief #of packets pushed to the next sink.
+     */
+    uint64_t get_number_of_passed_packets() const
+    {
+      return m_number_of_passed_packets;
+    }
+};
+
+#endif // FILTERINGSINK_H_INCLUDED
@@ -0,0 +1,51 @@
+/**
+ * @file
+ *
+ * @brief This file contains the free functions computing the
+ * key used to keep the packets of a flow on the same processor
+ * thread.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef FLOWHASH_H_INCLUDED
+#define FLOWHASH_H_INCLUDED
+
+#include "PacketDecoder.h"
+#include "common/PcapPacket.h"
+#include <cstdint>
+
+/**
+ * @brief Signature of the functions which map a packet to the
+ * key its processor thread is chosen by; packets with the same
+ * key are processed by the same thread in arrival order.
+ */
+typedef uint64_t (*FlowKeyFunction)(const Common::PcapPacket&);
+
+/**
+ * @brief Hash the 5-tuple (addresses, ports and protocol) of an
+ * Ethernet frame carrying an IPv4/IPv6 packet.
+ *
+ * The hash is symmetric: both directions of a connection give
+ * the same value. The headers are found by decodePacket (see
+ * PacketDecoder.h), so VLAN tags (802.1Q/802.1ad) and IPv6
+ * extension headers are skipped. Fragmented packets are hashed
+ * without their ports since only the first fragment carries
+ * them; TCP, UDP and SCTP are the only protocols whose ports
+ * are used.
+ *
+ * @return The hash of the 5-tuple; 0 for the frames which are
+ * not IP or are too short to decode.
+ */
+uint64_t hashFiveTuple(const Common::PcapPacket& packet);
+
+/**
+ * @brief Same as @ref hashFiveTuple(const Common::PcapPacket&)
+ * for a packet whose headers are already decoded; e.g. by a
+ * sink in front of the @ref PacketDispatcher.
+ */
+uint64_t hashFiveTuple(const Common::PcapPacket& packet,
+                       const DecodedPacket& decoded);
+
+#endif // FLOWHASH_H_INCLUDED
@@ -0,0 +1,309 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref FlowTable class which keeps
+ * the counters of the flows seen by a packet processor, and the
+ * @ref FlowKey and @ref FlowEntry structs it is made of.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef FLOWTABLE_H_INCLUDED
+#define FLOWTABLE_H_INCLUDED
+
+#include "common/Constants.h"
+#include "common/Nanoseconds.h"
+#include "common/PcapPacket.h"
+#include "PacketDecoder.h"
+#include <algorithm> // min
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // memcmp
+
+/**
+ * @brief The canonical 5-tuple of a flow.
+ *
+ * Both directions of a connection give the same key: the
+ * endpoint with the smaller (address, port) is always the
+ * "a" side. IPv4 addresses are kept as IPv4-mapped IPv6
+ * addresses (::ffff:a.b.c.d) so that every key has the same
+ * size. The padding is zeroed so keys can be compared as
+ * octets.
+ */
+struct FlowKey
+{
+  uint8_t address_a[16] = {};
+  uint8_t address_b[16] = {};
+  uint16_t port_a = 0;
+  uint16_t port_b = 0;
+  uint8_t protocol = 0;
+  uint8_t padding[3] = {};
+
+  bool operator==(const FlowKey& other) const
+  {
+    return std::memcmp(this, &other, sizeof(FlowKey)) == 0;
+  }
+  bool operator!=(const FlowKey& other) const
+  {
+    return !(*this == other);
+  }
+};
+
+static_assert(sizeof(FlowKey) == 40, "FlowKey should be packed");
+
+/**
+ * @brief Hashes a FlowKey for the standard containers; see
+ * FlowTable::hashKey.
+ */
+struct FlowKeyHash
+{
+  std::size_t operator()(const FlowKey& key) const;
+};
+
+/**
+ * @brief Make the key of the flow of a decoded packet.
+ *
+ * Fragments are keyed without their ports since only the first
+ * fragment carries them (like hashFiveTuple in FlowHash.h).
+ *
+ * @param is_from_b if not nullptr, set to true if the packet
+ * was sent by the "b" side of the key.
+ * @return false if the packet is not IPv4/IPv6.
+ */
+bool makeFlowKey(const uint8_t* data, uint32_t caplen,
+                 const DecodedPacket& decoded, FlowKey& key,
+                 bool* is_from_b = nullptr);
+
+/**
+ * @brief A flow and its counters; exactly one cache line, so
+ * finding and updating a flow touches a single line of the
+ * entries.
+ *
+ * The last seen time is kept as milliseconds after the first
+ * seen time (rounded down) for the counters to fit in the line;
+ * i.e. a flow can last about 49 days.
+ */
+struct alignas(Common::kCacheLineSize) FlowEntry
+{
+  FlowKey key;
+
+  /** saturates instead of wrapping */
+  uint32_t number_of_packets;
+  uint32_t last_seen_offset_ms;
+
+  /** the original (not the captured) lengths of the packets */
+  uint64_t number_of_octets;
+
+  Common::Nanoseconds first_seen_ns;
+
+  Common::Nanoseconds get_last_seen_ns() const
+  {
+    return first_seen_ns + last_seen_offset_ms
+                           * Common::kNanosecondsPerMillisecond;
+  }
+};
+
+static_assert(sizeof(FlowEntry) == Common::kCacheLineSize,
+              "FlowEntry should take exactly one cache line");
+
+/**
+ * @brief An open addressing hash table of the flows seen by a
+ * single packet processor.
+ *
+ * Like a SwissTable, a control byte per slot holds 7 bits of
+ * the hash (the tag) of the flow in the slot; the control bytes
+ * of a group of 16 slots are compared to the tag of a key at
+ * once (with SSE2) and only the entries whose tags match are
+ * compared to the key. So a lookup usually reads one line of
+ * control bytes and one entry.
+ *
+ * The memory is bounded: the table is mapped once for
+ * max_number_of_flows flows (rounded up to a power of two
+ * slots with 1/8 kept free for the probing to stay short) and
+ * never grows or moves; a new flow is dropped (see
+ * get_number_of_dropped_flows) while the table is full. The
+ * flows land all over the mapping by their hashes and it is
+ * backed by huge pages, so expect the whole mapping (65 octets
+ * per slot) to be resident once the table holds more than a
+ * few thousand flows.
+ *
+ * @note Not thread-safe; every processor thread keeps a table
+ * of its own (the flows are spread over the processors by
+ * their hashes, see PacketDispatcher) so no locking is needed.
+ */
+class FlowTable
+{
+  public:
+    static constexpr std::size_t kGroupSize = 16;
+
+  private:
+    /* control bytes; a zero-filled page is an empty table */
+    static constexpr uint8_t kEmpty   = 0x00;
+    static constexpr uint8_t kDeleted = 0x01;
+    static constexpr uint8_t kFull    = 0x80; ///< | the tag
+
+    std::size_t m_max_number_of_flows;
+    std::size_t m_capacity; ///< #of slots; a power of two
+    std::size_t m_number_of_flows = 0;
+    std::size_t m_number_of_deleted_slots = 0;
+    std::size_t m_number_of_dropped_flows = 0;
+
+    /**
+     * @brief The group evictIdleFlows continues from.
+     */
+    std::size_t m_eviction_cursor = 0;
+
+    /* both point into a single mapping; the control bytes come
+    after the entries */
+    void* m_mapping = nullptr;
+    std::size_t m_mapping_size = 0;
+    FlowEntry* m_entries = nullptr;
+    uint8_t* m_control = nullptr;
+
+    /**
+     * @brief A bit per slot of the group whose control byte is
+     * the given one.
+     */
+    uint32_t matchGroup(std::size_t group, uint8_t control) const;
+
+    /**
+     * @return The slot of the key or m_capacity if it is not in
+     * the table.
+     */
+    std::size_t findSlot(const FlowKey& key, uint64_t hash) const;
+
+    /**
+     * @return The first empty or deleted slot on the probe
+     * sequence of the hash.
+     */
+    std::size_t findFreeSlot(uint64_t hash) const;
+
+    void eraseSlot(std::size_t slot);
+
+    /**
+     * @brief Move the flows within the table to get rid of the
+     * deleted slots which make the probe sequences long; no
+     * second table is mapped.
+     */
+    void rebuild();
+
+    void map(std::size_t capacity);
+    void unmap();
+
+  public:
+    /**
+     * @brief The hash the flows are placed in the table by.
+     */
+    static uint64_t hashKey(const FlowKey& key);
+
+    explicit FlowTable(std::size_t max_number_of_flows =
+                         Common::kMaxNumberOfFlowsPerProcessor);
+    ~FlowTable();
+    FlowTable(FlowTable const&)      = delete;
+    void operator=(FlowTable const&) = delete;
+
+    /**
+     * @brief Count a packet of the given flow, adding the flow
+     * if it is new.
+     *
+     * @param length the original length of the packet.
+     * @return The entry of the flow; nullptr if the flow is new
+     * and the table is full.
+     */
+    FlowEntry* update(const FlowKey& key,
+                      Common::Nanoseconds arrival_time_ns,
+                      uint32_t length);
+
+    /**
+     * @brief Same as above for a decoded packet.
+     *
+     * @return nullptr also if the packet is not IPv4/IPv6.
+     */
+    FlowEntry* update(const Common::PcapPacket& packet,
+                      const DecodedPacket& decoded);
+
+    /**
+     * @return The entry of the flow; nullptr if it is not in
+     * the table.
+     */
+    const FlowEntry* find(const FlowKey& key) const;
+
+    /**
+     * @return false if the flow is not in the table.
+     */
+    bool erase(const FlowKey& key);
+
+    /**
+     * @brief Remove the flows not seen for idle_timeout_ns
+     * (e.g. as of Common::ExternalTime) from the next
+     * number_of_slots slots.
+     *
+     * The table is swept a bit at a time (e.g. once per batch
+     * of packets) so that a table of millions of flows does not
+     * stall the processor; the sweep continues from where the
+     * last one stopped.
+     *
+     * @param on_evict called with every evicted entry before it
+     * is removed.
+     * @return #of evicted flows.
+     */
+    template <typename OnEvict>
+    std::size_t evictIdleFlows(Common::Nanoseconds now_ns,
+                               Common::Nanoseconds idle_timeout_ns,
+                               std::size_t number_of_slots,
+                               OnEvict&& on_evict)
+    {
+      std::size_t number_of_evicted_flows = 0;
+      const auto number_of_groups = m_capacity / kGroupSize;
+      auto number_of_groups_to_sweep = std::min(
+        number_of_groups,
+        (number_of_slots + kGroupSize - 1) / kGroupSize);
+      for (; number_of_groups_to_sweep > 0 && m_number_of_flows > 0;
+           number_of_groups_to_sweep--)
+      {
+        const auto first_slot = m_eviction_cursor * kGroupSize;
+        m_eviction_cursor = (m_eviction_cursor + 1)
+                            & (number_of_groups - 1);
+        for (auto slot = first_slot;
+             slot < first_slot + kGroupSize; slot++)
+        {
+          if ((m_control[slot] & kFull) == 0)
+            continue;
+          const auto& entry = m_entries[slot];
+          if (now_ns - entry.get_last_seen_ns() < idle_timeout_ns)
+            continue;
+          on_evict(entry);
+          eraseSlot(slot);
+          number_of_evicted_flows++;
+        }
+      }
+      return number_of_evicted_flows;
+    }
+
+    std::size_t evictIdleFlows(Common::Nanoseconds now_ns,
+                               Common::Nanoseconds idle_timeout_ns,
+                               std::size_t number_of_slots)
+    {
+      return evictIdleFlows(now_ns, idle_timeout_ns,
+                            number_of_slots,
+                            [](const FlowEntry&) {});
+    }
+
+    std::size_t size() const { return m_number_of_flows; }
+    std::size_t get_capacity() const { return m_capacity; }
+    std::size_t get_max_number_of_flows() const
+    {
+      return m_max_number_of_flows;
+    }
+
+    /**
+     * @brief #of new flows not added since the table was full.
+     */
+    std::size_t get_number_of_dropped_flows() const
+    {
+      return m_number_of_dropped_flows;
+    }
+};
+
+#endif // FLOWTABLE_H_INCLUDED
@@ -0,0 +1,83 @@
+/**
+ * @file
+ *
+ * @brief This file contains the interface for the readers of
+ * capture files such as @ref PcapFileReader and
+ * @ref PcapngFileReader.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef IPCAPREADER_H_INCLUDED
+#define IPCAPREADER_H_INCLUDED
+
+#include "common/Nanoseconds.h"
+#include "common/PcapPacket.h"
+#include <cstdint>
+
+/**
+ * @brief Where a reader is in its capture file; enough for
+ * @ref IPcapReader::seek to resume reading from there later,
+ * e.g. from a checkpoint of a @ref PcapIndex.
+ */
+struct PcapReaderPosition
+{
+  /** offset of the next record (block) to read in the file */
+  uint64_t offset = 0;
+
+  /** pcapng only: offset of the Section Header Block of the
+   * section the offset is in */
+  uint64_t section_offset = 0;
+
+  /** pcapng only: #of interfaces of the section described
+   * before the offset */
+  uint32_t number_of_interfaces = 0;
+  uint32_t reserved = 0;
+
+  /** pcapng only: arrival time of the packet before the
+   * offset; the Simple Packet Blocks do not carry one */
+  Common::Nanoseconds last_arrival_time_ns = 0;
+};
+
+/**
+ * @brief interface class which represents a reader producing
+ * the packets of a capture file one by one in file order.
+ *
+ * The writer of the PcapPacketQueue only depends on this
+ * interface so that it does not need to know the format of the
+ * capture file it is reading.
+ */
+class IPcapReader
+{
+public:
+  virtual ~IPcapReader() {}
+
+  /**
+   * @brief Fill the given packet with the next packet of the
+   * capture file.
+   *
+   * @param packet The packet to fill.
+   * @return true  if a packet has been read.
+   * @return false at the end of the capture file or if the
+   * rest of the file cannot be decoded.
+   */
+  virtual bool nextPacket(Common::PcapPacket& packet) = 0;
+
+  /**
+   * @brief The position of the next packet to read (or of the
+   * blocks before it).
+   */
+  virtual PcapReaderPosition get_position() const = 0;
+
+  /**
+   * @brief Continue reading from a position returned by
+   * @ref get_position for the same file, without reading the
+   * packets in between.
+   *
+   * @return false if the position is not valid in the file.
+   */
+  virtual bool seek(const PcapReaderPosition& position) = 0;
+};
+
+#endif // IPCAPREADER_H_INCLUDED
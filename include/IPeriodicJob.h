@@ -12,11 +12,103 @@
 #ifndef IPERIODICJOB_H_INCLUDED
 #define IPERIODICJOB_H_INCLUDED
 
+#include "JobHandle.h"
+#include "common/Constants.h"
+#include "common/InplaceFunction.h"
+#include "common/Nanoseconds.h"
+#include <atomic>
+#include <cstdint>
 #include <ctime>
-#include <string>
+#include <cstddef>
 #include <mutex>
+#include <type_traits>
+#include <utility>
 
-typedef std::string JOBID;
+typedef JobHandle JOBID;
+
+/**
+ * @brief The consecutive periods a job is run for at once:
+ * normally one, more when the job catches up the periods the
+ * external time has jumped over (see Common::CatchUpMode).
+ *
+ * The times are the nominal ones (when each period was due)
+ * rather than the time the job happens to be run at, so the
+ * job sees the same times however fast the capture is
+ * replayed.
+ */
+struct JobCycles
+{
+  /** nominal time of the first period */
+  Common::Nanoseconds first_time_ns = 0;
+
+  /** the time between two consecutive periods */
+  Common::Nanoseconds period_ns = 0;
+
+  uint64_t number_of_cycles = 1;
+
+  Common::Nanoseconds get_time_ns(uint64_t cycle_index) const
+  {
+    return first_time_ns 
+           + static_cast<Common::Nanoseconds>(cycle_index) 
+             * period_ns;
+  }
+};
+
+/**
+ * @brief Run the given callable for the cycles of a job.
+ *
+ * The callable can take
+ * - a const JobCycles&: it is called once for all the cycles
+ *   run at once (e.g. the catch-up of a gap in the capture),
+ * - a Common::Nanoseconds: it is called once per cycle with
+ *   the nominal time of the cycle,
+ * - nothing: it is called once per cycle.
+ */
+template <typename JobType>
+void runJobCycles(JobType& job, const JobCycles& cycles)
+{
+  if constexpr (std::is_invocable_v<JobType&, const JobCycles&>)
+    job(cycles);
+  else
+    for (uint64_t i = 0; i < cycles.number_of_cycles; i++)
+      if constexpr (std::is_invocable_v<JobType&, 
+                                        Common::Nanoseconds>)
+        job(cycles.get_time_ns(i));
+      else
+        job();
+}
+
+/**
+ * @brief The work a job does in its cycles; any callable
+ * @ref runJobCycles accepts. Small callables are stored inline
+ * in the job (no heap allocation).
+ */
+class JobPayload 
+  : public Common::InplaceFunction<void(const JobCycles&), 
+                                   Common::kJobPayloadInlineSize>
+{
+  private:
+    using Function = 
+      Common::InplaceFunction<void(const JobCycles&), 
+                              Common::kJobPayloadInlineSize>;
+
+  public:
+    JobPayload() = default;
+    JobPayload(std::nullptr_t) {}
+
+    template <typename JobType,
+              typename = std::enable_if_t<!std::is_same<
+                std::decay_t<JobType>, JobPayload>::value>>
+    JobPayload(JobType&& job)
+      : Function(
+          [job = std::forward<JobType>(job)](
+            const JobCycles& cycles) mutable
+          {
+            runJobCycles(job, cycles);
+          })
+    {
+    }
+};
 
 /**
  * @brief interface class which represents a @ref PeriodicJob
@@ -27,25 +119,40 @@ typedef std::string JOBID;
  * provides a way to change this period even after starting
  * the job.
  *
+ * A job does not keep track of the time itself; whoever
+ * schedules it (e.g. the @ref PeriodicJobController) calls
+ * @ref run once per period.
+ *
  */
 class IPeriodicJob
 {
 protected:
   
   /**
-   * @brief period (period) of the job.
+   * @brief period (period) of the job in nanoseconds.
    *
    * Each job does some job where there should pass "period"
    * amount of time after the start of the previous job before
    * carrying onto the next job.
    *
+   * Atomic so that the scheduler can read it without waiting
+   * for a cycle in progress.
+   *
    */
-  struct timeval m_period = {1, 0};
+  std::atomic<Common::Nanoseconds> m_period_ns{
+    Common::kNanosecondsPerSecond};
 
   /**
-   * @brief if true, exit the run function 
+   * @brief What to do with the periods missed when the
+   * external time jumps.
    */
-  bool m_should_stop_running = false;
+  std::atomic<Common::CatchUpMode> m_catch_up_mode{
+    Common::kCatchUpMode};
+
+  /**
+   * @brief if true, the run function does nothing anymore
+   */
+  std::atomic<bool> m_should_stop_running{false};
 public:
   /**
    * @brief Useful when destructing child object via the parent.
@@ -62,28 +169,50 @@ public:
   /**
    * @brief change the period (period) of the job 
    *
-   * @param period the new period value for the job
+   * @param period_ns the new period value for the job
    */
-  virtual void changePeriod (struct timeval period) = 0;
+  virtual void changePeriod (Common::Nanoseconds period_ns) = 0;
+
+  void changePeriod (struct timeval period)
+  {
+    changePeriod(Common::toNanoseconds(period));
+  }
   
   /**
-   * @brief start the periodic job and run periodically
+   * @brief run the given cycles of the periodic job in order.
+   *
+   * Called by the scheduler of the job when its periods are
+   * due; the calls are not expected to overlap but might come
+   * from different threads.
    */
-  virtual void run() = 0;
+  virtual void run(const JobCycles& cycles) = 0;
 
   /**
    * @brief stop the periodic job.
    *
-   * Causes "run" method to come to a halt.
+   * The calls to "run" method after this call do nothing.
    */
   virtual void stop() = 0; 
 
   /**
-   * @brief Get the internal period object
+   * @brief Get the period of the job as a timeval.
    *
-   * @return const struct timeval& 
+   * @return struct timeval converted from the period in
+   * nanoseconds; a copy, since the period might be changed
+   * concurrently.
    */
-  virtual const struct timeval& get_period() = 0;
+  virtual struct timeval get_period() = 0;
+
+  virtual Common::Nanoseconds get_period_ns() = 0;
+
+  void set_catch_up_mode(Common::CatchUpMode catch_up_mode)
+  {
+    m_catch_up_mode = catch_up_mode;
+  }
+  Common::CatchUpMode get_catch_up_mode() const
+  {
+    return m_catch_up_mode;
+  }
 };
 
 #endif // IPERIODICJOB_H_INCLUDED
\ No newline at end of file
@@ -20,6 +20,7 @@
 #include <mutex>
 #include <vector>
 #include <memory> // shared_ptr
+#include <utility>
 
 /**
  * @brief thread-safe interface class which represents a
@@ -68,14 +69,42 @@ public:
    * @note Do not discard the return value or else there is no
    * way to remove the job easily.
    *
-   * @param period period of the new job to be added
-   * @return JOBID "" ON FAILURE .
+   * @param period_ns period of the new job to be added
+   * @return JOBID an empty handle ON FAILURE .
    * @return JOBID Job ID of the newly added job ON SUCCESS
    */
   /*[[gnu::warn_unused_result]]*/
   [[nodiscard]] /*[[gnu::warn_unused_result]]*/
   virtual JOBID addJob(
-    struct timeval period ) = 0;
+    Common::Nanoseconds period_ns ) = 0;
+
+  [[nodiscard]] /*[[gnu::warn_unused_result]]*/
+  JOBID addJob( struct timeval period )
+  {
+    return addJob(Common::toNanoseconds(period));
+  }
+
+  /**
+   * @brief Add a new job which runs the given payload in each
+   * of its cycles.
+   *
+   * @param period_ns period of the new job to be added
+   * @param payload the work of the job, e.g. a lambda; taking
+   * a Common::Nanoseconds (or a const JobCycles&) it is given
+   * the nominal times of the cycles (see @ref runJobCycles).
+   * @return JOBID an empty handle ON FAILURE .
+   * @return JOBID Job ID of the newly added job ON SUCCESS
+   */
+  [[nodiscard]] /*[[gnu::warn_unused_result]]*/
+  virtual JOBID addJob(
+    Common::Nanoseconds period_ns, JobPayload payload ) = 0;
+
+  [[nodiscard]] /*[[gnu::warn_unused_result]]*/
+  JOBID addJob( struct timeval period, JobPayload payload )
+  {
+    return addJob(Common::toNanoseconds(period), 
+                  std::move(payload));
+  }
 
   /**
    * @brief remove a PeriodicJob given from the internal job
@@ -98,7 +127,7 @@ public:
    * well.
    *
    * @return JOBID Job ID of the deleted job ON SUCCESS
-   * @return JOBID "" ON FAILURE.
+   * @return JOBID an empty handle ON FAILURE.
    */
   virtual JOBID removeAnArbitraryJob() = 0;
 
@@ -107,13 +136,18 @@ public:
    * specific job.
    *
    * @param job_id the target job to change the period of.
-   * @param period new period (period) for the given job
+   * @param period_ns new period (period) for the given job
    * @return true period successfully changed.
    * @return false period changing failed.
    */
   virtual bool changePeriod(
     JOBID job_id, 
-    struct timeval period) = 0;
+    Common::Nanoseconds period_ns) = 0;
+
+  bool changePeriod(JOBID job_id, struct timeval period)
+  {
+    return changePeriod(job_id, Common::toNanoseconds(period));
+  }
 };
 
 #endif // IPERIODICJOBCONTROLLER_H_INCLUDED
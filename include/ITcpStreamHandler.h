@@ -0,0 +1,80 @@
+/**
+ * @file
+ *
+ * @brief This file contains the interface the reassembled TCP
+ * streams of the @ref TcpReassembler are delivered to.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef ITCPSTREAMHANDLER_H_INCLUDED
+#define ITCPSTREAMHANDLER_H_INCLUDED
+
+#include "FlowTable.h"
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Which side of a flow (see @ref FlowKey) sent a
+ * segment.
+ */
+enum class TcpDirection : uint8_t
+{
+  kAToB = 0, ///< from the endpoint in address_a/port_a
+  kBToA = 1
+};
+
+/**
+ * @brief interface class which receives the byte streams of
+ * the TCP connections in order.
+ *
+ * Every direction of a connection is a stream of its own; the
+ * offsets are counted from the first octet after the SYN (or
+ * after the first segment seen if the SYN was not captured).
+ *
+ * @note The methods are called on the thread processing the
+ * packets of the flow.
+ */
+class ITcpStreamHandler
+{
+public:
+  /**
+   * @brief Why a connection is closed.
+   */
+  enum class CloseReason
+  {
+    kFin,     ///< both directions sent a FIN and got in order
+    kReset,   ///< a RST was seen
+    kTimeout  ///< idle for too long or at the end of stream
+  };
+
+  virtual ~ITcpStreamHandler() {}
+
+  /**
+   * @brief The next octets of a stream.
+   *
+   * @param data points into the captured packet whenever the
+   * segment came in order (no copy is made); only valid during
+   * the call.
+   */
+  virtual void onData(const FlowKey& key, TcpDirection direction,
+                      uint64_t offset, const uint8_t* data,
+                      std::size_t length) = 0;
+
+  /**
+   * @brief Octets of a stream which will never be delivered
+   * (e.g. not captured, or skipped to free the memory holding
+   * the out of order segments after them).
+   */
+  virtual void onGap(const FlowKey& key, TcpDirection direction,
+                     uint64_t offset, uint64_t length) = 0;
+
+  /**
+   * @brief The connection is done; nothing else is delivered
+   * for it.
+   */
+  virtual void onClose(const FlowKey& key, CloseReason reason) = 0;
+};
+
+#endif // ITCPSTREAMHANDLER_H_INCLUDED
@@ -0,0 +1,100 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref JobHandle class which
+ * identifies a job of a @ref PeriodicJobController.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef JOBHANDLE_H_INCLUDED
+#define JOBHANDLE_H_INCLUDED
+
+#include <cstdint>
+#include <functional> // hash
+#include <ostream>
+#include <string>
+
+/**
+ * @brief A 64-bit handle of a job made of the index of the
+ * slot the job is stored in and the generation of that slot.
+ *
+ * The index finds the job in O(1) without hashing and the
+ * generation tells a stale handle (of a job which has been
+ * removed, its slot possibly reused by another job) from a
+ * valid one. A slot's generation is never 0, so a default
+ * constructed handle refers to no job (see @ref empty).
+ *
+ * The handle is a plain value; creating, copying, comparing or
+ * hashing it never allocates. @ref to_string is only meant for
+ * printing.
+ */
+class JobHandle
+{
+  private:
+    uint64_t m_value = 0;
+
+  public:
+    constexpr JobHandle() = default;
+    constexpr JobHandle(uint32_t index, uint32_t generation)
+      : m_value((static_cast<uint64_t>(generation) << 32) | index)
+    {}
+
+    uint32_t get_index() const
+    {
+      return static_cast<uint32_t>(m_value);
+    }
+    uint32_t get_generation() const
+    {
+      return static_cast<uint32_t>(m_value >> 32);
+    }
+    uint64_t get_value() const { return m_value; }
+
+    /**
+     * @brief true if the handle refers to no job; e.g. what is
+     * returned when adding a job fails.
+     */
+    bool empty() const { return get_generation() == 0; }
+
+    bool operator==(const JobHandle& other) const
+    {
+      return m_value == other.m_value;
+    }
+    bool operator!=(const JobHandle& other) const
+    {
+      return m_value != other.m_value;
+    }
+
+    /**
+     * @brief "<index>.<generation>", or "" if the handle is
+     * empty.
+     */
+    std::string to_string() const
+    {
+      if (empty())
+        return "";
+      return std::to_string(get_index()) + "." 
+             + std::to_string(get_generation());
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os,
+                                const JobHandle& job_handle)
+{
+  return os << job_handle.to_string();
+}
+
+namespace std
+{
+  template <>
+  struct hash<JobHandle>
+  {
+    size_t operator()(const JobHandle& job_handle) const
+    {
+      return hash<uint64_t>()(job_handle.get_value());
+    }
+  };
+}
+
+#endif // JOBHANDLE_H_INCLUDED
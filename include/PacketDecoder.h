@@ -0,0 +1,242 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref DecodedPacket struct and
+ * the free functions decoding the L2-L4 headers of a captured
+ * Ethernet frame into it.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef PACKETDECODER_H_INCLUDED
+#define PACKETDECODER_H_INCLUDED
+
+#include "common/PcapPacket.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // memcpy, memset
+
+/**
+ * @brief Where the headers of a packet are, as offsets into
+ * the data of the packet.
+ *
+ * Nothing is copied out of the packet: the fields of the
+ * headers are read from the data of the packet at these
+ * offsets when they are needed (see the getters below). An
+ * offset is only set if the header it points to starts within
+ * the captured length.
+ */
+struct DecodedPacket
+{
+  /**
+   * @brief The header layers of a packet; combined in
+   * @ref layers.
+   */
+  enum Layer : uint8_t
+  {
+    kEthernet = 1 << 0,
+    kVlan     = 1 << 1, ///< at least one 802.1Q/802.1ad tag
+    kIPv4     = 1 << 2,
+    kIPv6     = 1 << 3,
+    kTcp      = 1 << 4,
+    kUdp      = 1 << 5
+  };
+
+  /**
+   * @brief Properties of a packet; combined in @ref flags.
+   */
+  enum Flag : uint8_t
+  {
+    /** a fragment of an IP datagram (first or not) */
+    kFragment  = 1 << 0,
+    /** a header did not fit in the captured length */
+    kTruncated = 1 << 1,
+    /** a header is inconsistent (e.g. a too short length) */
+    kMalformed = 1 << 2
+  };
+
+  /** the ether type after the VLAN tags */
+  uint16_t ether_type = 0;
+
+  /** the first octet of the IP header */
+  uint16_t l3_offset = 0;
+
+  /** the first octet of the transport (e.g. TCP) header; also
+   * set for the protocols which are not decoded */
+  uint16_t l4_offset = 0;
+
+  /** the first octet after the TCP/UDP header */
+  uint16_t payload_offset = 0;
+
+  /** the end of the IP datagram within the captured octets;
+   * i.e. without the padding of a short Ethernet frame */
+  uint32_t payload_end = 0;
+
+  /** the VLAN ID of the outermost tag */
+  uint16_t vlan_id = 0;
+  uint8_t number_of_vlan_tags = 0;
+
+  /** the transport protocol after the IPv6 extension headers */
+  uint8_t protocol = 0;
+
+  uint8_t layers = 0;
+  uint8_t flags = 0;
+
+  bool has(Layer layer) const { return (layers & layer) != 0; }
+  bool is(Flag flag) const { return (flags & flag) != 0; }
+
+  /**
+   * @brief true if l4_offset points to the transport header of
+   * the first fragment (or of an unfragmented datagram).
+   */
+  bool has_l4_offset() const { return l4_offset != 0; }
+
+  static uint16_t readBigEndianU16(const uint8_t* field)
+  {
+    return static_cast<uint16_t>((field[0] << 8) | field[1]);
+  }
+
+  /**
+   * @brief true if the ports of a TCP, UDP or SCTP header are
+   * captured; i.e. the packet is not a later fragment. The rest
+   * of the transport header need not be captured.
+   */
+  bool has_ports(uint32_t caplen) const
+  {
+    return !is(kFragment) && has_l4_offset()
+           && (protocol == 6 || protocol == 17 || protocol == 132)
+           && caplen >= l4_offset + 4u;
+  }
+
+  /**
+   * @note Only valid if the packet has a TCP or UDP layer (or
+   * if @ref has_ports).
+   */
+  uint16_t get_source_port(const uint8_t* data) const
+  {
+    return readBigEndianU16(data + l4_offset);
+  }
+  uint16_t get_destination_port(const uint8_t* data) const
+  {
+    return readBigEndianU16(data + l4_offset + 2);
+  }
+
+  /**
+   * @brief The source address (4 octets for IPv4, 16 for
+   * IPv6).
+   *
+   * @note Only valid if the packet has an IP layer.
+   */
+  const uint8_t* get_source_address(const uint8_t* data) const
+  {
+    return data + l3_offset + (has(kIPv4) ? 12 : 8);
+  }
+  const uint8_t* get_destination_address(const uint8_t* data) const
+  {
+    return data + l3_offset + (has(kIPv4) ? 16 : 24);
+  }
+  std::size_t get_address_length() const
+  {
+    return has(kIPv4) ? 4 : 16;
+  }
+
+  /**
+   * @brief #of octets after the TCP/UDP header within the
+   * captured octets.
+   */
+  uint32_t get_payload_length() const
+  {
+    return payload_end > payload_offset
+           ? payload_end - payload_offset : 0;
+  }
+};
+
+static_assert(sizeof(DecodedPacket) <= 24,
+              "DecodedPacket should stay compact");
+
+/**
+ * @brief Copy an IPv4 (as IPv4-mapped, ::ffff:a.b.c.d) or an
+ * IPv6 address into 16 octets; e.g. to handle the addresses of
+ * both families alike.
+ *
+ * @param address_length see DecodedPacket::get_address_length.
+ */
+inline void copyMappedAddress(const uint8_t* address,
+                              std::size_t address_length,
+                              uint8_t* mapped_address)
+{
+  if (address_length == 4)
+  {
+    std::memset(mapped_address, 0, 10);
+    mapped_address[10] = 0xff;
+    mapped_address[11] = 0xff;
+    std::memcpy(mapped_address + 12, address, 4);
+  }
+  else
+    std::memcpy(mapped_address, address, 16);
+}
+
+/**
+ * @brief Decode the Ethernet, VLAN (802.1Q/QinQ), IPv4/IPv6
+ * (walking the extension headers) and TCP/UDP headers of the
+ * given frame.
+ *
+ * Every header is checked against the captured length before
+ * it is read, so a truncated or malformed frame is decoded up
+ * to its last complete header.
+ *
+ * @param data the frame starting at its Ethernet header.
+ * @param caplen #of octets available in data.
+ * @param decoded filled with the offsets of the headers.
+ * @return false if the frame is too short for an Ethernet
+ * header.
+ */
+bool decodePacket(const uint8_t* data, uint32_t caplen,
+                  DecodedPacket& decoded);
+
+inline bool decodePacket(const Common::PcapPacket& packet,
+                         DecodedPacket& decoded)
+{
+  return decodePacket(packet.get_data(), packet.get_caplen(),
+                      decoded);
+}
+
+/**
+ * @brief Decode a burst of packets (see @ref decodePacket).
+ *
+ * The packets are decoded one by one unless
+ * Common::kUseVectorizedPacketDecoder selects the vectorized
+ * kernel (see @ref decodePacketsVectorized) and the CPU
+ * supports it. The result is the same either way.
+ *
+ * @param decoded filled with one entry per packet.
+ */
+void decodePackets(const Common::PcapPacket* packets,
+                   std::size_t number_of_packets,
+                   DecodedPacket* decoded);
+
+/**
+ * @brief Decode a burst of packets with the vectorized kernel,
+ * whatever Common::kUseVectorizedPacketDecoder is; e.g. to
+ * compare it with the scalar loop.
+ *
+ * The Ethernet/IP/TCP/UDP headers of the common packets
+ * (untagged, unfragmented, without IPv6 extension headers) are
+ * classified 4 packets at a time with AVX2 gathers; the others
+ * are decoded one by one.
+ *
+ * @return false (decoding nothing) if the CPU does not support
+ * AVX2.
+ */
+bool decodePacketsVectorized(const Common::PcapPacket* packets,
+                             std::size_t number_of_packets,
+                             DecodedPacket* decoded);
+
+/**
+ * @brief true if @ref decodePackets uses a vectorized kernel on
+ * this CPU.
+ */
+bool isDecodePacketsVectorized();
+
+#endif // PACKETDECODER_H_INCLUDED
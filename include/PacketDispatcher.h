@@ -0,0 +1,132 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref PacketDispatcher class
+ * which spreads the pcap packets over several processor
+ * threads keeping each flow on a single thread.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef PACKETDISPATCHER_H_INCLUDED
+#define PACKETDISPATCHER_H_INCLUDED
+
+#include "FlowHash.h"
+#include "common/IPacketSink.h"
+#include "common/LockFreePcapPacketQueue.h"
+#include "common/Constants.h"
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A @ref Common::IPacketSink which hashes the key of
+ * each packet (the 5-tuple by default) onto one of N shards;
+ * each shard is a queue consumed by its own processor thread.
+ *
+ * Since all the packets of a flow land on the same shard, they
+ * are processed in order by a single thread which can keep the
+ * state of the flow in thread-local storage without any
+ * locking. Each shard is a single-producer/single-consumer
+ * ring, so neither side takes a lock.
+ *
+ * @note The push methods must only be called by one writer
+ * thread at a time.
+ */
+class PacketDispatcher : public Common::IPacketSink
+{
+  private:
+    FlowKeyFunction m_flow_key_function;
+    std::vector<std::unique_ptr<Common::SpscPcapPacketQueue>>
+      m_shards;
+
+    /**
+     * @brief Packets of the batch being pushed grouped by their
+     * shards so that each shard gets a single batch push.
+     */
+    std::vector<std::vector<Common::PcapPacket>> m_pending_packets;
+
+    std::vector<std::thread> m_processors;
+
+    std::size_t getShardIndex(const Common::PcapPacket& packet) const
+    {
+      return m_flow_key_function(packet) % m_shards.size();
+    }
+
+    /**
+     * @brief Push the pending packets of each shard as a batch.
+     */
+    void pushPendingPackets();
+
+  public:
+    /**
+     * @param number_of_shards #of shards (and processor
+     * threads); 0 means one per hardware thread.
+     * @param flow_key_function the key the shard of a packet
+     * is chosen by.
+     * @param shard_capacity capacity of the queue of each
+     * shard.
+     */
+    explicit PacketDispatcher(
+      unsigned number_of_shards = Common::kNumberOfPacketProcessors,
+      FlowKeyFunction flow_key_function = hashFiveTuple,
+      std::size_t shard_capacity
+        = Common::kPacketDispatcherShardCapacity);
+
+    /**
+     * @brief Closes the shards and joins the processor threads
+     * if they are still running.
+     */
+    ~PacketDispatcher();
+    PacketDispatcher(PacketDispatcher const&) = delete;
+    void operator=(PacketDispatcher const&)   = delete;
+
+    /**
+     * @brief Fire up one processor thread per shard. Each
+     * thread keeps calling processPackets on its shard until the
+     * end of stream.
+     */
+    void start();
+
+    /**
+     * @brief Wait for the processor threads to drain their
+     * shards after @ref closeQueue is called.
+     */
+    void join();
+
+    void pushPacket(Common::PcapPacket&& packet) override;
+    void pushPackets(Common::PcapPacket* packets,
+                     std::size_t number_of_packets) override;
+
+    /**
+     * @brief Hash the 5-tuples from the decoded headers instead
+     * of decoding the packets again; with a custom flow key
+     * function, same as @ref pushPackets.
+     */
+    void pushDecodedPackets(Common::PcapPacket* packets,
+                            const DecodedPacket* decoded,
+                            std::size_t number_of_packets) override;
+
+    /**
+     * @brief Close every shard (end of stream).
+     */
+    void closeQueue() override;
+
+    std::size_t get_number_of_shards() const
+    {
+      return m_shards.size();
+    }
+
+    /**
+     * @brief Get the queue of a shard; e.g. to consume it
+     * without @ref start.
+     */
+    Common::IPcapPacketQueue& get_shard(std::size_t shard_index)
+    {
+      return *m_shards[shard_index];
+    }
+};
+
+#endif // PACKETDISPATCHER_H_INCLUDED
@@ -0,0 +1,169 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref PacketFilter class which
+ * compiles a tcpdump-like filter expression into a flat
+ * bytecode and matches the packets against it.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef PACKETFILTER_H_INCLUDED
+#define PACKETFILTER_H_INCLUDED
+
+#include "common/PcapPacket.h"
+#include "PacketDecoder.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A compiled filter expression.
+ *
+ * The expressions are a subset of the tcpdump (pcap-filter)
+ * language:
+ *
+ *     [src|dst] host ADDRESS        (IPv4 or IPv6)
+ *     [src|dst] net ADDRESS/LENGTH
+ *     [src|dst] port PORT           (TCP, UDP or SCTP)
+ *     [src|dst] portrange FIRST-LAST
+ *     ip | ip6 | arp | tcp | udp | sctp | icmp | icmp6
+ *     [ip|ip6] proto NUMBER
+ *     vlan [ID]                     (ID of the outermost tag)
+ *
+ * combined with and/&&, or/||, not/! and parentheses. An empty
+ * expression matches every packet.
+ *
+ * The expression is compiled into a flat array of tests; each
+ * test jumps forward to the next test to run, or to the
+ * verdict, depending on its result (like the classic BPF). So
+ * the and/or are short-circuited and a packet is matched
+ * without recursion or allocation on the headers decoded by
+ * decodePacket.
+ *
+ * @note The match counters are not atomic; a filter should be
+ * used by one thread at a time (e.g. by the writer thread
+ * through a @ref FilteringSink).
+ */
+class PacketFilter
+{
+  public:
+    /** where a jump goes besides the tests */
+    static constexpr uint16_t kAccept = 0xfffe;
+    static constexpr uint16_t kReject = 0xffff;
+
+    enum class Opcode : uint8_t
+    {
+      kEtherType,  ///< operand: the ether type after the tags
+      kIPv4,
+      kIPv6,
+      kProtocol,   ///< operand: the IP protocol
+      kAddress,    ///< operand: the index of an AddressPrefix
+      kPortRange,  ///< operand: first port | last port << 16
+      kVlan,
+      kVlanId      ///< operand: the VLAN ID
+    };
+
+    /** which addresses/ports of a packet a test looks at */
+    enum class Side : uint8_t
+    {
+      kSourceOrDestination,
+      kSource,
+      kDestination
+    };
+
+    struct Instruction
+    {
+      Opcode opcode;
+      Side side;
+      uint16_t jump_if_true;
+      uint16_t jump_if_false;
+      uint32_t operand;
+    };
+
+    /**
+     * @brief An IPv4 (as IPv4-mapped) or IPv6 network.
+     */
+    struct AddressPrefix
+    {
+      uint8_t address[16];
+      uint8_t length; ///< in bits, out of 128
+    };
+
+  private:
+    std::string m_expression;
+    std::vector<Instruction> m_instructions;
+    std::vector<AddressPrefix> m_address_prefixes;
+
+    uint64_t m_number_of_packets = 0;
+    uint64_t m_number_of_matches = 0;
+
+    bool test(const Instruction& instruction, const uint8_t* data,
+              uint32_t caplen, const DecodedPacket& decoded) const;
+
+  public:
+    /**
+     * @brief A filter matching every packet.
+     */
+    PacketFilter() = default;
+
+    /**
+     * @brief Compile a filter expression; prints why on failure.
+     *
+     * @return false if the expression is not valid; the filter
+     * is not changed then.
+     */
+    static bool fromString(const std::string& expression,
+                           PacketFilter& filter);
+
+    /**
+     * @brief Whether the packet matches, without counting it.
+     */
+    bool evaluate(const uint8_t* data, uint32_t caplen,
+                  const DecodedPacket& decoded) const;
+
+    /**
+     * @brief Same as @ref evaluate but counts the packet and the
+     * match.
+     */
+    bool matches(const uint8_t* data, uint32_t caplen,
+                 const DecodedPacket& decoded)
+    {
+      m_number_of_packets++;
+      bool is_matching = evaluate(data, caplen, decoded);
+      m_number_of_matches += is_matching;
+      return is_matching;
+    }
+
+    bool matches(const Common::PcapPacket& packet,
+                 const DecodedPacket& decoded)
+    {
+      return matches(packet.get_data(), packet.get_caplen(),
+                     decoded);
+    }
+
+    const std::string& get_expression() const
+    {
+      return m_expression;
+    }
+    const std::vector<Instruction>& get_instructions() const
+    {
+      return m_instructions;
+    }
+
+    /**
+     * @brief #of packets given to @ref matches.
+     */
+    uint64_t get_number_of_packets() const
+    {
+      return m_number_of_packets;
+    }
+    uint64_t get_number_of_matches() const
+    {
+      return m_number_of_matches;
+    }
+};
+
+#endif // PACKETFILTER_H_INCLUDED
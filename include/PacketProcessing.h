@@ -16,31 +16,109 @@
 #define PACKETPROCESSING_H_INCLUDED
 
 #include "common/PcapPacket.h"
+#include "common/IPcapPacketQueue.h"
+#include "FlowTable.h"
+#include "PacketDecoder.h"
+#include "PcapFileWriter.h"
+#include "TcpReassembler.h"
 #include <ctime>
 
 
+/**
+ * @brief The FlowTable of the calling processor thread.
+ *
+ * Every thread (e.g. every shard of a @ref PacketDispatcher)
+ * keeps the flows of the packets it processes in a table of
+ * its own, so no locking is needed.
+ */
+FlowTable& getFlowTable();
+
+/**
+ * @brief The TcpReassembler of the calling processor thread;
+ * its streams are printed.
+ *
+ * The connections are closed along with their flows when the
+ * flows go idle, and at the end of stream.
+ */
+TcpReassembler& getTcpReassembler();
+
+/**
+ * @brief Where @ref processPacket writes the packets it
+ * processes (e.g. to extract the packets passing the filters
+ * of a capture); nullptr, the default, writes nothing.
+ *
+ * @note Set it before the processor threads are started and
+ * close the writer after they are joined.
+ */
+void setPacketOutput(PcapFileWriter* packet_output);
+
 /** 
  * @brief A free stub function which is supposed to process
- * newly arrived pcap packet and destructs the packet
- * afterwards.
+ * newly arrived pcap packet.
  *
- * Currently, this function currently does nothing except for
- * destructing the passed packet.
+ * Currently, this function only decodes the headers of the
+ * packet (see PacketDecoder.h), counts the packet in the flow
+ * table of the calling thread (see @ref getFlowTable), prints
+ * the arrival time and a summary of them, feeds the TCP
+ * segments to the reassembler of the thread (see
+ * @ref getTcpReassembler) and writes the packet into the
+ * output, if any (see @ref setPacketOutput). The packet is
+ * taken by value
+ * so that its data is released as soon as the function
+ * returns.
  *
  * @param packet newly arrived pcap packet to process.
  */
-void processPacket(Common::PcapPacket&& packet);
+void processPacket(Common::PcapPacket packet);
+
+/**
+ * @brief Same as @ref processPacket(Common::PcapPacket) for a
+ * packet whose headers are already decoded (e.g. by
+ * decodePackets over a burst).
+ */
+void processPacket(Common::PcapPacket packet,
+                   const DecodedPacket& decoded);
 
 
-/** A free function which is designed to run continuously in a
- * thread and process newly arrived pcap packets.  
+/** A free function which is designed to be called repeatedly
+ * in a thread and process newly arrived pcap packets.  
  *
  * This function calls uses Common::kMaxNumberOfPacketsToProcess
  * constant to determine how many packets to process. The
  * function prototype can be changed to accept parameter to
  * determine this number for each different call instead.
+ * These packets are popped from the PcapPacketQueue as one
+ * batch and their headers are decoded in bursts of
+ * Common::kPacketDecoderBurstSize packets.
+ *
+ * After the batch, a part of the flow table of the thread is
+ * swept for the flows idle for
+ * Common::kFlowIdleTimeoutNanoseconds as of the
+ * Common::ExternalTime.
+ *
+ * If the PcapPacketQueue is empty, the calling thread waits
+ * (spinning briefly and then parking) for new packets instead
+ * of busy-looping.
+ *
+ * @return true  if more packets might arrive; call again.
+ * @return false if the writer has closed the PcapPacketQueue
+ * and every packet in it has been processed (end of stream).
+ */
+bool processPackets();
+
+/**
+ * @brief Same as @ref processPackets() but consumes the given
+ * queue instead of the global PcapPacketQueue; e.g. the shard
+ * of a @ref PacketDispatcher.
+ *
+ * The state kept between the calls is thread-local, so every
+ * shard can be processed by its own thread without locking.
+ *
+ * @param queue the queue to pop the packets from.
+ * @return true  if more packets might arrive; call again.
+ * @return false at the end of stream of the queue.
  */
-void processPackets();
+bool processPackets(Common::IPcapPacketQueue& queue);
 
 
 #endif // PACKETPROCESSING_H_INCLUDED
\ No newline at end of file
@@ -0,0 +1,134 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref PcapFileReader class which
+ * reads the packets of a classic libpcap capture file.
+ *
+ * The file is memory-mapped and the record headers are walked
+ * in place; so the packets produced by this reader point into
+ * the mapping instead of being copied into a heap buffer.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef PCAPFILEREADER_H_INCLUDED
+#define PCAPFILEREADER_H_INCLUDED
+
+#include "IPcapReader.h"
+#include "common/PcapPacket.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Zero-copy reader of classic libpcap capture files
+ * which implements @ref IPcapReader.
+ *
+ * Both microsecond (0xa1b2c3d4) and nanosecond (0xa1b23c4d)
+ * resolution files are supported in either byte order.
+ *
+ * The file stays mapped as long as the reader instance is
+ * alive. Since the packets returned by @ref nextPacket point
+ * into this mapping (with the data owner set to
+ * Common::PcapPacketDataOwner::kMappedFile), the reader must
+ * outlive every packet it produced.
+ *
+ * @note This class is not thread-safe; a single thread (e.g.
+ * the PcapPacketQueue writer) is expected to walk the file.
+ */
+class PcapFileReader : public IPcapReader
+{
+  private:
+    /**
+     * @brief Beginning of the mapping of the whole file.
+     */
+    const uint8_t* m_begin = nullptr;
+
+    /**
+     * @brief Size of the mapped file in octets.
+     */
+    std::size_t m_size = 0;
+
+    /**
+     * @brief Offset of the next record header to read.
+     */
+    std::size_t m_offset = 0;
+
+    /**
+     * @brief true if the file was written on a host with a
+     * different byte order than ours.
+     */
+    bool m_is_byte_swapped = false;
+
+    /**
+     * @brief true if the record timestamps carry nanoseconds
+     * instead of microseconds.
+     */
+    bool m_is_nanosecond_resolution = false;
+
+    /**
+     * @brief Link-layer header type (LINKTYPE_*) of the file.
+     */
+    uint32_t m_link_type = 0;
+
+    /**
+     * @brief Snapshot length of the file.
+     */
+    uint32_t m_snaplen = 0;
+
+    /**
+     * @brief Read a 32-bit field of the file in host order.
+     */
+    uint32_t readU32(std::size_t offset) const;
+
+    /**
+     * @brief Unmap the file if mapped.
+     */
+    void close();
+
+  public:
+    PcapFileReader() = default;
+    ~PcapFileReader();
+    PcapFileReader(PcapFileReader const&)  = delete;
+    void operator=(PcapFileReader const&) = delete;
+
+    /**
+     * @brief Map the given capture file and validate its
+     * global header.
+     *
+     * @param file_path path of the classic pcap file to read.
+     * @return true  ON SUCCESS
+     * @return false if the file could not be opened, mapped or
+     * is not a classic pcap file.
+     */
+    bool open(const std::string& file_path);
+
+    /**
+     * @brief Fill the given packet with the next record of the
+     * file.
+     *
+     * The data member of the packet points into the mapping; no
+     * allocation or copy is made.
+     *
+     * @param packet The packet to fill.
+     * @return true  if a packet has been read.
+     * @return false at the end of the file or if the last
+     * record is truncated.
+     */
+    bool nextPacket(Common::PcapPacket& packet) override;
+
+    PcapReaderPosition get_position() const override;
+    bool seek(const PcapReaderPosition& position) override;
+
+    /**
+     * @brief Start reading from the first record again.
+     */
+    void rewind();
+
+    bool is_open() const { return m_begin != nullptr; }
+    uint32_t get_link_type() const { return m_link_type; }
+    uint32_t get_snaplen() const { return m_snaplen; }
+};
+
+#endif // PCAPFILEREADER_H_INCLUDED
@@ -0,0 +1,296 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref PcapFileWriter class which
+ * writes the processed packets into pcap or pcapng capture
+ * files through large buffers on a thread of its own.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef PCAPFILEWRITER_H_INCLUDED
+#define PCAPFILEWRITER_H_INCLUDED
+
+#include "common/Constants.h"
+#include "common/Nanoseconds.h"
+#include "common/PcapPacket.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib> // free
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Writes packets into capture files without holding up
+ * the threads writing them.
+ *
+ * Every thread writing packets copies the records into a large
+ * buffer of its own (see Common::kPcapWriterBufferSize), so the
+ * threads do not share a lock per packet; the lock is only
+ * taken to queue a full buffer and take an empty one. The
+ * queued buffers are written by the thread of the writer, with
+ * a single writev for all the buffers waiting, while the others
+ * are being filled. The threads writing packets only wait if
+ * too many buffers are waiting to be written (see
+ * get_number_of_stalls); a buffer is allocated on demand
+ * otherwise, so there are about as many buffers as threads.
+ *
+ * The output can be split into several files by size and by the
+ * arrival time of the packets (i.e. the external time); the
+ * files are then named after the given path with a sequence
+ * number before its extension (e.g. out_00000.pcap,
+ * out_00001.pcap, ...). The files are split between the
+ * buffers: a buffer only holds the packets of a period and
+ * never more than fits a file, and a buffer of an earlier
+ * period queued late goes into the current file.
+ *
+ * The pcap files have nanosecond timestamps (magic 0xa1b23c4d);
+ * the pcapng files have a single interface with if_tsresol of
+ * nanoseconds.
+ *
+ * @note @ref writePacket is thread-safe, so every processor
+ * thread can write into the same writer; a thread is expected
+ * to write into a single writer at a time. The packets of a
+ * thread are written in the order of its calls, and the buffers
+ * of the threads in the order they are queued, which is not
+ * the order of the arrival times across the processors.
+ */
+class PcapFileWriter
+{
+  public:
+    enum class Format
+    {
+      kPcap,
+      kPcapng
+    };
+
+  private:
+    struct Buffer
+    {
+      std::unique_ptr<uint8_t, void (*)(void*)> data{nullptr, free};
+      std::size_t size = 0;
+      uint64_t number_of_packets = 0;
+
+      /** the end of the period of the packets, if the files
+       * are split by time */
+      Common::Nanoseconds period_end_ns = 0;
+
+      /** the file the data is written into; set when the
+       * buffer is queued */
+      uint64_t file_index = 0;
+    };
+
+    /**
+     * @brief The buffer the calling thread fills for the writer
+     * opened as the given session (see m_session).
+     */
+    struct ThreadBuffer
+    {
+      uint64_t session = 0;
+      Buffer* buffer = nullptr;
+    };
+    static thread_local ThreadBuffer t_thread_buffer;
+
+    std::string m_file_path;
+    Format m_format = Format::kPcap;
+    uint32_t m_link_type = 1;
+    uint64_t m_max_file_size = 0;
+    Common::Nanoseconds m_file_period_ns = 0;
+
+    /**
+     * @brief Unique per open, so that the buffers the threads
+     * hold for a closed writer are never used again.
+     */
+    uint64_t m_session = 0;
+
+    /**
+     * @brief The records of a buffer do not exceed this (but
+     * for a single record), so a buffer fits an empty file.
+     */
+    std::size_t m_buffer_capacity = Common::kPcapWriterBufferSize;
+    std::atomic<bool> m_is_open{false};
+
+    /* guarded by m_mutex */
+    std::mutex m_mutex;
+    std::condition_variable m_buffer_written;
+    std::condition_variable m_buffer_filled;
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+    std::vector<Buffer*> m_free_buffers;
+    /** the buffers being filled by the threads */
+    std::vector<Buffer*> m_held_buffers;
+    std::deque<Buffer*> m_filled_buffers;
+    /** #of buffers queued or being written */
+    std::size_t m_number_of_unwritten_buffers = 0;
+    bool m_should_stop_running = false;
+    uint64_t m_file_index = 0;
+    uint64_t m_file_size = 0;
+    uint64_t m_number_of_file_packets = 0;
+    Common::Nanoseconds m_file_end_ns = 0;
+    uint64_t m_number_of_files = 0;
+    uint64_t m_number_of_packets = 0;
+    uint64_t m_number_of_stalls = 0;
+
+    /* only touched by the thread of the writer */
+    std::thread m_thread;
+    int m_fd = -1;
+    uint64_t m_fd_file_index = 0;
+    bool m_has_failed = false;
+    uint64_t m_number_of_octets = 0;
+
+    /**
+     * @brief Take a free buffer for the calling thread,
+     * allocating one unless too many are waiting to be written
+     * (then wait for one to be written).
+     */
+    Buffer* takeBuffer(std::unique_lock<std::mutex>& lock);
+
+    /**
+     * @brief Put the buffer into the file it belongs to
+     * (starting the next file if need be) and queue it for
+     * writing.
+     *
+     * @note The mutex must be held.
+     */
+    void queueBuffer(Buffer* buffer);
+
+    /**
+     * @brief Queue the buffer of the calling thread and take
+     * another one.
+     */
+    Buffer* handOff(Buffer* buffer);
+
+    /**
+     * @brief Put the header of a file into the given array
+     * (of at least 64 octets).
+     *
+     * @return The size of the header.
+     */
+    std::size_t formatFileHeader(uint8_t* header) const;
+    uint32_t getRecordSize(uint32_t caplen) const;
+    void formatRecord(Buffer& buffer,
+                      const Common::PcapPacket& packet,
+                      uint32_t caplen, uint32_t record_size) const;
+
+    /**
+     * @brief The loop of the thread writing the filled buffers.
+     */
+    void writeBuffers();
+    void writeToFiles(const std::vector<Buffer*>& buffers);
+
+    /**
+     * @brief Create the file and write its header.
+     */
+    bool openFile(uint64_t file_index);
+    void closeFile();
+
+  public:
+    PcapFileWriter() = default;
+
+    /**
+     * @brief Flushes and closes the files if still open; see
+     * @ref close.
+     */
+    ~PcapFileWriter();
+    PcapFileWriter(PcapFileWriter const&) = delete;
+    void operator=(PcapFileWriter const&) = delete;
+
+    /**
+     * @brief Pick the format by the extension of the path:
+     * pcapng for ".pcapng", pcap otherwise.
+     */
+    static Format getFormat(const std::string& file_path);
+
+    /**
+     * @brief Split the output into a new file whenever it would
+     * exceed the given size, and whenever the arrival time of a
+     * packet reaches the next multiple of the given period; 0
+     * disables each. Must be called before @ref open.
+     */
+    void set_rotation(uint64_t max_file_size,
+                      Common::Nanoseconds file_period_ns);
+
+    /**
+     * @brief Allocate the buffers, start the thread of the writer
+     * and create the first file.
+     *
+     * @param link_type the LINKTYPE_* of the packets; Ethernet
+     * by default.
+     * @return false if the file can not be created (it is
+     * printed why).
+     */
+    bool open(const std::string& file_path, Format format,
+              uint32_t link_type = 1);
+
+    bool open(const std::string& file_path)
+    {
+      return open(file_path, getFormat(file_path));
+    }
+
+    /**
+     * @brief Append the packet to the output; its data is copied
+     * (into the buffer of the calling thread) so the packet can
+     * be released right away.
+     */
+    void writePacket(const Common::PcapPacket& packet);
+
+    /**
+     * @brief Write what is buffered (by every thread), join the
+     * thread and close the file. Call it after the last
+     * @ref writePacket of every thread.
+     */
+    void close();
+
+    bool is_open() const { return m_is_open.load(); }
+
+    /**
+     * @brief false if a write failed; the packets after it are
+     * dropped.
+     */
+    bool is_good() const { return !m_has_failed; }
+
+    /**
+     * @brief #of packets written; only complete after
+     * @ref close.
+     */
+    uint64_t get_number_of_packets() const
+    {
+      return m_number_of_packets;
+    }
+
+    /**
+     * @brief #of octets written into the files (the headers
+     * included); only complete after @ref close.
+     */
+    uint64_t get_number_of_octets() const
+    {
+      return m_number_of_octets;
+    }
+
+    uint64_t get_number_of_files() const
+    {
+      return m_number_of_files;
+    }
+
+    /**
+     * @brief #of times a thread had to wait for a buffer to be
+     * written; the disk could not keep up.
+     */
+    uint64_t get_number_of_stalls() const
+    {
+      return m_number_of_stalls;
+    }
+
+    /**
+     * @brief The path of the file with the given index.
+     */
+    std::string get_file_path(uint64_t file_index) const;
+};
+
+#endif // PCAPFILEWRITER_H_INCLUDED
@@ -0,0 +1,199 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref PcapIndex class which
+ * keeps the timestamp checkpoints of a capture file in a
+ * sidecar file, and the @ref PcapTimeWindowReader reading only
+ * the packets of a time window through it.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef PCAPINDEX_H_INCLUDED
+#define PCAPINDEX_H_INCLUDED
+
+#include "IPcapReader.h"
+#include "common/Constants.h"
+#include "common/Nanoseconds.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief A memory-mapped index of the packets of a capture file
+ * by their arrival times.
+ *
+ * The index (a sidecar file next to the capture, see
+ * getIndexPath) holds a checkpoint every N packets: the reader
+ * position of the packet, the latest arrival time before it
+ * and the earliest arrival time from it on. Both times never
+ * decrease from a checkpoint to the next even if the capture is
+ * not sorted by time, so the checkpoint to start at for a time
+ * (and the one to stop at) are found by a binary search over
+ * the mapping; nothing is read into memory.
+ *
+ * The size and the modification time of the capture file are
+ * kept in the index; an index of a capture file which has
+ * changed since is not opened.
+ */
+class PcapIndex
+{
+  public:
+    struct Checkpoint
+    {
+      PcapReaderPosition position;
+
+      /** #of packets before the checkpoint */
+      uint64_t packet_number;
+
+      /** the latest arrival time of the packets before the
+       * checkpoint (the minimum for the first checkpoint) */
+      Common::Nanoseconds max_time_before_ns;
+
+      /** the earliest arrival time of the packets from the
+       * checkpoint on */
+      Common::Nanoseconds min_time_from_ns;
+    };
+
+  private:
+    const uint8_t* m_mapping = nullptr;
+    std::size_t m_mapping_size = 0;
+    const Checkpoint* m_checkpoints = nullptr;
+    std::size_t m_number_of_checkpoints = 0;
+    uint64_t m_number_of_packets = 0;
+
+  public:
+    PcapIndex() = default;
+    ~PcapIndex();
+    PcapIndex(PcapIndex const&) = delete;
+    void operator=(PcapIndex const&) = delete;
+
+    /**
+     * @brief The path of the index of a capture file.
+     */
+    static std::string getIndexPath(const std::string& capture_path)
+    {
+      return capture_path + ".idx";
+    }
+
+    /**
+     * @brief Read the whole capture file and write its index;
+     * the index is written under a temporary name first, so a
+     * half written index is never opened.
+     *
+     * @param packet_interval a checkpoint is taken every that
+     * many packets.
+     * @return false if the capture can not be read or the index
+     * can not be written (it is printed why).
+     */
+    static bool build(const std::string& capture_path,
+                      const std::string& index_path,
+                      uint32_t packet_interval
+                        = Common::kPcapIndexPacketInterval);
+
+    /**
+     * @brief Map the given index of the given capture file.
+     *
+     * @return false if the index does not exist, is malformed
+     * or is stale (the capture file has changed since).
+     */
+    bool open(const std::string& index_path,
+              const std::string& capture_path);
+
+    /**
+     * @brief Open the index next to the capture file, building
+     * it first if it is missing or stale.
+     */
+    bool openOrBuild(const std::string& capture_path);
+
+    void close();
+
+    bool is_open() const { return m_mapping != nullptr; }
+
+    std::size_t get_number_of_checkpoints() const
+    {
+      return m_number_of_checkpoints;
+    }
+    const Checkpoint& get_checkpoint(std::size_t index) const
+    {
+      return m_checkpoints[index];
+    }
+    uint64_t get_number_of_packets() const
+    {
+      return m_number_of_packets;
+    }
+
+    /**
+     * @brief The last checkpoint before which every packet
+     * arrived before start_ns; reading from it misses no packet
+     * arriving at or after start_ns.
+     *
+     * @return nullptr if there are no checkpoints (no packets).
+     */
+    const Checkpoint* findStart(Common::Nanoseconds start_ns) const;
+
+    /**
+     * @brief The first checkpoint from which on every packet
+     * arrives at or after end_ns; reading can stop there.
+     *
+     * @return nullptr if the packets before end_ns may last
+     * until the end of the file.
+     */
+    const Checkpoint* findEnd(Common::Nanoseconds end_ns) const;
+};
+
+/**
+ * @brief A reader of the packets of a capture file arriving in
+ * a time window [start, end) which implements @ref IPcapReader.
+ *
+ * The given reader is moved to the checkpoint found by
+ * PcapIndex::findStart, and stops at the one found by
+ * PcapIndex::findEnd; so only about the packets of the window
+ * are read whatever the size of the file. The packets around
+ * the window read this way are skipped.
+ */
+class PcapTimeWindowReader : public IPcapReader
+{
+  private:
+    std::unique_ptr<IPcapReader> m_reader;
+    Common::Nanoseconds m_start_ns;
+    Common::Nanoseconds m_end_ns;
+
+    /** where to stop reading, unless at the end of the file */
+    bool m_has_end_offset = false;
+    uint64_t m_end_offset = 0;
+    uint64_t m_number_of_skipped_packets = 0;
+
+  public:
+    /**
+     * @param reader a reader of the capture file the index is
+     * built for, at its first packet.
+     */
+    PcapTimeWindowReader(std::unique_ptr<IPcapReader> reader,
+                         const PcapIndex& index,
+                         Common::Nanoseconds start_ns,
+                         Common::Nanoseconds end_ns);
+
+    bool nextPacket(Common::PcapPacket& packet) override;
+
+    PcapReaderPosition get_position() const override
+    {
+      return m_reader->get_position();
+    }
+    bool seek(const PcapReaderPosition& position) override
+    {
+      return m_reader->seek(position);
+    }
+
+    /**
+     * @brief #of packets read but out of the window.
+     */
+    uint64_t get_number_of_skipped_packets() const
+    {
+      return m_number_of_skipped_packets;
+    }
+};
+
+#endif // PCAPINDEX_H_INCLUDED
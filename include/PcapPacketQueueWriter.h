@@ -17,14 +17,64 @@
 #ifndef PCAPWRITER_H_INCLUDED
 #define PCAPWRITER_H_INCLUDED
 #include "common/Constants.h"
+#include "ReplayClock.h"
+
+class IPcapReader;
+namespace Common
+{
+  class IPacketSink;
+}
 
 /**
  * @brief This function can be used to fill the PcapPacketQueue
  * so that processor threads have something to process
  *
+ * The PcapPacketQueue is closed (end of stream) after the last
+ * packet is pushed.
+ *
  * @param number_of_packets_to_write 
+ * @param replay_clock paces the pushes by the arrival times of
+ * the packets.
  */
 void writeToPcapPacketQueue(unsigned number_of_packets_to_write 
-                            = Common::kMaxNumberOfPacketsToWrite);
+                            = Common::kMaxNumberOfPacketsToWrite,
+                            ReplayClock replay_clock 
+                            = ReplayClock());
+
+/**
+ * @brief This function fills the PcapPacketQueue with the
+ * packets of a capture file until the end of the file is
+ * reached and then closes the PcapPacketQueue (end of stream).
+ *
+ * The pushed packets might point into the memory of the reader
+ * (e.g. the mapping of a @ref PcapFileReader), so the reader
+ * must outlive the consumers of the queue.
+ *
+ * @param reader An opened reader of the capture file.
+ * @param replay_clock paces the pushes by the arrival times of
+ * the packets (as fast as possible by default).
+ */
+void writeToPcapPacketQueue(IPcapReader& reader,
+                            ReplayClock replay_clock 
+                            = ReplayClock());
+
+/**
+ * @brief Same as writeToPcapPacketQueue(unsigned) but pushes
+ * the packets to the given sink (e.g. a @ref PacketDispatcher)
+ * and closes it at the end.
+ */
+void writeToPacketSink(Common::IPacketSink& sink,
+                       unsigned number_of_packets_to_write 
+                       = Common::kMaxNumberOfPacketsToWrite,
+                       ReplayClock replay_clock = ReplayClock());
+
+/**
+ * @brief Same as writeToPcapPacketQueue(IPcapReader&) but
+ * pushes the packets to the given sink (e.g. a
+ * @ref PacketDispatcher) and closes it at the end.
+ */
+void writeToPacketSink(Common::IPacketSink& sink,
+                       IPcapReader& reader,
+                       ReplayClock replay_clock = ReplayClock());
 
 #endif
\ No newline at end of file
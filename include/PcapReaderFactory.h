@@ -0,0 +1,51 @@
+/**
+ * @file
+ *
+ * @brief This file contains a free function to create the
+ * right @ref IPcapReader for a capture file depending on its
+ * format.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef PCAPREADERFACTORY_H_INCLUDED
+#define PCAPREADERFACTORY_H_INCLUDED
+
+#include "IPcapReader.h"
+#include "common/Nanoseconds.h"
+#include <memory>
+#include <string>
+
+/**
+ * @brief Open the given capture file with a reader suitable for
+ * its format.
+ *
+ * The format is detected from the first block type/magic
+ * number of the file: pcapng files are read by a
+ * @ref PcapngFileReader and classic pcap files by a
+ * @ref PcapFileReader.
+ *
+ * @param file_path path of the capture file.
+ * @return std::unique_ptr<IPcapReader> nullptr ON FAILURE
+ * @return std::unique_ptr<IPcapReader> an opened reader ON
+ * SUCCESS
+ */
+std::unique_ptr<IPcapReader> openPcapReader(
+  const std::string& file_path);
+
+/**
+ * @brief Open the given capture file with a reader of only the
+ * packets arriving in [start_ns, end_ns) (see
+ * PcapTimeWindowReader).
+ *
+ * The reader jumps to the window through the index next to the
+ * capture file (see PcapIndex), which is built first if it is
+ * missing or out of date; so only the first analysis of a
+ * capture reads all of it.
+ */
+std::unique_ptr<IPcapReader> openPcapReader(
+  const std::string& file_path, Common::Nanoseconds start_ns,
+  Common::Nanoseconds end_ns);
+
+#endif // PCAPREADERFACTORY_H_INCLUDED
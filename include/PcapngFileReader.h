@@ -0,0 +1,253 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref PcapngFileReader class
+ * which decodes the blocks of a pcapng capture file in a
+ * streaming manner.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef PCAPNGFILEREADER_H_INCLUDED
+#define PCAPNGFILEREADER_H_INCLUDED
+
+#include "IPcapReader.h"
+#include "common/PcapPacket.h"
+#include "common/Constants.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Streaming reader of pcapng capture files which
+ * implements @ref IPcapReader.
+ *
+ * The file is read sequentially through a fixed-size window
+ * and the blocks are decoded in place from this window. Only
+ * Enhanced Packet Blocks and Simple Packet Blocks produce
+ * packets; Section Header Blocks and Interface Description
+ * Blocks update the decoding state and every other block type
+ * is skipped.
+ *
+ * Each section can describe several interfaces with different
+ * timestamp resolutions (if_tsresol) and offsets
+ * (if_tsoffset). The timestamps of the packets are normalized
+ * into the nanoseconds used by Common::ExternalTime regardless
+ * of the interface they were captured on; nothing finer than a
+ * nanosecond is lost.
+ *
+ * Since the window is reused, the payload of each packet is
+ * copied into a buffer of the Common::PacketBufferPool owned by
+ * the returned packet.
+ *
+ * @note This class is not thread-safe; a single thread (e.g.
+ * the PcapPacketQueue writer) is expected to walk the file.
+ */
+class PcapngFileReader : public IPcapReader
+{
+  private:
+    /**
+     * @brief Decoding state of an interface described by an
+     * Interface Description Block.
+     */
+    struct Interface
+    {
+      uint16_t link_type;
+      uint32_t snaplen;
+
+      /**
+       * @brief if true, timestamps are in 2^-resolution
+       * seconds, otherwise in 10^-resolution seconds.
+       */
+      bool is_binary_resolution;
+      uint8_t resolution;
+
+      /**
+       * @brief #of timestamp units per second for decimal
+       * resolutions.
+       */
+      uint64_t units_per_second;
+
+      /**
+       * @brief seconds to add to every timestamp of the
+       * interface (if_tsoffset).
+       */
+      int64_t offset_seconds;
+    };
+
+    int m_fd = -1;
+
+    /**
+     * @brief The window the file is read through.
+     */
+    std::unique_ptr<uint8_t[]> m_window;
+    std::size_t m_window_capacity = 0;
+
+    /**
+     * @brief Offset of the first octet not decoded yet in the
+     * window.
+     */
+    std::size_t m_window_begin = 0;
+
+    /**
+     * @brief Offset of the end of the valid data in the window.
+     */
+    std::size_t m_window_end = 0;
+
+    /**
+     * @brief Offset in the file of the octet at m_window_begin.
+     */
+    uint64_t m_offset = 0;
+
+    /**
+     * @brief Offset of the Section Header Block of the current
+     * section.
+     */
+    uint64_t m_section_offset = 0;
+
+    /**
+     * @brief true once the end of the file has been reached by
+     * the reads filling the window.
+     */
+    bool m_is_eof = false;
+
+    /**
+     * @brief true if the current section was written on a host
+     * with a different byte order than ours.
+     */
+    bool m_is_byte_swapped = false;
+
+    /**
+     * @brief Interfaces of the current section indexed by their
+     * interface ID.
+     */
+    std::vector<Interface> m_interfaces;
+
+    /**
+     * @brief Arrival time of the last packet; used for the
+     * Simple Packet Blocks which do not carry a timestamp.
+     */
+    Common::Nanoseconds m_last_arrival_time_ns = 0;
+
+    uint16_t readU16(const uint8_t* field) const;
+    uint32_t readU32(const uint8_t* field) const;
+
+    /**
+     * @brief Make sure at least "length" octets are available
+     * in the window starting from m_window_begin.
+     *
+     * @return false if the file ends before that.
+     */
+    bool fillWindow(std::size_t length);
+
+    /**
+     * @brief Skip the given number of octets of the file
+     * without reading them into the window.
+     */
+    bool skip(std::size_t length);
+
+    /**
+     * @brief Read the type and the length of the block at the
+     * beginning of the window (detecting the byte order of a
+     * Section Header Block).
+     *
+     * @return false at the end of the file or if the block is
+     * malformed.
+     */
+    bool readBlockHeader(uint32_t& block_type,
+                         std::size_t& block_length);
+
+    /**
+     * @brief Continue reading the file from the given offset.
+     */
+    bool jumpTo(uint64_t offset);
+
+    /**
+     * @brief Decode the Section Header Block at the beginning
+     * of the window and reset the section state.
+     */
+    bool decodeSectionHeader(std::size_t block_length);
+
+    /**
+     * @brief Decode the Interface Description Block at the
+     * beginning of the window.
+     */
+    bool decodeInterfaceDescription(std::size_t block_length);
+
+    /**
+     * @brief Convert a raw timestamp of an interface into
+     * nanoseconds since the epoch.
+     */
+    Common::Nanoseconds toNanoseconds(const Interface& interface,
+                                      uint64_t timestamp) const;
+
+    /**
+     * @brief Fill the packet with the given payload by copying
+     * it into a pooled buffer owned by the packet.
+     */
+    void fillPacket(Common::PcapPacket& packet,
+                    const uint8_t* payload, uint32_t caplen,
+                    uint32_t len,
+                    Common::Nanoseconds arrival_time_ns,
+                    uint16_t interface_index);
+
+    void close();
+
+  public:
+    PcapngFileReader() = default;
+    ~PcapngFileReader();
+    PcapngFileReader(PcapngFileReader const&) = delete;
+    void operator=(PcapngFileReader const&)   = delete;
+
+    /**
+     * @brief Open the given capture file and decode its first
+     * Section Header Block.
+     *
+     * @param file_path path of the pcapng file to read.
+     * @param window_size size of the window the file is read
+     * through.
+     * @return true  ON SUCCESS
+     * @return false if the file could not be opened or does not
+     * start with a Section Header Block.
+     */
+    bool open(const std::string& file_path,
+              std::size_t window_size
+              = Common::kPcapngReaderWindowSize);
+
+    /**
+     * @brief Fill the given packet with the next packet of the
+     * file, decoding and skipping the non-packet blocks on the
+     * way.
+     *
+     * @param packet The packet to fill.
+     * @return true  if a packet has been read.
+     * @return false at the end of the file or if a malformed
+     * block is encountered.
+     */
+    bool nextPacket(Common::PcapPacket& packet) override;
+
+    PcapReaderPosition get_position() const override;
+
+    /**
+     * @brief Decode the Section Header Block and the Interface
+     * Description Blocks of the section of the position, and
+     * continue reading from the position.
+     */
+    bool seek(const PcapReaderPosition& position) override;
+
+    bool is_open() const { return m_fd >= 0; }
+
+    /**
+     * @brief Get the #of interfaces described so far in the
+     * current section.
+     */
+    std::size_t get_number_of_interfaces() const
+    {
+      return m_interfaces.size();
+    }
+};
+
+#endif // PCAPNGFILEREADER_H_INCLUDED
@@ -13,9 +13,10 @@
 #define PERIODICJOB_H_INCLUDED
 
 #include "IPeriodicJob.h"
-#include "common/PcapPacket.h"
 #include <ctime>
-
+#include <mutex>
+#include <utility>
+#include <vector>
 
 /**
  * @brief A thread-safe class which implements 
@@ -44,23 +45,115 @@ class PeriodicJob : public IPeriodicJob
      * their IDs.
      */
     JOBID m_job_id;
+
+    /**
+     * @brief Serializes the cycles of the job (which might be
+     * run by different workers).
+     */
+    std::mutex m_mutex;
+
+    /**
+     * @brief The work given by the creator of the job (if any).
+     */
+    JobPayload m_payload;
+
+    /**
+     * @brief Guards m_queued_cycles and m_is_scheduled.
+     */
+    std::mutex m_queue_mutex;
+
+    /**
+     * @brief The cycles handed over by the scheduler and not
+     * run yet, oldest first.
+     */
+    std::vector<JobCycles> m_queued_cycles;
+
+    /**
+     * @brief The cycles being run by @ref runQueuedCycles;
+     * swapped with m_queued_cycles so that neither gives its
+     * memory back.
+     */
+    std::vector<JobCycles> m_running_cycles;
+
+    /**
+     * @brief true while a call of @ref runQueuedCycles is
+     * queued or running.
+     */
+    bool m_is_scheduled = false;
     
+  protected:
     /** 
-     * @brief stub method for doing some job.
+     * @brief method for doing the job of the given cycles;
+     * runs the payload of the job (if any) for them.
      *
      * This method does not exist in the parent class because
      * each child could have different kinds of jobs to do or
      * different kinds of methods to call periodically.
      */
-    void doSomeJob();
+    virtual void doSomeJob(const JobCycles& cycles);
   public:
     PeriodicJob() = delete;
-    PeriodicJob(struct timeval period, JOBID job_id);
-    void changePeriod(struct timeval tv_period) override;
-    void run() override;
+    PeriodicJob(Common::Nanoseconds period_ns, JOBID job_id,
+                JobPayload payload = nullptr);
+
+    /**
+     * @brief Set by the controller when the job is added,
+     * before the job is run.
+     */
+    void set_job_id(JOBID job_id) { m_job_id = job_id; }
+    using IPeriodicJob::changePeriod;
+    void changePeriod(Common::Nanoseconds period_ns) override;
+    void run(const JobCycles& cycles) override;
+
+    /**
+     * @brief Queue the cycles to be run after the ones queued
+     * before them.
+     *
+     * @return true if no @ref runQueuedCycles call is queued
+     * or running; the caller must then hand one to a worker.
+     * So a job has a single task in the WorkerPool at a time
+     * and its cycles run in the order they are queued.
+     */
+    bool queueCycles(const JobCycles& cycles);
+
+    /**
+     * @brief Run the queued cycles in order, including the ones
+     * queued meanwhile, until there are none left.
+     */
+    void runQueuedCycles();
     void stop() override;
-    const struct timeval& get_period() override;
+    struct timeval get_period() override;
+    Common::Nanoseconds get_period_ns() override;
   
 };
 
+/**
+ * @brief A @ref PeriodicJob whose work is a callable of a type
+ * known at compile time.
+ *
+ * The callable is a member of the job, so calling it neither
+ * goes through the type-erased JobPayload nor needs a separate
+ * allocation, and the compiler can inline it into
+ * doSomeJob.
+ *
+ * The callable can take what @ref runJobCycles accepts.
+ */
+template <typename JobType>
+class TypedPeriodicJob final : public PeriodicJob
+{
+  private:
+    JobType m_job;
+
+  protected:
+    void doSomeJob(const JobCycles& cycles) override
+    {
+      runJobCycles(m_job, cycles);
+    }
+
+  public:
+    TypedPeriodicJob(Common::Nanoseconds period_ns, JOBID job_id,
+                     JobType job)
+      : PeriodicJob(period_ns, job_id), m_job(std::move(job)) {}
+};
+
 #endif // PERIODICJOB_H_INCLUDED
\ No newline at end of file
@@ -30,33 +30,235 @@
 #define PERIODICJOBCONTROLLER_H_INCLUDED
 
 #include "IPeriodicJobController.h"
-#include <unordered_map>
+#include "common/Constants.h"
+#include "common/ExternalTime.h"
+#include "common/TimerWheel.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <random>
+#include <vector>
 
 /**
  * @brief thread-safe class which implements
  * IPeriodicJobController.
  *
+ * The jobs do not have threads of their own. Each job has a
+ * timer in a hierarchical timer wheel keyed on the external
+ * time (in microseconds). The controller subscribes to the
+ * Common::ExternalTime for the earliest deadline of the wheel,
+ * so right when the external time crosses it, the wheel is
+ * advanced and only the jobs which are due are handed over to
+ * the Common::WorkerPool. So the cost of an idle job is a few
+ * pointers and neither a thread nor a wakeup.
+ *
+ * The jobs are spread over independently locked shards in
+ * round-robin; each shard has a job table, a timer wheel
+ * and a time subscription of its own. So adding, removing or
+ * changing the period of jobs from many threads (e.g. a job
+ * per flow) only contends when the jobs share a shard, and
+ * the tables grow with the #of jobs up to a limit which can be
+ * changed at runtime.
+ *
  */
 class PeriodicJobController : public IPeriodicJobController
 {
   friend class PeriodicJobControllerFriend;
 
 private:
+  /**
+   * @brief A job and its timer in the timer wheel of its shard.
+   */
+  struct JobTimer : Common::TimerWheel::Timer
+  {
+    std::shared_ptr<PeriodicJob> job;
+
+    /** the nominal tick of the last cycle handed to a
+     * worker; the next one is due a period later */
+    uint64_t last_run_tick = 0;
+  };
+
+  /**
+   * @brief A slot of the job table of a shard; reused for
+   * another job after its job is removed.
+   */
+  struct Slot
+  {
+    /**
+     * @brief Incremented whenever the job of the slot is
+     * removed, so the handles of the removed job go stale.
+     * Never 0.
+     */
+    uint32_t generation = 1;
+
+    /**
+     * @brief Position of the slot in Shard::active_slots, or
+     * kFreeSlot if the slot has no job.
+     */
+    uint32_t active_position = kFreeSlot;
+
+    JobTimer job_timer;
+  };
+
+  static constexpr uint32_t kFreeSlot = ~0u;
+
+  /**
+   * @brief A part of the jobs guarded by a lock of its own.
+   *
+   * The index of a job handle is (slot index * #of shards +
+   * shard index), so both the shard and the slot of a job are
+   * found from its handle without hashing.
+   */
+  struct alignas(Common::kCacheLineSize) Shard
+  {
+    std::mutex mutex;
+
+    /**
+     * @brief An internal job container to store currently
+     * running jobs of the shard (with their timers).
+     *
+     * A deque never moves its elements when it grows, so the
+     * wheel can link the timers in it.
+     */
+    std::deque<Slot> slots;
+
+    /** indices of the slots without a job */
+    std::vector<uint32_t> free_slots;
+
+    /**
+     * @brief indices of the slots with a job; lets an
+     * arbitrary job be found in O(1).
+     */
+    std::vector<uint32_t> active_slots;
+
+    /**
+     * @brief indices of the slots whose jobs were added before
+     * the external time was set; they are not in timer_wheel
+     * yet, since there is no time to count their periods from.
+     */
+    std::vector<uint32_t> unanchored_slots;
+
+    Common::TimerWheel timer_wheel;
+
     /**
-   * @brief An internal job container to store currently
-   * running jobs.
+     * @brief Subscription to the external time armed for the
+     * earliest deadline of timer_wheel (or for the first time
+     * set if there are unanchored_slots).
+     */
+    Common::ExternalTime::SubscriptionId time_subscription = 0;
+  };
+
+  std::vector<std::unique_ptr<Shard>> m_shards;
+
+  /**
+   * @brief #of jobs in all the shards.
+   */
+  std::atomic<std::size_t> m_number_of_jobs{0};
+  std::atomic<std::size_t> m_max_number_of_jobs{
+    Common::kMaxNumberOfActivePeriodicJobsAllowed};
+
+  /**
+   * @brief Where the next job is added; the jobs are spread
+   * over the shards in round-robin.
+   */
+  std::atomic<std::size_t> m_next_shard_index{0};
+
+  Shard& getShard(const JOBID& job_id) const;
+
+  /**
+   * @brief Get the slot of the job with the given handle.
+   *
+   * @note The mutex of the shard must be held.
+   * @return nullptr if the handle is stale or invalid.
+   */
+  Slot* findSlot(Shard& shard, const JOBID& job_id) const;
+
+  /**
+   * @brief Get the handle of the job in the given slot.
+   */
+  JOBID toJobId(std::size_t shard_index, uint32_t slot_index,
+                const Slot& slot) const;
+
+  /**
+   * @brief Hand the job over to the WorkerPool and schedule its
+   * next cycle one period later.
+   *
+   * The cycle was due at due_tick; if the job catches up (see
+   * Common::CatchUpMode) every period due until now is handed
+   * over at once, with their nominal times, as a single
+   * JobCycles. The cycles are queued in the job (see
+   * PeriodicJob::queueCycles), so they run in order and after
+   * the cycles handed over on the earlier ticks.
+   *
+   * @note The mutex of the shard must be held.
+   */
+  static void runAndReschedule(Shard& shard, JobTimer& job_timer,
+                               uint64_t due_tick, uint64_t now);
+
+  /**
+   * @brief Run the first cycles of the jobs added before the
+   * external time was set and schedule their next ones, as if
+   * they had been added at the given tick.
+   *
+   * @note The mutex of the shard must be held.
+   */
+  static void anchorJobs(Shard& shard, uint64_t now);
+
+  /**
+   * @brief Convert a time to the ticks of the timer wheels.
+   */
+  static uint64_t toTicks(Common::Nanoseconds time_ns);
+
+  /**
+   * @brief Convert a period to the ticks of the timer wheels;
+   * rounded up and at least a tick, since a period shorter
+   * than a tick would expire forever.
+   */
+  static uint64_t toPeriodTicks(Common::Nanoseconds period_ns);
+
+  /**
+   * @brief Advance the timer wheel of the shard to the current
+   * external time, running the jobs which are due (and the
+   * first cycles of the unanchored ones).
+   */
+  static void advanceTimers(Shard& shard);
+
+  /**
+   * @brief Arm the time subscription of the shard for the
+   * earliest deadline of its timer wheel.
    *
-   * It stores the id of the job and the job itself.
+   * @note The mutex of the shard must be held.
+   */
+  static void updateTimeSubscription(Shard& shard);
+
+  /**
+   * @brief Remove the job from the shard and its timer wheel
+   * after stopping it, and free its slot.
+   *
+   * @note The mutex of the shard must be held.
+   */
+  void eraseJob(Shard& shard, uint32_t slot_index);
+
+  /**
+   * @brief Give the job an ID, add it to a shard and run its
+   * first cycle; at the first time set if the external time
+   * is not set yet, so that the job does not catch up the
+   * periods from the epoch to the start of the capture.
    *
-   * @note This is not declared in the parent since each child
-   * might want to implement their own container types.
+   * @return JOBID an empty handle if the limit of jobs is
+   * reached.
    */
+  JOBID insertJob(std::shared_ptr<PeriodicJob> periodic_job);
 
-  std::unordered_map<
-    JOBID, 
-    std::shared_ptr<IPeriodicJob> 
-    > m_active_jobs;
+  /**
+   * @brief Get the job with the given ID.
+   *
+   * @return nullptr if there is no such job.
+   */
+  std::shared_ptr<IPeriodicJob> findJob(const JOBID& job_id) const;
 
   /**
    * @brief How many @ref PeriodicJobs to assign upon the
@@ -79,36 +281,113 @@ private:
    * @note Normally, we should not add the period (periods)
    * randomly; but maybe after making some calculations
    * depending on the job or some constant value. But, for now
-   * let's do this way.
+   * let's do this way. Guarded by m_mutex.
    *
    */
   std::default_random_engine m_generator;
 
-  /**
-   * @brief Create an unique ID for the new job object
-   *
-   * boost::uuids::uuid is used to generate the unique job ids.
-   *
-   * @return JOBID "" if creation of the ID was unsucessfull.
-   * @return JOBID Job ID of the newly generated job/ 
-   */
-  JOBID createIdForNewJob();
 protected:
  /**
  * @brief Currently running jobs are stored in this container.
  */
 public:
+  /**
+   * @param number_of_shards #of independently locked parts the
+   * jobs are spread over.
+   */
+  explicit PeriodicJobController(
+    unsigned number_of_shards 
+    = Common::kNumberOfPeriodicJobControllerShards);
+
+  /**
+   * @brief Unsubscribes from the external time and stops the
+   * remaining jobs so that their cycles already handed to the
+   * workers do nothing.
+   */
+  ~PeriodicJobController();
   
   [[nodiscard]] /*[[gnu::warn_unused_result]]*/
   std::vector<JOBID> onNewTime() override;
+
+  /* the timeval versions of the interface */
+  using IPeriodicJobController::addJob;
+  using IPeriodicJobController::changePeriod;
+
   [[nodiscard]] /*[[gnu::warn_unused_result]]*/ 
-  JOBID addJob( struct timeval period ) override; 
+  JOBID addJob( Common::Nanoseconds period_ns ) override; 
+  [[nodiscard]] /*[[gnu::warn_unused_result]]*/ 
+  JOBID addJob( Common::Nanoseconds period_ns, 
+                JobPayload payload ) override; 
+
+  /**
+   * @brief Add a new job running a callable whose type is
+   * known at compile time; faster to call than a JobPayload
+   * (see @ref TypedPeriodicJob).
+   */
+  template <typename JobType>
+  [[nodiscard]] JOBID addTypedJob( Common::Nanoseconds period_ns, 
+                                   JobType job )
+  {
+    return insertJob(std::make_shared<TypedPeriodicJob<JobType>>(
+      period_ns, JOBID(), std::move(job)));
+  }
+
+  template <typename JobType>
+  [[nodiscard]] JOBID addTypedJob( struct timeval period, 
+                                   JobType job )
+  {
+    return addTypedJob(Common::toNanoseconds(period), 
+                       std::move(job));
+  }
   bool removeJob( JOBID job_id ) override;
   JOBID removeAnArbitraryJob() override;
   bool changePeriod(
     JOBID job_id, 
-    struct timeval period
+    Common::Nanoseconds period_ns
     ) override;
+
+  /**
+   * @brief Change what the given job does with the periods the
+   * external time jumps over.
+   *
+   * @return false if there is no such job.
+   */
+  bool changeCatchUpMode(JOBID job_id, 
+                         Common::CatchUpMode catch_up_mode);
+
+  /**
+   * @brief Get the #of active jobs.
+   */
+  std::size_t get_number_of_jobs() const
+  {
+    return m_number_of_jobs.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Change the #of active jobs above which addJob
+   * fails. Lowering it below the current #of jobs does not
+   * remove any job.
+   *
+   * @note Limited to UINT32_MAX / #of shards, so that the
+   * indices of the job handles fit in 32 bits.
+   */
+  void set_max_number_of_jobs(std::size_t max_number_of_jobs)
+  {
+    m_max_number_of_jobs.store(
+      std::min<std::size_t>(max_number_of_jobs,
+                            UINT32_MAX / m_shards.size()),
+      std::memory_order_relaxed);
+  }
+
+  std::size_t get_max_number_of_jobs() const
+  {
+    return m_max_number_of_jobs.load(std::memory_order_relaxed);
+  }
+
+  std::size_t get_number_of_shards() const
+  {
+    return m_shards.size();
+  }
 };
 
 extern PeriodicJobController* g_ptr_periodic_class_controller_instance;
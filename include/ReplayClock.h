@@ -0,0 +1,80 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref ReplayClock class which
+ * paces replaying captured packets.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef REPLAYCLOCK_H_INCLUDED
+#define REPLAYCLOCK_H_INCLUDED
+
+#include "common/Constants.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Tells the packet writers when to push each packet
+ * according to its arrival time and a Common::ReplayMode.
+ *
+ * The wall clock is anchored at the first packet: a packet
+ * which arrived "d" after the first one is due "d / speed"
+ * after the first one was pushed (speed being 1 for real time).
+ * In max-speed mode every packet is due right away; the
+ * external time still follows the timestamps of the packets,
+ * so the PeriodicJobs fire on the same external ticks
+ * regardless of the mode.
+ *
+ * @note Time never goes backwards; a packet older than the
+ * ones before it is due right away.
+ */
+class ReplayClock
+{
+  private:
+    Common::ReplayMode m_mode;
+    double m_speed;
+
+    bool m_is_started = false;
+    int64_t m_first_arrival_time_ns = 0;
+    std::chrono::steady_clock::time_point m_wall_start;
+
+  public:
+    /**
+     * @param speed how many times faster than the capture to
+     * replay in Common::ReplayMode::kScaled; ignored otherwise.
+     */
+    explicit ReplayClock(
+      Common::ReplayMode mode = Common::kReplayMode,
+      double speed = Common::kReplaySpeed);
+
+    /**
+     * @brief Parse a replay mode given on the command line:
+     * "max", "realtime" or a speed factor (e.g. "4" or "0.5")
+     * for a scaled replay.
+     *
+     * @return false if the text is none of them.
+     */
+    static bool fromString(const std::string& text,
+                           ReplayClock& replay_clock);
+
+    /**
+     * @brief How long to wait until the packet with the given
+     * arrival time is due; the first call starts the clock.
+     */
+    std::chrono::nanoseconds get_time_until_due(
+      int64_t arrival_time_ns);
+
+    /**
+     * @brief Sleep until the packet with the given arrival time
+     * is due.
+     */
+    void waitUntilDue(int64_t arrival_time_ns);
+
+    Common::ReplayMode get_mode() const { return m_mode; }
+    double get_speed() const { return m_speed; }
+};
+
+#endif // REPLAYCLOCK_H_INCLUDED
@@ -0,0 +1,249 @@
+/**
+ * @file
+ *
+ * @brief This file contains the @ref TcpReassembler class which
+ * puts the segments of the TCP connections back in order and
+ * delivers their byte streams to an @ref ITcpStreamHandler.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef TCPREASSEMBLER_H_INCLUDED
+#define TCPREASSEMBLER_H_INCLUDED
+
+#include "common/Constants.h"
+#include "FlowTable.h"
+#include "ITcpStreamHandler.h"
+#include "PacketDecoder.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Reassembles the byte streams of the TCP connections
+ * seen by a single packet processor.
+ *
+ * Each direction of a connection tracks the sequence number of
+ * its next octet. A segment coming in order is delivered right
+ * away from the packet (zero-copy), followed by any out of
+ * order segments it makes contiguous. The out of order
+ * segments are copied into an interval map of the direction
+ * (non-overlapping; overlaps are resolved by the
+ * Common::TcpOverlapPolicy) until the hole before them is
+ * filled.
+ *
+ * The octets held by all the reassemblers are bounded by a
+ * process-wide budget (see set_memory_budget): a reassembler
+ * short of room flushes its least recently buffered connections
+ * first, reporting their holes as gaps; one pathological
+ * connection can not take more than the budget.
+ *
+ * A connection is closed when both directions have got their
+ * FIN in order, on a RST, or by @ref closeStream (e.g. when its
+ * flow goes idle).
+ *
+ * @note Not thread-safe except for the budget; every processor
+ * thread keeps a reassembler of its own (see
+ * getTcpReassembler in PacketProcessing.h).
+ */
+class TcpReassembler
+{
+  private:
+    /**
+     * @brief The stream of a direction.
+     */
+    struct HalfStream
+    {
+      bool is_started = false;
+      bool has_fin = false;
+      bool is_closed = false;
+
+      /** sequence number of the octet at next_offset */
+      uint32_t next_sequence = 0;
+
+      /** #of octets delivered (or skipped as gaps) so far */
+      uint64_t next_offset = 0;
+      uint64_t fin_offset = 0;
+
+      /** out of order data by offset; never overlapping and
+       * always after next_offset */
+      std::map<uint64_t, std::vector<uint8_t>> segments;
+    };
+
+    struct Stream
+    {
+      HalfStream halves[2];
+
+      /** octets charged to the budget for the segments */
+      std::size_t number_of_buffered_octets = 0;
+
+      bool is_in_lru = false;
+      std::list<FlowKey>::iterator lru_position;
+    };
+
+    /**
+     * @brief A piece of the data of a segment to deliver or to
+     * buffer after its overlaps are resolved.
+     */
+    struct Piece
+    {
+      uint64_t offset;
+      const uint8_t* data;
+      std::size_t length;
+    };
+
+    typedef std::unordered_map<FlowKey, Stream, FlowKeyHash>
+      StreamMap;
+
+    ITcpStreamHandler& m_handler;
+    Common::TcpOverlapPolicy m_overlap_policy;
+    StreamMap m_streams;
+
+    /**
+     * @brief The streams holding out of order segments, the
+     * least recently buffered first.
+     */
+    std::list<FlowKey> m_lru;
+
+    std::size_t m_number_of_buffered_octets = 0;
+    std::size_t m_number_of_dropped_segments = 0;
+    std::size_t m_number_of_flushed_streams = 0;
+
+    /**
+     * @brief Resolve the overlaps of the given data with the
+     * segments buffered in the half stream.
+     */
+    void resolveOverlaps(const FlowKey& key, Stream& stream,
+                         HalfStream& half, const Piece& data,
+                         std::vector<Piece>& pieces);
+
+    void addData(const FlowKey& key, Stream& stream,
+                 TcpDirection direction, uint64_t offset,
+                 const uint8_t* data, std::size_t length);
+
+    /**
+     * @brief Deliver the given data and the buffered segments
+     * it makes contiguous.
+     */
+    void deliver(const FlowKey& key, Stream& stream,
+                 TcpDirection direction, const uint8_t* data,
+                 std::size_t length);
+
+    /**
+     * @brief Copy the given data into the half stream if the
+     * budget allows.
+     *
+     * @return false if the data is dropped.
+     */
+    bool buffer(const FlowKey& key, Stream& stream,
+                HalfStream& half, const Piece& piece);
+
+    /**
+     * @brief Take the given #of octets from the budget,
+     * flushing the least recently buffered streams except for
+     * the given one as needed.
+     */
+    bool reserve(const FlowKey& key, std::size_t octets);
+    void release(Stream& stream, std::size_t octets);
+
+    /**
+     * @brief Deliver every buffered segment of the stream,
+     * reporting the holes before them as gaps.
+     */
+    void flush(const FlowKey& key, Stream& stream);
+
+    /**
+     * @brief Close the direction if its FIN is reached; close
+     * the connection once both are closed.
+     *
+     * @return true if the connection is closed (and erased).
+     */
+    bool checkFin(const FlowKey& key, Stream& stream,
+                  TcpDirection direction);
+
+    void eraseStream(StreamMap::iterator stream_iterator);
+
+  public:
+    explicit TcpReassembler(ITcpStreamHandler& handler,
+                            Common::TcpOverlapPolicy overlap_policy
+                              = Common::kTcpOverlapPolicy);
+
+    /**
+     * @brief Releases the buffered segments without delivering
+     * them; see @ref closeAllStreams.
+     */
+    ~TcpReassembler();
+    TcpReassembler(TcpReassembler const&) = delete;
+    void operator=(TcpReassembler const&) = delete;
+
+    /**
+     * @brief Feed a TCP segment of the given flow.
+     *
+     * @param data the packet the segment is decoded from.
+     * @param decoded must have a complete TCP header
+     * (DecodedPacket::kTcp).
+     */
+    void processSegment(const FlowKey& key, TcpDirection direction,
+                        const uint8_t* data,
+                        const DecodedPacket& decoded);
+
+    /**
+     * @brief Flush and close the connection of the given flow
+     * (CloseReason::kTimeout); does nothing if it is not
+     * tracked.
+     */
+    void closeStream(const FlowKey& key);
+
+    /**
+     * @brief @ref closeStream every connection; e.g. at the end
+     * of the packets.
+     */
+    void closeAllStreams();
+
+    std::size_t get_number_of_streams() const
+    {
+      return m_streams.size();
+    }
+    std::size_t get_number_of_buffered_octets() const
+    {
+      return m_number_of_buffered_octets;
+    }
+
+    /**
+     * @brief #of out of order segments (or parts of them)
+     * dropped since the budget was used up.
+     */
+    std::size_t get_number_of_dropped_segments() const
+    {
+      return m_number_of_dropped_segments;
+    }
+
+    /**
+     * @brief #of times a stream was flushed to make room in the
+     * budget.
+     */
+    std::size_t get_number_of_flushed_streams() const
+    {
+      return m_number_of_flushed_streams;
+    }
+
+    /**
+     * @brief The octets the out of order segments of all the
+     * reassemblers can take; Common::kTcpReassemblyMemoryBudget
+     * by default.
+     */
+    static void set_memory_budget(std::size_t octets);
+    static std::size_t get_memory_budget();
+
+    /**
+     * @brief The octets taken from the budget by all the
+     * reassemblers.
+     */
+    static std::size_t get_total_number_of_buffered_octets();
+};
+
+#endif // TCPREASSEMBLER_H_INCLUDED
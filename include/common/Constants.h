@@ -14,6 +14,10 @@
 #ifndef COMMON_CONSTANTS_H_INCLUDED
 #define COMMON_CONSTANTS_H_INCLUDED
 
+#include <cstddef>
+#include <cstdint>
+#include "Nanoseconds.h"
+
 namespace Common
 {
   /**
@@ -25,9 +29,40 @@ namespace Common
    * be run in threads; this function specifies
    * how many packets should each thread calling 
    * @ref processPackets consume.
+   *
+   * These packets are popped from the PcapPacketQueue as a
+   * single batch, so this is also the #of packets per queue
+   * synchronization on the processor side. Larger values
+   * amortize the synchronization better.
    * 
    */
-  constexpr unsigned kMaxNumberOfPacketsToProcess = 6;
+  constexpr unsigned kMaxNumberOfPacketsToProcess = 256;
+
+  /**
+   * @brief #of packets whose headers are decoded at once (see
+   * decodePackets) by @ref processPackets; small enough for the
+   * decoded headers to stay in the L1 cache until the packets
+   * are processed.
+   */
+  constexpr std::size_t kPacketDecoderBurstSize = 32;
+
+  /**
+   * @brief if true, @ref decodePackets classifies the common
+   * packets with the AVX2 kernel on the CPUs supporting it.
+   *
+   * @note Off by default: on bursts of 32 minimal TCP/UDP
+   * packets (-O2), the scalar loop decodes ~95 Mpps of uniform
+   * and ~65-70 Mpps of mixed IPv4/IPv6 traffic, the kernel
+   * ~55 Mpps of either.
+   */
+  constexpr bool kUseVectorizedPacketDecoder = false;
+
+  /**
+   * @brief #of packets the writer of a capture file collects
+   * before pushing them to the PcapPacketQueue as a single
+   * batch.
+   */
+  constexpr unsigned kPcapPacketQueueWriteBatchSize = 256;
 
   /**
    * @brief The constant, defined to be pass used as the 
@@ -49,45 +84,319 @@ namespace Common
   constexpr unsigned kProgramStayAliveTimeSeconds = 20;
 
   /**
-   * @brief Used in PeriodicJob's run function to check
-   * how many milliseconds (ms) to sleep between each time
-   * check.
-   * 
-   * Note that, ExternalTime's time updated at each second
-   * at most which is 1000ms. We should sleep less than
-   * 1000ms not to miss any time modification with an error
-   * more than a second. Ideally, we should set this to a 
-   * value which gives us best average least remainder 
-   * according to module 1000 (i.e. for 400ms, we could miss 
-   * the time update for 200ms after 3 sleeps, and 0ms after 5 
-   * sleeps etc. even though 0ms is not reliable). So generally,
-   * the less we sleep, the higher the accuracy of our periods.
-   * 
+   * @brief How the writers of PcapPacketQueueWriter.h pace
+   * pushing the packets (see ReplayClock.h).
    */
-  constexpr unsigned kPeriodicJobTimeCheckingperiod = 300;
+  enum class ReplayMode
+  {
+    /** push as fast as possible; only the timestamps of the
+     * packets move the external time */
+    kMaxSpeed,
+    /** push each packet when its inter-arrival gap has passed
+     * on the wall clock */
+    kRealTime,
+    /** like kRealTime but kReplaySpeed times faster */
+    kScaled
+  };
 
   /**
-   * @brief How many milliseconds to wait before pushing
-   * another item to the PcapPacketQueue.
-   *
-   * This constant is used by PcapPacketQueueWriter.h
+   * @brief The default pacing of the packet writers; archived
+   * captures are processed as fast as possible.
    */
-  constexpr unsigned kPcapPacketQueueWritingperiod = 300;
+  constexpr ReplayMode kReplayMode = ReplayMode::kMaxSpeed;
 
   /**
-   * @brief #of total PeriodicJobs that can be active 
+   * @brief How many times faster than the capture the packets
+   * are pushed in ReplayMode::kScaled.
+   */
+  constexpr double kReplaySpeed = 10.0;
+
+  /**
+   * @brief How far (in nanoseconds of packet time) a packet
+   * processor can get ahead of the external time moved by the
+   * ClockStage before it waits for the tick thread.
+   */
+  constexpr Nanoseconds kClockStageMaxSkewNanoseconds = 
+    kNanosecondsPerSecond;
+
+  /**
+   * @brief What a PeriodicJob does with the periods it missed
+   * when the external time jumps over several of them (e.g. a
+   * gap in the capture).
+   */
+  enum class CatchUpMode
+  {
+    /** run once at the new time and count the next period
+     * from there; the missed periods are dropped */
+    kSkipMissedPeriods,
+    /** run every missed period with its nominal time (the
+     * time it was due), so the results do not depend on how
+     * fast the capture is replayed */
+    kRunMissedPeriods
+  };
+
+  /**
+   * @brief The catch-up mode of the newly added PeriodicJobs.
+   */
+  constexpr CatchUpMode kCatchUpMode = 
+    CatchUpMode::kRunMissedPeriods;
+
+  /**
+   * @brief The most periods a PeriodicJob catches up at once;
+   * older missed periods are dropped. Protects against e.g. a
+   * job added before the first packet set the external time,
+   * which would otherwise catch up every period since the
+   * epoch.
+   */
+  constexpr uint64_t kMaxNumberOfCatchUpPeriods = 64 * 1024;
+
+  /**
+   * @brief Default #of total PeriodicJobs that can be active
    * at the same time in a PeriodicJobController.
    * 
    * This number specifies how many active PeriodicJobs
-   * can be stored in the internal queue of
-   * PeriodicJobController. In case we only use
-   * g_ptr_periodic_class_controller_instance declared
-   * and defined in PeriodicJobController files, this
-   * number specifies total number of concurrent threads
-   * to run the PeriodicJobs throughout the application. 
+   * can be stored in the internal tables of a
+   * PeriodicJobController unless it is changed at runtime via
+   * PeriodicJobController::set_max_number_of_jobs. The jobs do
+   * not have threads of their own (they are scheduled on timer
+   * wheels and run on the WorkerPool), so this only bounds the
+   * memory used by the jobs.
    * 
    */
-  constexpr unsigned kMaxNumberOfActivePeriodicJobsAllowed = 30;
+  constexpr std::size_t kMaxNumberOfActivePeriodicJobsAllowed 
+    = 16 * 1024 * 1024;
+
+  /**
+   * @brief The resolution (in nanoseconds) of the timer wheels
+   * the PeriodicJobs are scheduled on. The periods are kept in
+   * nanoseconds; they are only rounded up to a tick when they
+   * are scheduled. A wheel covers 2^60 ticks, so a tick can not
+   * be a nanosecond for absolute (since the epoch) deadlines.
+   */
+  constexpr Nanoseconds kPeriodicJobTimerTickNanoseconds = 1000;
+
+  /**
+   * @brief #of independently locked shards the jobs of a
+   * PeriodicJobController are spread over.
+   */
+  constexpr unsigned kNumberOfPeriodicJobControllerShards = 16;
+
+  /**
+   * @brief Size of the window (in octets) the pcapng reader
+   * reads the capture file through.
+   *
+   * Blocks are decoded in place from this window which is
+   * refilled with large sequential reads, so the whole file is
+   * never buffered. Blocks bigger than the window (rare, e.g.
+   * huge custom blocks) are skipped without being buffered
+   * unless they carry packets or interface descriptions, in
+   * which case the window grows to fit them.
+   */
+  constexpr unsigned kPcapngReaderWindowSize = 4 * 1024 * 1024;
+
+  /**
+   * @brief Size of a cache line in octets on the target
+   * architecture.
+   *
+   * Used to pad the members which are written by different
+   * threads so that they do not share a cache line (false
+   * sharing).
+   */
+  constexpr std::size_t kCacheLineSize = 64;
+
+  /**
+   * @brief Kinds of containers the PcapPacketQueue used
+   * throughout the application can be backed by.
+   */
+  enum class PcapPacketQueueType
+  {
+    /** unbounded std::deque guarded by a std::mutex */
+    kMutexDeque,
+    /** lock-free bounded ring for a single writer & a single
+     * processor thread */
+    kSpscRing,
+    /** lock-free bounded ring for any #of writer & processor
+     * threads */
+    kMpmcRing
+  };
+
+  /**
+   * @brief Which PcapPacketQueue is returned by
+   * Common::getPcapPacketQueue() defined in
+   * PcapPacketQueueSelector.h.
+   *
+   * @note kSpscRing must only be selected if there is exactly
+   * one writer thread and one processor thread.
+   */
+  constexpr PcapPacketQueueType kPcapPacketQueueType =
+    PcapPacketQueueType::kMpmcRing;
+
+  /**
+   * @brief Capacity of the lock-free PcapPacketQueue rings.
+   *
+   * The capacity of the rings must be a power of two; other
+   * values are rounded up to the next power of two. When the
+   * ring is full, the writer waits for the processors to make
+   * room.
+   */
+  constexpr std::size_t kPcapPacketQueueCapacity = 1 << 16;
+
+  /**
+   * @brief How many times a thread waiting on a
+   * PcapPacketQueue (e.g. a processor thread waiting for a
+   * packet) checks the queue before parking.
+   *
+   * Spinning a little avoids sleeping & waking up for each
+   * packet while the writer keeps pushing; parking afterwards
+   * makes sure an idle processor does not burn a whole core.
+   * Can be changed at runtime via set_spin_budget of the
+   * queues.
+   */
+  constexpr unsigned kPcapPacketQueueSpinBudget = 1000;
+
+  /**
+   * @brief Size of the slabs (in octets) the PacketBufferPool
+   * carves the packet buffers out of.
+   *
+   * Each thread allocating packet buffers reserves slabs of
+   * this size for each size class it uses. 2 MiB is the size of
+   * a huge page on x86-64.
+   */
+  constexpr std::size_t kPacketBufferPoolSlabSize = 2 * 1024 * 1024;
+
+  /**
+   * @brief Whether the slabs of the PacketBufferPool should be
+   * backed by huge pages by default.
+   *
+   * Can be changed at runtime via set_use_huge_pages method of
+   * the PacketBufferPool instance.
+   */
+  constexpr bool kPacketBufferPoolUseHugePages = false;
+
+  /**
+   * @brief #of processor threads the PacketDispatcher spreads
+   * the flows over; 0 means one per hardware thread.
+   */
+  constexpr unsigned kNumberOfPacketProcessors = 0;
+
+  /**
+   * @brief Capacity of the queue of each processor thread of
+   * the PacketDispatcher (rounded up to a power of two).
+   */
+  constexpr std::size_t kPacketDispatcherShardCapacity = 1 << 14;
+
+  /**
+   * @brief #of threads of the WorkerPool running the
+   * PeriodicJobs; 0 means one per hardware thread.
+   */
+  constexpr unsigned kNumberOfJobWorkers = 0;
+
+  /**
+   * @brief #of octets a job payload (see JobPayload in
+   * IPeriodicJob.h) can take before it is allocated on the
+   * heap; enough for a lambda capturing a few pointers.
+   */
+  constexpr std::size_t kJobPayloadInlineSize = 48;
+
+  /**
+   * @brief #of octets a task of the WorkerPool can take before
+   * it is allocated on the heap; enough for the task of a job
+   * (a shared_ptr to it) and a few more pointers.
+   */
+  constexpr std::size_t kWorkerPoolTaskInlineSize = 48;
+
+  /**
+   * @brief At max how many flows the FlowTable of each packet
+   * processor keeps; the new flows are dropped while it is
+   * full.
+   *
+   * A slot takes a cache line plus a control byte, and the
+   * table has a power of two slots, about twice this many
+   * (1M slots, 65 MiB, for 512K flows). The flows are spread
+   * over the whole table by their hashes (and the table is
+   * backed by huge pages), so a table with a few thousand flows
+   * is already resident entirely: count 65 MiB per processor
+   * thread.
+   */
+  constexpr std::size_t kMaxNumberOfFlowsPerProcessor = 
+    512 * 1024;
+
+  /**
+   * @brief How long (in nanoseconds of packet time, i.e. of the
+   * ExternalTime) a flow can go without a packet before it is
+   * evicted from the FlowTable of its processor.
+   */
+  constexpr Nanoseconds kFlowIdleTimeoutNanoseconds = 
+    60 * kNanosecondsPerSecond;
+
+  /**
+   * @brief #of slots of its FlowTable a packet processor sweeps
+   * for the idle flows per batch of packets; the whole table is
+   * swept over many batches instead of at once.
+   */
+  constexpr std::size_t kFlowTableEvictionScanSize = 1024;
+
+  /**
+   * @brief Which data the TcpReassembler keeps when the
+   * segments of a stream overlap with different contents (e.g.
+   * an evasion attempt). The data already delivered is never
+   * replaced.
+   */
+  enum class TcpOverlapPolicy
+  {
+    /** keep the data seen first (BSD, Windows) */
+    kFirst,
+    /** keep the data seen last (e.g. old Linux, Solaris) */
+    kLast
+  };
+
+  /**
+   * @brief The overlap policy of the newly created
+   * TcpReassemblers.
+   */
+  constexpr TcpOverlapPolicy kTcpOverlapPolicy = 
+    TcpOverlapPolicy::kFirst;
+
+  /**
+   * @brief At max how many octets the out of order TCP
+   * segments held by all the TcpReassemblers together can take.
+   *
+   * When it is reached, the least recently buffered streams are
+   * flushed (their holes are reported as gaps) to make room; a
+   * segment still not fitting is dropped. Can be changed at
+   * runtime via TcpReassembler::set_memory_budget.
+   */
+  constexpr std::size_t kTcpReassemblyMemoryBudget = 
+    256 * 1024 * 1024;
+
+  /**
+   * @brief Size (in octets) of each buffer the PcapFileWriter
+   * collects the records in; every thread writing packets fills
+   * a buffer of its own, and the files are written a whole
+   * buffer at a time.
+   */
+  constexpr std::size_t kPcapWriterBufferSize = 1024 * 1024;
+
+  /**
+   * @brief #of buffers of a PcapFileWriter which can wait to be
+   * written; a thread needing an empty buffer then waits for
+   * the disk rather than allocating one more.
+   */
+  constexpr std::size_t kPcapWriterNumberOfBuffers = 8;
+
+  /**
+   * @brief The snapshot length written into the headers of the
+   * capture files by the PcapFileWriter.
+   */
+  constexpr uint32_t kPcapWriterSnaplen = 262144;
+
+  /**
+   * @brief A PcapIndex takes a checkpoint every that many
+   * packets; reading from a time reads at most that many packets
+   * before it (in a capture sorted by time). A checkpoint takes
+   * 56 octets of the index.
+   */
+  constexpr uint32_t kPcapIndexPacketInterval = 4096;
 }
 
 #endif
\ No newline at end of file
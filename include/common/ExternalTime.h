@@ -16,9 +16,19 @@
 #ifndef COMMON_EXTERNALTIME_H_INCLUDED
 #define COMMON_EXTERNALTIME_H_INCLUDED
 
+#include "Nanoseconds.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <ctime>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <mutex>
-#include <thread>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <sys/time.h> // timeval
 
 namespace Common
 {
@@ -45,14 +55,99 @@ namespace Common
    * anyone needing the time can use get_current_time function
    * on the Singleton instance.
    *
+   * The time is a single atomic count of nanoseconds, so
+   * reading it is wait-free and setting it is a compare and
+   * swap; nobody takes a lock per packet.
+   *
+   * Instead of polling the time, anyone who needs to act at a
+   * given external time can @ref subscribe to it: the callback
+   * is run by the thread moving the time to (or past) that
+   * value. @ref waitUntil blocks the calling thread until then
+   * in the same way.
    *
   */
   class ExternalTime // ExternalTime Singleton
   {
+  public:
+    typedef uint64_t SubscriptionId;
+
+    /**
+     * @brief Called with the time which has crossed the
+     * subscribed one.
+     */
+    typedef std::function<void(Nanoseconds current_time_ns)>
+      SubscriptionCallback;
+
+    /**
+     * @brief The time of a disarmed subscription; it is never
+     * crossed.
+     */
+    static constexpr Nanoseconds kNever =
+      std::numeric_limits<Nanoseconds>::max();
+
+    /**
+     * @brief The time before any is set; every time set is
+     * later than this.
+     */
+    static constexpr Nanoseconds kUnset = 0;
+
   // member variables
   private: 
-    struct timeval m_current_time;
-    std::mutex m_mutex;
+    /**
+     * @brief The current time in nanoseconds since the epoch.
+     */
+    std::atomic<Nanoseconds> m_current_time_ns{kUnset};
+
+    /**
+     * @brief The earliest time a subscription is armed for
+     * (kNever if none); lets @ref set_current_time skip the
+     * subscriptions with a single load.
+     */
+    std::atomic<Nanoseconds> m_next_subscription_time_ns{kNever};
+
+    struct Subscription
+    {
+      std::shared_ptr<SubscriptionCallback> callback;
+      Nanoseconds time_ns = kNever;
+    };
+
+    /**
+     * @brief Guards m_subscriptions and m_armed_subscriptions.
+     * It is never held while a callback runs, so the callbacks
+     * can (re)subscribe.
+     */
+    std::mutex m_subscriptions_mutex;
+    std::unordered_map<SubscriptionId, Subscription>
+      m_subscriptions;
+
+    /**
+     * @brief The armed subscriptions ordered by their times.
+     */
+    std::set<std::pair<Nanoseconds, SubscriptionId>>
+      m_armed_subscriptions;
+    SubscriptionId m_last_subscription_id = 0;
+
+    /**
+     * @brief Held while the callbacks of the crossed
+     * subscriptions run; @ref unsubscribe takes it to wait for a
+     * callback in flight. Recursive so that a callback can
+     * unsubscribe itself.
+     */
+    std::recursive_mutex m_callbacks_mutex;
+
+    /**
+     * @brief Disarm the subscriptions crossed by the given time
+     * and run their callbacks.
+     */
+    void runCrossedSubscriptions(Nanoseconds current_time_ns);
+
+    /**
+     * @brief Arm the subscription for the given time.
+     *
+     * @note m_subscriptions_mutex must be held.
+     */
+    void arm(SubscriptionId id, Subscription& subscription,
+             Nanoseconds time_ns);
 
   // methods
   public:
@@ -72,37 +167,123 @@ namespace Common
      *
      * Called by the pcap queue consumer to set/update the time
      * on the Singleton instance so that there is one source of
-     * truth for the time throughout the application.
+     * truth for the time throughout the application. The
+     * callbacks of the subscriptions crossed by the new time
+     * are run by the calling thread before returning.
      *
-     * @param current_time newly arrived pcap packet's arrival
-     * time
+     * @param current_time_ns newly arrived pcap packet's arrival
+     * time in nanoseconds since the epoch
+     * @return true  if the time has advanced to a new second.
+     * Several processor threads can see the same new second;
+     * only the one getting true should act on the new time.
+     * @return false if the time has not moved to a new second
+     * (it is still updated if it is newer within the second).
      */
-    void set_current_time(struct timeval current_time)
+    bool set_current_time_ns(Nanoseconds current_time_ns)
     {
-      std::scoped_lock<std::mutex> lock(m_mutex);
-      // // not consider microseconds for now
-      if (current_time.tv_sec > m_current_time.tv_sec) 
-        m_current_time = current_time;
+      auto last_time_ns = 
+        m_current_time_ns.load(std::memory_order_relaxed);
+      do
+      {
+        /* time never goes backwards */
+        if (current_time_ns <= last_time_ns)
+          return false;
+      }
+      while (!m_current_time_ns.compare_exchange_weak(
+               last_time_ns, current_time_ns));
+
+      /* a single load unless a subscription is crossed */
+      if (current_time_ns >= m_next_subscription_time_ns.load())
+        runCrossedSubscriptions(current_time_ns);
+      return current_time_ns / kNanosecondsPerSecond 
+             != last_time_ns / kNanosecondsPerSecond;
+    }
+
+    bool set_current_time(struct timeval current_time)
+    {
+      return set_current_time_ns(toNanoseconds(current_time));
     }
 
     /** Gets the internal time object to be used as ground-truth
      * time.
      *
      * Called by any code to get the single source of truth for
-     * the time.
+     * the time. Wait-free.
      *
      * @return internal time object
      */
-    struct timeval get_current_time()
+    Nanoseconds get_current_time_ns() const
+    {
+      return m_current_time_ns.load(std::memory_order_acquire);
+    }
+
+    struct timeval get_current_time() const
+    {
+      return toTimeval(get_current_time_ns());
+    }
+
+    /**
+     * @brief true once a time has been set, i.e. the time is
+     * not kUnset any more.
+     */
+    bool is_set() const
     {
-      std::scoped_lock<std::mutex> lock(m_mutex);
-      return m_current_time;
+      return get_current_time_ns() != kUnset;
     }
 
+    /**
+     * @brief Run the callback when the time reaches (or passes)
+     * the given one.
+     *
+     * The subscription fires once and is then disarmed; use
+     * @ref reschedule to arm it again (e.g. from the callback
+     * itself) and @ref unsubscribe when it is not needed any
+     * more. If the time has already been reached, the callback
+     * is run by the next update of the time; it is never run by
+     * the subscribing thread, so the caller can hold the locks
+     * its callback takes.
+     *
+     * @param time_ns kNever to create a disarmed subscription.
+     * @return SubscriptionId to reschedule/unsubscribe with.
+     */
+    SubscriptionId subscribe(Nanoseconds time_ns,
+                             SubscriptionCallback callback);
+
+    /**
+     * @brief Arm the subscription for another time (kNever to
+     * disarm it). Like @ref subscribe, it never runs the
+     * callback itself.
+     *
+     * @return false if there is no such subscription.
+     */
+    bool reschedule(SubscriptionId id, Nanoseconds time_ns);
+
+    /**
+     * @brief Remove the subscription. When this returns, its
+     * callback is not running (unless the caller is the
+     * callback itself) and will not be run any more.
+     *
+     * @return false if there is no such subscription.
+     */
+    bool unsubscribe(SubscriptionId id);
+
+    /**
+     * @brief Block the calling thread until the time reaches
+     * the given one.
+     *
+     * @param timeout how long to wait at most (in the system
+     * time since the external time might never get there).
+     * @return true  if the time has been reached.
+     * @return false on timeout.
+     */
+    bool waitUntil(Nanoseconds time_ns,
+                   std::chrono::nanoseconds timeout
+                   = std::chrono::nanoseconds::max());
+
   private:
-    ExternalTime(): m_current_time({0, 0}), m_mutex()  {}
+    ExternalTime() = default;
   };
 }
 
 
-#endif // COMMON_EXTERNALTIME_H_INCLUDED
\ No newline at end of file
+#endif // COMMON_EXTERNALTIME_H_INCLUDED
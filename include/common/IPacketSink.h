@@ -0,0 +1,93 @@
+/**
+ * @file
+ *
+ * @brief This file contains the interface of anything the pcap
+ * packets can be written into by the writer threads.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef COMMON_IPACKETSINK_H_INCLUDED
+#define COMMON_IPACKETSINK_H_INCLUDED
+
+#include "PcapPacket.h"
+#include <cstddef>
+
+/* see PacketDecoder.h */
+struct DecodedPacket;
+
+namespace Common
+{
+  /**
+   * @brief interface class which represents the writing end of
+   * a stream of @ref PcapPacket.
+   *
+   * Implemented by every @ref IPcapPacketQueue and by the
+   * @ref PacketDispatcher spreading the packets over several
+   * queues, so that the writer functions do not need to know
+   * where the packets go.
+   */
+  class IPacketSink
+  {
+    public:
+      virtual ~IPacketSink() {}
+
+      /**
+       * @brief Pushes a PcapPacket instance to the sink.
+       *
+       * If the sink is bounded and full, waits until there is
+       * room for the packet.
+       *
+       * @param packet A newly arrived PcapPacket
+       */
+      virtual void pushPacket(PcapPacket&& packet) = 0;
+
+      /**
+       * @brief Pushes the given packets to the sink in FIFO
+       * order with as few synchronizations as possible (e.g.
+       * one lock acquisition for the whole batch).
+       *
+       * If the sink is bounded and does not have room for all
+       * of them, waits until every packet is pushed.
+       *
+       * @param packets array of newly arrived packets; all of
+       * them are moved from.
+       * @param number_of_packets #of packets in the array.
+       */
+      virtual void pushPackets(PcapPacket* packets,
+                               std::size_t number_of_packets) = 0;
+
+      /**
+       * @brief Same as @ref pushPackets for the packets whose
+       * headers are already decoded (e.g. by a sink in front of
+       * this one), so that the sink does not decode them again.
+       *
+       * The sinks which do not look into the packets ignore the
+       * decoded headers.
+       *
+       * @param decoded the headers of the packets, one entry
+       * per packet.
+       */
+      virtual void pushDecodedPackets(PcapPacket* packets,
+                                      const DecodedPacket* decoded,
+                                      std::size_t number_of_packets)
+      {
+        (void)decoded;
+        pushPackets(packets, number_of_packets);
+      }
+
+      /**
+       * @brief Signal the end of stream to the consumers of the
+       * sink.
+       *
+       * Called by the writer after pushing its last packet. The
+       * packets already pushed are still consumed.
+       *
+       * @note Do not push any packet after closing the sink.
+       */
+      virtual void closeQueue() = 0;
+  };
+}
+
+#endif // COMMON_IPACKETSINK_H_INCLUDED
@@ -0,0 +1,103 @@
+/**
+ * @file
+ *
+ * @brief This file contains the interface of the queues the
+ * pcap packets are passed from the writer threads to the
+ * processor threads through.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef COMMON_IPCAPPACKETQUEUE_H_INCLUDED
+#define COMMON_IPCAPPACKETQUEUE_H_INCLUDED
+
+#include "IPacketSink.h"
+#include "PcapPacket.h"
+#include <cstddef>
+
+namespace Common
+{
+  /**
+   * @brief thread-safe interface class which represents a FIFO
+   * container of @ref PcapPacket with queue-like methods.
+   *
+   * Implemented by the mutex-guarded @ref PcapPacketQueue and
+   * the lock-free @ref LockFreePcapPacketQueue so that the
+   * writer and processor functions do not depend on a concrete
+   * queue. The pushing side is inherited from
+   * @ref IPacketSink.
+   */
+  class IPcapPacketQueue : public IPacketSink
+  {
+    public:
+      virtual ~IPcapPacketQueue() {}
+
+      /**
+       * @brief Pops (deletes) and returns the oldest PcapPacket
+       * instance from the queue.
+       *
+       * @return An empty packet (see PcapPacket::empty) ON
+       * FAILURE (i.e. if the queue is empty)
+       * @return The oldest packet ON SUCCESS
+       */
+      [[nodiscard]]
+      virtual PcapPacket popPacket() = 0;
+
+      /**
+       * @brief Pops (deletes) the oldest PcapPacket instance
+       * from the queue, waiting for one to arrive if the queue
+       * is empty.
+       *
+       * The waiting thread spins for a while and then parks
+       * until a packet is pushed or the queue is closed.
+       *
+       * @param packet the popped packet ON SUCCESS
+       * @return true  if a packet has been popped.
+       * @return false if the queue is closed and there is no
+       * packet left in it (end of stream).
+       */
+      virtual bool waitAndPopPacket(PcapPacket& packet) = 0;
+
+      /**
+       * @brief Pops (deletes) up to "max_number_of_packets" of
+       * the oldest packets without waiting.
+       *
+       * @param packets array of at least max_number_of_packets
+       * packets to move the popped packets into.
+       * @return #of packets popped; 0 if the queue is empty.
+       */
+      virtual std::size_t popPackets(
+        PcapPacket* packets,
+        std::size_t max_number_of_packets) = 0;
+
+      /**
+       * @brief Pops (deletes) up to "max_number_of_packets" of
+       * the oldest packets, waiting for at least one to arrive
+       * if the queue is empty.
+       *
+       * @param packets array of at least max_number_of_packets
+       * packets to move the popped packets into.
+       * @return #of packets popped; 0 only if the queue is
+       * closed and there is no packet left in it (end of stream).
+       */
+      virtual std::size_t waitAndPopPackets(
+        PcapPacket* packets,
+        std::size_t max_number_of_packets) = 0;
+
+      /**
+       * @brief true if closeQueue has been called. The packets
+       * already in the queue can still be popped; after that,
+       * @ref waitAndPopPacket returns false instead of waiting.
+       */
+      virtual bool is_closed() const = 0;
+
+      /**
+       * @brief Set how many times a waiting thread checks the
+       * queue before parking.
+       */
+      virtual void set_spin_budget(unsigned spin_budget) = 0;
+  };
+}
+
+#endif // COMMON_IPCAPPACKETQUEUE_H_INCLUDED
@@ -0,0 +1,201 @@
+/**
+ * @file
+ *
+ * @brief This file contains the Common::InplaceFunction class
+ * which stores a small callable inline instead of on the heap.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef COMMON_INPLACEFUNCTION_H_INCLUDED
+#define COMMON_INPLACEFUNCTION_H_INCLUDED
+
+#include <cstddef>
+#include <new> // placement new
+#include <type_traits>
+#include <utility>
+
+namespace Common
+{
+  template <typename Signature, std::size_t Capacity>
+  class InplaceFunction;
+
+  /**
+   * @brief A move-only std::function alike which keeps the
+   * callables of up to "Capacity" octets in a buffer of its own
+   * (small-buffer optimization).
+   *
+   * A small lambda (e.g. one capturing a few pointers) is moved
+   * into the buffer, so creating and calling the function
+   * neither allocates nor chases a pointer to a heap closure.
+   * Larger callables (or the ones which might throw while being
+   * moved) are still supported but allocated on the heap; see
+   * @ref is_inline.
+   *
+   * @note Unlike std::function, this can hold move-only
+   * callables and can not be copied.
+   */
+  template <typename R, typename... Args, std::size_t Capacity>
+  class InplaceFunction<R(Args...), Capacity>
+  {
+    private:
+      /**
+       * @brief What to do with the stored callable; one
+       * static table per callable type.
+       */
+      struct Operations
+      {
+        R (*invoke)(void* storage, Args&&... args);
+        void (*move)(void* from, void* to);
+        void (*destroy)(void* storage);
+        bool is_inline;
+      };
+
+      template <typename F>
+      static constexpr bool kFitsInline =
+        sizeof(F) <= Capacity 
+        && alignof(F) <= alignof(std::max_align_t)
+        && std::is_nothrow_move_constructible<F>::value;
+
+      template <typename F>
+      struct InlineOperations
+      {
+        static R invoke(void* storage, Args&&... args)
+        {
+          return (*static_cast<F*>(storage))(
+            std::forward<Args>(args)...);
+        }
+        static void move(void* from, void* to)
+        {
+          new (to) F(std::move(*static_cast<F*>(from)));
+          static_cast<F*>(from)->~F();
+        }
+        static void destroy(void* storage)
+        {
+          static_cast<F*>(storage)->~F();
+        }
+        static constexpr Operations kOperations = 
+          {&invoke, &move, &destroy, true};
+      };
+
+      /* the buffer only holds a pointer to the callable */
+      template <typename F>
+      struct HeapOperations
+      {
+        static F*& pointer(void* storage)
+        {
+          return *static_cast<F**>(storage);
+        }
+        static R invoke(void* storage, Args&&... args)
+        {
+          return (*pointer(storage))(std::forward<Args>(args)...);
+        }
+        static void move(void* from, void* to)
+        {
+          new (to) F*(pointer(from));
+        }
+        static void destroy(void* storage)
+        {
+          delete pointer(storage);
+        }
+        static constexpr Operations kOperations = 
+          {&invoke, &move, &destroy, false};
+      };
+
+      alignas(std::max_align_t) unsigned char m_storage[
+        Capacity < sizeof(void*) ? sizeof(void*) : Capacity];
+      const Operations* m_operations = nullptr;
+
+    public:
+      InplaceFunction() = default;
+      InplaceFunction(std::nullptr_t) {}
+
+      template <typename F,
+                typename = std::enable_if_t<!std::is_same<
+                  std::decay_t<F>, InplaceFunction>::value>>
+      InplaceFunction(F&& callable)
+      {
+        using Callable = std::decay_t<F>;
+        if constexpr (kFitsInline<Callable>)
+        {
+          new (m_storage) Callable(std::forward<F>(callable));
+          m_operations = &InlineOperations<Callable>::kOperations;
+        }
+        else
+        {
+          new (m_storage) Callable*(
+            new Callable(std::forward<F>(callable)));
+          m_operations = &HeapOperations<Callable>::kOperations;
+        }
+      }
+
+      InplaceFunction(InplaceFunction&& other) noexcept
+        : m_operations(other.m_operations)
+      {
+        if (m_operations != nullptr)
+        {
+          m_operations->move(other.m_storage, m_storage);
+          other.m_operations = nullptr;
+        }
+      }
+
+      InplaceFunction& operator=(InplaceFunction&& other) noexcept
+      {
+        if (this != &other)
+        {
+          reset();
+          m_operations = other.m_operations;
+          if (m_operations != nullptr)
+          {
+            m_operations->move(other.m_storage, m_storage);
+            other.m_operations = nullptr;
+          }
+        }
+        return *this;
+      }
+
+      InplaceFunction(InplaceFunction const&)  = delete;
+      void operator=(InplaceFunction const&)   = delete;
+
+      ~InplaceFunction() { reset(); }
+
+      /**
+       * @brief Destroy the callable and become empty.
+       */
+      void reset()
+      {
+        if (m_operations != nullptr)
+        {
+          m_operations->destroy(m_storage);
+          m_operations = nullptr;
+        }
+      }
+
+      explicit operator bool() const
+      {
+        return m_operations != nullptr;
+      }
+
+      /**
+       * @brief true if the callable is stored in the buffer of
+       * the function rather than on the heap.
+       */
+      bool is_inline() const
+      {
+        return m_operations != nullptr && m_operations->is_inline;
+      }
+
+      /**
+       * @note Calling an empty function is undefined; check it
+       * via operator bool first.
+       */
+      R operator()(Args... args)
+      {
+        return m_operations->invoke(m_storage,
+                                    std::forward<Args>(args)...);
+      }
+  };
+}
+
+#endif // COMMON_INPLACEFUNCTION_H_INCLUDED
@@ -0,0 +1,213 @@
+/**
+ * @file
+ *
+ * @brief This file contains the Common::LockFreePcapPacketQueue
+ * class which is a bounded, lock-free alternative of
+ * Common::PcapPacketQueue.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef COMMON_LOCKFREEPCAPPACKETQUEUE_H_INCLUDED
+#define COMMON_LOCKFREEPCAPPACKETQUEUE_H_INCLUDED
+
+#include "IPcapPacketQueue.h"
+#include "RingBuffer.h"
+#include "PcapPacket.h"
+#include "SpinThenParkWaiter.h"
+#include "Constants.h"
+#include <atomic>
+#include <cstddef>
+
+namespace Common
+{
+  /**
+   * @brief A thread-safe, bounded and lock-free FIFO container
+   * of PcapPacket implementing @ref IPcapPacketQueue.
+   *
+   * Unlike @ref PcapPacketQueue, this class is not a Singleton;
+   * the capacity is given at construction. See
+   * Common::getPcapPacketQueue() for the instance used
+   * throughout the application.
+   *
+   * @tparam Ring the ring buffer holding the packets which
+   * determines how many threads can push/pop concurrently (see
+   * @ref SpscPcapPacketQueue & @ref MpmcPcapPacketQueue).
+   */
+  template <typename Ring>
+  class LockFreePcapPacketQueue : public IPcapPacketQueue
+  {
+    private:
+      Ring m_ring;
+      std::atomic<bool> m_is_closed{false};
+
+      /**
+       * @brief processors waiting for the ring to be non-empty
+       */
+      SpinThenParkWaiter m_not_empty_waiter;
+
+      /**
+       * @brief writers waiting for the ring to be non-full
+       */
+      SpinThenParkWaiter m_not_full_waiter;
+
+      bool tryPopPacket(PcapPacket& packet)
+      {
+        if (!m_ring.tryPop(packet))
+          return false;
+        m_not_full_waiter.notifyOne();
+        return true;
+      }
+
+      std::size_t tryPopPackets(PcapPacket* packets,
+                                std::size_t max_number_of_packets)
+      {
+        auto count = m_ring.tryPopBatch(packets, 
+                                        max_number_of_packets);
+        if (count != 0)
+          m_not_full_waiter.notifyOne();
+        return count;
+      }
+
+    public:
+      LockFreePcapPacketQueue() = delete;
+
+      /**
+       * @param capacity maximum #of packets waiting in the
+       * queue; rounded up to a power of two.
+       * @param spin_budget how many times a waiting thread
+       * checks the queue before parking.
+       */
+      explicit LockFreePcapPacketQueue(
+        std::size_t capacity,
+        unsigned spin_budget = kPcapPacketQueueSpinBudget)
+        : m_ring(capacity),
+          m_not_empty_waiter(spin_budget),
+          m_not_full_waiter(spin_budget) {}
+      LockFreePcapPacketQueue(LockFreePcapPacketQueue const&)
+        = delete;
+      void operator=(LockFreePcapPacketQueue const&) = delete;
+
+      [[nodiscard]]
+      PcapPacket popPacket() override
+      {
+        PcapPacket packet;
+        /* if empty, the packet stays empty */
+        tryPopPacket(packet);
+        return packet;
+      }
+
+      void pushPacket(PcapPacket&& packet) override
+      {
+        /* If the ring is full, let the processors make room. */
+        if (!m_ring.tryPush(std::move(packet)))
+          m_not_full_waiter.wait([this, &packet]()
+          {
+            return m_ring.tryPush(std::move(packet));
+          });
+        m_not_empty_waiter.notifyOne();
+      }
+
+      void pushPackets(PcapPacket* packets,
+                       std::size_t number_of_packets) override
+      {
+        std::size_t number_of_packets_pushed = 0;
+        while (number_of_packets_pushed < number_of_packets)
+        {
+          auto pushBatch = [&]()
+          {
+            return m_ring.tryPushBatch(
+              packets + number_of_packets_pushed,
+              number_of_packets - number_of_packets_pushed);
+          };
+          auto count = pushBatch();
+          /* If the ring is full, let the processors make room */
+          if (count == 0)
+            m_not_full_waiter.wait([&]()
+            {
+              count = pushBatch();
+              return count != 0;
+            });
+          number_of_packets_pushed += count;
+          /* more than one processor might have work now */
+          if (count > 1)
+            m_not_empty_waiter.notifyAll();
+          else
+            m_not_empty_waiter.notifyOne();
+        }
+      }
+
+      std::size_t popPackets(
+        PcapPacket* packets,
+        std::size_t max_number_of_packets) override
+      {
+        return tryPopPackets(packets, max_number_of_packets);
+      }
+
+      std::size_t waitAndPopPackets(
+        PcapPacket* packets,
+        std::size_t max_number_of_packets) override
+      {
+        std::size_t count = 0;
+        m_not_empty_waiter.wait([&]()
+        {
+          count = tryPopPackets(packets, max_number_of_packets);
+          return count != 0
+                 || m_is_closed.load(std::memory_order_acquire);
+        });
+        if (count == 0)
+          count = tryPopPackets(packets, max_number_of_packets);
+        return count;
+      }
+
+      bool waitAndPopPacket(PcapPacket& packet) override
+      {
+        bool is_popped = false;
+        m_not_empty_waiter.wait([this, &packet, &is_popped]()
+        {
+          is_popped = tryPopPacket(packet);
+          return is_popped
+                 || m_is_closed.load(std::memory_order_acquire);
+        });
+        /* the last packets might have been pushed right before
+        closing the queue */
+        return is_popped || tryPopPacket(packet);
+      }
+
+      void closeQueue() override
+      {
+        m_is_closed.store(true, std::memory_order_release);
+        m_not_empty_waiter.notifyAll();
+      }
+
+      bool is_closed() const override
+      {
+        return m_is_closed.load(std::memory_order_acquire);
+      }
+
+      void set_spin_budget(unsigned spin_budget) override
+      {
+        m_not_empty_waiter.set_spin_budget(spin_budget);
+        m_not_full_waiter.set_spin_budget(spin_budget);
+      }
+
+      std::size_t capacity() const { return m_ring.capacity(); }
+  };
+
+  /**
+   * @brief lock-free queue for a single writer thread and a
+   * single processor thread.
+   */
+  typedef LockFreePcapPacketQueue<SpscRingBuffer<PcapPacket>>
+    SpscPcapPacketQueue;
+
+  /**
+   * @brief lock-free queue for any #of writer and processor
+   * threads.
+   */
+  typedef LockFreePcapPacketQueue<MpmcRingBuffer<PcapPacket>>
+    MpmcPcapPacketQueue;
+}
+
+#endif // COMMON_LOCKFREEPCAPPACKETQUEUE_H_INCLUDED
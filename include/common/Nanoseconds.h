@@ -0,0 +1,73 @@
+/**
+ * @file
+ *
+ * @brief This file contains the Common::Nanoseconds type used
+ * for the timestamps and the periods throughout the project,
+ * and its conversions from/to timeval.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef COMMON_NANOSECONDS_H_INCLUDED
+#define COMMON_NANOSECONDS_H_INCLUDED
+
+#include <cstdint>
+#include <ctime>
+#include <sys/time.h> // timeval
+
+namespace Common
+{
+  /**
+   * @brief A point in time (nanoseconds since the epoch) or a
+   * duration in nanoseconds.
+   *
+   * A single 64-bit integer is cheap to compare, add and store
+   * atomically, unlike a timeval which needs normalizing its
+   * microseconds; it covers the years 1678 to 2262.
+   */
+  typedef int64_t Nanoseconds;
+
+  constexpr Nanoseconds kNanosecondsPerMicrosecond = 1000;
+  constexpr Nanoseconds kNanosecondsPerMillisecond = 1000000;
+  constexpr Nanoseconds kNanosecondsPerSecond = 1000000000;
+
+  inline Nanoseconds toNanoseconds(const struct timeval& tv)
+  {
+    return static_cast<Nanoseconds>(tv.tv_sec) 
+           * kNanosecondsPerSecond
+           + static_cast<Nanoseconds>(tv.tv_usec) 
+           * kNanosecondsPerMicrosecond;
+  }
+
+  /**
+   * @note The nanoseconds below a microsecond are truncated.
+   */
+  inline struct timeval toTimeval(Nanoseconds nanoseconds)
+  {
+    struct timeval tv;
+    auto seconds = nanoseconds / kNanosecondsPerSecond;
+    auto remainder = nanoseconds % kNanosecondsPerSecond;
+    /* round towards the past for times before the epoch */
+    if (remainder < 0)
+    {
+      seconds--;
+      remainder += kNanosecondsPerSecond;
+    }
+    tv.tv_sec = static_cast<time_t>(seconds);
+    tv.tv_usec = static_cast<suseconds_t>(
+      remainder / kNanosecondsPerMicrosecond);
+    return tv;
+  }
+
+  /**
+   * @brief Seconds (with their fraction) for printing.
+   */
+  inline double toSeconds(Nanoseconds nanoseconds)
+  {
+    return static_cast<double>(nanoseconds) 
+           / kNanosecondsPerSecond;
+  }
+}
+
+#endif // COMMON_NANOSECONDS_H_INCLUDED
@@ -0,0 +1,143 @@
+/**
+ * @file
+ *
+ * @brief This file contains the Common::PacketBufferPool
+ * Singleton class which provides the buffers holding the data
+ * of the PcapPackets.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef COMMON_PACKETBUFFERPOOL_H_INCLUDED
+#define COMMON_PACKETBUFFERPOOL_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace Common
+{
+  /**
+   * @brief A thread-safe, size-classed pool of packet buffers &
+   * Singleton class to be used instead of new[]/delete[] for
+   * packet data.
+   *
+   * Whenever this class's methods are requried; firstly
+   * getInstance method of this class should be called to get
+   * the one and only instance of this class and the methods
+   * should be called on this instance.
+   *
+   * Buffers are carved out of large slabs; each size class has
+   * its own free list in a per-thread cache, so allocating and
+   * freeing a buffer on the same thread takes no lock and makes
+   * no system call. A buffer freed on another thread (e.g.
+   * allocated by the PcapPacketQueue writer and freed by a
+   * processor) is pushed onto a lock-free list of the owning
+   * thread's cache, which takes it back the next time its own
+   * free list runs dry.
+   *
+   * Slabs can optionally be backed by huge pages to reduce TLB
+   * misses. Slabs are never returned to the system; the memory
+   * footprint of the pool is bounded by the peak #of buffers in
+   * flight.
+   *
+   * @note Buffers are not zero-initialized.
+   */
+  class PacketBufferPool // PacketBufferPool Singleton
+  {
+    public:
+      /**
+       * @brief #of size classes; requests larger than the
+       * largest class are served by the global allocator.
+       */
+      static constexpr std::size_t kNumberOfSizeClasses = 9;
+
+      /**
+       * @brief Capacities of the buffers of each size class.
+       * 9216 is for jumbo frames and 65536 for a full IP
+       * datagram.
+       */
+      static constexpr std::size_t kSizeClasses
+        [kNumberOfSizeClasses] =
+        {128, 256, 512, 1024, 2048, 4096, 9216, 16384, 65536};
+
+    private:
+      /**
+       * @brief true if the slabs should be backed by huge
+       * pages.
+       */
+      std::atomic<bool> m_use_huge_pages;
+
+      /**
+       * @brief total #of octets reserved by the slabs.
+       */
+      std::atomic<std::size_t> m_number_of_reserved_octets{0};
+
+    // SINGLETON STUFF BEGIN //
+    public:
+      /**
+       * @brief Get Singleton instance
+       */
+      static PacketBufferPool& getInstance();
+      PacketBufferPool(PacketBufferPool const&) = delete;
+      void operator=(PacketBufferPool const&)   = delete;
+    private:
+      PacketBufferPool();
+    // SINGLETON STUFF END // CLASS-SPECIFIC METHODS BEGIN //
+    public:
+      /**
+       * @brief Get a buffer which can hold at least "size"
+       * octets.
+       *
+       * @throw std::bad_alloc if no memory can be reserved.
+       */
+      uint8_t* allocate(std::size_t size);
+
+      /**
+       * @brief Give a buffer obtained from @ref allocate back to
+       * the pool. Can be called from any thread.
+       *
+       * @param buffer nullptr is allowed and ignored.
+       */
+      void deallocate(uint8_t* buffer);
+
+      /**
+       * @brief Get the capacity of a buffer obtained from
+       * @ref allocate which might be larger than requested.
+       */
+      std::size_t get_capacity(const uint8_t* buffer) const;
+
+      /**
+       * @brief Enable/disable huge page backed slabs for the
+       * slabs reserved after this call.
+       *
+       * If huge pages can not be reserved (e.g. none are
+       * configured on the host), transparent huge pages are
+       * requested for normal slabs instead.
+       */
+      void set_use_huge_pages(bool use_huge_pages)
+      {
+        m_use_huge_pages.store(use_huge_pages);
+      }
+
+      /**
+       * @brief Get the total #of octets reserved by the slabs of
+       * all the threads.
+       */
+      std::size_t get_number_of_reserved_octets() const
+      {
+        return m_number_of_reserved_octets.load();
+      }
+
+      /**
+       * @brief Reserve a new slab for the calling thread.
+       *
+       * @note Used internally by the thread caches.
+       */
+      uint8_t* reserveSlab(std::size_t size);
+      // CLASS-SPECIFIC METHODS END //
+  };
+}
+
+#endif // COMMON_PACKETBUFFERPOOL_H_INCLUDED
@@ -1,9 +1,9 @@
 /**
  * @file
  *
- * @brief This file contains the @ref PcapPacket class and a
- * destructor function to destruct dynamically allocated members
- * of this struct.
+ * @brief This file contains the @ref PcapPacket class which is
+ * a compact, move-only handle of a captured packet releasing
+ * the memory holding its data by itself.
  *
  * @author Aybars Kerem TAŞKAN
  *
@@ -12,75 +12,251 @@
 #ifndef COMMON_PCAPPACKET_H_INCLUDED
 #define COMMON_PCAPPACKET_H_INCLUDED
 
+#include "Nanoseconds.h"
+#include "PacketBufferPool.h"
 #include <ctime>
 #include <cstdint>
+#include <sys/time.h> // timeval
 
 namespace Common
 {
   /**
-   * @brief POD pcap packet structure stub that needs to be
-   * storing pcap arrival time and packet data.
+   * @brief Who owns the memory pointed by the data of a
+   * @ref PcapPacket; determines how the packet releases it.
    *
-   * We can represent different pcap packets with this data
-   * structure since data member variable can be of any size.
+   * Packets read from a memory-mapped capture file point
+   * directly into the mapping (zero-copy) and must not be
+   * freed per packet; the mapping is released as a whole by the
+   * reader which created it.
+   */
+  enum class PcapPacketDataOwner : uint8_t
+  {
+    kNone       = 0, ///< no data (an empty packet)
+    kMappedFile = 1, ///< points into a file mapping, not freed
+    kPool       = 2, ///< allocated from the PacketBufferPool
+    kHeap       = 3  ///< allocated with new[], freed by delete[]
+  };
+
+  /**
+   * @brief Move-only handle of a pcap packet storing its
+   * arrival time, its data and the lengths of this data.
    *
-   * Ethernet frame, IPv4 frame etc. can be inherited from
-   * PcapPacket its default constructor can be deleted; but to
-   * make sure PcapPacket is POD (trivial & standard layout), I
-   * chose not to do like that. Having this struct as a POD type
-   * could be useful in case of a need to send PcapPacket to
-   * outside without a wrapper or to be able to utilize static
-   * default initialization capabilities etc.
+   * We can represent different pcap packets with this class
+   * since the data can be of any size; e.g. for an Ethernet
+   * frame the data would be holding a header of 14 to 18 octets
+   * and a payload of upto 1500 octets, for an IPv4 packet a
+   * header of 20 to 60 octets with a payload of upto 65475
+   * octets etc. The captured length tells how many of these
+   * octets are really available, so nobody needs to guess the
+   * size of the buffer.
    *
+   * The data is released by the destructor according to its
+   * owner (see @ref PcapPacketDataOwner), so a dropped packet
+   * never leaks. Since a packet can not be copied, the data
+   * always has exactly one owner; moving a packet leaves the
+   * source empty.
+   *
+   * The arrival time is kept as nanoseconds since the epoch
+   * rather than a timeval so that the whole handle fits in 32
+   * octets (half a cache line) and the queues can store the
+   * packets densely.
+   *
+   * @note A default constructed packet is empty (see
+   * @ref empty); it is what the queues give when there is no
+   * packet to pop.
    */
-  typedef struct PcapPacket
+  class PcapPacket
   {
+    private:
       /**
-       * @brief Pcap packet's arrival time that can be used to
-       * set project-wide time instead of relying on the system
-       * clock. 
+       * @brief Pcap packet's arrival time (nanoseconds since the
+       * epoch) that can be used to set project-wide time instead
+       * of relying on the system clock.
        */
-      struct timeval arrival_time;
+      Nanoseconds m_arrival_time_ns = 0;
+
       /**
-       * @brief 
-       *
-       * "data" member holds the binary data like the header and
-       * the payload. For example, for an Ethernet frame, data
-       * member would be holding a header of 14 to 18 octets and
-       * a payload of upto 1500 octets; for an IPv4 packet a
-       * header of 20 to 60 octets with a payload of upto 65475
-       * octets, for an IPv6 packet a header of 40 octets and a
-       * payload of 65535 octets (2^32-1 octets if a Jumbogram)
-       * etc.
+       * @brief The binary data like the header and the payload.
+       */
+      uint8_t* m_data = nullptr;
+
+      /**
+       * @brief #of octets of the packet available in m_data
+       * (i.e. captured length which can be less than the
+       * length on the wire due to the snapshot length).
+       */
+      uint32_t m_caplen = 0;
+
+      /**
+       * @brief #of octets of the packet on the wire when it
+       * was captured.
+       */
+      uint32_t m_len = 0;
+
+      /**
+       * @brief Index of the interface the packet was captured
+       * on (always 0 for classic pcap files).
+       */
+      uint16_t m_interface_index = 0;
+
+      PcapPacketDataOwner m_data_owner = PcapPacketDataOwner::kNone;
+
+      /**
+       * @brief Release the data according to its owner.
+       */
+      void release()
+      {
+        switch (m_data_owner)
+        {
+          case PcapPacketDataOwner::kPool:
+            PacketBufferPool::getInstance().deallocate(m_data);
+            break;
+          case PcapPacketDataOwner::kHeap:
+            delete[] m_data;
+            break;
+          default:
+            break;
+        }
+      }
+
+    public:
+      static Nanoseconds toNanoseconds(const struct timeval& tv)
+      {
+        return Common::toNanoseconds(tv);
+      }
+
+      static struct timeval toTimeval(Nanoseconds nanoseconds)
+      {
+        return Common::toTimeval(nanoseconds);
+      }
+
+      /**
+       * @brief Create a packet whose data is a new buffer of
+       * the PacketBufferPool with room for "caplen" octets.
        *
-       * I chose to have "data" member as a pointer (but
-       * otherwise I should have done something like data[1518]
-       * for ethernet and different size for every other
-       * possible packet.
+       * @note The buffer is not initialized; fill it via
+       * @ref get_data.
+       */
+      static PcapPacket allocate(
+        Nanoseconds arrival_time_ns, uint32_t caplen, uint32_t len,
+        uint16_t interface_index = 0)
+      {
+        return PcapPacket(
+          arrival_time_ns,
+          PacketBufferPool::getInstance().allocate(caplen),
+          caplen, len, PcapPacketDataOwner::kPool,
+          interface_index);
+      }
+
+      PcapPacket() = default;
+
+      /**
+       * @brief Take over the given data.
        *
-       * @note Since "data" member is a pointer, some memory
-       * needs to be allocated before storing some data in it;
-       * then deleting falls under the responsibility of whoever
-       * uses the packet last.
+       * @param data_owner how the data is to be released when
+       * the packet is destructed.
        */
-      uint8_t* data;
-  } PcapPacket;
+      PcapPacket(Nanoseconds arrival_time_ns, uint8_t* data,
+                 uint32_t caplen, uint32_t len,
+                 PcapPacketDataOwner data_owner,
+                 uint16_t interface_index = 0)
+        : m_arrival_time_ns(arrival_time_ns), m_data(data),
+          m_caplen(caplen), m_len(len),
+          m_interface_index(interface_index),
+          m_data_owner(data_owner) {}
 
-  /**
-   * @brief destruct the PcapPacket's dynamically allocated data
-   * members.
-   *
-   * This is a free function and not a method inside the 
-   * @ref PcapPacket since I wanted to keep @ref PcapPacket a
-   * POD type.
-   *
-   * @param packet The @ref PcapPacket to destruct the members
-   * of
-   */
-  inline void destructPcapPacket(PcapPacket&& packet)
-  {
-    delete[] packet.data;
-  }
+      /**
+       * @brief Create a packet without any data which only
+       * carries an arrival time.
+       */
+      explicit PcapPacket(const struct timeval& arrival_time)
+        : m_arrival_time_ns(toNanoseconds(arrival_time)) {}
+
+      ~PcapPacket() { release(); }
+
+      PcapPacket(PcapPacket const&)         = delete;
+      void operator=(PcapPacket const&)     = delete;
+
+      PcapPacket(PcapPacket&& other) noexcept
+        : m_arrival_time_ns(other.m_arrival_time_ns),
+          m_data(other.m_data), m_caplen(other.m_caplen),
+          m_len(other.m_len),
+          m_interface_index(other.m_interface_index),
+          m_data_owner(other.m_data_owner)
+      {
+        other.m_data = nullptr;
+        other.m_caplen = 0;
+        other.m_len = 0;
+        other.m_data_owner = PcapPacketDataOwner::kNone;
+      }
+
+      PcapPacket& operator=(PcapPacket&& other) noexcept
+      {
+        if (this != &other)
+        {
+          release();
+          m_arrival_time_ns = other.m_arrival_time_ns;
+          m_data = other.m_data;
+          m_caplen = other.m_caplen;
+          m_len = other.m_len;
+          m_interface_index = other.m_interface_index;
+          m_data_owner = other.m_data_owner;
+          other.m_data = nullptr;
+          other.m_caplen = 0;
+          other.m_len = 0;
+          other.m_data_owner = PcapPacketDataOwner::kNone;
+        }
+        return *this;
+      }
+
+      /**
+       * @brief Release the data and make the packet empty.
+       */
+      void reset() { *this = PcapPacket(); }
+
+      /**
+       * @brief true if the packet neither has data nor an
+       * arrival time; e.g. what is popped from an empty queue.
+       */
+      bool empty() const
+      {
+        return m_data_owner == PcapPacketDataOwner::kNone
+               && m_arrival_time_ns == 0;
+      }
+
+      Nanoseconds get_arrival_time_ns() const
+      {
+        return m_arrival_time_ns;
+      }
+      struct timeval get_arrival_time() const
+      {
+        return toTimeval(m_arrival_time_ns);
+      }
+      void set_arrival_time_ns(Nanoseconds arrival_time_ns)
+      {
+        m_arrival_time_ns = arrival_time_ns;
+      }
+      void set_arrival_time(const struct timeval& arrival_time)
+      {
+        m_arrival_time_ns = toNanoseconds(arrival_time);
+      }
+
+      const uint8_t* get_data() const { return m_data; }
+      uint8_t* get_data() { return m_data; }
+      uint32_t get_caplen() const { return m_caplen; }
+      uint32_t get_len() const { return m_len; }
+      uint16_t get_interface_index() const
+      {
+        return m_interface_index;
+      }
+      PcapPacketDataOwner get_data_owner() const
+      {
+        return m_data_owner;
+      }
+  };
+
+  static_assert(sizeof(PcapPacket) == 32,
+                "PcapPacket should stay half a cache line");
 }
 
 #endif // COMMON_PCAPPACKET_H_INCLUDED
@@ -11,7 +11,11 @@
 #ifndef COMMON_PCAPPACKETQUEUE_H_INCLUDED
 #define COMMON_PCAPPACKETQUEUE_H_INCLUDED
 
+#include "IPcapPacketQueue.h"
 #include "PcapPacket.h"
+#include "SpinThenParkWaiter.h"
+#include <atomic>
+#include <cstddef>
 #include <deque>
 #include <mutex>
 #include <thread>
@@ -32,12 +36,70 @@ namespace Common
    * This class has an internal container holding PcapPacket
    * class instances where anyone can push or pop&read those.
    *
+   * The internal container is unbounded. For a bounded and
+   * lock-free alternative see @ref LockFreePcapPacketQueue.
+   *
    */
-  class PcapPacketQueue // PcapPacketQueue Singleton
+  class PcapPacketQueue : public IPcapPacketQueue // Singleton
   {
     private:
       std::deque <PcapPacket> m_queue;
       std::mutex m_mutex;
+
+      /**
+       * @brief #of packets in m_queue which can be checked by
+       * the waiting processors without taking m_mutex.
+       */
+      std::atomic<std::size_t> m_number_of_packets{0};
+      std::atomic<bool> m_is_closed{false};
+      SpinThenParkWaiter m_waiter;
+
+      /**
+       * @brief Pop the oldest packet if any.
+       *
+       * @return false if the queue is empty.
+       */
+      bool tryPopPacket(PcapPacket& packet)
+      {
+        /* do not take the lock just to find out it is empty */
+        if (m_number_of_packets.load(std::memory_order_acquire)
+            == 0)
+          return false;
+
+        /*superior version of lock_guard*/
+        std::scoped_lock<std::mutex> lock(m_mutex);
+        if ( m_queue.empty() )
+          return false;
+
+        /* FIFO (serve the oldest element in the queue first) */
+        packet = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_number_of_packets.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+
+      /**
+       * @brief Pop up to max_number_of_packets of the oldest
+       * packets under a single lock acquisition.
+       */
+      std::size_t tryPopPackets(PcapPacket* packets,
+                                std::size_t max_number_of_packets)
+      {
+        if (m_number_of_packets.load(std::memory_order_acquire)
+            == 0)
+          return 0;
+
+        std::scoped_lock<std::mutex> lock(m_mutex);
+        std::size_t count = 0;
+        while (count < max_number_of_packets && !m_queue.empty())
+        {
+          packets[count++] = std::move(m_queue.front());
+          m_queue.pop_front();
+        }
+        m_number_of_packets.fetch_sub(count, 
+                                      std::memory_order_relaxed);
+        return count;
+      }
     
     // SINGLETON STUFF BEGIN //
     public:   
@@ -59,28 +121,18 @@ namespace Common
        * @brief Pops (deletes) and returns the oldest PcapPacket
        * instance from the internal queue
        *
-       * @note Do not discard the returned packet or else it is
-       * lost.
-       *
-       * @return A pseudo-packet with zero initialized fields ON
+       * @return An empty packet (see PcapPacket::empty) ON
        * FAILURE    
        * @return The oldest packet (the first arrived in the
        * internal queue) ON SUCCESS
        */
       /*[[gnu::warn_unused_result]]*/
       [[nodiscard]]
-      PcapPacket popPacket() 
+      PcapPacket popPacket() override
       { 
-        /*superior version of lock_guard*/
-        std::scoped_lock<std::mutex> lock(m_mutex);
-        /* if empty, send a pcap packet with 0, 0 in time to
-        indicate it is an empty packet*/
-        if ( m_queue.empty() )
-          return PcapPacket( {0, 0} );
-
-        /* FIFO (serve the oldest element in the queue first) */
-        const auto packet = std::move(m_queue.front());
-        m_queue.pop_front();
+        PcapPacket packet;
+        /* if empty, the packet stays empty */
+        tryPopPacket(packet);
         return packet;
       }
       /** 
@@ -93,11 +145,85 @@ namespace Common
        *
        * @param PcapPacket A newly arrived PcapPacket
        */
-      void pushPacket(PcapPacket&& packet)
+      void pushPacket(PcapPacket&& packet) override
       {
-        std::scoped_lock<std::mutex> lock(m_mutex);
-        /* add the newest element to the back */
-        m_queue.push_back(std::move(packet) );
+        {
+          std::scoped_lock<std::mutex> lock(m_mutex);
+          /* add the newest element to the back */
+          m_queue.push_back(std::move(packet) );
+          m_number_of_packets.fetch_add(1, 
+                                        std::memory_order_release);
+        }
+        m_waiter.notifyOne();
+      }
+
+      void pushPackets(PcapPacket* packets,
+                       std::size_t number_of_packets) override
+      {
+        if (number_of_packets == 0)
+          return;
+        {
+          std::scoped_lock<std::mutex> lock(m_mutex);
+          for (std::size_t i = 0; i < number_of_packets; i++)
+            m_queue.push_back(std::move(packets[i]));
+          m_number_of_packets.fetch_add(number_of_packets, 
+                                        std::memory_order_release);
+        }
+        /* more than one processor might have work now */
+        m_waiter.notifyAll();
+      }
+
+      std::size_t popPackets(
+        PcapPacket* packets,
+        std::size_t max_number_of_packets) override
+      {
+        return tryPopPackets(packets, max_number_of_packets);
+      }
+
+      std::size_t waitAndPopPackets(
+        PcapPacket* packets,
+        std::size_t max_number_of_packets) override
+      {
+        std::size_t count = 0;
+        m_waiter.wait([&]()
+        {
+          count = tryPopPackets(packets, max_number_of_packets);
+          return count != 0 
+                 || m_is_closed.load(std::memory_order_acquire);
+        });
+        if (count == 0)
+          count = tryPopPackets(packets, max_number_of_packets);
+        return count;
+      }
+
+      bool waitAndPopPacket(PcapPacket& packet) override
+      {
+        bool is_popped = false;
+        m_waiter.wait([this, &packet, &is_popped]()
+        {
+          is_popped = tryPopPacket(packet);
+          return is_popped 
+                 || m_is_closed.load(std::memory_order_acquire);
+        });
+        /* the last packets might have been pushed right before
+        closing the queue */
+        return is_popped || tryPopPacket(packet);
+      }
+
+      void closeQueue() override
+      {
+        m_is_closed.store(true, std::memory_order_release);
+        m_waiter.notifyAll();
+      }
+
+      bool is_closed() const override
+      {
+        return m_is_closed.load(std::memory_order_acquire);
+      }
+
+      void set_spin_budget(unsigned spin_budget) override
+      {
+        m_waiter.set_spin_budget(spin_budget);
       }
       // CLASS-SPECIFIC METHODS END //
   };
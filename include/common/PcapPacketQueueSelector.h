@@ -0,0 +1,54 @@
+/**
+ * @file
+ *
+ * @brief This file contains the Common::getPcapPacketQueue
+ * function which returns the PcapPacketQueue shared by the
+ * writer and the processor threads.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef COMMON_PCAPPACKETQUEUESELECTOR_H_INCLUDED
+#define COMMON_PCAPPACKETQUEUESELECTOR_H_INCLUDED
+
+#include "IPcapPacketQueue.h"
+#include "PcapPacketQueue.h"
+#include "LockFreePcapPacketQueue.h"
+#include "Constants.h"
+
+namespace Common
+{
+  /**
+   * @brief Get the one and only PcapPacketQueue instance used
+   * throughout the application.
+   *
+   * Which queue is returned is determined by
+   * Common::kPcapPacketQueueType: either the
+   * @ref PcapPacketQueue Singleton or a lock-free ring of
+   * Common::kPcapPacketQueueCapacity packets created on the
+   * first call.
+   */
+  inline IPcapPacketQueue& getPcapPacketQueue()
+  {
+    switch (kPcapPacketQueueType)
+    {
+      case PcapPacketQueueType::kSpscRing:
+      {
+        static SpscPcapPacketQueue spsc_queue(
+          kPcapPacketQueueCapacity);
+        return spsc_queue;
+      }
+      case PcapPacketQueueType::kMpmcRing:
+      {
+        static MpmcPcapPacketQueue mpmc_queue(
+          kPcapPacketQueueCapacity);
+        return mpmc_queue;
+      }
+      default:
+        return PcapPacketQueue::getInstance();
+    }
+  }
+}
+
+#endif // COMMON_PCAPPACKETQUEUESELECTOR_H_INCLUDED
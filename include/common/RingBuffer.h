@@ -0,0 +1,416 @@
+/**
+ * @file
+ *
+ * @brief This file contains the lock-free bounded ring buffers
+ * Common::SpscRingBuffer and Common::MpmcRingBuffer.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef COMMON_RINGBUFFER_H_INCLUDED
+#define COMMON_RINGBUFFER_H_INCLUDED
+
+#include "Constants.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace Common
+{
+  /**
+   * @brief Round the given capacity up to the next power of
+   * two (at least 2) so that the ring indices can be wrapped
+   * with a mask instead of a division.
+   */
+  inline std::size_t roundUpToPowerOfTwo(std::size_t capacity)
+  {
+    std::size_t rounded = 2;
+    while (rounded < capacity)
+      rounded <<= 1;
+    return rounded;
+  }
+
+  /**
+   * @brief A lock-free bounded FIFO ring for exactly one
+   * producer thread and exactly one consumer thread.
+   *
+   * The head (written by the consumer) and the tail (written
+   * by the producer) are on different cache lines. Each side
+   * also keeps a private copy of the other side's index which
+   * is only refreshed when the ring looks full/empty, so that
+   * the shared indices are touched as rarely as possible.
+   *
+   * @tparam T type of the elements; must be default
+   * constructible and move assignable.
+   */
+  template <typename T>
+  class SpscRingBuffer
+  {
+    private:
+      /* consumer side */
+      alignas(kCacheLineSize) std::atomic<std::size_t> m_head{0};
+      std::size_t m_cached_tail = 0;
+
+      /* producer side */
+      alignas(kCacheLineSize) std::atomic<std::size_t> m_tail{0};
+      std::size_t m_cached_head = 0;
+
+      /* read-only after construction */
+      alignas(kCacheLineSize) const std::size_t m_mask;
+      const std::unique_ptr<T[]> m_slots;
+
+    public:
+      SpscRingBuffer() = delete;
+
+      /**
+       * @param capacity maximum #of elements in the ring;
+       * rounded up to a power of two.
+       */
+      explicit SpscRingBuffer(std::size_t capacity)
+        : m_mask(roundUpToPowerOfTwo(capacity) - 1),
+          m_slots(new T[m_mask + 1]) {}
+      SpscRingBuffer(SpscRingBuffer const&) = delete;
+      void operator=(SpscRingBuffer const&) = delete;
+
+      /**
+       * @brief Append the value to the ring if there is room.
+       *
+       * @note Must only be called by the producer thread. The
+       * value is only moved from on success.
+       *
+       * @return false if the ring is full.
+       */
+      bool tryPush(T&& value)
+      {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cached_head > m_mask)
+        {
+          m_cached_head = m_head.load(std::memory_order_acquire);
+          if (tail - m_cached_head > m_mask)
+            return false;
+        }
+        m_slots[tail & m_mask] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+      }
+
+      /**
+       * @brief Remove the oldest value from the ring if any.
+       *
+       * @note Must only be called by the consumer thread.
+       *
+       * @return false if the ring is empty.
+       */
+      bool tryPop(T& value)
+      {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cached_tail)
+        {
+          m_cached_tail = m_tail.load(std::memory_order_acquire);
+          if (head == m_cached_tail)
+            return false;
+        }
+        value = std::move(m_slots[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+      }
+
+      /**
+       * @brief Append as many of the given values as there is
+       * room for, publishing them with a single index update.
+       *
+       * @note Must only be called by the producer thread. Only
+       * the values which are pushed are moved from.
+       *
+       * @return #of values pushed (the first ones of "values").
+       */
+      std::size_t tryPushBatch(T* values,
+                               std::size_t number_of_values)
+      {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+        auto free_slots = m_mask + 1 - (tail - m_cached_head);
+        if (free_slots < number_of_values)
+        {
+          m_cached_head = m_head.load(std::memory_order_acquire);
+          free_slots = m_mask + 1 - (tail - m_cached_head);
+        }
+        const auto count = number_of_values < free_slots
+                           ? number_of_values : free_slots;
+        for (std::size_t i = 0; i < count; i++)
+          m_slots[(tail + i) & m_mask] = std::move(values[i]);
+        if (count != 0)
+          m_tail.store(tail + count, std::memory_order_release);
+        return count;
+      }
+
+      /**
+       * @brief Remove up to "max_number_of_values" of the
+       * oldest values, releasing their slots with a single
+       * index update.
+       *
+       * @note Must only be called by the consumer thread.
+       *
+       * @return #of values popped into "values".
+       */
+      std::size_t tryPopBatch(T* values,
+                              std::size_t max_number_of_values)
+      {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        auto available = m_cached_tail - head;
+        if (available < max_number_of_values)
+        {
+          m_cached_tail = m_tail.load(std::memory_order_acquire);
+          available = m_cached_tail - head;
+        }
+        const auto count = max_number_of_values < available
+                           ? max_number_of_values : available;
+        for (std::size_t i = 0; i < count; i++)
+          values[i] = std::move(m_slots[(head + i) & m_mask]);
+        if (count != 0)
+          m_head.store(head + count, std::memory_order_release);
+        return count;
+      }
+
+      std::size_t capacity() const { return m_mask + 1; }
+  };
+
+  /**
+   * @brief A lock-free bounded FIFO ring for any #of producer
+   * and consumer threads.
+   *
+   * This is the array based queue of Dmitry Vyukov: each slot
+   * carries a sequence number telling whether it is ready to be
+   * written or read for the current lap, so producers and
+   * consumers only contend on their own index (enqueue or
+   * dequeue position) with a single CAS per operation. The two
+   * positions are on different cache lines.
+   *
+   * @tparam T type of the elements; must be default
+   * constructible and move assignable.
+   */
+  template <typename T>
+  class MpmcRingBuffer
+  {
+    private:
+      struct Slot
+      {
+        std::atomic<std::size_t> sequence;
+        T value;
+      };
+
+      alignas(kCacheLineSize)
+        std::atomic<std::size_t> m_enqueue_position{0};
+      alignas(kCacheLineSize)
+        std::atomic<std::size_t> m_dequeue_position{0};
+
+      /* read-only after construction */
+      alignas(kCacheLineSize) const std::size_t m_mask;
+      const std::unique_ptr<Slot[]> m_slots;
+
+    public:
+      MpmcRingBuffer() = delete;
+
+      /**
+       * @param capacity maximum #of elements in the ring;
+       * rounded up to a power of two.
+       */
+      explicit MpmcRingBuffer(std::size_t capacity)
+        : m_mask(roundUpToPowerOfTwo(capacity) - 1),
+          m_slots(new Slot[m_mask + 1])
+      {
+        for (std::size_t i = 0; i <= m_mask; i++)
+          m_slots[i].sequence.store(i, std::memory_order_relaxed);
+      }
+      MpmcRingBuffer(MpmcRingBuffer const&) = delete;
+      void operator=(MpmcRingBuffer const&) = delete;
+
+      /**
+       * @brief Append the value to the ring if there is room.
+       *
+       * @note The value is only moved from on success.
+       *
+       * @return false if the ring is full.
+       */
+      bool tryPush(T&& value)
+      {
+        auto position =
+          m_enqueue_position.load(std::memory_order_relaxed);
+        while (true)
+        {
+          Slot& slot = m_slots[position & m_mask];
+          const auto sequence =
+            slot.sequence.load(std::memory_order_acquire);
+          const auto difference =
+            static_cast<std::ptrdiff_t>(sequence - position);
+          if (difference == 0)
+          {
+            /* the slot is free for this lap; claim it */
+            if (m_enqueue_position.compare_exchange_weak(
+                  position, position + 1,
+                  std::memory_order_relaxed))
+            {
+              slot.value = std::move(value);
+              slot.sequence.store(position + 1,
+                                  std::memory_order_release);
+              return true;
+            }
+          }
+          else if (difference < 0)
+            return false; /* not consumed yet from the last lap */
+          else
+            position =
+              m_enqueue_position.load(std::memory_order_relaxed);
+        }
+      }
+
+      /**
+       * @brief Remove the oldest value from the ring if any.
+       *
+       * @return false if the ring is empty.
+       */
+      bool tryPop(T& value)
+      {
+        auto position =
+          m_dequeue_position.load(std::memory_order_relaxed);
+        while (true)
+        {
+          Slot& slot = m_slots[position & m_mask];
+          const auto sequence =
+            slot.sequence.load(std::memory_order_acquire);
+          const auto difference =
+            static_cast<std::ptrdiff_t>(sequence - (position + 1));
+          if (difference == 0)
+          {
+            /* the slot is filled for this lap; claim it */
+            if (m_dequeue_position.compare_exchange_weak(
+                  position, position + 1,
+                  std::memory_order_relaxed))
+            {
+              value = std::move(slot.value);
+              /* make the slot free for the next lap */
+              slot.sequence.store(position + m_mask + 1,
+                                  std::memory_order_release);
+              return true;
+            }
+          }
+          else if (difference < 0)
+            return false; /* not produced yet */
+          else
+            position =
+              m_dequeue_position.load(std::memory_order_relaxed);
+        }
+      }
+
+      /**
+       * @brief Append as many of the given values as there is
+       * room for, claiming all of their slots with a single CAS.
+       *
+       * The run of consecutive free slots starting at the
+       * enqueue position is claimed at once. A slot which is
+       * observed free stays free until its position is claimed,
+       * so a successful CAS makes the whole run ours.
+       *
+       * @note Only the values which are pushed are moved from.
+       *
+       * @return #of values pushed (the first ones of "values").
+       */
+      std::size_t tryPushBatch(T* values,
+                               std::size_t number_of_values)
+      {
+        auto position =
+          m_enqueue_position.load(std::memory_order_relaxed);
+        while (number_of_values != 0)
+        {
+          std::size_t count = 0;
+          while (count < number_of_values
+                 && m_slots[(position + count) & m_mask]
+                    .sequence.load(std::memory_order_acquire)
+                    == position + count)
+            count++;
+
+          if (count == 0)
+          {
+            const auto difference = static_cast<std::ptrdiff_t>(
+              m_slots[position & m_mask].sequence.load(
+                std::memory_order_acquire) - position);
+            if (difference < 0)
+              return 0; /* full */
+            position =
+              m_enqueue_position.load(std::memory_order_relaxed);
+            continue;
+          }
+
+          if (m_enqueue_position.compare_exchange_weak(
+                position, position + count,
+                std::memory_order_relaxed))
+          {
+            for (std::size_t i = 0; i < count; i++)
+            {
+              Slot& slot = m_slots[(position + i) & m_mask];
+              slot.value = std::move(values[i]);
+              slot.sequence.store(position + i + 1,
+                                  std::memory_order_release);
+            }
+            return count;
+          }
+        }
+        return 0;
+      }
+
+      /**
+       * @brief Remove up to "max_number_of_values" of the
+       * oldest values, claiming all of their slots with a single
+       * CAS.
+       *
+       * @return #of values popped into "values".
+       */
+      std::size_t tryPopBatch(T* values,
+                              std::size_t max_number_of_values)
+      {
+        auto position =
+          m_dequeue_position.load(std::memory_order_relaxed);
+        while (max_number_of_values != 0)
+        {
+          std::size_t count = 0;
+          while (count < max_number_of_values
+                 && m_slots[(position + count) & m_mask]
+                    .sequence.load(std::memory_order_acquire)
+                    == position + count + 1)
+            count++;
+
+          if (count == 0)
+          {
+            const auto difference = static_cast<std::ptrdiff_t>(
+              m_slots[position & m_mask].sequence.load(
+                std::memory_order_acquire) - (position + 1));
+            if (difference < 0)
+              return 0; /* empty */
+            position =
+              m_dequeue_position.load(std::memory_order_relaxed);
+            continue;
+          }
+
+          if (m_dequeue_position.compare_exchange_weak(
+                position, position + count,
+                std::memory_order_relaxed))
+          {
+            for (std::size_t i = 0; i < count; i++)
+            {
+              Slot& slot = m_slots[(position + i) & m_mask];
+              values[i] = std::move(slot.value);
+              slot.sequence.store(position + i + m_mask + 1,
+                                  std::memory_order_release);
+            }
+            return count;
+          }
+        }
+        return 0;
+      }
+
+      std::size_t capacity() const { return m_mask + 1; }
+  };
+}
+
+#endif // COMMON_RINGBUFFER_H_INCLUDED
@@ -0,0 +1,148 @@
+/**
+ * @file
+ *
+ * @brief This file contains the Common::SpinThenParkWaiter
+ * class which is used by the PcapPacketQueues to make their
+ * consumers (and producers) wait without burning a core.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef COMMON_SPINTHENPARKWAITER_H_INCLUDED
+#define COMMON_SPINTHENPARKWAITER_H_INCLUDED
+
+#include "Constants.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace Common
+{
+  /**
+   * @brief Hint the CPU that we are in a busy-wait loop.
+   */
+  inline void cpuRelax()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+  }
+
+  /**
+   * @brief A thread-safe wait strategy which first spins for a
+   * configurable #of iterations and then parks the waiting
+   * thread on a condition variable.
+   *
+   * Spinning avoids the cost of sleeping and waking up when
+   * the condition is about to become true (e.g. a writer pushing
+   * packets continuously) while parking makes sure an idle
+   * thread does not burn a core.
+   *
+   * The notifying side only takes the internal mutex if some
+   * thread is parked, so notifying is cheap while nobody waits.
+   */
+  class SpinThenParkWaiter
+  {
+    private:
+      std::mutex m_mutex;
+      std::condition_variable m_condition;
+
+      /**
+       * @brief #of threads parked (or about to be parked) on
+       * m_condition.
+       */
+      std::atomic<unsigned> m_number_of_parked_threads{0};
+
+      /**
+       * @brief #of times the condition is checked before
+       * parking.
+       */
+      std::atomic<unsigned> m_spin_budget;
+
+    public:
+      explicit SpinThenParkWaiter(
+        unsigned spin_budget = kPcapPacketQueueSpinBudget)
+        : m_spin_budget(spin_budget) {}
+      SpinThenParkWaiter(SpinThenParkWaiter const&) = delete;
+      void operator=(SpinThenParkWaiter const&)     = delete;
+
+      /**
+       * @brief Wait until the given predicate returns true.
+       *
+       * @note The predicate is called from the waiting thread
+       * only, but possibly while holding the internal mutex; it
+       * must not call notify methods of this waiter.
+       *
+       * @param is_ready predicate checking the condition to wait
+       * for. It might have side effects (e.g. trying to pop a
+       * packet) since it is called until it returns true.
+       */
+      template <typename Predicate>
+      void wait(Predicate is_ready)
+      {
+        const auto spin_budget =
+          m_spin_budget.load(std::memory_order_relaxed);
+        for (unsigned i = 0; i < spin_budget; i++)
+        {
+          if (is_ready())
+            return;
+          cpuRelax();
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_number_of_parked_threads.fetch_add(1);
+        /* pairs with the fence in notify methods: either the
+        notifier sees us parked or we see its update */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_condition.wait(lock, is_ready);
+        m_number_of_parked_threads.fetch_sub(1);
+      }
+
+      /**
+       * @brief Wake up one parked thread, if any, after making
+       * the condition true.
+       */
+      void notifyOne()
+      {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_number_of_parked_threads.load(
+              std::memory_order_relaxed) == 0)
+          return;
+        /* make sure the waiter is either before checking the
+        predicate or already waiting on the condition */
+        { std::scoped_lock<std::mutex> lock(m_mutex); }
+        m_condition.notify_one();
+      }
+
+      /**
+       * @brief Wake up all the parked threads, if any, after
+       * making the condition true.
+       */
+      void notifyAll()
+      {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_number_of_parked_threads.load(
+              std::memory_order_relaxed) == 0)
+          return;
+        { std::scoped_lock<std::mutex> lock(m_mutex); }
+        m_condition.notify_all();
+      }
+
+      void set_spin_budget(unsigned spin_budget)
+      {
+        m_spin_budget.store(spin_budget,
+                            std::memory_order_relaxed);
+      }
+
+      unsigned get_spin_budget() const
+      {
+        return m_spin_budget.load(std::memory_order_relaxed);
+      }
+  };
+}
+
+#endif // COMMON_SPINTHENPARKWAITER_H_INCLUDED
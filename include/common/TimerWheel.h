@@ -0,0 +1,355 @@
+/**
+ * @file
+ *
+ * @brief This file contains the Common::TimerWheel class which
+ * keeps track of the deadlines of many timers in O(1) per
+ * timer.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef COMMON_TIMERWHEEL_H_INCLUDED
+#define COMMON_TIMERWHEEL_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Common
+{
+  /**
+   * @brief A hierarchical timer wheel with 64 slots per level.
+   *
+   * Level 0 has a slot per tick, level 1 a slot per 64 ticks,
+   * level 2 a slot per 64^2 ticks and so on. A timer is put into
+   * the lowest level whose slot range covers its deadline
+   * relative to the current tick; when the wheel reaches a slot
+   * of a higher level, the timers of that slot are cascaded into
+   * the lower levels. Each level keeps a bitmap of its non-empty
+   * slots so that the next deadline is found with a couple of
+   * bit operations instead of visiting the empty slots one by
+   * one, which makes advancing over long idle periods (e.g.
+   * gaps in a capture file) cheap.
+   *
+   * What a tick is, is up to the user of the wheel (e.g. a
+   * microsecond of the external time).
+   *
+   * The timers are intrusive: the wheel only links the
+   * @ref Timer objects given to it and never allocates, so
+   * inserting, removing and expiring a timer are all O(1)
+   * (cascading moves a timer at most once per level).
+   *
+   * @note This class is not thread-safe; the owner is expected
+   * to guard it (e.g. with the mutex of the
+   * PeriodicJobController).
+   */
+  class TimerWheel
+  {
+    public:
+      /**
+       * @brief A timer to be embedded into (or inherited by)
+       * whatever should be notified at its deadline.
+       */
+      struct Timer
+      {
+        /** tick the timer expires at */
+        uint64_t deadline = 0;
+
+        /* links of the slot the timer is in; managed by the
+        wheel */
+        Timer* previous = nullptr;
+        Timer* next = nullptr;
+        uint8_t level = kNotScheduled;
+        uint8_t slot = 0;
+
+        bool is_scheduled() const
+        {
+          return level != kNotScheduled;
+        }
+      };
+
+      /**
+       * @brief #of bits of a tick resolved by each level.
+       */
+      static constexpr unsigned kBitsPerLevel = 6;
+      static constexpr unsigned kNumberOfSlots =
+        1u << kBitsPerLevel;
+
+      /**
+       * @brief 10 levels cover 2^60 ticks; later deadlines are
+       * clamped to @ref kMaxDeadline.
+       */
+      static constexpr unsigned kNumberOfLevels = 10;
+      static constexpr uint64_t kMaxDeadline =
+        (1ULL << (kBitsPerLevel * kNumberOfLevels)) - 1;
+
+    private:
+      static constexpr uint8_t kNotScheduled = 0xff;
+
+      /**
+       * @brief The level of the timers which were already due
+       * when they were inserted.
+       */
+      static constexpr uint8_t kExpiredLevel = 0xfe;
+
+      struct Level
+      {
+        uint64_t occupied = 0; ///< bit i: slot i is not empty
+        Timer* slots[kNumberOfSlots] = {};
+      };
+
+      /**
+       * @brief The current tick; every deadline before it has
+       * been expired.
+       */
+      uint64_t m_elapsed = 0;
+      Level m_levels[kNumberOfLevels];
+
+      /**
+       * @brief Timers inserted with a deadline which has
+       * already passed; expired by the next @ref advance.
+       */
+      Timer* m_expired = nullptr;
+      std::size_t m_number_of_timers = 0;
+
+      static void pushFront(Timer*& head, Timer* timer)
+      {
+        timer->previous = nullptr;
+        timer->next = head;
+        if (head != nullptr)
+          head->previous = timer;
+        head = timer;
+      }
+
+      static void unlink(Timer*& head, Timer* timer)
+      {
+        if (timer->previous != nullptr)
+          timer->previous->next = timer->next;
+        else
+          head = timer->next;
+        if (timer->next != nullptr)
+          timer->next->previous = timer->previous;
+        timer->previous = nullptr;
+        timer->next = nullptr;
+      }
+
+      /**
+       * @brief The level whose slot range covers the deadline:
+       * the index of the highest bit in which the deadline
+       * differs from the current tick tells how far it is.
+       */
+      unsigned getLevel(uint64_t deadline) const
+      {
+        uint64_t masked = (m_elapsed ^ deadline)
+                          | (kNumberOfSlots - 1);
+        unsigned significant_bit = 63 - __builtin_clzll(masked);
+        unsigned level = significant_bit / kBitsPerLevel;
+        return level < kNumberOfLevels ? level : kNumberOfLevels - 1;
+      }
+
+      static unsigned getSlot(uint64_t deadline, unsigned level)
+      {
+        return (deadline >> (level * kBitsPerLevel))
+               & (kNumberOfSlots - 1);
+      }
+
+      void link(Timer* timer)
+      {
+        if (timer->deadline <= m_elapsed)
+        {
+          timer->level = kExpiredLevel;
+          pushFront(m_expired, timer);
+          return;
+        }
+        auto level = getLevel(timer->deadline);
+        auto slot = getSlot(timer->deadline, level);
+        timer->level = static_cast<uint8_t>(level);
+        timer->slot = static_cast<uint8_t>(slot);
+        pushFront(m_levels[level].slots[slot], timer);
+        m_levels[level].occupied |= 1ULL << slot;
+      }
+
+      /**
+       * @brief Find the earliest non-empty slot of the lowest
+       * non-empty level.
+       *
+       * @return false if the wheel is empty.
+       */
+      bool findNextSlot(unsigned& level, unsigned& slot,
+                        uint64_t& slot_start) const
+      {
+        for (level = 0; level < kNumberOfLevels; level++)
+        {
+          const auto occupied = m_levels[level].occupied;
+          if (occupied == 0)
+            continue;
+
+          const unsigned shift = level * kBitsPerLevel;
+          const unsigned current_slot = getSlot(m_elapsed, level);
+          /* rotate so that the current slot is bit 0 */
+          const uint64_t rotated = current_slot == 0
+            ? occupied
+            : (occupied >> current_slot)
+              | (occupied << (kNumberOfSlots - current_slot));
+          slot = (current_slot + __builtin_ctzll(rotated))
+                 & (kNumberOfSlots - 1);
+
+          const uint64_t level_range_mask =
+            (1ULL << (shift + kBitsPerLevel)) - 1;
+          slot_start = (m_elapsed & ~level_range_mask)
+                       + (static_cast<uint64_t>(slot) << shift);
+          /* the slot belongs to the next round of this level */
+          if (slot_start + ((1ULL << shift) - 1) < m_elapsed)
+            slot_start += level_range_mask + 1;
+          return true;
+        }
+        return false;
+      }
+
+    public:
+      TimerWheel() = default;
+      TimerWheel(TimerWheel const&)     = delete;
+      void operator=(TimerWheel const&) = delete;
+
+      /**
+       * @brief Start counting from the given tick; e.g. the
+       * external time when the first timer is added.
+       *
+       * @note Only allowed while the wheel is empty.
+       */
+      void reset(uint64_t now)
+      {
+        if (m_number_of_timers == 0)
+          m_elapsed = now;
+      }
+
+      /**
+       * @brief Schedule the timer to expire at the given tick.
+       * A deadline which has already passed expires on the next
+       * @ref advance.
+       *
+       * @note The timer must not be scheduled already and must
+       * stay alive until it expires or is removed.
+       */
+      void insert(Timer& timer, uint64_t deadline)
+      {
+        timer.deadline = deadline < kMaxDeadline
+                         ? deadline : kMaxDeadline;
+        link(&timer);
+        m_number_of_timers++;
+      }
+
+      /**
+       * @brief Unschedule the timer; nothing is done if the
+       * timer is not scheduled.
+       */
+      void remove(Timer& timer)
+      {
+        if (!timer.is_scheduled())
+          return;
+        if (timer.level == kExpiredLevel)
+          unlink(m_expired, &timer);
+        else
+        {
+          auto& level = m_levels[timer.level];
+          unlink(level.slots[timer.slot], &timer);
+          if (level.slots[timer.slot] == nullptr)
+            level.occupied &= ~(1ULL << timer.slot);
+        }
+        timer.level = kNotScheduled;
+        m_number_of_timers--;
+      }
+
+      /**
+       * @brief Advance the wheel to the given tick and call
+       * on_expired(Timer&) for every timer whose deadline is not
+       * later than it, in the order of their deadlines (timers
+       * of the same tick in no particular order).
+       *
+       * A timer is unscheduled before on_expired is called with
+       * it, so on_expired can insert it again (e.g. for its next
+       * period) or delete it. Inserting it again with a deadline
+       * not later than "now" expires it again in the same call,
+       * so a period must be at least a tick.
+       *
+       * @note Time never goes backwards; a tick before the
+       * current one only expires the already expired timers.
+       */
+      template <typename OnExpired>
+      void advance(uint64_t now, OnExpired&& on_expired)
+      {
+        auto expire = [this, &on_expired](Timer*& head)
+        {
+          while (head != nullptr)
+          {
+            Timer* timer = head;
+            unlink(head, timer);
+            timer->level = kNotScheduled;
+            m_number_of_timers--;
+            on_expired(*timer);
+          }
+        };
+        expire(m_expired);
+
+        unsigned level;
+        unsigned slot;
+        uint64_t slot_start;
+        while (findNextSlot(level, slot, slot_start)
+               && slot_start <= now)
+        {
+          /* take the whole slot; its timers either expire or
+          move to a lower level */
+          auto& slot_head = m_levels[level].slots[slot];
+          Timer* timers = slot_head;
+          slot_head = nullptr;
+          m_levels[level].occupied &= ~(1ULL << slot);
+          if (slot_start > m_elapsed)
+            m_elapsed = slot_start;
+
+          while (timers != nullptr)
+          {
+            Timer* timer = timers;
+            unlink(timers, timer);
+            /* a timer of a higher level might still be later
+            than the start of its slot */
+            if (timer->deadline <= m_elapsed)
+            {
+              timer->level = kNotScheduled;
+              m_number_of_timers--;
+              on_expired(*timer);
+            }
+            else
+              link(timer);
+          }
+          /* timers inserted again by on_expired with a deadline
+          which has already passed */
+          expire(m_expired);
+        }
+        if (now > m_elapsed)
+          m_elapsed = now;
+      }
+
+      /**
+       * @brief The deadline of the earliest timer (or a tick
+       * before it when it is in a higher level).
+       *
+       * @return false if there is no timer.
+       */
+      bool get_next_deadline(uint64_t& deadline) const
+      {
+        if (m_expired != nullptr)
+        {
+          deadline = m_elapsed;
+          return true;
+        }
+        unsigned level;
+        unsigned slot;
+        return findNextSlot(level, slot, deadline);
+      }
+
+      uint64_t get_current_tick() const { return m_elapsed; }
+      std::size_t size() const { return m_number_of_timers; }
+  };
+}
+
+#endif // COMMON_TIMERWHEEL_H_INCLUDED
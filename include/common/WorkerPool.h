@@ -0,0 +1,171 @@
+/**
+ * @file
+ *
+ * @brief This file contains the Common::WorkerPool Singleton
+ * class which runs the bodies of the PeriodicJobs on a fixed
+ * set of threads.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#ifndef COMMON_WORKERPOOL_H_INCLUDED
+#define COMMON_WORKERPOOL_H_INCLUDED
+
+#include "Constants.h"
+#include "InplaceFunction.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Common
+{
+  /**
+   * @brief A thread-safe, fixed-size pool of worker threads &
+   * Singleton class executing the submitted tasks.
+   *
+   * Whenever this class's methods are requried; firstly
+   * getInstance method of this class should be called to get
+   * the one and only instance of this class and the methods
+   * should be called on this instance.
+   *
+   * The #of workers is fixed when the pool is created (see
+   * Common::kNumberOfJobWorkers), so running a job costs a
+   * queue operation rather than creating a thread.
+   *
+   * Each worker has a run queue of its own, so the workers do
+   * not contend on a single lock. A task submitted by a worker
+   * goes to its own queue (it is likely to share data with the
+   * task submitting it) and the other tasks are spread over the
+   * queues in round-robin. A worker runs the tasks of its own
+   * queue in the order they were queued; once its queue is
+   * empty, it steals the oldest task of another worker's queue
+   * before going to sleep, so no worker idles while another one
+   * has a backlog.
+   *
+   * @note The tasks of different queues (or stolen ones) run
+   * in no particular order; work which must run in order (e.g.
+   * the cycles of a job) has to be a single task at a time.
+   *
+   * @note Although getInstance is the one to use, other pools
+   * can be created as well (e.g. by the tests).
+   */
+  class WorkerPool // WorkerPool Singleton
+  {
+    public:
+      /**
+       * @brief A task of the pool; small callables (see
+       * Common::kWorkerPoolTaskInlineSize) are stored in the
+       * run queues without a heap allocation.
+       */
+      using Task = InplaceFunction<void(), kWorkerPoolTaskInlineSize>;
+
+    private:
+      /**
+       * @brief A worker and its run queue; on a cache line of
+       * its own since each is locked by a different thread.
+       */
+      struct alignas(kCacheLineSize) Worker
+      {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+      };
+
+      std::vector<std::unique_ptr<Worker>> m_workers;
+
+      /**
+       * @brief #of tasks waiting in the run queues; the
+       * workers sleep only when it is 0.
+       */
+      alignas(kCacheLineSize) std::atomic<std::size_t>
+        m_number_of_queued_tasks{0};
+
+      /**
+       * @brief #of tasks submitted but not finished yet.
+       */
+      std::atomic<std::size_t> m_number_of_unfinished_tasks{0};
+
+      /**
+       * @brief Where the next task submitted from outside the
+       * pool goes.
+       */
+      std::atomic<std::size_t> m_next_worker_index{0};
+
+      std::atomic<std::size_t> m_number_of_stolen_tasks{0};
+
+      /* the sleeping workers park here */
+      std::mutex m_sleep_mutex;
+      std::condition_variable m_sleep_condition;
+      std::atomic<unsigned> m_number_of_sleeping_workers{0};
+      std::atomic<bool> m_should_stop_running{false};
+
+      std::mutex m_idle_mutex;
+      std::condition_variable m_idle_condition;
+
+      /**
+       * @brief Take the oldest task of the worker's own queue
+       * or else the oldest one of another worker's queue.
+       *
+       * @return false if all the queues are empty.
+       */
+      bool takeTask(std::size_t worker_index, Task& task);
+
+      void runWorker(std::size_t worker_index);
+
+    // SINGLETON STUFF BEGIN //
+    public:
+      /**
+       * @brief Get Singleton instance
+       */
+      static WorkerPool& getInstance();
+      WorkerPool(WorkerPool const&)     = delete;
+      void operator=(WorkerPool const&) = delete;
+
+      /**
+       * @param number_of_workers 0 for one per hardware thread.
+       */
+      explicit WorkerPool(unsigned number_of_workers);
+
+      /**
+       * @brief Runs the tasks already submitted and joins the
+       * workers.
+       */
+      ~WorkerPool();
+    // SINGLETON STUFF END // CLASS-SPECIFIC METHODS BEGIN //
+    public:
+      /**
+       * @brief Queue the task to be run by one of the workers.
+       */
+      void submit(Task task);
+
+      /**
+       * @brief Block until every submitted task (including the
+       * ones submitted while waiting) has finished.
+       */
+      void waitUntilIdle();
+
+      std::size_t get_number_of_workers() const
+      {
+        return m_workers.size();
+      }
+
+      /**
+       * @brief #of tasks run by a worker other than the one
+       * they were queued to.
+       */
+      std::size_t get_number_of_stolen_tasks() const
+      {
+        return m_number_of_stolen_tasks.load(
+          std::memory_order_relaxed);
+      }
+      // CLASS-SPECIFIC METHODS END //
+  };
+}
+
+#endif // COMMON_WORKERPOOL_H_INCLUDED
@@ -21,7 +21,9 @@
 #define PRIVATE_PERIODICJOBCONTROLLERFRIEND_H_INCLUDED
 
 #include "PeriodicJobController.h"
+#include <cstddef>
 #include <memory>
+#include <utility>
 
 /**
  * @brief Friend class to @ref PeriodicJobController to expose
@@ -39,6 +41,62 @@ class PeriodicJobControllerFriend
 {
 
 public:
+  /**
+   * @brief A live view of the jobs of a
+   * @ref PeriodicJobController which are spread over its
+   * shards, offering the lookups of a map.
+   *
+   * Every call looks at the current state of the controller,
+   * so a view taken once reflects later additions and
+   * removals.
+   */
+  class ActiveJobs
+  {
+    public:
+      /**
+       * @brief Points to a found job (or to nothing for
+       * @ref end) and keeps the job alive.
+       */
+      class const_iterator
+      {
+        private:
+          std::pair<JOBID, std::shared_ptr<IPeriodicJob>> m_entry;
+
+        public:
+          const_iterator() = default;
+          const_iterator(
+            JOBID job_id, std::shared_ptr<IPeriodicJob> job)
+            : m_entry(std::move(job_id), std::move(job)) {}
+
+          const std::pair<JOBID, std::shared_ptr<IPeriodicJob>>*
+            operator->() const { return &m_entry; }
+          const std::pair<JOBID, std::shared_ptr<IPeriodicJob>>&
+            operator*() const { return m_entry; }
+
+          bool operator==(const const_iterator& other) const
+          {
+            return m_entry.second == other.m_entry.second;
+          }
+          bool operator!=(const const_iterator& other) const
+          {
+            return !(*this == other);
+          }
+      };
+
+    private:
+      std::shared_ptr<PeriodicJobController> m_controller;
+
+    public:
+      explicit ActiveJobs(
+        std::shared_ptr<PeriodicJobController> controller)
+        : m_controller(std::move(controller)) {}
+
+      std::size_t size() const;
+      bool empty() const { return size() == 0; }
+      const_iterator find(const JOBID& job_id) const;
+      const_iterator end() const { return const_iterator(); }
+  };
+
   /**
    * @brief Get the internal container of
    * @ref PeriodicJobController which contains currently active
@@ -48,19 +106,12 @@ public:
    * @ref PeriodicJobController instance to be accessed the
    * internal container of.
    *
-   * @return const std::unordered_map
-   * <
-   * JOBID, std::shared_ptr<IPeriodicJob>
-   * >& The internal container of PeriodicJobController which 
+   * @return ActiveJobs A live view of the internal (sharded)
+   * containers of PeriodicJobController.
    */
-  static const std::unordered_map 
-  <
-    JOBID, 
-    std::shared_ptr<IPeriodicJob> 
-  >& 
-  get_active_jobs(
+  static ActiveJobs get_active_jobs(
     std::shared_ptr<PeriodicJobController> 
     periodic_job_controller_ptr);
 };
 
-#endif // PRIVATE_PERIODICJOBCONTROLLERFRIEND_H_INCLUDED
\ No newline at end of file
+#endif // PRIVATE_PERIODICJOBCONTROLLERFRIEND_H_INCLUDED
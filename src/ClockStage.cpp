@@ -0,0 +1,122 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in ClockStage.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "ClockStage.h"
+#include "common/ExternalTime.h"
+#include "PeriodicJobController.h"
+#include <iostream>
+
+ClockStage& ClockStage::getInstance()
+{
+  static ClockStage singleton_instance;
+  return singleton_instance;
+}
+
+ClockStage::~ClockStage()
+{
+  stop();
+}
+
+void ClockStage::advance(Common::Nanoseconds time_ns)
+{
+  /* The jobs subscribed to the external time are run by this
+  call right when it moves the time past their ticks. */
+  if (!Common::ExternalTime::getInstance().
+        set_current_time_ns(time_ns))
+    return;
+
+  /* Calling onNewTime method of our PeriodicJobController so
+  that necessary PeriodicJobs are added. We can use the
+  returned job ids from this method to delete the added the
+  jobs if desired. */
+  auto added_job_ids =
+    g_ptr_periodic_class_controller_instance->onNewTime();
+  std::cout << "newly added job ids on time "
+    << Common::toSeconds(time_ns) << " are: " << std::endl;
+  for(auto id: added_job_ids)
+    std::cout << id << std::endl;
+}
+
+void ClockStage::runTicks()
+{
+  Common::Nanoseconds applied_time_ns =
+    Common::ExternalTime::getInstance().get_current_time_ns();
+  while (true)
+  {
+    Common::Nanoseconds published_time_ns;
+    m_waiter.wait([this, &published_time_ns, applied_time_ns]()
+    {
+      published_time_ns = get_published_time_ns();
+      return published_time_ns > applied_time_ns
+             || m_should_stop_running;
+    });
+
+    /* Only the newest time is applied; the ones published
+    meanwhile are skipped over like the packets in between. */
+    if (published_time_ns > applied_time_ns)
+    {
+      applied_time_ns = published_time_ns;
+      advance(applied_time_ns);
+    }
+    else if (m_should_stop_running)
+      return;
+  }
+}
+
+void ClockStage::start()
+{
+  std::scoped_lock<std::mutex> lock(m_mutex);
+  if (m_is_running)
+    return;
+  m_should_stop_running = false;
+  m_is_running = true;
+  m_tick_thread = std::thread(&ClockStage::runTicks, this);
+}
+
+void ClockStage::stop()
+{
+  std::scoped_lock<std::mutex> lock(m_mutex);
+  if (!m_is_running)
+    return;
+  m_should_stop_running = true;
+  m_waiter.notifyOne();
+  m_tick_thread.join();
+  m_is_running = false;
+
+  /* a time published while the thread was exiting */
+  advance(get_published_time_ns());
+}
+
+void ClockStage::publish(Common::Nanoseconds time_ns)
+{
+  auto published_time_ns =
+    m_published_time_ns.load(std::memory_order_relaxed);
+  while (time_ns > published_time_ns)
+    if (m_published_time_ns.compare_exchange_weak(
+          published_time_ns, time_ns,
+          std::memory_order_acq_rel,
+          std::memory_order_relaxed))
+    {
+      if (!m_is_running)
+      {
+        advance(time_ns);
+        return;
+      }
+      m_waiter.notifyOne();
+      break;
+    }
+
+  /* Do not run away from the jobs; they should see the packets
+  of about the time they are run for. A newer time published by
+  another processor is fine too. */
+  if (m_is_running)
+    Common::ExternalTime::getInstance().waitUntil(
+      time_ns - Common::kClockStageMaxSkewNanoseconds);
+}
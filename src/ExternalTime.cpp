@@ -0,0 +1,155 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the
+ * subscription methods declared in common/ExternalTime.h
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "common/ExternalTime.h"
+#include <condition_variable>
+#include <vector>
+
+namespace Common
+{
+  void ExternalTime::arm(SubscriptionId id,
+                         Subscription& subscription,
+                         Nanoseconds time_ns)
+  {
+    if (subscription.time_ns != kNever)
+      m_armed_subscriptions.erase({subscription.time_ns, id});
+    subscription.time_ns = time_ns;
+    if (time_ns != kNever)
+      m_armed_subscriptions.insert({time_ns, id});
+    m_next_subscription_time_ns.store(
+      m_armed_subscriptions.empty() 
+      ? kNever : m_armed_subscriptions.begin()->first);
+  }
+
+  void ExternalTime::runCrossedSubscriptions(
+    Nanoseconds current_time_ns)
+  {
+    /* Only one thread runs the callbacks at a time; a thread
+    coming later finds the subscriptions already disarmed. */
+    std::scoped_lock<std::recursive_mutex> 
+      callbacks_lock(m_callbacks_mutex);
+
+    std::vector<std::pair<SubscriptionId, 
+                          std::shared_ptr<SubscriptionCallback>>>
+      crossed_subscriptions;
+    {
+      std::scoped_lock<std::mutex> lock(m_subscriptions_mutex);
+      /* the time might have advanced further meanwhile */
+      current_time_ns = get_current_time_ns();
+      while (!m_armed_subscriptions.empty()
+             && m_armed_subscriptions.begin()->first 
+                <= current_time_ns)
+      {
+        auto id = m_armed_subscriptions.begin()->second;
+        auto& subscription = m_subscriptions.at(id);
+        crossed_subscriptions.emplace_back(
+          id, subscription.callback);
+        arm(id, subscription, kNever);
+      }
+    }
+
+    for (auto& crossed_subscription : crossed_subscriptions)
+    {
+      /* an earlier callback might have unsubscribed it */
+      {
+        std::scoped_lock<std::mutex> lock(m_subscriptions_mutex);
+        if (m_subscriptions.find(crossed_subscription.first)
+            == m_subscriptions.end())
+          continue;
+      }
+      (*crossed_subscription.second)(current_time_ns);
+    }
+  }
+
+  ExternalTime::SubscriptionId ExternalTime::subscribe(
+    Nanoseconds time_ns, SubscriptionCallback callback)
+  {
+    std::scoped_lock<std::mutex> lock(m_subscriptions_mutex);
+    auto id = ++m_last_subscription_id;
+    auto& subscription = m_subscriptions[id];
+    subscription.callback = 
+      std::make_shared<SubscriptionCallback>(std::move(callback));
+    arm(id, subscription, time_ns);
+    return id;
+  }
+
+  bool ExternalTime::reschedule(SubscriptionId id,
+                                Nanoseconds time_ns)
+  {
+    std::scoped_lock<std::mutex> lock(m_subscriptions_mutex);
+    auto subscription_itr = m_subscriptions.find(id);
+    if (subscription_itr == m_subscriptions.end())
+      return false;
+    arm(id, subscription_itr->second, time_ns);
+    return true;
+  }
+
+  bool ExternalTime::unsubscribe(SubscriptionId id)
+  {
+    {
+      std::scoped_lock<std::mutex> lock(m_subscriptions_mutex);
+      auto subscription_itr = m_subscriptions.find(id);
+      if (subscription_itr == m_subscriptions.end())
+        return false;
+      arm(id, subscription_itr->second, kNever);
+      m_subscriptions.erase(subscription_itr);
+    }
+    /* wait for the callback if it is running right now */
+    std::scoped_lock<std::recursive_mutex> 
+      callbacks_lock(m_callbacks_mutex);
+    return true;
+  }
+
+  bool ExternalTime::waitUntil(Nanoseconds time_ns,
+                               std::chrono::nanoseconds timeout)
+  {
+    if (get_current_time_ns() >= time_ns)
+      return true;
+
+    /* shared with the callback which might outlive this call
+    in a timeout */
+    struct Waiter
+    {
+      std::mutex mutex;
+      std::condition_variable condition;
+      bool is_reached = false;
+    };
+    auto waiter = std::make_shared<Waiter>();
+    auto id = subscribe(time_ns, [waiter](Nanoseconds)
+    {
+      {
+        std::scoped_lock<std::mutex> lock(waiter->mutex);
+        waiter->is_reached = true;
+      }
+      waiter->condition.notify_all();
+    });
+
+    /* the time might have been reached before subscribing */
+    auto is_reached = [this, &waiter, time_ns]()
+    {
+      return waiter->is_reached 
+             || get_current_time_ns() >= time_ns;
+    };
+    bool retVal;
+    {
+      std::unique_lock<std::mutex> lock(waiter->mutex);
+      if (timeout == std::chrono::nanoseconds::max())
+      {
+        waiter->condition.wait(lock, is_reached);
+        retVal = true;
+      }
+      else
+        retVal = waiter->condition.wait_for(
+          lock, timeout, is_reached);
+    }
+    unsubscribe(id);
+    return retVal;
+  }
+}
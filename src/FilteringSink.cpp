@@ -0,0 +1,98 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in FilteringSink.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "FilteringSink.h"
+#include "common/Constants.h"
+#include <algorithm>
+#include <utility>
+
+FilteringSink::FilteringSink(Common::IPacketSink& next_sink,
+                             std::vector<PacketFilter> filters)
+  : m_next_sink(next_sink),
+    m_filters(std::move(filters))
+{
+}
+
+bool FilteringSink::matches(const Common::PcapPacket& packet,
+                            const DecodedPacket& decoded)
+{
+  m_number_of_packets++;
+  if (m_filters.empty())
+  {
+    m_number_of_passed_packets++;
+    return true;
+  }
+  /* no short-circuit so that every filter counts the packet */
+  bool is_matching = false;
+  for (auto& filter : m_filters)
+    is_matching |= filter.matches(packet, decoded);
+  m_number_of_passed_packets += is_matching;
+  return is_matching;
+}
+
+void FilteringSink::pushPacket(Common::PcapPacket&& packet)
+{
+  DecodedPacket decoded;
+  decodePacket(packet, decoded);
+  if (matches(packet, decoded))
+    m_next_sink.pushDecodedPackets(&packet, &decoded, 1);
+  else
+    packet.reset();
+}
+
+void FilteringSink::pushPackets(Common::PcapPacket* packets,
+                                std::size_t number_of_packets)
+{
+  if (m_filters.empty())
+  {
+    m_number_of_packets += number_of_packets;
+    m_number_of_passed_packets += number_of_packets;
+    m_next_sink.pushPackets(packets, number_of_packets);
+    return;
+  }
+
+  /* the packets passing (and their headers) are moved to the
+  front of the arrays */
+  m_decoded_packets.resize(number_of_packets);
+  std::size_t number_of_passed_packets = 0;
+  for (std::size_t first = 0; first < number_of_packets;
+       first += Common::kPacketDecoderBurstSize)
+  {
+    auto burst_size = std::min(Common::kPacketDecoderBurstSize,
+                               number_of_packets - first);
+    decodePackets(packets + first, burst_size, 
+                  m_decoded_packets.data() + first);
+    for (std::size_t i = first; i < first + burst_size; i++)
+    {
+      auto& packet = packets[i];
+      if (!matches(packet, m_decoded_packets[i]))
+        packet.reset();
+      else
+      {
+        if (number_of_passed_packets != i)
+        {
+          packets[number_of_passed_packets] = std::move(packet);
+          m_decoded_packets[number_of_passed_packets] = 
+            m_decoded_packets[i];
+        }
+        number_of_passed_packets++;
+      }
+    }
+  }
+  if (number_of_passed_packets > 0)
+    m_next_sink.pushDecodedPackets(packets, 
+                                   m_decoded_packets.data(),
+                                   number_of_passed_packets);
+}
+
+void FilteringSink::closeQueue()
+{
+  m_next_sink.closeQueue();
+}
@@ -0,0 +1,119 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the free
+ * functions declared in FlowHash.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "FlowHash.h"
+#include <cstring> // memcmp
+
+namespace
+{
+  constexpr uint8_t kProtocolTcp  = 6;
+  constexpr uint8_t kProtocolUdp  = 17;
+  constexpr uint8_t kProtocolSctp = 132;
+
+  /**
+   * @brief FNV-1a over the given octets, continuing from
+   * "hash".
+   */
+  inline uint64_t hashOctets(uint64_t hash, const uint8_t* octets,
+                             std::size_t length)
+  {
+    for (std::size_t i = 0; i < length; i++)
+    {
+      hash ^= octets[i];
+      hash *= 0x100000001b3ULL;
+    }
+    return hash;
+  }
+
+  /**
+   * @brief Hash both endpoints in a canonical (sorted) order so
+   * that swapping the source and the destination does not
+   * change the result.
+   */
+  uint64_t hashEndpoints(const uint8_t* source_address,
+                         const uint8_t* destination_address,
+                         std::size_t address_length,
+                         uint16_t source_port,
+                         uint16_t destination_port,
+                         uint8_t protocol)
+  {
+    auto order = std::memcmp(source_address, destination_address,
+                             address_length);
+    bool is_swapped = order > 0
+                      || (order == 0
+                          && source_port > destination_port);
+    const uint8_t* first_address =
+      is_swapped ? destination_address : source_address;
+    const uint8_t* second_address =
+      is_swapped ? source_address : destination_address;
+    uint8_t ports[4] = {
+      static_cast<uint8_t>(
+        (is_swapped ? destination_port : source_port) >> 8),
+      static_cast<uint8_t>(
+        is_swapped ? destination_port : source_port),
+      static_cast<uint8_t>(
+        (is_swapped ? source_port : destination_port) >> 8),
+      static_cast<uint8_t>(
+        is_swapped ? source_port : destination_port)};
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = hashOctets(hash, first_address, address_length);
+    hash = hashOctets(hash, second_address, address_length);
+    hash = hashOctets(hash, ports, sizeof(ports));
+    hash = hashOctets(hash, &protocol, 1);
+
+    /* FNV spreads the low bits poorly; mix them (the finalizer
+    of MurmurHash3) since the shard is picked by a modulo */
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+  }
+}
+
+uint64_t hashFiveTuple(const Common::PcapPacket& packet)
+{
+  DecodedPacket decoded;
+  if (!decodePacket(packet, decoded))
+    return 0;
+  return hashFiveTuple(packet, decoded);
+}
+
+uint64_t hashFiveTuple(const Common::PcapPacket& packet,
+                       const DecodedPacket& decoded)
+{
+  if (!(decoded.has(DecodedPacket::kIPv4) 
+        || decoded.has(DecodedPacket::kIPv6)))
+    return 0;
+
+  /* All the fragments of a datagram are hashed without the
+  ports since only the first fragment carries them. The ports
+  are read even if the rest of the transport header is not
+  captured. */
+  const uint8_t* data = packet.get_data();
+  const auto protocol = decoded.protocol;
+  uint16_t source_port = 0;
+  uint16_t destination_port = 0;
+  if (!decoded.is(DecodedPacket::kFragment)
+      && decoded.has_l4_offset()
+      && (protocol == kProtocolTcp || protocol == kProtocolUdp
+          || protocol == kProtocolSctp)
+      && packet.get_caplen() >= decoded.l4_offset + 4u)
+  {
+    source_port = decoded.get_source_port(data);
+    destination_port = decoded.get_destination_port(data);
+  }
+  return hashEndpoints(decoded.get_source_address(data), 
+                       decoded.get_destination_address(data),
+                       decoded.get_address_length(), source_port,
+                       destination_port, protocol);
+}
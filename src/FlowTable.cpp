@@ -0,0 +1,324 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in FlowTable.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "FlowTable.h"
+#include <limits>
+#include <new> // bad_alloc
+#include <utility> // swap
+#include <sys/mman.h> // mmap, madvise, munmap
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+bool makeFlowKey(const uint8_t* data, uint32_t caplen,
+                 const DecodedPacket& decoded, FlowKey& key,
+                 bool* is_from_b)
+{
+  if (!(decoded.has(DecodedPacket::kIPv4)
+        || decoded.has(DecodedPacket::kIPv6)))
+    return false;
+
+  key = FlowKey();
+  key.protocol = decoded.protocol;
+  uint8_t source_address[16];
+  uint8_t destination_address[16];
+  copyMappedAddress(decoded.get_source_address(data),
+                    decoded.get_address_length(), source_address);
+  copyMappedAddress(decoded.get_destination_address(data),
+                    decoded.get_address_length(), 
+                    destination_address);
+
+  uint16_t source_port = 0;
+  uint16_t destination_port = 0;
+  if (decoded.has_ports(caplen))
+  {
+    source_port = decoded.get_source_port(data);
+    destination_port = decoded.get_destination_port(data);
+  }
+
+  /* the smaller endpoint is the "a" side whatever the
+  direction of the packet is */
+  auto order = std::memcmp(source_address, destination_address,
+                           sizeof(source_address));
+  bool is_swapped = order > 0
+                    || (order == 0 && source_port > destination_port);
+  std::memcpy(key.address_a,
+              is_swapped ? destination_address : source_address, 16);
+  std::memcpy(key.address_b,
+              is_swapped ? source_address : destination_address, 16);
+  key.port_a = is_swapped ? destination_port : source_port;
+  key.port_b = is_swapped ? source_port : destination_port;
+  if (is_from_b != nullptr)
+    *is_from_b = is_swapped;
+  return true;
+}
+
+std::size_t FlowKeyHash::operator()(const FlowKey& key) const
+{
+  return FlowTable::hashKey(key);
+}
+
+FlowTable::FlowTable(std::size_t max_number_of_flows)
+  : m_max_number_of_flows(max_number_of_flows)
+{
+  /* at most 7/8 of the slots are used so that the probe
+  sequences stay short */
+  std::size_t capacity = kGroupSize;
+  while (capacity / 8 * 7 < max_number_of_flows)
+    capacity *= 2;
+  map(capacity);
+}
+
+FlowTable::~FlowTable()
+{
+  unmap();
+}
+
+void FlowTable::map(std::size_t capacity)
+{
+  m_capacity = capacity;
+  m_mapping_size = capacity * sizeof(FlowEntry) + capacity;
+  /* Only the touched pages are backed by memory, and they are
+  zero-filled: all the slots are empty (kEmpty) to begin with.
+  */
+  m_mapping = mmap(nullptr, m_mapping_size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                   -1, 0);
+  if (m_mapping == MAP_FAILED)
+  {
+    m_mapping = nullptr;
+    throw std::bad_alloc();
+  }
+  /* Every lookup of a large table misses the TLB with 4 KiB
+  pages; ask for transparent huge pages (a hint only). */
+  madvise(m_mapping, m_mapping_size, MADV_HUGEPAGE);
+  m_entries = static_cast<FlowEntry*>(m_mapping);
+  m_control = reinterpret_cast<uint8_t*>(m_entries + capacity);
+}
+
+void FlowTable::unmap()
+{
+  if (m_mapping != nullptr)
+    munmap(m_mapping, m_mapping_size);
+  m_mapping = nullptr;
+}
+
+uint64_t FlowTable::hashKey(const FlowKey& key)
+{
+  uint64_t words[sizeof(FlowKey) / sizeof(uint64_t)];
+  std::memcpy(words, &key, sizeof(words));
+  /* The words are multiplied independently (rather than one
+  after the other) so the multiplications overlap; the
+  finalizer of MurmurHash3 mixes the sum. */
+  uint64_t hash = words[0] * 0x9e3779b97f4a7c15ULL
+                  + words[1] * 0xc2b2ae3d27d4eb4fULL
+                  + words[2] * 0x165667b19e3779f9ULL
+                  + words[3] * 0xd6e8feb86659fd93ULL
+                  + words[4] * 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+uint32_t FlowTable::matchGroup(std::size_t group,
+                               uint8_t control) const
+{
+  const uint8_t* group_control = m_control + group * kGroupSize;
+#if defined(__SSE2__)
+  const __m128i controls = _mm_load_si128(
+    reinterpret_cast<const __m128i*>(group_control));
+  return static_cast<uint32_t>(_mm_movemask_epi8(
+    _mm_cmpeq_epi8(controls, _mm_set1_epi8(
+      static_cast<char>(control)))));
+#else
+  uint32_t mask = 0;
+  for (std::size_t i = 0; i < kGroupSize; i++)
+    mask |= static_cast<uint32_t>(group_control[i] == control) << i;
+  return mask;
+#endif
+}
+
+std::size_t FlowTable::findSlot(const FlowKey& key,
+                                uint64_t hash) const
+{
+  const uint8_t tag = kFull | (hash & 0x7f);
+  const auto group_mask = m_capacity / kGroupSize - 1;
+  /* triangular probing visits every group once */
+  auto group = (hash >> 7) & group_mask;
+  for (std::size_t probe = 1; probe <= group_mask + 1; probe++)
+  {
+    for (auto matches = matchGroup(group, tag); matches != 0;
+         matches &= matches - 1)
+    {
+      auto slot = group * kGroupSize + __builtin_ctz(matches);
+      if (m_entries[slot].key == key)
+        return slot;
+    }
+    /* an insertion would have stopped at this group */
+    if (matchGroup(group, kEmpty) != 0)
+      break;
+    group = (group + probe) & group_mask;
+  }
+  return m_capacity;
+}
+
+std::size_t FlowTable::findFreeSlot(uint64_t hash) const
+{
+  const auto group_mask = m_capacity / kGroupSize - 1;
+  auto group = (hash >> 7) & group_mask;
+  for (std::size_t probe = 1; ; probe++)
+  {
+    auto free_slots = matchGroup(group, kEmpty)
+                      | matchGroup(group, kDeleted);
+    if (free_slots != 0)
+      return group * kGroupSize + __builtin_ctz(free_slots);
+    group = (group + probe) & group_mask;
+  }
+}
+
+void FlowTable::eraseSlot(std::size_t slot)
+{
+  /* The slot can be made empty again if its group has an empty
+  slot: no lookup passes through such a group, so no flow
+  depends on the slot being occupied to be found. Otherwise it
+  is marked deleted (a tombstone). */
+  if (matchGroup(slot / kGroupSize, kEmpty) != 0)
+    m_control[slot] = kEmpty;
+  else
+  {
+    m_control[slot] = kDeleted;
+    m_number_of_deleted_slots++;
+  }
+  m_number_of_flows--;
+}
+
+void FlowTable::rebuild()
+{
+  /* Like SwissTable does in place: the tombstones become empty
+  and the flows are marked deleted (i.e. not placed yet); then
+  each marked flow is moved to the first free slot of its probe
+  sequence, swapping places with a flow not placed yet if need
+  be. */
+  for (std::size_t slot = 0; slot < m_capacity; slot++)
+    m_control[slot] = (m_control[slot] & kFull) != 0 ? kDeleted
+                                                     : kEmpty;
+  for (std::size_t slot = 0; slot < m_capacity;)
+  {
+    if (m_control[slot] != kDeleted)
+    {
+      slot++;
+      continue;
+    }
+    auto hash = hashKey(m_entries[slot].key);
+    const uint8_t tag = kFull | (hash & 0x7f);
+    auto new_slot = findFreeSlot(hash);
+    /* the groups before it on the probe sequence are full, so
+    the flow is found where it is */
+    if (new_slot / kGroupSize == slot / kGroupSize)
+    {
+      m_control[slot] = tag;
+      slot++;
+    }
+    else if (m_control[new_slot] == kEmpty)
+    {
+      m_entries[new_slot] = m_entries[slot];
+      m_control[new_slot] = tag;
+      m_control[slot] = kEmpty;
+      slot++;
+    }
+    else
+    {
+      /* the flow swapped in is placed in the next round */
+      std::swap(m_entries[slot], m_entries[new_slot]);
+      m_control[new_slot] = tag;
+    }
+  }
+  m_number_of_deleted_slots = 0;
+}
+
+FlowEntry* FlowTable::update(const FlowKey& key,
+                             Common::Nanoseconds arrival_time_ns,
+                             uint32_t length)
+{
+  auto hash = hashKey(key);
+  auto slot = findSlot(key, hash);
+  if (slot == m_capacity)
+  {
+    if (m_number_of_flows >= m_max_number_of_flows)
+    {
+      m_number_of_dropped_flows++;
+      return nullptr;
+    }
+    /* Keep 1/16 of the slots empty; the lookups of the missing
+    keys would probe too long otherwise. Rebuilding frees at
+    least 1/8 of the slots, so it happens rarely. */
+    if (m_capacity - m_number_of_flows - m_number_of_deleted_slots
+        < m_capacity / 16)
+      rebuild();
+
+    slot = findFreeSlot(hash);
+    if (m_control[slot] == kDeleted)
+      m_number_of_deleted_slots--;
+    m_control[slot] = kFull | (hash & 0x7f);
+    m_number_of_flows++;
+
+    auto& entry = m_entries[slot];
+    entry.key = key;
+    entry.number_of_packets = 0;
+    entry.last_seen_offset_ms = 0;
+    entry.number_of_octets = 0;
+    entry.first_seen_ns = arrival_time_ns;
+  }
+
+  auto& entry = m_entries[slot];
+  if (entry.number_of_packets
+      != std::numeric_limits<uint32_t>::max())
+    entry.number_of_packets++;
+  entry.number_of_octets += length;
+  /* the last seen time never goes back (e.g. for a packet out
+  of order) */
+  auto offset_ms = (arrival_time_ns - entry.first_seen_ns)
+                   / Common::kNanosecondsPerMillisecond;
+  if (offset_ms > entry.last_seen_offset_ms)
+    entry.last_seen_offset_ms = static_cast<uint32_t>(std::min<
+      Common::Nanoseconds>(offset_ms,
+                           std::numeric_limits<uint32_t>::max()));
+  return &entry;
+}
+
+FlowEntry* FlowTable::update(const Common::PcapPacket& packet,
+                             const DecodedPacket& decoded)
+{
+  FlowKey key;
+  if (!makeFlowKey(packet.get_data(), packet.get_caplen(), decoded,
+                   key))
+    return nullptr;
+  return update(key, packet.get_arrival_time_ns(),
+                packet.get_len());
+}
+
+const FlowEntry* FlowTable::find(const FlowKey& key) const
+{
+  auto slot = findSlot(key, hashKey(key));
+  return slot == m_capacity ? nullptr : &m_entries[slot];
+}
+
+bool FlowTable::erase(const FlowKey& key)
+{
+  auto slot = findSlot(key, hashKey(key));
+  if (slot == m_capacity)
+    return false;
+  eraseSlot(slot);
+  return true;
+}
@@ -0,0 +1,289 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in common/PacketBufferPool.h and the per-thread
+ * caches behind them.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "common/PacketBufferPool.h"
+#include "common/Constants.h"
+#include <mutex>
+#include <new> // bad_alloc
+#include <vector>
+
+#include <sys/mman.h> // mmap, madvise
+
+namespace
+{
+  using Common::PacketBufferPool;
+
+  struct ThreadCache;
+
+  /**
+   * @brief Placed right before the data of every buffer to
+   * find out where to return the buffer to.
+   */
+  struct BufferHeader
+  {
+    /** nullptr for buffers from the global allocator */
+    ThreadCache* owner;
+    uint32_t size_class;
+    uint32_t reserved;
+  };
+  static_assert(sizeof(BufferHeader) == 16,
+                "buffer data must stay 16-octet aligned");
+
+  constexpr uint32_t kGlobalAllocatorSizeClass = ~0u;
+
+  inline BufferHeader* headerOf(const uint8_t* buffer)
+  {
+    return reinterpret_cast<BufferHeader*>(
+      const_cast<uint8_t*>(buffer) - sizeof(BufferHeader));
+  }
+
+  /* Free buffers are linked through their (unused) data. */
+  inline uint8_t*& nextOf(uint8_t* buffer)
+  {
+    return *reinterpret_cast<uint8_t**>(buffer);
+  }
+
+  /**
+   * @brief Free lists of a thread. Only the owning thread
+   * touches "free_lists"; the other threads only push onto
+   * "remote_frees".
+   */
+  struct ThreadCache
+  {
+    uint8_t* free_lists[PacketBufferPool::kNumberOfSizeClasses] = {};
+
+    /** Buffers of this cache freed by other threads */
+    std::atomic<uint8_t*> remote_frees{nullptr};
+
+    /**
+     * @brief Move the buffers freed by other threads to the
+     * local free lists.
+     */
+    void collectRemoteFrees()
+    {
+      /* Taking the whole list at once (instead of popping one
+      by one) makes the list immune to ABA problems. */
+      auto* buffer = remote_frees.exchange(
+        nullptr, std::memory_order_acquire);
+      while (buffer != nullptr)
+      {
+        auto* next = nextOf(buffer);
+        auto& free_list = free_lists[headerOf(buffer)->size_class];
+        nextOf(buffer) = free_list;
+        free_list = buffer;
+        buffer = next;
+      }
+    }
+
+    /**
+     * @brief Carve a new slab into buffers of the given size
+     * class and put them to the local free list.
+     */
+    void refill(uint32_t size_class)
+    {
+      const auto chunk_size = sizeof(BufferHeader)
+        + PacketBufferPool::kSizeClasses[size_class];
+      const auto number_of_chunks =
+        chunk_size > Common::kPacketBufferPoolSlabSize
+        ? 1 : Common::kPacketBufferPoolSlabSize / chunk_size;
+      auto* slab = PacketBufferPool::getInstance().reserveSlab(
+        number_of_chunks * chunk_size);
+
+      auto& free_list = free_lists[size_class];
+      for (std::size_t i = number_of_chunks; i-- > 0; )
+      {
+        auto* header =
+          reinterpret_cast<BufferHeader*>(slab + i * chunk_size);
+        header->owner = this;
+        header->size_class = size_class;
+        auto* buffer = reinterpret_cast<uint8_t*>(header + 1);
+        nextOf(buffer) = free_list;
+        free_list = buffer;
+      }
+    }
+  };
+
+  /**
+   * @brief Caches of the exited threads. Their buffers might
+   * still be in flight, so the caches are never deleted but
+   * adopted by the next new threads instead.
+   */
+  struct OrphanedThreadCaches
+  {
+    std::mutex mutex;
+    std::vector<ThreadCache*> caches;
+  };
+
+  OrphanedThreadCaches& getOrphanedThreadCaches()
+  {
+    /* never destructed; thread caches can outlive statics */
+    static auto* orphans = new OrphanedThreadCaches();
+    return *orphans;
+  }
+
+  /**
+   * @brief Gives the cache of a thread to the orphans when the
+   * thread exits.
+   */
+  struct ThreadCacheHolder
+  {
+    ThreadCache* cache = nullptr;
+    ~ThreadCacheHolder()
+    {
+      if (cache == nullptr)
+        return;
+      auto& orphans = getOrphanedThreadCaches();
+      std::scoped_lock<std::mutex> lock(orphans.mutex);
+      orphans.caches.push_back(cache);
+    }
+  };
+
+  thread_local ThreadCacheHolder t_thread_cache_holder;
+
+  ThreadCache& getThreadCache()
+  {
+    auto*& cache = t_thread_cache_holder.cache;
+    if (cache != nullptr)
+      return *cache;
+
+    auto& orphans = getOrphanedThreadCaches();
+    {
+      std::scoped_lock<std::mutex> lock(orphans.mutex);
+      if (!orphans.caches.empty())
+      {
+        cache = orphans.caches.back();
+        orphans.caches.pop_back();
+      }
+    }
+    if (cache == nullptr)
+      cache = new ThreadCache();
+    return *cache;
+  }
+
+  inline uint32_t toSizeClass(std::size_t size)
+  {
+    for (uint32_t size_class = 0;
+         size_class < PacketBufferPool::kNumberOfSizeClasses;
+         size_class++)
+      if (size <= PacketBufferPool::kSizeClasses[size_class])
+        return size_class;
+    return kGlobalAllocatorSizeClass;
+  }
+}
+
+namespace Common
+{
+  PacketBufferPool& PacketBufferPool::getInstance()
+  {
+    static PacketBufferPool singleton_instance;
+    return singleton_instance;
+  }
+
+  PacketBufferPool::PacketBufferPool()
+    : m_use_huge_pages(kPacketBufferPoolUseHugePages) {}
+
+  uint8_t* PacketBufferPool::reserveSlab(std::size_t size)
+  {
+    void* slab = MAP_FAILED;
+    if (m_use_huge_pages.load(std::memory_order_relaxed))
+    {
+      /* explicit huge pages; length must be a multiple of the
+      huge page size */
+      constexpr std::size_t kHugePageSize = 2 * 1024 * 1024;
+      auto huge_size = (size + kHugePageSize - 1)
+                       & ~(kHugePageSize - 1);
+      slab = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                  -1, 0);
+      if (slab != MAP_FAILED)
+        size = huge_size;
+    }
+    if (slab == MAP_FAILED)
+    {
+      slab = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (slab == MAP_FAILED)
+        throw std::bad_alloc();
+      if (m_use_huge_pages.load(std::memory_order_relaxed))
+        madvise(slab, size, MADV_HUGEPAGE);
+    }
+    m_number_of_reserved_octets.fetch_add(
+      size, std::memory_order_relaxed);
+    return static_cast<uint8_t*>(slab);
+  }
+
+  uint8_t* PacketBufferPool::allocate(std::size_t size)
+  {
+    auto size_class = toSizeClass(size);
+    if (size_class == kGlobalAllocatorSizeClass)
+    {
+      /* Rare huge packets are not worth a size class */
+      auto* header = reinterpret_cast<BufferHeader*>(
+        new uint8_t[sizeof(BufferHeader) + size]);
+      header->owner = nullptr;
+      header->size_class = kGlobalAllocatorSizeClass;
+      header->reserved = static_cast<uint32_t>(size);
+      return reinterpret_cast<uint8_t*>(header + 1);
+    }
+
+    auto& cache = getThreadCache();
+    auto& free_list = cache.free_lists[size_class];
+    if (free_list == nullptr)
+    {
+      cache.collectRemoteFrees();
+      if (free_list == nullptr)
+        cache.refill(size_class);
+    }
+    auto* buffer = free_list;
+    free_list = nextOf(buffer);
+    return buffer;
+  }
+
+  void PacketBufferPool::deallocate(uint8_t* buffer)
+  {
+    if (buffer == nullptr)
+      return;
+
+    auto* header = headerOf(buffer);
+    if (header->size_class == kGlobalAllocatorSizeClass)
+    {
+      delete[] reinterpret_cast<uint8_t*>(header);
+      return;
+    }
+
+    auto* owner = header->owner;
+    if (owner == t_thread_cache_holder.cache)
+    {
+      auto& free_list = owner->free_lists[header->size_class];
+      nextOf(buffer) = free_list;
+      free_list = buffer;
+      return;
+    }
+
+    /* freed on another thread: hand it back to its owner */
+    auto* head = owner->remote_frees.load(
+      std::memory_order_relaxed);
+    do
+      nextOf(buffer) = head;
+    while (!owner->remote_frees.compare_exchange_weak(
+             head, buffer, std::memory_order_release,
+             std::memory_order_relaxed));
+  }
+
+  std::size_t PacketBufferPool::get_capacity(
+    const uint8_t* buffer) const
+  {
+    auto* header = headerOf(buffer);
+    if (header->size_class == kGlobalAllocatorSizeClass)
+      return header->reserved;
+    return kSizeClasses[header->size_class];
+  }
+}
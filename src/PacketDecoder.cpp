@@ -0,0 +1,588 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the free
+ * functions declared in PacketDecoder.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "PacketDecoder.h"
+#include "common/Constants.h"
+#include <algorithm> // min
+#include <cstddef> // offsetof
+#include <cstring> // memcpy
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+  constexpr uint16_t kEtherTypeIPv4  = 0x0800;
+  constexpr uint16_t kEtherTypeIPv6  = 0x86DD;
+  constexpr uint16_t kEtherTypeVlan  = 0x8100;
+  constexpr uint16_t kEtherTypeQinQ  = 0x88A8;
+
+  constexpr uint8_t kProtocolHopByHop     = 0;
+  constexpr uint8_t kProtocolTcp          = 6;
+  constexpr uint8_t kProtocolUdp          = 17;
+  constexpr uint8_t kProtocolRouting      = 43;
+  constexpr uint8_t kProtocolFragment     = 44;
+  constexpr uint8_t kProtocolAuthentication = 51;
+  constexpr uint8_t kProtocolDestinationOptions = 60;
+  constexpr uint8_t kProtocolMobility     = 135;
+  constexpr uint8_t kProtocolHip          = 139;
+  constexpr uint8_t kProtocolShim6        = 140;
+
+  /* Real traffic has a few at most; a frame with more is
+  treated as malformed rather than walked forever. */
+  constexpr unsigned kMaxNumberOfVlanTags = 8;
+  constexpr unsigned kMaxNumberOfIPv6ExtensionHeaders = 8;
+
+  /* The offsets are kept in 16 bits; leave room for the
+  longest transport header */
+  constexpr uint32_t kMaxHeaderOffset = 0xffff - 60;
+
+  using Layer = DecodedPacket::Layer;
+  using Flag = DecodedPacket::Flag;
+
+  inline uint16_t readBigEndianU16(const uint8_t* field)
+  {
+    return DecodedPacket::readBigEndianU16(field);
+  }
+
+  /**
+   * @brief Walk the extension headers of an IPv6 packet.
+   *
+   * @param offset the first octet after the fixed header;
+   * moved to the first octet after the extension headers.
+   * @param next_header the next header field of the fixed
+   * header; set to the protocol after the extension headers.
+   * @return false if the walk can not go further than the
+   * extension headers (e.g. a non-first fragment).
+   */
+  bool skipIPv6ExtensionHeaders(const uint8_t* data, uint32_t caplen,
+                                uint32_t& offset,
+                                uint8_t& next_header,
+                                DecodedPacket& decoded)
+  {
+    for (unsigned i = 0; i < kMaxNumberOfIPv6ExtensionHeaders; i++)
+    {
+      /* next header(1) length(1) ... */
+      if (next_header != kProtocolHopByHop
+          && next_header != kProtocolRouting
+          && next_header != kProtocolFragment
+          && next_header != kProtocolAuthentication
+          && next_header != kProtocolDestinationOptions
+          && next_header != kProtocolMobility
+          && next_header != kProtocolHip
+          && next_header != kProtocolShim6)
+        /* not an extension header; the transport header */
+        return true;
+      if (offset + 8 > caplen)
+      {
+        decoded.flags |= Flag::kTruncated;
+        return false;
+      }
+
+      const uint8_t* header = data + offset;
+      uint32_t length;
+      if (next_header == kProtocolFragment)
+      {
+        /* fragment offset(13 bits) reserved(2 bits) more
+        fragments(1 bit) at 2 */
+        length = 8;
+        decoded.flags |= Flag::kFragment;
+        /* only the first fragment carries the transport
+        header */
+        if ((readBigEndianU16(header + 2) & 0xfff8) != 0)
+        {
+          next_header = header[0];
+          return false;
+        }
+      }
+      else if (next_header == kProtocolAuthentication)
+        length = (header[1] + 2u) * 4;
+      else
+        length = (header[1] + 1u) * 8;
+
+      if (offset + length > caplen)
+      {
+        decoded.flags |= Flag::kTruncated;
+        return false;
+      }
+      next_header = header[0];
+      offset += length;
+    }
+    decoded.flags |= Flag::kMalformed;
+    return false;
+  }
+}
+
+bool decodePacket(const uint8_t* data, uint32_t caplen,
+                  DecodedPacket& decoded)
+{
+  decoded = DecodedPacket();
+
+  /* destination MAC(6) source MAC(6) ether type(2) */
+  if (data == nullptr || caplen < 14)
+    return false;
+  decoded.layers = Layer::kEthernet;
+  uint16_t ether_type = readBigEndianU16(data + 12);
+  uint32_t offset = 14;
+
+  /* tag control (2) ether type (2) per tag */
+  while (ether_type == kEtherTypeVlan
+         || ether_type == kEtherTypeQinQ)
+  {
+    if (decoded.number_of_vlan_tags == kMaxNumberOfVlanTags)
+    {
+      decoded.flags |= Flag::kMalformed;
+      return true;
+    }
+    if (offset + 4 > caplen)
+    {
+      decoded.flags |= Flag::kTruncated;
+      return true;
+    }
+    if (decoded.number_of_vlan_tags == 0)
+      decoded.vlan_id = readBigEndianU16(data + offset) & 0x0fff;
+    decoded.number_of_vlan_tags++;
+    decoded.layers |= Layer::kVlan;
+    ether_type = readBigEndianU16(data + offset + 2);
+    offset += 4;
+  }
+  decoded.ether_type = ether_type;
+
+  uint8_t protocol;
+  if (ether_type == kEtherTypeIPv4)
+  {
+    /* version/IHL(1) ... total length(2) at 2, flags/fragment
+    offset(2) at 6, protocol(1) at 9 */
+    if (offset + 20 > caplen)
+    {
+      decoded.flags |= Flag::kTruncated;
+      return true;
+    }
+    const uint8_t* header = data + offset;
+    const uint32_t header_length = (header[0] & 0x0f) * 4u;
+    const uint32_t total_length = readBigEndianU16(header + 2);
+    if ((header[0] >> 4) != 4 || header_length < 20
+        || total_length < header_length)
+    {
+      decoded.flags |= Flag::kMalformed;
+      return true;
+    }
+    if (offset + header_length > caplen)
+    {
+      decoded.flags |= Flag::kTruncated;
+      return true;
+    }
+    decoded.l3_offset = static_cast<uint16_t>(offset);
+    decoded.layers |= Layer::kIPv4;
+    decoded.payload_end = std::min(caplen, offset + total_length);
+    protocol = header[9];
+    decoded.protocol = protocol;
+
+    const uint16_t fragment_field = readBigEndianU16(header + 6);
+    /* more fragments flag or a non-zero fragment offset */
+    if ((fragment_field & 0x3fff) != 0)
+      decoded.flags |= Flag::kFragment;
+    /* only the first fragment carries the transport header */
+    if ((fragment_field & 0x1fff) != 0)
+      return true;
+    offset += header_length;
+  }
+  else if (ether_type == kEtherTypeIPv6)
+  {
+    /* version(4 bits) ... payload length(2) at 4, next
+    header(1) at 6, source(16) at 8, destination(16) at 24 */
+    if (offset + 40 > caplen)
+    {
+      decoded.flags |= Flag::kTruncated;
+      return true;
+    }
+    const uint8_t* header = data + offset;
+    if ((header[0] >> 4) != 6)
+    {
+      decoded.flags |= Flag::kMalformed;
+      return true;
+    }
+    decoded.l3_offset = static_cast<uint16_t>(offset);
+    decoded.layers |= Layer::kIPv6;
+    const uint32_t payload_length = readBigEndianU16(header + 4);
+    /* a payload length of 0 is a jumbogram; take what is
+    captured */
+    decoded.payload_end = payload_length == 0
+      ? caplen : std::min(caplen, offset + 40 + payload_length);
+    protocol = header[6];
+    offset += 40;
+    const bool has_transport_header = skipIPv6ExtensionHeaders(
+      data, caplen, offset, protocol, decoded);
+    decoded.protocol = protocol;
+    if (!has_transport_header)
+      return true;
+  }
+  else
+    return true;
+
+  if (offset > kMaxHeaderOffset)
+  {
+    decoded.flags |= Flag::kMalformed;
+    return true;
+  }
+  decoded.l4_offset = static_cast<uint16_t>(offset);
+
+  if (protocol == kProtocolTcp)
+  {
+    /* ... data offset(4 bits) at 12 */
+    if (offset + 20 > caplen)
+    {
+      decoded.flags |= Flag::kTruncated;
+      return true;
+    }
+    const uint32_t header_length = (data[offset + 12] >> 4) * 4u;
+    if (header_length < 20)
+    {
+      decoded.flags |= Flag::kMalformed;
+      return true;
+    }
+    if (offset + header_length > caplen)
+    {
+      decoded.flags |= Flag::kTruncated;
+      return true;
+    }
+    decoded.layers |= Layer::kTcp;
+    decoded.payload_offset =
+      static_cast<uint16_t>(offset + header_length);
+  }
+  else if (protocol == kProtocolUdp)
+  {
+    if (offset + 8 > caplen)
+    {
+      decoded.flags |= Flag::kTruncated;
+      return true;
+    }
+    decoded.layers |= Layer::kUdp;
+    decoded.payload_offset = static_cast<uint16_t>(offset + 8);
+  }
+  return true;
+}
+
+namespace
+{
+  /**
+   * @brief The fields of a burst of packets as classified by a
+   * kernel; a lane which is not "is_simple" is left to
+   * decodePacket.
+   *
+   * A simple packet is an untagged Ethernet frame carrying an
+   * unfragmented IPv4 datagram (or an IPv6 packet without
+   * extension headers) with a complete TCP or UDP header; i.e.
+   * the bulk of the traffic.
+   */
+  struct BurstLanes
+  {
+    static constexpr std::size_t kNumberOfLanes = 4;
+    alignas(32) uint64_t is_simple[kNumberOfLanes];
+
+    /* The fields of DecodedPacket as laid out in its first 16
+    octets (on a little endian CPU): ether_type, l3_offset,
+    l4_offset and payload_offset; then payload_end, vlan_id,
+    number_of_vlan_tags and protocol. */
+    alignas(32) uint64_t offsets[kNumberOfLanes];
+    alignas(32) uint64_t lengths[kNumberOfLanes];
+    alignas(32) uint64_t layers[kNumberOfLanes];
+  };
+
+  static_assert(offsetof(DecodedPacket, payload_offset) == 6
+                && offsetof(DecodedPacket, payload_end) == 8
+                && offsetof(DecodedPacket, protocol) == 15
+                && offsetof(DecodedPacket, layers) == 16,
+                "BurstLanes relies on the layout of DecodedPacket");
+
+  /**
+   * @brief Fill the decoded packets of a burst from the lanes
+   * classified by a kernel; the lanes which are not simple are
+   * decoded one by one.
+   */
+  void fillDecodedPackets(const Common::PcapPacket* packets,
+                          std::size_t number_of_packets,
+                          const BurstLanes& lanes,
+                          DecodedPacket* decoded)
+  {
+    for (std::size_t lane = 0; lane < number_of_packets; lane++)
+    {
+      auto& decoded_packet = decoded[lane];
+      if (!lanes.is_simple[lane])
+      {
+        decodePacket(packets[lane], decoded_packet);
+        continue;
+      }
+      auto* fields = reinterpret_cast<unsigned char*>(&decoded_packet);
+      std::memcpy(fields, &lanes.offsets[lane], 8);
+      std::memcpy(fields + 8, &lanes.lengths[lane], 8);
+      decoded_packet.layers = static_cast<uint8_t>(lanes.layers[lane]);
+      decoded_packet.flags = 0;
+    }
+  }
+
+  void decodePacketsScalar(const Common::PcapPacket* packets,
+                           std::size_t number_of_packets,
+                           DecodedPacket* decoded)
+  {
+    for (std::size_t i = 0; i < number_of_packets; i++)
+      decodePacket(packets[i], decoded[i]);
+  }
+
+#if defined(__x86_64__)
+  /* The helpers of the AVX2 kernel; each 64-bit lane holds a
+  field of a packet and a mask lane is all ones or all zeros. */
+
+  __attribute__((target("avx2")))
+  inline __m256i u64(uint64_t value)
+  {
+    return _mm256_set1_epi64x(static_cast<long long>(value));
+  }
+
+  /**
+   * @brief The lanes whose value is not below the given one.
+   */
+  __attribute__((target("avx2")))
+  inline __m256i atLeast(__m256i lhs, __m256i rhs)
+  {
+    return _mm256_xor_si256(_mm256_cmpgt_epi64(rhs, lhs),
+                            _mm256_set1_epi64x(-1));
+  }
+
+  /**
+   * @brief The 16-bit big endian field starting at the given
+   * bit of the lanes.
+   */
+  __attribute__((target("avx2")))
+  inline __m256i readBigEndianU16(__m256i lanes, int bit)
+  {
+    const __m256i byte_mask = u64(0xff);
+    const __m256i high = _mm256_and_si256(
+      _mm256_srli_epi64(lanes, bit), byte_mask);
+    const __m256i low = _mm256_and_si256(
+      _mm256_srli_epi64(lanes, bit + 8), byte_mask);
+    return _mm256_or_si256(_mm256_slli_epi64(high, 8), low);
+  }
+
+  /**
+   * @brief Load 8 octets from the address of each lane whose
+   * mask is set; the other lanes are not read and give 0.
+   */
+  __attribute__((target("avx2")))
+  inline __m256i gather(__m256i addresses, __m256i mask)
+  {
+    return _mm256_mask_i64gather_epi64(
+      _mm256_setzero_si256(), static_cast<const long long*>(nullptr),
+      addresses, mask, 1);
+  }
+
+  __attribute__((target("avx2")))
+  inline void store(uint64_t* lane_values, __m256i values)
+  {
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lane_values),
+                       values);
+  }
+
+  /**
+   * @brief Classify 4 packets at a time with AVX2: the header
+   * fields of the 4 packets are gathered into the 64-bit lanes
+   * of a register and checked without branching.
+   *
+   * Every gather is masked by the captured lengths, so no lane
+   * reads beyond its packet.
+   */
+  __attribute__((target("avx2")))
+  void decodePacketsAvx2(const Common::PcapPacket* packets,
+                         std::size_t number_of_packets,
+                         DecodedPacket* decoded)
+  {
+    constexpr auto kNumberOfLanes = BurstLanes::kNumberOfLanes;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i byte_mask = u64(0xff);
+
+    BurstLanes lanes;
+    for (std::size_t first = 0; first < number_of_packets;
+         first += kNumberOfLanes)
+    {
+      const auto number_of_lanes = 
+        std::min(kNumberOfLanes, number_of_packets - first);
+      alignas(32) uint64_t addresses[kNumberOfLanes] = {};
+      alignas(32) uint64_t caplens[kNumberOfLanes] = {};
+      for (std::size_t lane = 0; lane < number_of_lanes; lane++)
+      {
+        const auto& packet = packets[first + lane];
+        addresses[lane] = 
+          reinterpret_cast<uintptr_t>(packet.get_data());
+        caplens[lane] = packet.get_data() == nullptr 
+                        ? 0 : packet.get_caplen();
+      }
+      const __m256i address = _mm256_load_si256(
+        reinterpret_cast<const __m256i*>(addresses));
+      const __m256i caplen = _mm256_load_si256(
+        reinterpret_cast<const __m256i*>(caplens));
+
+      /* octets 12-19 and 20-27: the ether type and the start
+      of the IP header */
+      const __m256i has_ip_header = atLeast(caplen, u64(28));
+      const __m256i octets_12 = gather(
+        _mm256_add_epi64(address, u64(12)), has_ip_header);
+      const __m256i octets_20 = gather(
+        _mm256_add_epi64(address, u64(20)), has_ip_header);
+
+      const __m256i ether_type = readBigEndianU16(octets_12, 0);
+      const __m256i version = _mm256_and_si256(
+        _mm256_srli_epi64(octets_12, 20), u64(0xf));
+      const __m256i ipv4_header_length = _mm256_slli_epi64(
+        _mm256_and_si256(_mm256_srli_epi64(octets_12, 16), 
+                         u64(0xf)), 2);
+      const __m256i ipv4_total_length = 
+        readBigEndianU16(octets_12, 32);
+      const __m256i ipv6_payload_length = 
+        readBigEndianU16(octets_12, 48);
+      const __m256i ipv4_fragment_field = _mm256_and_si256(
+        readBigEndianU16(octets_20, 0), u64(0x3fff));
+      const __m256i ipv4_protocol = _mm256_and_si256(
+        _mm256_srli_epi64(octets_20, 24), byte_mask);
+      const __m256i ipv6_next_header = 
+        _mm256_and_si256(octets_20, byte_mask);
+
+      const __m256i is_ipv4 = _mm256_and_si256(
+        _mm256_and_si256(
+          _mm256_cmpeq_epi64(ether_type, u64(kEtherTypeIPv4)),
+          _mm256_cmpeq_epi64(version, u64(4))),
+        _mm256_and_si256(
+          _mm256_and_si256(
+            atLeast(ipv4_header_length, u64(20)),
+            atLeast(ipv4_total_length, ipv4_header_length)),
+          _mm256_cmpeq_epi64(ipv4_fragment_field, zero)));
+      const __m256i is_ipv6 = _mm256_and_si256(
+        _mm256_and_si256(
+          _mm256_cmpeq_epi64(ether_type, u64(kEtherTypeIPv6)),
+          _mm256_cmpeq_epi64(version, u64(6))),
+        _mm256_xor_si256(
+          _mm256_cmpeq_epi64(ipv6_payload_length, zero),
+          _mm256_set1_epi64x(-1)));
+
+      const __m256i protocol = _mm256_blendv_epi8(
+        ipv6_next_header, ipv4_protocol, is_ipv4);
+      const __m256i l4_offset = _mm256_blendv_epi8(
+        u64(14 + 40), _mm256_add_epi64(ipv4_header_length, u64(14)),
+        is_ipv4);
+      const __m256i payload_end = _mm256_blendv_epi8(
+        _mm256_add_epi64(ipv6_payload_length, u64(14 + 40)),
+        _mm256_add_epi64(ipv4_total_length, u64(14)), is_ipv4);
+      const __m256i is_ip = _mm256_or_si256(is_ipv4, is_ipv6);
+
+      /* octets 8-15 of the TCP header: the data offset */
+      const __m256i is_tcp = _mm256_and_si256(
+        _mm256_and_si256(is_ip, 
+          _mm256_cmpeq_epi64(protocol, u64(kProtocolTcp))),
+        atLeast(caplen, _mm256_add_epi64(l4_offset, u64(20))));
+      const __m256i tcp_octets_8 = gather(
+        _mm256_add_epi64(_mm256_add_epi64(address, l4_offset), 
+                         u64(8)), 
+        is_tcp);
+      const __m256i tcp_header_length = _mm256_slli_epi64(
+        _mm256_and_si256(_mm256_srli_epi64(tcp_octets_8, 36), 
+                         u64(0xf)), 2);
+      const __m256i tcp_payload_offset = 
+        _mm256_add_epi64(l4_offset, tcp_header_length);
+      const __m256i is_complete_tcp = _mm256_and_si256(
+        _mm256_and_si256(is_tcp, 
+                         atLeast(tcp_header_length, u64(20))),
+        atLeast(caplen, tcp_payload_offset));
+
+      const __m256i udp_payload_offset = 
+        _mm256_add_epi64(l4_offset, u64(8));
+      const __m256i is_complete_udp = _mm256_and_si256(
+        _mm256_and_si256(is_ip, 
+          _mm256_cmpeq_epi64(protocol, u64(kProtocolUdp))),
+        atLeast(caplen, udp_payload_offset));
+
+      const __m256i is_simple = 
+        _mm256_or_si256(is_complete_tcp, is_complete_udp);
+      const __m256i payload_offset = _mm256_blendv_epi8(
+        udp_payload_offset, tcp_payload_offset, is_complete_tcp);
+      /* the payload ends at the end of the datagram or of the
+      captured octets, whichever comes first */
+      const __m256i captured_payload_end = _mm256_blendv_epi8(
+        payload_end, caplen, 
+        _mm256_cmpgt_epi64(payload_end, caplen));
+
+      store(lanes.is_simple, is_simple);
+      store(lanes.offsets, _mm256_or_si256(
+        _mm256_or_si256(ether_type, u64(14 << 16)),
+        _mm256_or_si256(_mm256_slli_epi64(l4_offset, 32),
+                        _mm256_slli_epi64(payload_offset, 48))));
+      store(lanes.lengths, _mm256_or_si256(
+        captured_payload_end, _mm256_slli_epi64(protocol, 56)));
+      store(lanes.layers, _mm256_or_si256(
+        _mm256_blendv_epi8(u64(Layer::kEthernet | Layer::kIPv6),
+                           u64(Layer::kEthernet | Layer::kIPv4),
+                           is_ipv4),
+        _mm256_blendv_epi8(u64(Layer::kUdp), u64(Layer::kTcp),
+                           is_complete_tcp)));
+
+      fillDecodedPackets(packets + first, number_of_lanes, lanes,
+                         decoded + first);
+    }
+  }
+#endif
+
+  typedef void (*DecodePacketsFunction)(const Common::PcapPacket*,
+                                        std::size_t,
+                                        DecodedPacket*);
+
+  /**
+   * @brief The vectorized kernel the CPU running the program
+   * supports (nullptr if none); the binary itself is built for
+   * the baseline ISA.
+   */
+  DecodePacketsFunction getVectorizedDecodePacketsFunction()
+  {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+      return decodePacketsAvx2;
+#endif
+    return nullptr;
+  }
+
+  const DecodePacketsFunction g_vectorized_decode_packets_function =
+    getVectorizedDecodePacketsFunction();
+
+  const DecodePacketsFunction g_decode_packets_function =
+    Common::kUseVectorizedPacketDecoder 
+    && g_vectorized_decode_packets_function != nullptr
+    ? g_vectorized_decode_packets_function : decodePacketsScalar;
+}
+
+void decodePackets(const Common::PcapPacket* packets,
+                   std::size_t number_of_packets,
+                   DecodedPacket* decoded)
+{
+  g_decode_packets_function(packets, number_of_packets, decoded);
+}
+
+bool decodePacketsVectorized(const Common::PcapPacket* packets,
+                             std::size_t number_of_packets,
+                             DecodedPacket* decoded)
+{
+  if (g_vectorized_decode_packets_function == nullptr)
+    return false;
+  g_vectorized_decode_packets_function(packets, number_of_packets,
+                                       decoded);
+  return true;
+}
+
+bool isDecodePacketsVectorized()
+{
+  return g_decode_packets_function != decodePacketsScalar;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in PacketDispatcher.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "PacketDispatcher.h"
+#include "PacketProcessing.h"
+#include <utility>
+
+PacketDispatcher::PacketDispatcher(unsigned number_of_shards,
+                                   FlowKeyFunction flow_key_function,
+                                   std::size_t shard_capacity)
+  : m_flow_key_function(flow_key_function)
+{
+  if (number_of_shards == 0)
+    number_of_shards = std::thread::hardware_concurrency();
+  /* hardware_concurrency might not be computable */
+  if (number_of_shards == 0)
+    number_of_shards = 1;
+
+  for (unsigned i = 0; i < number_of_shards; i++)
+    m_shards.push_back(
+      std::make_unique<Common::SpscPcapPacketQueue>(shard_capacity));
+  m_pending_packets.resize(number_of_shards);
+}
+
+PacketDispatcher::~PacketDispatcher()
+{
+  if (!m_processors.empty())
+  {
+    closeQueue();
+    join();
+  }
+}
+
+void PacketDispatcher::start()
+{
+  for (auto& shard : m_shards)
+    m_processors.emplace_back([&shard]()
+    {
+      while (processPackets(*shard)) {}
+    });
+}
+
+void PacketDispatcher::join()
+{
+  for (auto& processor : m_processors)
+    if (processor.joinable())
+      processor.join();
+  m_processors.clear();
+}
+
+void PacketDispatcher::pushPacket(Common::PcapPacket&& packet)
+{
+  m_shards[getShardIndex(packet)]->pushPacket(std::move(packet));
+}
+
+void PacketDispatcher::pushPackets(Common::PcapPacket* packets,
+                                   std::size_t number_of_packets)
+{
+  for (std::size_t i = 0; i < number_of_packets; i++)
+    m_pending_packets[getShardIndex(packets[i])]
+      .push_back(std::move(packets[i]));
+  pushPendingPackets();
+}
+
+void PacketDispatcher::pushDecodedPackets(
+  Common::PcapPacket* packets,
+  const DecodedPacket* decoded,
+  std::size_t number_of_packets)
+{
+  /* a custom key might need more than the headers */
+  if (m_flow_key_function 
+      != static_cast<FlowKeyFunction>(hashFiveTuple))
+  {
+    pushPackets(packets, number_of_packets);
+    return;
+  }
+  for (std::size_t i = 0; i < number_of_packets; i++)
+    m_pending_packets[hashFiveTuple(packets[i], decoded[i]) 
+                      % m_shards.size()]
+      .push_back(std::move(packets[i]));
+  pushPendingPackets();
+}
+
+void PacketDispatcher::pushPendingPackets()
+{
+  for (std::size_t shard_index = 0; 
+       shard_index < m_shards.size(); shard_index++)
+  {
+    auto& pending_packets = m_pending_packets[shard_index];
+    if (pending_packets.empty())
+      continue;
+    m_shards[shard_index]->pushPackets(pending_packets.data(),
+                                       pending_packets.size());
+    /* the capacity is kept for the next batches */
+    pending_packets.clear();
+  }
+}
+
+void PacketDispatcher::closeQueue()
+{
+  for (auto& shard : m_shards)
+    shard->closeQueue();
+}
@@ -0,0 +1,592 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in PacketFilter.h and the compiler of the filter
+ * expressions.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "PacketFilter.h"
+#include <arpa/inet.h> // inet_pton
+#include <cctype>
+#include <iostream>
+#include <memory>
+#include <utility>
+
+namespace
+{
+  constexpr uint16_t kEtherTypeArp = 0x0806;
+  constexpr uint8_t kProtocolIcmp   = 1;
+  constexpr uint8_t kProtocolTcp    = 6;
+  constexpr uint8_t kProtocolUdp    = 17;
+  constexpr uint8_t kProtocolIcmpV6 = 58;
+  constexpr uint8_t kProtocolSctp   = 132;
+
+  typedef PacketFilter::Instruction Instruction;
+  typedef PacketFilter::Opcode Opcode;
+  typedef PacketFilter::Side Side;
+
+  /**
+   * @brief A node of the parsed expression.
+   */
+  struct Node
+  {
+    enum Kind { kTest, kAnd, kOr, kNot };
+
+    Kind kind;
+    Instruction test{};
+    std::unique_ptr<Node> left;
+    std::unique_ptr<Node> right;
+  };
+
+  std::unique_ptr<Node> makeTest(Opcode opcode, uint32_t operand = 0,
+                                 Side side = Side::kSourceOrDestination)
+  {
+    auto node = std::make_unique<Node>();
+    node->kind = Node::kTest;
+    node->test.opcode = opcode;
+    node->test.side = side;
+    node->test.operand = operand;
+    return node;
+  }
+
+  std::unique_ptr<Node> makeNode(Node::Kind kind,
+                                 std::unique_ptr<Node> left,
+                                 std::unique_ptr<Node> right = {})
+  {
+    auto node = std::make_unique<Node>();
+    node->kind = kind;
+    node->left = std::move(left);
+    node->right = std::move(right);
+    return node;
+  }
+
+  /**
+   * @brief Parses a filter expression and generates its tests
+   * with their jumps.
+   */
+  class Compiler
+  {
+    private:
+      std::vector<std::string> m_tokens;
+      std::size_t m_position = 0;
+      std::string m_error;
+
+      /** position of each label; the first two are the
+       * verdicts */
+      std::vector<std::size_t> m_label_positions;
+      static constexpr uint16_t kAcceptLabel = 0;
+      static constexpr uint16_t kRejectLabel = 1;
+
+      void tokenize(const std::string& expression)
+      {
+        std::size_t i = 0;
+        while (i < expression.size())
+        {
+          const char c = expression[i];
+          if (std::isspace(static_cast<unsigned char>(c)))
+            i++;
+          else if (c == '(' || c == ')' || c == '!')
+            m_tokens.emplace_back(1, expression[i++]);
+          else if ((c == '&' || c == '|')
+                   && i + 1 < expression.size()
+                   && expression[i + 1] == c)
+          {
+            m_tokens.emplace_back(2, c);
+            i += 2;
+          }
+          else
+          {
+            auto end = i;
+            while (end < expression.size()
+                   && !std::isspace(
+                        static_cast<unsigned char>(expression[end]))
+                   && std::string("()!&|").find(expression[end])
+                      == std::string::npos)
+              end++;
+            if (end == i)
+              end++; // a lone '&' or '|'
+            m_tokens.push_back(expression.substr(i, end - i));
+            i = end;
+          }
+        }
+      }
+
+      bool isAtEnd() const { return m_position >= m_tokens.size(); }
+
+      const std::string& peek() const
+      {
+        static const std::string end_of_expression;
+        return isAtEnd() ? end_of_expression : m_tokens[m_position];
+      }
+
+      bool accept(const char* token)
+      {
+        if (isAtEnd() || m_tokens[m_position] != token)
+          return false;
+        m_position++;
+        return true;
+      }
+
+      std::nullptr_t fail(const std::string& expected)
+      {
+        if (m_error.empty())
+          m_error = "expected " + expected + " instead of "
+                    + (isAtEnd() ? std::string("the end")
+                                 : "'" + peek() + "'");
+        return nullptr;
+      }
+
+      static bool toNumber(const std::string& text,
+                           uint32_t maximum, uint32_t& number)
+      {
+        if (text.empty() || text.size() > 10)
+          return false;
+        uint64_t value = 0;
+        for (char c : text)
+        {
+          if (!std::isdigit(static_cast<unsigned char>(c)))
+            return false;
+          value = value * 10 + (c - '0');
+        }
+        if (value > maximum)
+          return false;
+        number = static_cast<uint32_t>(value);
+        return true;
+      }
+
+      bool parseNumber(uint32_t maximum, uint32_t& number)
+      {
+        if (!toNumber(peek(), maximum, number))
+          return false;
+        m_position++;
+        return true;
+      }
+
+      /**
+       * @brief Parse an address with an optional /LENGTH.
+       */
+      bool parseAddress(bool is_network,
+                        PacketFilter::AddressPrefix& prefix)
+      {
+        auto text = peek();
+        int length = -1;
+        auto slash = text.find('/');
+        if (slash != std::string::npos)
+        {
+          if (!is_network || slash + 1 == text.size()
+              || text.size() - slash > 4)
+            return false;
+          length = 0;
+          for (auto i = slash + 1; i < text.size(); i++)
+          {
+            if (!std::isdigit(static_cast<unsigned char>(text[i])))
+              return false;
+            length = length * 10 + (text[i] - '0');
+          }
+          text.resize(slash);
+        }
+        else if (is_network)
+          return false;
+
+        uint8_t address[16];
+        if (inet_pton(AF_INET, text.c_str(), address) == 1)
+        {
+          if (length > 32)
+            return false;
+          copyMappedAddress(address, 4, prefix.address);
+          prefix.length = 96 + (length < 0 ? 32 : length);
+        }
+        else if (inet_pton(AF_INET6, text.c_str(), address) == 1)
+        {
+          if (length > 128)
+            return false;
+          copyMappedAddress(address, 16, prefix.address);
+          prefix.length = length < 0 ? 128 : length;
+        }
+        else
+          return false;
+        m_position++;
+        return true;
+      }
+
+      /**
+       * @brief [src|dst] host/net/port/portrange ...
+       */
+      std::unique_ptr<Node> parseQualified(Side side)
+      {
+        if (accept("host") || accept("net"))
+        {
+          const bool is_network = m_tokens[m_position - 1] == "net";
+          PacketFilter::AddressPrefix prefix{};
+          if (!parseAddress(is_network, prefix))
+            return fail(is_network ? "an ADDRESS/LENGTH"
+                                   : "an IPv4 or IPv6 address");
+          m_address_prefixes.push_back(prefix);
+          return makeTest(Opcode::kAddress,
+                          m_address_prefixes.size() - 1, side);
+        }
+        if (accept("port"))
+        {
+          uint32_t port;
+          if (!parseNumber(0xffff, port))
+            return fail("a port number");
+          return makeTest(Opcode::kPortRange, port | port << 16,
+                          side);
+        }
+        if (accept("portrange"))
+        {
+          /* FIRST-LAST as a single token */
+          const auto& text = peek();
+          const auto dash = text.find('-');
+          uint32_t first;
+          uint32_t last;
+          if (dash == std::string::npos
+              || !toNumber(text.substr(0, dash), 0xffff, first)
+              || !toNumber(text.substr(dash + 1), 0xffff, last)
+              || first > last)
+            return fail("a port range such as 1024-2047");
+          m_position++;
+          return makeTest(Opcode::kPortRange, first | last << 16,
+                          side);
+        }
+        return fail("host, net, port or portrange");
+      }
+
+      std::unique_ptr<Node> parseProtocol(
+        std::unique_ptr<Node> ip_version)
+      {
+        uint32_t protocol;
+        if (!parseNumber(0xff, protocol))
+          return fail("a protocol number");
+        auto test = makeTest(Opcode::kProtocol, protocol);
+        if (!ip_version)
+          return test;
+        return makeNode(Node::kAnd, std::move(ip_version),
+                        std::move(test));
+      }
+
+      std::unique_ptr<Node> parsePrimitive()
+      {
+        if (accept("src"))
+          return parseQualified(Side::kSource);
+        if (accept("dst"))
+          return parseQualified(Side::kDestination);
+        if (peek() == "host" || peek() == "net" || peek() == "port"
+            || peek() == "portrange")
+          return parseQualified(Side::kSourceOrDestination);
+
+        if (accept("ip"))
+        {
+          auto ipv4 = makeTest(Opcode::kIPv4);
+          return accept("proto") ? parseProtocol(std::move(ipv4))
+                                 : std::move(ipv4);
+        }
+        if (accept("ip6"))
+        {
+          auto ipv6 = makeTest(Opcode::kIPv6);
+          return accept("proto") ? parseProtocol(std::move(ipv6))
+                                 : std::move(ipv6);
+        }
+        if (accept("proto"))
+          return parseProtocol(nullptr);
+        if (accept("arp"))
+          return makeTest(Opcode::kEtherType, kEtherTypeArp);
+        if (accept("tcp"))
+          return makeTest(Opcode::kProtocol, kProtocolTcp);
+        if (accept("udp"))
+          return makeTest(Opcode::kProtocol, kProtocolUdp);
+        if (accept("sctp"))
+          return makeTest(Opcode::kProtocol, kProtocolSctp);
+        if (accept("icmp"))
+          return makeNode(Node::kAnd, makeTest(Opcode::kIPv4),
+                          makeTest(Opcode::kProtocol, kProtocolIcmp));
+        if (accept("icmp6"))
+          return makeNode(Node::kAnd, makeTest(Opcode::kIPv6),
+                          makeTest(Opcode::kProtocol,
+                                   kProtocolIcmpV6));
+        if (accept("vlan"))
+        {
+          uint32_t vlan_id;
+          if (!isAtEnd() && std::isdigit(
+                static_cast<unsigned char>(peek()[0])))
+          {
+            if (!parseNumber(0xfff, vlan_id))
+              return fail("a VLAN ID");
+            return makeTest(Opcode::kVlanId, vlan_id);
+          }
+          return makeTest(Opcode::kVlan);
+        }
+        return fail("a primitive (e.g. host, port or tcp)");
+      }
+
+      std::unique_ptr<Node> parseUnary()
+      {
+        if (accept("not") || accept("!"))
+        {
+          auto operand = parseUnary();
+          return operand ? makeNode(Node::kNot, std::move(operand))
+                         : nullptr;
+        }
+        if (accept("("))
+        {
+          auto expression = parseOr();
+          if (!expression)
+            return nullptr;
+          if (!accept(")"))
+            return fail("')'");
+          return expression;
+        }
+        return parsePrimitive();
+      }
+
+      std::unique_ptr<Node> parseAnd()
+      {
+        auto left = parseUnary();
+        while (left && (accept("and") || accept("&&")))
+        {
+          auto right = parseUnary();
+          if (!right)
+            return nullptr;
+          left = makeNode(Node::kAnd, std::move(left),
+                          std::move(right));
+        }
+        return left;
+      }
+
+      std::unique_ptr<Node> parseOr()
+      {
+        auto left = parseAnd();
+        while (left && (accept("or") || accept("||")))
+        {
+          auto right = parseAnd();
+          if (!right)
+            return nullptr;
+          left = makeNode(Node::kOr, std::move(left),
+                          std::move(right));
+        }
+        return left;
+      }
+
+      uint16_t makeLabel()
+      {
+        m_label_positions.push_back(0);
+        return static_cast<uint16_t>(m_label_positions.size() - 1);
+      }
+
+      void bindLabel(uint16_t label)
+      {
+        m_label_positions[label] = m_instructions.size();
+      }
+
+      /**
+       * @brief Generate the tests of the node so that they end
+       * up jumping to true_label or false_label (the
+       * short-circuit evaluation of and/or).
+       */
+      void generate(const Node& node, uint16_t true_label,
+                    uint16_t false_label)
+      {
+        switch (node.kind)
+        {
+          case Node::kTest:
+          {
+            auto instruction = node.test;
+            instruction.jump_if_true = true_label;
+            instruction.jump_if_false = false_label;
+            m_instructions.push_back(instruction);
+            break;
+          }
+          case Node::kNot:
+            generate(*node.left, false_label, true_label);
+            break;
+          case Node::kAnd:
+          {
+            auto right_label = makeLabel();
+            generate(*node.left, right_label, false_label);
+            bindLabel(right_label);
+            generate(*node.right, true_label, false_label);
+            break;
+          }
+          case Node::kOr:
+          {
+            auto right_label = makeLabel();
+            generate(*node.left, true_label, right_label);
+            bindLabel(right_label);
+            generate(*node.right, true_label, false_label);
+            break;
+          }
+        }
+      }
+
+      uint16_t resolveLabel(uint16_t label) const
+      {
+        if (label == kAcceptLabel)
+          return PacketFilter::kAccept;
+        if (label == kRejectLabel)
+          return PacketFilter::kReject;
+        return static_cast<uint16_t>(m_label_positions[label]);
+      }
+
+    public:
+      std::vector<Instruction> m_instructions;
+      std::vector<PacketFilter::AddressPrefix> m_address_prefixes;
+
+      /**
+       * @return false if the expression is not valid; see
+       * get_error.
+       */
+      bool compile(const std::string& expression)
+      {
+        tokenize(expression);
+        if (m_tokens.empty())
+          return true;
+
+        auto root = parseOr();
+        if (root && !isAtEnd())
+          root = fail("and, or or the end");
+        if (!root)
+          return false;
+
+        m_label_positions = {0, 0};
+        generate(*root, kAcceptLabel, kRejectLabel);
+        if (m_instructions.size() >= PacketFilter::kAccept)
+        {
+          m_error = "the expression is too long";
+          return false;
+        }
+        for (auto& instruction : m_instructions)
+        {
+          instruction.jump_if_true =
+            resolveLabel(instruction.jump_if_true);
+          instruction.jump_if_false =
+            resolveLabel(instruction.jump_if_false);
+        }
+        return true;
+      }
+
+      const std::string& get_error() const { return m_error; }
+  };
+
+  /**
+   * @brief Whether the first "length" bits of the addresses
+   * are the same.
+   */
+  inline bool isInPrefix(const uint8_t* address,
+                         const PacketFilter::AddressPrefix& prefix)
+  {
+    const unsigned number_of_octets = prefix.length / 8;
+    if (std::memcmp(address, prefix.address, number_of_octets) != 0)
+      return false;
+    const unsigned number_of_bits = prefix.length % 8;
+    if (number_of_bits == 0)
+      return true;
+    const uint8_t mask = static_cast<uint8_t>(0xff00 >> number_of_bits);
+    return ((address[number_of_octets]
+             ^ prefix.address[number_of_octets]) & mask) == 0;
+  }
+}
+
+bool PacketFilter::fromString(const std::string& expression,
+                              PacketFilter& filter)
+{
+  Compiler compiler;
+  if (!compiler.compile(expression))
+  {
+    std::cout << "invalid filter expression \"" << expression
+      << "\": " << compiler.get_error() << std::endl;
+    return false;
+  }
+  filter = PacketFilter();
+  filter.m_expression = expression;
+  filter.m_instructions = std::move(compiler.m_instructions);
+  filter.m_address_prefixes = std::move(compiler.m_address_prefixes);
+  return true;
+}
+
+bool PacketFilter::test(const Instruction& instruction,
+                        const uint8_t* data, uint32_t caplen,
+                        const DecodedPacket& decoded) const
+{
+  const bool is_ip = decoded.has(DecodedPacket::kIPv4)
+                     || decoded.has(DecodedPacket::kIPv6);
+  switch (instruction.opcode)
+  {
+    case Opcode::kEtherType:
+      return decoded.has(DecodedPacket::kEthernet)
+             && decoded.ether_type == instruction.operand;
+    case Opcode::kIPv4:
+      return decoded.has(DecodedPacket::kIPv4);
+    case Opcode::kIPv6:
+      return decoded.has(DecodedPacket::kIPv6);
+    case Opcode::kProtocol:
+      return is_ip && decoded.protocol == instruction.operand;
+    case Opcode::kAddress:
+    {
+      if (!is_ip)
+        return false;
+      const auto& prefix = m_address_prefixes[instruction.operand];
+      uint8_t address[16];
+      if (instruction.side != Side::kDestination)
+      {
+        copyMappedAddress(decoded.get_source_address(data),
+                          decoded.get_address_length(), address);
+        if (isInPrefix(address, prefix))
+          return true;
+      }
+      if (instruction.side != Side::kSource)
+      {
+        copyMappedAddress(decoded.get_destination_address(data),
+                          decoded.get_address_length(), address);
+        if (isInPrefix(address, prefix))
+          return true;
+      }
+      return false;
+    }
+    case Opcode::kPortRange:
+    {
+      if (!decoded.has_ports(caplen))
+        return false;
+      const uint16_t first_port = instruction.operand & 0xffff;
+      const uint16_t last_port = instruction.operand >> 16;
+      auto isInRange = [first_port, last_port](uint16_t port)
+      {
+        return port >= first_port && port <= last_port;
+      };
+      return (instruction.side != Side::kDestination
+              && isInRange(decoded.get_source_port(data)))
+             || (instruction.side != Side::kSource
+                 && isInRange(decoded.get_destination_port(data)));
+    }
+    case Opcode::kVlan:
+      return decoded.number_of_vlan_tags > 0;
+    case Opcode::kVlanId:
+      return decoded.number_of_vlan_tags > 0
+             && decoded.vlan_id == instruction.operand;
+  }
+  return false;
+}
+
+bool PacketFilter::evaluate(const uint8_t* data, uint32_t caplen,
+                            const DecodedPacket& decoded) const
+{
+  if (m_instructions.empty())
+    return true;
+  /* the jumps only go forward, so this ends */
+  std::size_t position = 0;
+  while (true)
+  {
+    const auto& instruction = m_instructions[position];
+    const auto next = test(instruction, data, caplen, decoded)
+                      ? instruction.jump_if_true
+                      : instruction.jump_if_false;
+    if (next == kAccept)
+      return true;
+    if (next == kReject)
+      return false;
+    position = next;
+  }
+}
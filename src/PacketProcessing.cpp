@@ -9,57 +9,198 @@
  */
 
 #include "PacketProcessing.h"
-#include "common/PcapPacketQueue.h"
-#include "common/ExternalTime.h"
+#include "common/PcapPacketQueueSelector.h"
 #include "common/Constants.h"
-#include "PeriodicJobController.h"
+#include "ClockStage.h"
+#include "common/ExternalTime.h"
+#include "PacketDecoder.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <array>
+
+namespace
+{
+  /**
+   * @brief Prints what the TcpReassemblers deliver, like the
+   * rest of the stub processing.
+   */
+  class TcpStreamPrinter : public ITcpStreamHandler
+  {
+    public:
+      void onData(const FlowKey&, TcpDirection direction,
+                  uint64_t offset, const uint8_t*,
+                  std::size_t length) override
+      {
+        std::cout << "reassembled " << length 
+          << " octets at the offset " << offset << " of a TCP " 
+          << (direction == TcpDirection::kAToB ? "a->b" : "b->a")
+          << " stream" << std::endl;
+      }
+
+      void onGap(const FlowKey&, TcpDirection, uint64_t offset,
+                 uint64_t length) override
+      {
+        std::cout << "missing " << length 
+          << " octets at the offset " << offset 
+          << " of a TCP stream" << std::endl;
+      }
+
+      void onClose(const FlowKey&, CloseReason reason) override
+      {
+        std::cout << "a TCP connection is closed by " 
+          << (reason == CloseReason::kFin 
+              ? "FIN" : reason == CloseReason::kReset 
+                        ? "RST" : "timeout") << std::endl;
+      }
+  };
+
+  std::atomic<PcapFileWriter*> g_packet_output{nullptr};
+}
+
+void setPacketOutput(PcapFileWriter* packet_output)
+{
+  g_packet_output.store(packet_output);
+}
+
+FlowTable& getFlowTable()
+{
+  /* The flows of a processor never show up on another one, so
+  each processor thread keeps its own table. It is only mapped
+  by the threads which process packets. */
+  thread_local FlowTable t_flow_table;
+  return t_flow_table;
+}
+
+TcpReassembler& getTcpReassembler()
+{
+  static TcpStreamPrinter tcp_stream_printer;
+  thread_local TcpReassembler t_tcp_reassembler(tcp_stream_printer);
+  return t_tcp_reassembler;
+}
 
+void processPacket(Common::PcapPacket packet)
+{
+  /* The headers are decoded in place; the decoded packet only
+  holds where they are. */
+  DecodedPacket decoded;
+  decodePacket(packet, decoded);
+  processPacket(std::move(packet), decoded);
+}
 
-void processPacket(Common::PcapPacket&& packet)
+void processPacket(Common::PcapPacket packet,
+                   const DecodedPacket& decoded)
 {
+  FlowKey key;
+  bool is_from_b = false;
+  const FlowEntry* flow = nullptr;
+  if (makeFlowKey(packet.get_data(), packet.get_caplen(), decoded,
+                  key, &is_from_b))
+    flow = getFlowTable().update(key, packet.get_arrival_time_ns(),
+                                 packet.get_len());
   std::cout << "processing the packet with the arrival time of " 
-    << packet.arrival_time.tv_sec <<  std::endl;
-  destructPcapPacket(std::move(packet));
+    << Common::toSeconds(packet.get_arrival_time_ns());
+  if (decoded.has(DecodedPacket::kIPv4) 
+      || decoded.has(DecodedPacket::kIPv6))
+    std::cout << " (IPv" 
+      << (decoded.has(DecodedPacket::kIPv4) ? 4 : 6) 
+      << ", protocol " << static_cast<unsigned>(decoded.protocol)
+      << ", " << decoded.get_payload_length() 
+      << " octets of payload)";
+  if (flow != nullptr)
+    std::cout << ", packet #" << flow->number_of_packets 
+      << " of its flow";
+  std::cout << std::endl;
+
+  /* Only the connections of the flows in the table are
+  reassembled, so that they go idle together. */
+  if (flow != nullptr && decoded.has(DecodedPacket::kTcp))
+    getTcpReassembler().processSegment(
+      key, is_from_b ? TcpDirection::kBToA : TcpDirection::kAToB,
+      packet.get_data(), decoded);
+
+  /* The data is copied into the buffers of the writer; the
+  packet is still released when this function returns. */
+  if (auto* packet_output = 
+        g_packet_output.load(std::memory_order_relaxed))
+    packet_output->writePacket(packet);
 }
 
-void processPackets()
+bool processPackets()
 {
-  unsigned number_of_packets_processed = 0;
-  while( true )
+  return processPackets(Common::getPcapPacketQueue());
+}
+
+bool processPackets(Common::IPcapPacketQueue& queue)
+{
+  /* The arrival time of the newest packet this thread has
+  seen. The clock stage is only touched by the packets moving
+  it forward instead of by every packet. */
+  thread_local Common::Nanoseconds t_last_arrival_time_ns = -1;
+
+  /* Pop all the packets of this call at once to pay for the
+  queue synchronization once per batch instead of per packet.
+  Park (instead of spinning) while the queue is empty. */
+  std::array<Common::PcapPacket, 
+             Common::kMaxNumberOfPacketsToProcess> packets;
+  auto number_of_packets = 
+    queue.waitAndPopPackets(packets.data(), packets.size());
+
+  /* the writer has signaled the end of stream; what is left
+  of the TCP streams is delivered */
+  if (number_of_packets == 0)
+  {
+    getTcpReassembler().closeAllStreams();
+    return false;
+  }
+
+  /* The headers are decoded a burst at a time (vectorized if
+  the CPU allows it) rather than packet by packet; a burst of
+  decoded packets stays in the L1 cache until it is processed.
+  */
+  std::array<DecodedPacket, Common::kPacketDecoderBurstSize> 
+    decoded_packets;
+  for (std::size_t i = 0; i < number_of_packets; i++)
   {
-    auto packet = Common::PcapPacketQueue::getInstance().popPacket();
-    
-    /* if the queue was empty, then nothing to process */
-    if (packet.arrival_time.tv_sec == 0 
-        && packet.arrival_time.tv_usec == 0) 
-      continue;
-
-    if ( Common::ExternalTime::getInstance().get_current_time().tv_sec 
-                                        != packet.arrival_time.tv_sec)
+    const auto burst_index = i % decoded_packets.size();
+    if (burst_index == 0)
+      decodePackets(packets.data() + i, 
+                    std::min(decoded_packets.size(), 
+                             number_of_packets - i),
+                    decoded_packets.data());
+
+    auto& packet = packets[i];
+    const auto arrival_time_ns = packet.get_arrival_time_ns();
+    /* Setting system-wide time to that of external one (to
+    the one obtained from the latest pcap packet). The clock
+    stage moves the time (running the jobs and adding the jobs
+    of a new second) on its own thread, so the packet loop is
+    not held up by them. */
+    if (arrival_time_ns > t_last_arrival_time_ns)
     {
-      /* Setting system-wide time to that of external one (to
-      the one obtained from the latest pcap packet */
-      Common::ExternalTime::getInstance().
-        set_current_time(packet.arrival_time);
-
-      /* Calling onNewTime method of our PeriodicJobController
-      so that necessary PeriodicJobs are run. We can use the
-      returned job ids from this method to delete the added the
-      jobs if desired. */
-      auto added_job_ids = 
-        g_ptr_periodic_class_controller_instance->onNewTime();
-      std::cout << "newly added job ids on time "
-        << packet.arrival_time.tv_sec << " are: " << std::endl; 
-      for(auto id: added_job_ids)
-        std::cout << id << std::endl;
+      t_last_arrival_time_ns = arrival_time_ns;
+      ClockStage::getInstance().publish(arrival_time_ns);
     }
      
-    /* Packet is destructed in this function after processing
-    it, so move semantics is used. */
-    processPacket(std::move(packet));
-    number_of_packets_processed++;
-    if(number_of_packets_processed >= Common::kMaxNumberOfPacketsToProcess)
-      break;
+    /* The packet (and its data) is released when processing
+    it is done, so move semantics is used. */
+    processPacket(std::move(packet), decoded_packets[burst_index]);
   }
-}
\ No newline at end of file
+
+  /* Sweep a part of the flow table for the flows idle as of the
+  external time (i.e. of the packets rather than of the wall
+  clock). */
+  getFlowTable().evictIdleFlows(
+    Common::ExternalTime::getInstance().get_current_time_ns(),
+    Common::kFlowIdleTimeoutNanoseconds,
+    Common::kFlowTableEvictionScanSize,
+    [](const FlowEntry& flow)
+    {
+      getTcpReassembler().closeStream(flow.key);
+      std::cout << "evicting an idle flow of " 
+        << flow.number_of_packets << " packets (" 
+        << flow.number_of_octets << " octets) last seen at "
+        << Common::toSeconds(flow.get_last_seen_ns()) << std::endl;
+    });
+  return true;
+}
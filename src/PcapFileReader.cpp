@@ -0,0 +1,188 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in PcapFileReader.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "PcapFileReader.h"
+#include <iostream>
+#include <cstring> // memcpy
+
+#include <fcntl.h>    // open
+#include <unistd.h>   // close
+#include <sys/mman.h> // mmap, madvise
+#include <sys/stat.h> // fstat
+
+namespace
+{
+  /* Magic numbers of the classic pcap global header as they are
+  read in host byte order. */
+  constexpr uint32_t kPcapMagicMicroseconds        = 0xa1b2c3d4;
+  constexpr uint32_t kPcapMagicNanoseconds         = 0xa1b23c4d;
+  constexpr uint32_t kPcapMagicMicrosecondsSwapped = 0xd4c3b2a1;
+  constexpr uint32_t kPcapMagicNanosecondsSwapped  = 0x4d3cb2a1;
+
+  constexpr std::size_t kPcapGlobalHeaderLength = 24;
+  constexpr std::size_t kPcapRecordHeaderLength = 16;
+}
+
+PcapFileReader::~PcapFileReader()
+{
+  close();
+}
+
+void PcapFileReader::close()
+{
+  if (m_begin != nullptr)
+    munmap(const_cast<uint8_t*>(m_begin), m_size);
+  m_begin  = nullptr;
+  m_size   = 0;
+  m_offset = 0;
+}
+
+uint32_t PcapFileReader::readU32(std::size_t offset) const
+{
+  uint32_t value;
+  /* records are not necessarily 4-octet aligned in the file */
+  std::memcpy(&value, m_begin + offset, sizeof(value));
+  return m_is_byte_swapped ? __builtin_bswap32(value) : value;
+}
+
+bool PcapFileReader::open(const std::string& file_path)
+{
+  close();
+
+  int fd = ::open(file_path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cout << "could not open the pcap file "
+      << file_path << std::endl;
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0
+      || static_cast<std::size_t>(file_stat.st_size)
+         < kPcapGlobalHeaderLength)
+  {
+    std::cout << "the pcap file " << file_path
+      << " is too small to be a pcap file" << std::endl;
+    ::close(fd);
+    return false;
+  }
+
+  std::size_t size = file_stat.st_size;
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE,
+                       fd, 0);
+  /* the mapping stays valid after closing the descriptor */
+  ::close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    std::cout << "could not map the pcap file "
+      << file_path << std::endl;
+    return false;
+  }
+
+  /* The file is walked once from the beginning to the end; let
+  the kernel read ahead aggressively. */
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  madvise(mapping, size, MADV_WILLNEED);
+
+  m_begin = static_cast<const uint8_t*>(mapping);
+  m_size  = size;
+
+  uint32_t magic;
+  std::memcpy(&magic, m_begin, sizeof(magic));
+  switch (magic)
+  {
+    case kPcapMagicMicroseconds:
+      m_is_byte_swapped = false;
+      m_is_nanosecond_resolution = false;
+      break;
+    case kPcapMagicNanoseconds:
+      m_is_byte_swapped = false;
+      m_is_nanosecond_resolution = true;
+      break;
+    case kPcapMagicMicrosecondsSwapped:
+      m_is_byte_swapped = true;
+      m_is_nanosecond_resolution = false;
+      break;
+    case kPcapMagicNanosecondsSwapped:
+      m_is_byte_swapped = true;
+      m_is_nanosecond_resolution = true;
+      break;
+    default:
+      std::cout << file_path
+        << " is not a classic pcap file" << std::endl;
+      close();
+      return false;
+  }
+
+  /* magic(4) version_major(2) version_minor(2) thiszone(4)
+  sigfigs(4) snaplen(4) network(4) */
+  m_snaplen   = readU32(16);
+  m_link_type = readU32(20);
+  m_offset    = kPcapGlobalHeaderLength;
+  return true;
+}
+
+bool PcapFileReader::nextPacket(Common::PcapPacket& packet)
+{
+  if (m_begin == nullptr
+      || m_size - m_offset < kPcapRecordHeaderLength)
+    return false;
+
+  /* ts_sec(4) ts_usec/ts_nsec(4) incl_len(4) orig_len(4) */
+  uint32_t ts_sec   = readU32(m_offset);
+  uint32_t ts_frac  = readU32(m_offset + 4);
+  uint32_t incl_len = readU32(m_offset + 8);
+  uint32_t orig_len = readU32(m_offset + 12);
+
+  std::size_t data_offset = m_offset + kPcapRecordHeaderLength;
+  if (m_size - data_offset < incl_len)
+  {
+    std::cout << "the last record of the pcap file is truncated"
+      << std::endl;
+    m_offset = m_size;
+    return false;
+  }
+
+  int64_t arrival_time_ns = static_cast<int64_t>(ts_sec) 
+                            * 1000000000
+                            + (m_is_nanosecond_resolution
+                               ? ts_frac : ts_frac * 1000LL);
+  packet = Common::PcapPacket(
+    arrival_time_ns, const_cast<uint8_t*>(m_begin + data_offset),
+    incl_len, orig_len, Common::PcapPacketDataOwner::kMappedFile);
+
+  m_offset = data_offset + incl_len;
+  return true;
+}
+
+PcapReaderPosition PcapFileReader::get_position() const
+{
+  PcapReaderPosition position;
+  position.offset = m_offset;
+  return position;
+}
+
+bool PcapFileReader::seek(const PcapReaderPosition& position)
+{
+  /* the records are only walked forward from the offset; a
+  bogus offset is caught by the checks of nextPacket */
+  if (m_begin == nullptr || position.offset < kPcapGlobalHeaderLength
+      || position.offset > m_size)
+    return false;
+  m_offset = position.offset;
+  return true;
+}
+
+void PcapFileReader::rewind()
+{
+  if (m_begin != nullptr)
+    m_offset = kPcapGlobalHeaderLength;
+}
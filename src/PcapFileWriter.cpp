@@ -0,0 +1,509 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in PcapFileWriter.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "PcapFileWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits> // IOV_MAX
+#include <cstdio>  // snprintf
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new> // bad_alloc
+#include <sys/uio.h> // writev
+#include <unistd.h>
+
+namespace
+{
+  constexpr uint32_t kPcapMagicNanoseconds = 0xa1b23c4d;
+
+  constexpr uint32_t kPcapngSectionHeaderBlockType = 0x0a0d0d0a;
+  constexpr uint32_t kPcapngInterfaceDescriptionBlockType = 1;
+  constexpr uint32_t kPcapngEnhancedPacketBlockType = 6;
+  constexpr uint32_t kPcapngByteOrderMagic = 0x1a2b3c4d;
+  constexpr uint16_t kPcapngOptionIfTsresol = 9;
+
+  /** the buffers are aligned like the pages so that the kernel
+   * copies them from whole pages */
+  constexpr std::size_t kBufferAlignment = 4096;
+
+  static_assert(Common::kPcapWriterBufferSize
+                >= 32 + Common::kPcapWriterSnaplen + 3,
+                "a record of the snaplen must fit a buffer");
+
+  void putU16(uint8_t*& position, uint16_t value)
+  {
+    std::memcpy(position, &value, sizeof(value));
+    position += sizeof(value);
+  }
+
+  void putU32(uint8_t*& position, uint32_t value)
+  {
+    std::memcpy(position, &value, sizeof(value));
+    position += sizeof(value);
+  }
+}
+
+PcapFileWriter::~PcapFileWriter()
+{
+  close();
+}
+
+PcapFileWriter::Format PcapFileWriter::getFormat(
+  const std::string& file_path)
+{
+  const std::string extension = ".pcapng";
+  if (file_path.size() >= extension.size()
+      && file_path.compare(file_path.size() - extension.size(),
+                           extension.size(), extension) == 0)
+    return Format::kPcapng;
+  return Format::kPcap;
+}
+
+void PcapFileWriter::set_rotation(uint64_t max_file_size,
+                                  Common::Nanoseconds file_period_ns)
+{
+  m_max_file_size = max_file_size;
+  m_file_period_ns = std::max<Common::Nanoseconds>(file_period_ns,
+                                                   0);
+}
+
+std::string PcapFileWriter::get_file_path(uint64_t file_index) const
+{
+  if (m_max_file_size == 0 && m_file_period_ns == 0)
+    return m_file_path;
+
+  /* the sequence number goes before the extension, if any */
+  auto extension_position = m_file_path.rfind('.');
+  auto directory_position = m_file_path.rfind('/');
+  if (extension_position == std::string::npos
+      || (directory_position != std::string::npos
+          && extension_position < directory_position))
+    extension_position = m_file_path.size();
+  char sequence_number[32];
+  std::snprintf(sequence_number, sizeof(sequence_number), "_%05llu",
+                static_cast<unsigned long long>(file_index));
+  return m_file_path.substr(0, extension_position) + sequence_number
+         + m_file_path.substr(extension_position);
+}
+
+thread_local PcapFileWriter::ThreadBuffer
+  PcapFileWriter::t_thread_buffer;
+
+bool PcapFileWriter::open(const std::string& file_path,
+                          Format format, uint32_t link_type)
+{
+  close();
+  m_file_path = file_path;
+  m_format = format;
+  m_link_type = link_type;
+  m_has_failed = false;
+  m_number_of_octets = 0;
+  if (!openFile(0))
+    return false;
+
+  static std::atomic<uint64_t> s_number_of_sessions{0};
+  m_session = ++s_number_of_sessions;
+  uint8_t header[64];
+  const auto header_size = formatFileHeader(header);
+  m_buffer_capacity = Common::kPcapWriterBufferSize;
+  if (m_max_file_size > header_size)
+    m_buffer_capacity = std::min<uint64_t>(
+      m_buffer_capacity, m_max_file_size - header_size);
+
+  m_free_buffers.clear();
+  m_held_buffers.clear();
+  m_filled_buffers.clear();
+  for (auto& buffer : m_buffers)
+    m_free_buffers.push_back(buffer.get());
+  m_number_of_unwritten_buffers = 0;
+
+  m_file_index = 0;
+  m_file_size = header_size;
+  m_number_of_file_packets = 0;
+  m_file_end_ns = 0;
+  m_number_of_files = 1;
+  m_number_of_packets = 0;
+  m_number_of_stalls = 0;
+  m_should_stop_running = false;
+  m_is_open = true;
+  m_thread = std::thread(&PcapFileWriter::writeBuffers, this);
+  return true;
+}
+
+void PcapFileWriter::close()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (!m_is_open)
+    return;
+  m_is_open = false;
+  /* the threads have stopped writing, so their buffers can be
+  queued from here */
+  while (!m_held_buffers.empty())
+    queueBuffer(m_held_buffers.back());
+  m_should_stop_running = true;
+  m_buffer_filled.notify_one();
+  lock.unlock();
+
+  m_thread.join();
+  closeFile();
+}
+
+PcapFileWriter::Buffer* PcapFileWriter::takeBuffer(
+  std::unique_lock<std::mutex>& lock)
+{
+  if (m_free_buffers.empty() && m_number_of_unwritten_buffers
+                                >= Common::kPcapWriterNumberOfBuffers)
+  {
+    m_number_of_stalls++;
+    m_buffer_written.wait(lock, [this]()
+    {
+      return !m_free_buffers.empty();
+    });
+  }
+
+  Buffer* buffer;
+  if (!m_free_buffers.empty())
+  {
+    buffer = m_free_buffers.back();
+    m_free_buffers.pop_back();
+  }
+  else
+  {
+    void* data = nullptr;
+    if (posix_memalign(&data, kBufferAlignment,
+                       Common::kPcapWriterBufferSize) != 0)
+      throw std::bad_alloc();
+    m_buffers.push_back(std::make_unique<Buffer>());
+    buffer = m_buffers.back().get();
+    buffer->data.reset(static_cast<uint8_t*>(data));
+  }
+  buffer->size = 0;
+  buffer->number_of_packets = 0;
+  buffer->period_end_ns = 0;
+  m_held_buffers.push_back(buffer);
+  return buffer;
+}
+
+void PcapFileWriter::queueBuffer(Buffer* buffer)
+{
+  m_held_buffers.erase(std::find(m_held_buffers.begin(),
+                                 m_held_buffers.end(), buffer));
+  if (buffer->number_of_packets == 0)
+  {
+    m_free_buffers.push_back(buffer);
+    return;
+  }
+
+  /* A buffer of an earlier period (of a processor running
+  late) still goes into the current file. */
+  bool should_start_file = false;
+  if (m_number_of_file_packets > 0)
+  {
+    if (m_file_period_ns > 0 && buffer->period_end_ns > m_file_end_ns)
+      should_start_file = true;
+    if (m_max_file_size > 0
+        && m_file_size + buffer->size > m_max_file_size)
+      should_start_file = true;
+  }
+  if (should_start_file)
+  {
+    uint8_t header[64];
+    m_file_index++;
+    m_number_of_files++;
+    m_file_size = formatFileHeader(header);
+    m_number_of_file_packets = 0;
+  }
+  m_file_end_ns = std::max(m_file_end_ns, buffer->period_end_ns);
+  buffer->file_index = m_file_index;
+  m_file_size += buffer->size;
+  m_number_of_file_packets += buffer->number_of_packets;
+  m_number_of_packets += buffer->number_of_packets;
+
+  m_filled_buffers.push_back(buffer);
+  m_number_of_unwritten_buffers++;
+  m_buffer_filled.notify_one();
+}
+
+PcapFileWriter::Buffer* PcapFileWriter::handOff(Buffer* buffer)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  queueBuffer(buffer);
+  return takeBuffer(lock);
+}
+
+std::size_t PcapFileWriter::formatFileHeader(uint8_t* header) const
+{
+  uint8_t* position = header;
+  if (m_format == Format::kPcap)
+  {
+    /* magic(4) version_major(2) version_minor(2) thiszone(4)
+    sigfigs(4) snaplen(4) network(4) */
+    putU32(position, kPcapMagicNanoseconds);
+    putU16(position, 2);
+    putU16(position, 4);
+    putU32(position, 0);
+    putU32(position, 0);
+    putU32(position, Common::kPcapWriterSnaplen);
+    putU32(position, m_link_type);
+  }
+  else
+  {
+    /* Section Header Block: type(4) length(4) byte-order
+    magic(4) major(2) minor(2) section length(8) length(4) */
+    putU32(position, kPcapngSectionHeaderBlockType);
+    putU32(position, 28);
+    putU32(position, kPcapngByteOrderMagic);
+    putU16(position, 1);
+    putU16(position, 0);
+    putU32(position, 0xffffffff); // unknown section length
+    putU32(position, 0xffffffff);
+    putU32(position, 28);
+    /* Interface Description Block: type(4) length(4) link
+    type(2) reserved(2) snaplen(4) if_tsresol of 10^-9 seconds
+    (8) end of options (4) length(4) */
+    putU32(position, kPcapngInterfaceDescriptionBlockType);
+    putU32(position, 32);
+    putU16(position, static_cast<uint16_t>(m_link_type));
+    putU16(position, 0);
+    putU32(position, Common::kPcapWriterSnaplen);
+    putU16(position, kPcapngOptionIfTsresol);
+    putU16(position, 1);
+    putU32(position, 9); // 9 and 3 octets of padding
+    putU32(position, 0);
+    putU32(position, 32);
+  }
+  return position - header;
+}
+
+uint32_t PcapFileWriter::getRecordSize(uint32_t caplen) const
+{
+  if (m_format == Format::kPcap)
+    return 16 + caplen;
+  return 32 + caplen + (4 - caplen % 4) % 4;
+}
+
+void PcapFileWriter::formatRecord(Buffer& buffer,
+                                  const Common::PcapPacket& packet,
+                                  uint32_t caplen,
+                                  uint32_t record_size) const
+{
+  const auto arrival_time_ns = packet.get_arrival_time_ns();
+  uint8_t* position = buffer.data.get() + buffer.size;
+  buffer.size += record_size;
+  if (m_format == Format::kPcap)
+  {
+    /* ts_sec(4) ts_nsec(4) caplen(4) len(4) */
+    putU32(position, static_cast<uint32_t>(
+      arrival_time_ns / Common::kNanosecondsPerSecond));
+    putU32(position, static_cast<uint32_t>(
+      arrival_time_ns % Common::kNanosecondsPerSecond));
+    putU32(position, caplen);
+    putU32(position, packet.get_len());
+    std::memcpy(position, packet.get_data(), caplen);
+    return;
+  }
+
+  /* Enhanced Packet Block: type(4) length(4) interface(4)
+  timestamp high(4) timestamp low(4) caplen(4) len(4) data
+  (padded to 4) length(4) */
+  const auto timestamp = static_cast<uint64_t>(arrival_time_ns);
+  putU32(position, kPcapngEnhancedPacketBlockType);
+  putU32(position, record_size);
+  putU32(position, 0);
+  putU32(position, static_cast<uint32_t>(timestamp >> 32));
+  putU32(position, static_cast<uint32_t>(timestamp));
+  putU32(position, caplen);
+  putU32(position, packet.get_len());
+  std::memcpy(position, packet.get_data(), caplen);
+  position += caplen;
+  const auto padding = record_size - 32 - caplen;
+  std::memset(position, 0, padding);
+  position += padding;
+  putU32(position, record_size);
+}
+
+void PcapFileWriter::writePacket(const Common::PcapPacket& packet)
+{
+  if (!m_is_open.load(std::memory_order_relaxed))
+    return;
+  auto& thread_buffer = t_thread_buffer;
+  if (thread_buffer.session != m_session
+      || thread_buffer.buffer == nullptr)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    thread_buffer.buffer = takeBuffer(lock);
+    thread_buffer.session = m_session;
+  }
+
+  /* longer records would not fit a buffer and are not valid
+  for the snaplen of the files anyway */
+  const uint32_t caplen = std::min(packet.get_caplen(),
+                                   Common::kPcapWriterSnaplen);
+  const auto record_size = getRecordSize(caplen);
+
+  /* split by the packet time: the files cover the multiples of
+  the period */
+  Common::Nanoseconds period_end_ns = 0;
+  if (m_file_period_ns > 0)
+  {
+    const auto arrival_time_ns = packet.get_arrival_time_ns();
+    period_end_ns = arrival_time_ns
+                    - arrival_time_ns % m_file_period_ns;
+    if (arrival_time_ns % m_file_period_ns < 0)
+      period_end_ns -= m_file_period_ns;
+    period_end_ns += m_file_period_ns;
+  }
+
+  auto* buffer = thread_buffer.buffer;
+  if (buffer->number_of_packets > 0
+      && (buffer->period_end_ns != period_end_ns
+          || buffer->size + record_size > m_buffer_capacity))
+  {
+    buffer = handOff(buffer);
+    thread_buffer.buffer = buffer;
+  }
+  buffer->period_end_ns = period_end_ns;
+  formatRecord(*buffer, packet, caplen, record_size);
+  buffer->number_of_packets++;
+}
+
+void PcapFileWriter::writeBuffers()
+{
+  std::vector<Buffer*> buffers;
+  while (true)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_buffer_filled.wait(lock, [this]()
+    {
+      return !m_filled_buffers.empty() || m_should_stop_running;
+    });
+    if (m_filled_buffers.empty())
+      return;
+
+    /* everything filled so far goes with as few system calls
+    as possible */
+    buffers.assign(m_filled_buffers.begin(), m_filled_buffers.end());
+    m_filled_buffers.clear();
+    lock.unlock();
+
+    writeToFiles(buffers);
+
+    lock.lock();
+    for (auto* buffer : buffers)
+      m_free_buffers.push_back(buffer);
+    m_number_of_unwritten_buffers -= buffers.size();
+    m_buffer_written.notify_all();
+  }
+}
+
+void PcapFileWriter::writeToFiles(const std::vector<Buffer*>& buffers)
+{
+  std::vector<struct iovec> iovecs;
+  std::size_t first = 0;
+  while (first < buffers.size() && !m_has_failed)
+  {
+    /* the buffers of the same file in a single writev */
+    const auto file_index = buffers[first]->file_index;
+    if (file_index != m_fd_file_index)
+    {
+      closeFile();
+      if (!openFile(file_index))
+        return;
+    }
+    iovecs.clear();
+    auto last = first;
+    while (last < buffers.size() && iovecs.size() < IOV_MAX
+           && buffers[last]->file_index == file_index)
+    {
+      iovecs.push_back({buffers[last]->data.get(),
+                        buffers[last]->size});
+      last++;
+    }
+    first = last;
+
+    auto* iovec = iovecs.data();
+    auto number_of_iovecs = iovecs.size();
+    while (number_of_iovecs > 0)
+    {
+      auto written = writev(m_fd, iovec, number_of_iovecs);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written < 0)
+      {
+        std::cout << "could not write into "
+          << get_file_path(m_fd_file_index) << ": "
+          << std::strerror(errno) << std::endl;
+        m_has_failed = true;
+        return;
+      }
+      m_number_of_octets += written;
+      /* skip what is written of a partial write */
+      while (number_of_iovecs > 0
+             && static_cast<std::size_t>(written) >= iovec->iov_len)
+      {
+        written -= iovec->iov_len;
+        iovec++;
+        number_of_iovecs--;
+      }
+      if (number_of_iovecs > 0)
+      {
+        iovec->iov_base = static_cast<uint8_t*>(iovec->iov_base)
+                          + written;
+        iovec->iov_len -= written;
+      }
+    }
+  }
+}
+
+bool PcapFileWriter::openFile(uint64_t file_index)
+{
+  const auto file_path = get_file_path(file_index);
+  m_fd = ::open(file_path.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (m_fd < 0)
+  {
+    std::cout << "could not create the capture file " << file_path
+      << ": " << std::strerror(errno) << std::endl;
+    m_has_failed = true;
+    return false;
+  }
+  m_fd_file_index = file_index;
+
+  uint8_t header[64];
+  const auto header_size = formatFileHeader(header);
+  std::size_t written_size = 0;
+  while (written_size < header_size)
+  {
+    auto written = ::write(m_fd, header + written_size,
+                           header_size - written_size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written < 0)
+    {
+      std::cout << "could not write into " << file_path << ": "
+        << std::strerror(errno) << std::endl;
+      m_has_failed = true;
+      return false;
+    }
+    written_size += written;
+  }
+  m_number_of_octets += header_size;
+  return true;
+}
+
+void PcapFileWriter::closeFile()
+{
+  if (m_fd >= 0)
+  {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
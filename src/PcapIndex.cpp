@@ -0,0 +1,292 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in PcapIndex.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "PcapIndex.h"
+#include "PcapReaderFactory.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>  // rename
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <limits>
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  constexpr char kIndexMagic[8] = {'P', 'C', 'A', 'P', 'I', 'D', 'X',
+                                   '\0'};
+  constexpr uint32_t kIndexVersion = 1;
+
+  /**
+   * @brief The beginning of an index file; followed by the
+   * checkpoints. Written in host byte order, so an index moved
+   * to a host of the other byte order is rebuilt.
+   */
+  struct IndexHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t checkpoint_size;
+    /** of the capture file the index is built for */
+    uint64_t capture_size;
+    int64_t capture_modification_time_ns;
+    uint64_t number_of_packets;
+    uint64_t number_of_checkpoints;
+    uint32_t packet_interval;
+    uint32_t reserved;
+  };
+
+  static_assert(sizeof(IndexHeader) % alignof(PcapIndex::Checkpoint)
+                == 0, "the checkpoints must be aligned");
+
+  bool getFileStatus(const std::string& file_path,
+                     uint64_t& size,
+                     Common::Nanoseconds& modification_time_ns)
+  {
+    struct stat file_stat;
+    if (stat(file_path.c_str(), &file_stat) != 0)
+      return false;
+    size = file_stat.st_size;
+    modification_time_ns =
+      static_cast<Common::Nanoseconds>(file_stat.st_mtim.tv_sec)
+      * Common::kNanosecondsPerSecond + file_stat.st_mtim.tv_nsec;
+    return true;
+  }
+
+  bool writeAll(int fd, const void* data, std::size_t length)
+  {
+    const auto* octets = static_cast<const uint8_t*>(data);
+    while (length > 0)
+    {
+      auto written = ::write(fd, octets, length);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written < 0)
+        return false;
+      octets += written;
+      length -= written;
+    }
+    return true;
+  }
+}
+
+PcapIndex::~PcapIndex()
+{
+  close();
+}
+
+void PcapIndex::close()
+{
+  if (m_mapping != nullptr)
+    munmap(const_cast<uint8_t*>(m_mapping), m_mapping_size);
+  m_mapping = nullptr;
+  m_mapping_size = 0;
+  m_checkpoints = nullptr;
+  m_number_of_checkpoints = 0;
+  m_number_of_packets = 0;
+}
+
+bool PcapIndex::build(const std::string& capture_path,
+                      const std::string& index_path,
+                      uint32_t packet_interval)
+{
+  IndexHeader header{};
+  std::memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+  header.version = kIndexVersion;
+  header.checkpoint_size = sizeof(Checkpoint);
+  header.packet_interval = std::max<uint32_t>(packet_interval, 1);
+  /* taken before reading so that a capture still being written
+  makes the index stale rather than incomplete */
+  if (!getFileStatus(capture_path, header.capture_size,
+                     header.capture_modification_time_ns))
+  {
+    std::cout << "could not find the capture file " << capture_path
+      << std::endl;
+    return false;
+  }
+  auto reader = openPcapReader(capture_path);
+  if (!reader)
+    return false;
+
+  std::vector<Checkpoint> checkpoints;
+  auto max_time_ns = std::numeric_limits<Common::Nanoseconds>::min();
+  Common::PcapPacket packet;
+  while (true)
+  {
+    const auto position = reader->get_position();
+    if (!reader->nextPacket(packet))
+      break;
+    if (header.number_of_packets % header.packet_interval == 0)
+      checkpoints.push_back(
+        {position, header.number_of_packets, max_time_ns,
+         std::numeric_limits<Common::Nanoseconds>::max()});
+    const auto arrival_time_ns = packet.get_arrival_time_ns();
+    max_time_ns = std::max(max_time_ns, arrival_time_ns);
+    auto& min_time_ns = checkpoints.back().min_time_from_ns;
+    min_time_ns = std::min(min_time_ns, arrival_time_ns);
+    header.number_of_packets++;
+  }
+  /* so far the earliest time of the packets up to the next
+  checkpoint */
+  for (auto i = checkpoints.size(); i-- > 1;)
+    checkpoints[i - 1].min_time_from_ns =
+      std::min(checkpoints[i - 1].min_time_from_ns,
+               checkpoints[i].min_time_from_ns);
+  header.number_of_checkpoints = checkpoints.size();
+
+  const auto temporary_path = index_path + ".tmp";
+  int fd = ::open(temporary_path.c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool is_written = fd >= 0
+    && writeAll(fd, &header, sizeof(header))
+    && writeAll(fd, checkpoints.data(),
+                checkpoints.size() * sizeof(Checkpoint));
+  if (fd >= 0)
+    is_written = ::close(fd) == 0 && is_written;
+  if (!is_written
+      || std::rename(temporary_path.c_str(), index_path.c_str()) != 0)
+  {
+    std::cout << "could not write the index " << index_path << ": "
+      << std::strerror(errno) << std::endl;
+    unlink(temporary_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool PcapIndex::open(const std::string& index_path,
+                     const std::string& capture_path)
+{
+  close();
+  uint64_t capture_size;
+  Common::Nanoseconds capture_modification_time_ns;
+  if (!getFileStatus(capture_path, capture_size,
+                     capture_modification_time_ns))
+    return false;
+
+  int fd = ::open(index_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0
+      || static_cast<std::size_t>(file_stat.st_size)
+         < sizeof(IndexHeader))
+  {
+    ::close(fd);
+    return false;
+  }
+  std::size_t size = file_stat.st_size;
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  /* the mapping stays valid after closing the descriptor */
+  ::close(fd);
+  if (mapping == MAP_FAILED)
+    return false;
+  m_mapping = static_cast<const uint8_t*>(mapping);
+  m_mapping_size = size;
+
+  IndexHeader header;
+  std::memcpy(&header, m_mapping, sizeof(header));
+  if (std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0
+      || header.version != kIndexVersion
+      || header.checkpoint_size != sizeof(Checkpoint)
+      || header.capture_size != capture_size
+      || header.capture_modification_time_ns
+         != capture_modification_time_ns
+      || header.number_of_checkpoints
+         != (size - sizeof(IndexHeader)) / sizeof(Checkpoint)
+      || (size - sizeof(IndexHeader)) % sizeof(Checkpoint) != 0)
+  {
+    close();
+    return false;
+  }
+  m_checkpoints = reinterpret_cast<const Checkpoint*>(
+    m_mapping + sizeof(IndexHeader));
+  m_number_of_checkpoints = header.number_of_checkpoints;
+  m_number_of_packets = header.number_of_packets;
+  return true;
+}
+
+bool PcapIndex::openOrBuild(const std::string& capture_path)
+{
+  const auto index_path = getIndexPath(capture_path);
+  if (open(index_path, capture_path))
+    return true;
+  std::cout << "building the index " << index_path << std::endl;
+  return build(capture_path, index_path)
+         && open(index_path, capture_path);
+}
+
+const PcapIndex::Checkpoint* PcapIndex::findStart(
+  Common::Nanoseconds start_ns) const
+{
+  if (m_number_of_checkpoints == 0)
+    return nullptr;
+  const auto* end = m_checkpoints + m_number_of_checkpoints;
+  const auto* checkpoint = std::partition_point(
+    m_checkpoints, end, [start_ns](const Checkpoint& checkpoint)
+    {
+      return checkpoint.max_time_before_ns < start_ns;
+    });
+  /* the first checkpoint has no packets before it */
+  return checkpoint == m_checkpoints ? m_checkpoints : checkpoint - 1;
+}
+
+const PcapIndex::Checkpoint* PcapIndex::findEnd(
+  Common::Nanoseconds end_ns) const
+{
+  const auto* end = m_checkpoints + m_number_of_checkpoints;
+  const auto* checkpoint = std::partition_point(
+    m_checkpoints, end, [end_ns](const Checkpoint& checkpoint)
+    {
+      return checkpoint.min_time_from_ns < end_ns;
+    });
+  return checkpoint == end ? nullptr : checkpoint;
+}
+
+PcapTimeWindowReader::PcapTimeWindowReader(
+  std::unique_ptr<IPcapReader> reader, const PcapIndex& index,
+  Common::Nanoseconds start_ns, Common::Nanoseconds end_ns)
+  : m_reader(std::move(reader)),
+    m_start_ns(start_ns),
+    m_end_ns(end_ns)
+{
+  /* Reading from the beginning is still correct, only slower;
+  so that is what is done if the index can not be used. */
+  const auto first_position = m_reader->get_position();
+  if (const auto* start = index.findStart(start_ns))
+    if (!m_reader->seek(start->position))
+      m_reader->seek(first_position);
+  if (const auto* end = index.findEnd(end_ns))
+  {
+    m_has_end_offset = true;
+    m_end_offset = end->position.offset;
+  }
+}
+
+bool PcapTimeWindowReader::nextPacket(Common::PcapPacket& packet)
+{
+  while (true)
+  {
+    if (m_has_end_offset
+        && m_reader->get_position().offset >= m_end_offset)
+      return false;
+    if (!m_reader->nextPacket(packet))
+      return false;
+    const auto arrival_time_ns = packet.get_arrival_time_ns();
+    if (arrival_time_ns >= m_start_ns && arrival_time_ns < m_end_ns)
+      return true;
+    m_number_of_skipped_packets++;
+  }
+}
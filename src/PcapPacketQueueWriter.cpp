@@ -9,11 +9,16 @@
  */
 
 #include "PcapPacketQueueWriter.h"
+#include "IPcapReader.h"
 #include "common/PcapPacket.h"
-#include "common/PcapPacketQueue.h"
+#include "common/IPacketSink.h"
+#include "common/PcapPacketQueueSelector.h"
 #include "common/Constants.h"
 #include <ctime>
 #include <cstring> // memcpy
+#include <array>
+#include <thread>
+#include <utility> // swap
 
 /**
  * @brief Push some packets to @ref PcapPacketQueue so that
@@ -21,7 +26,31 @@
  * 
  * @param number_of_packets_to_write How many packets to push.
  */
-void writeToPcapPacketQueue(unsigned number_of_packets_to_write)
+void writeToPcapPacketQueue(unsigned number_of_packets_to_write,
+                            ReplayClock replay_clock)
+{
+  writeToPacketSink(Common::getPcapPacketQueue(),
+                    number_of_packets_to_write, replay_clock);
+}
+
+void writeToPcapPacketQueue(IPcapReader& reader,
+                            ReplayClock replay_clock)
+{
+  writeToPacketSink(Common::getPcapPacketQueue(), reader,
+                    replay_clock);
+}
+
+/**
+ * @brief Push some packets to the given sink so that the
+ * consumers behind it have some packets to process.
+ * 
+ * @param sink Where to push the packets to.
+ * @param number_of_packets_to_write How many packets to push.
+ * @param replay_clock Paces the pushes.
+ */
+void writeToPacketSink(Common::IPacketSink& sink,
+                       unsigned number_of_packets_to_write,
+                       ReplayClock replay_clock)
 {
   unsigned curr_packet_number = 0;
 
@@ -32,28 +61,25 @@ void writeToPcapPacketQueue(unsigned number_of_packets_to_write)
 
   /* Some random number for the first PcapPacket
   arrival time */
-  __time_t tv_sec = 10; 
+  Common::Nanoseconds arrival_time_ns = 
+    10 * Common::kNanosecondsPerSecond; 
 
   /* If specified #of packets are written (pushed)
     then stop writing. */
   while(curr_packet_number < number_of_packets_to_write)
   {
-    struct timeval tv {tv_sec, 0};
-    /*Assume a 64-octet Ethernet Frame*/
-    uint8_t* data = new uint8_t[64]();
-    Common::PcapPacket packet = {tv, data};
-    std::cout << "pushing a pcap packet with tv_sec " 
-      << packet.arrival_time.tv_sec << std::endl;
-    Common::PcapPacketQueue::getInstance().
-                             pushPacket( std::move(packet) );
-    
-    /* Do not continuously write, sleep between
-    each writes */
-    std::this_thread::sleep_for(
-      std::chrono::milliseconds(
-        Common::kPcapPacketQueueWritingperiod
-      )
-    );
+    /*Assume a 64-octet Ethernet Frame. The content of the
+    bogus frame is not meaningful, so it is not initialized.*/
+    auto packet = Common::PcapPacket::allocate(
+      arrival_time_ns, 64, 64);
+
+    /* Push the packet when it is due according to the replay
+    mode rather than after a fixed sleep */
+    replay_clock.waitUntilDue(packet.get_arrival_time_ns());
+    std::cout << "pushing a pcap packet with the arrival time " 
+      << Common::toSeconds(packet.get_arrival_time_ns()) 
+      << std::endl;
+    sink.pushPacket( std::move(packet) );
 
     /* increment each pcap consective pcap packet time 
     by 0, 1 or 2 seconds (some random increment) */
@@ -61,12 +87,70 @@ void writeToPcapPacketQueue(unsigned number_of_packets_to_write)
 
     /* Increase pcap arrival time for each pcap packet
       by some random number */
-    tv_sec += random_tv_offset_for_pcaps; 
+    arrival_time_ns += random_tv_offset_for_pcaps 
+                       * Common::kNanosecondsPerSecond; 
 
     curr_packet_number++; 
   }
 
+  /* Let the processors know that no more packets will come */
+  sink.closeQueue();
   std::cout << "Done with pushing packets!" << std::endl;
   
   
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Push every packet of the capture file to the given
+ * sink when it is due according to the replay clock; in
+ * max-speed mode as fast as the file can be read.
+ *
+ * @param sink Where to push the packets to.
+ * @param reader An opened reader of the capture file.
+ * @param replay_clock Paces the pushes.
+ */
+void writeToPacketSink(Common::IPacketSink& sink,
+                       IPcapReader& reader,
+                       ReplayClock replay_clock)
+{
+  unsigned long long number_of_packets_written = 0;
+
+  /* Collect the packets and push them as a batch so that the
+  queue synchronization is paid once per batch. */
+  std::array<Common::PcapPacket, 
+             Common::kPcapPacketQueueWriteBatchSize> packets;
+  std::size_t number_of_packets_in_batch = 0;
+  while (reader.nextPacket(packets[number_of_packets_in_batch]))
+  {
+    /* A packet which is not due yet must not wait behind the
+    ones which are, so push the batch collected so far before
+    sleeping. */
+    const auto time_until_due = replay_clock.get_time_until_due(
+      packets[number_of_packets_in_batch].get_arrival_time_ns());
+    if (time_until_due.count() > 0)
+    {
+      sink.pushPackets(packets.data(), 
+                       number_of_packets_in_batch);
+      number_of_packets_written += number_of_packets_in_batch;
+      std::swap(packets[0], packets[number_of_packets_in_batch]);
+      number_of_packets_in_batch = 0;
+      std::this_thread::sleep_for(time_until_due);
+    }
+
+    number_of_packets_in_batch++;
+    if (number_of_packets_in_batch == packets.size())
+    {
+      sink.pushPackets(packets.data(), 
+                       number_of_packets_in_batch);
+      number_of_packets_written += number_of_packets_in_batch;
+      number_of_packets_in_batch = 0;
+    }
+  }
+  sink.pushPackets(packets.data(), number_of_packets_in_batch);
+  number_of_packets_written += number_of_packets_in_batch;
+
+  /* Let the processors know that no more packets will come */
+  sink.closeQueue();
+  std::cout << "Done with pushing " << number_of_packets_written
+    << " packets from the pcap file!" << std::endl;
+}
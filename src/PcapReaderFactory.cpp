@@ -0,0 +1,65 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the free
+ * functions declared in PcapReaderFactory.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "PcapReaderFactory.h"
+#include "PcapFileReader.h"
+#include "PcapIndex.h"
+#include "PcapngFileReader.h"
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+std::unique_ptr<IPcapReader> openPcapReader(
+  const std::string& file_path)
+{
+  /* Section Header Block type of pcapng; classic pcap files
+  start with their magic number instead. */
+  constexpr uint32_t kPcapngSectionHeaderBlockType = 0x0A0D0D0A;
+
+  uint32_t first_word = 0;
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file.read(reinterpret_cast<char*>(&first_word), 
+                 sizeof(first_word)))
+  {
+    std::cout << "could not read the capture file "
+      << file_path << std::endl;
+    return nullptr;
+  }
+
+  if (first_word == kPcapngSectionHeaderBlockType)
+  {
+    auto reader = std::make_unique<PcapngFileReader>();
+    if (!reader->open(file_path))
+      return nullptr;
+    return reader;
+  }
+
+  auto reader = std::make_unique<PcapFileReader>();
+  if (!reader->open(file_path))
+    return nullptr;
+  return reader;
+}
+
+std::unique_ptr<IPcapReader> openPcapReader(
+  const std::string& file_path, Common::Nanoseconds start_ns,
+  Common::Nanoseconds end_ns)
+{
+  auto reader = openPcapReader(file_path);
+  if (!reader)
+    return nullptr;
+  /* Without an index, the whole file is read and the packets
+  out of the window are skipped. */
+  PcapIndex index;
+  if (!index.openOrBuild(file_path))
+    std::cout << "reading the whole capture file without an index"
+      << std::endl;
+  return std::make_unique<PcapTimeWindowReader>(
+    std::move(reader), index, start_ns, end_ns);
+}
@@ -0,0 +1,525 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in PcapngFileReader.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "PcapngFileReader.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring> // memcpy, memmove
+
+#include <fcntl.h>  // open, posix_fadvise
+#include <unistd.h> // read, lseek, close
+
+namespace
+{
+  constexpr uint32_t kSectionHeaderBlockType        = 0x0A0D0D0A;
+  constexpr uint32_t kInterfaceDescriptionBlockType = 0x00000001;
+  constexpr uint32_t kSimplePacketBlockType         = 0x00000003;
+  constexpr uint32_t kEnhancedPacketBlockType       = 0x00000006;
+
+  /* The byte-order magic of a Section Header Block as read in
+  host byte order */
+  constexpr uint32_t kByteOrderMagic        = 0x1A2B3C4D;
+  constexpr uint32_t kByteOrderMagicSwapped = 0x4D3C2B1A;
+
+  constexpr uint16_t kOptionEndOfOptions = 0;
+  constexpr uint16_t kOptionIfTsresol    = 9;
+  constexpr uint16_t kOptionIfTsoffset   = 14;
+
+  /* block type(4) + block total length(4) + ... + block total
+  length(4) */
+  constexpr std::size_t kMinimumBlockLength = 12;
+
+  /* Anything larger is certainly a corrupted length field
+  rather than a real block (same limit as libpcap's). */
+  constexpr std::size_t kMaximumBlockLength = 16 * 1024 * 1024;
+
+  constexpr std::size_t pad4(std::size_t length)
+  {
+    return (length + 3) & ~static_cast<std::size_t>(3);
+  }
+}
+
+PcapngFileReader::~PcapngFileReader()
+{
+  close();
+}
+
+void PcapngFileReader::close()
+{
+  if (m_fd >= 0)
+    ::close(m_fd);
+  m_fd = -1;
+  m_window.reset();
+  m_window_capacity = 0;
+  m_window_begin = 0;
+  m_window_end = 0;
+  m_is_eof = false;
+  m_interfaces.clear();
+  m_offset = 0;
+  m_section_offset = 0;
+}
+
+uint16_t PcapngFileReader::readU16(const uint8_t* field) const
+{
+  uint16_t value;
+  std::memcpy(&value, field, sizeof(value));
+  return m_is_byte_swapped ? __builtin_bswap16(value) : value;
+}
+
+uint32_t PcapngFileReader::readU32(const uint8_t* field) const
+{
+  uint32_t value;
+  std::memcpy(&value, field, sizeof(value));
+  return m_is_byte_swapped ? __builtin_bswap32(value) : value;
+}
+
+bool PcapngFileReader::open(const std::string& file_path,
+                            std::size_t window_size)
+{
+  close();
+
+  m_fd = ::open(file_path.c_str(), O_RDONLY);
+  if (m_fd < 0)
+  {
+    std::cout << "could not open the pcapng file "
+      << file_path << std::endl;
+    return false;
+  }
+
+  /* The file is read once from the beginning to the end; let
+  the kernel read ahead aggressively. */
+  posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  m_window_capacity = window_size < kMinimumBlockLength
+                      ? kMinimumBlockLength : window_size;
+  m_window.reset(new uint8_t[m_window_capacity]);
+
+  /* The file must start with a Section Header Block. It is
+  left in the window to be decoded by nextPacket. */
+  uint32_t byte_order_magic = 0;
+  if (fillWindow(kMinimumBlockLength))
+    std::memcpy(&byte_order_magic, m_window.get() + 8, 4);
+  if (byte_order_magic != kByteOrderMagic
+      && byte_order_magic != kByteOrderMagicSwapped)
+  {
+    std::cout << file_path
+      << " is not a pcapng file" << std::endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool PcapngFileReader::fillWindow(std::size_t length)
+{
+  if (m_window_end - m_window_begin >= length)
+    return true;
+
+  std::size_t available = m_window_end - m_window_begin;
+  if (length > m_window_capacity)
+  {
+    /* A block carrying a packet does not fit in the window;
+    grow the window rather than dropping the packet. */
+    std::unique_ptr<uint8_t[]> window(new uint8_t[length]);
+    std::memcpy(window.get(), m_window.get() + m_window_begin,
+                available);
+    m_window = std::move(window);
+    m_window_capacity = length;
+    m_window_begin = 0;
+    m_window_end = available;
+  }
+  else if (m_window_begin + length > m_window_capacity)
+  {
+    /* Move the partially read block to the front to make room
+    for the rest of it. */
+    std::memmove(m_window.get(),
+                 m_window.get() + m_window_begin, available);
+    m_window_begin = 0;
+    m_window_end = available;
+  }
+
+  while (m_window_end - m_window_begin < length && !m_is_eof)
+  {
+    auto number_of_octets_read = ::read(
+      m_fd, m_window.get() + m_window_end,
+      m_window_capacity - m_window_end);
+    if (number_of_octets_read < 0 && errno == EINTR)
+      continue;
+    if (number_of_octets_read <= 0)
+      m_is_eof = true;
+    else
+      m_window_end += number_of_octets_read;
+  }
+  return m_window_end - m_window_begin >= length;
+}
+
+bool PcapngFileReader::skip(std::size_t length)
+{
+  std::size_t available = m_window_end - m_window_begin;
+  m_offset += length;
+  if (length <= available)
+  {
+    m_window_begin += length;
+    return true;
+  }
+
+  /* Do not read the part of the block which is not in the
+  window yet; seek over it instead. */
+  m_window_begin = 0;
+  m_window_end = 0;
+  if (lseek(m_fd, length - available, SEEK_CUR) < 0)
+  {
+    m_is_eof = true;
+    return false;
+  }
+  return true;
+}
+
+bool PcapngFileReader::decodeSectionHeader(std::size_t block_length)
+{
+  /* block type(4) length(4) byte-order magic(4) major(2)
+  minor(2) section length(8) options... */
+  if (block_length < 24)
+    return false;
+
+  const uint8_t* block = m_window.get() + m_window_begin;
+  if (readU16(block + 12) != 1)
+  {
+    std::cout << "unsupported pcapng major version "
+      << readU16(block + 12) << std::endl;
+    return false;
+  }
+
+  /* Interface IDs are local to a section */
+  m_interfaces.clear();
+  m_section_offset = m_offset;
+  return true;
+}
+
+bool PcapngFileReader::decodeInterfaceDescription(
+  std::size_t block_length)
+{
+  /* block type(4) length(4) link type(2) reserved(2)
+  snaplen(4) options... length(4) */
+  if (block_length < 20)
+    return false;
+
+  const uint8_t* block = m_window.get() + m_window_begin;
+  Interface interface;
+  interface.link_type = readU16(block + 8);
+  interface.snaplen = readU32(block + 12);
+  /* Default resolution is microseconds */
+  interface.is_binary_resolution = false;
+  interface.resolution = 6;
+  interface.units_per_second = 1000000;
+  interface.offset_seconds = 0;
+
+  std::size_t option_offset = 16;
+  std::size_t options_end = block_length - 4;
+  while (option_offset + 4 <= options_end)
+  {
+    uint16_t code = readU16(block + option_offset);
+    uint16_t length = readU16(block + option_offset + 2);
+    const uint8_t* value = block + option_offset + 4;
+    if (code == kOptionEndOfOptions
+        || option_offset + 4 + length > options_end)
+      break;
+
+    if (code == kOptionIfTsresol && length >= 1)
+    {
+      bool is_binary = (value[0] & 0x80) != 0;
+      uint8_t resolution = value[0] & 0x7f;
+      /* larger values can not be represented in 64 bits */
+      if ((is_binary && resolution < 64)
+          || (!is_binary && resolution <= 19))
+      {
+        interface.is_binary_resolution = is_binary;
+        interface.resolution = resolution;
+        interface.units_per_second = 1;
+        if (!is_binary)
+          for (auto i = 0; i < resolution; i++)
+            interface.units_per_second *= 10;
+      }
+    }
+    else if (code == kOptionIfTsoffset && length >= 8)
+    {
+      uint64_t offset;
+      std::memcpy(&offset, value, sizeof(offset));
+      if (m_is_byte_swapped)
+        offset = __builtin_bswap64(offset);
+      interface.offset_seconds = static_cast<int64_t>(offset);
+    }
+    option_offset += 4 + pad4(length);
+  }
+
+  m_interfaces.push_back(interface);
+  return true;
+}
+
+Common::Nanoseconds PcapngFileReader::toNanoseconds(
+  const Interface& interface,
+  uint64_t timestamp) const
+{
+  constexpr uint64_t kNanosecondsPerSecond = 
+    Common::kNanosecondsPerSecond;
+  uint64_t seconds;
+  uint64_t nanoseconds;
+  if (interface.is_binary_resolution)
+  {
+    unsigned shift = interface.resolution;
+    seconds = timestamp >> shift;
+    uint64_t fraction = shift == 0
+                        ? 0 : timestamp & ((1ULL << shift) - 1);
+    nanoseconds = static_cast<uint64_t>(
+      (static_cast<unsigned __int128>(fraction) 
+       * kNanosecondsPerSecond) >> shift);
+  }
+  else
+  {
+    uint64_t units_per_second = interface.units_per_second;
+    seconds = timestamp / units_per_second;
+    uint64_t fraction = timestamp % units_per_second;
+    nanoseconds = units_per_second >= kNanosecondsPerSecond
+      ? fraction / (units_per_second / kNanosecondsPerSecond)
+      : fraction * (kNanosecondsPerSecond / units_per_second);
+  }
+
+  return (static_cast<Common::Nanoseconds>(seconds) 
+          + interface.offset_seconds) 
+         * Common::kNanosecondsPerSecond
+         + static_cast<Common::Nanoseconds>(nanoseconds);
+}
+
+void PcapngFileReader::fillPacket(Common::PcapPacket& packet,
+                                  const uint8_t* payload,
+                                  uint32_t caplen, uint32_t len,
+                                  Common::Nanoseconds arrival_time_ns,
+                                  uint16_t interface_index)
+{
+  packet = Common::PcapPacket::allocate(
+    arrival_time_ns, caplen, len, interface_index);
+  std::memcpy(packet.get_data(), payload, caplen);
+  m_last_arrival_time_ns = arrival_time_ns;
+}
+
+bool PcapngFileReader::readBlockHeader(uint32_t& block_type,
+                                       std::size_t& block_length)
+{
+  if (!fillWindow(kMinimumBlockLength))
+  {
+    if (m_window_end != m_window_begin)
+      std::cout << "the last block of the pcapng file is "
+        "truncated" << std::endl;
+    return false;
+  }
+
+  const uint8_t* block = m_window.get() + m_window_begin;
+  /* The block type of a Section Header Block is a palindrome;
+  it can be compared before knowing the byte order. */
+  std::memcpy(&block_type, block, sizeof(block_type));
+  if (block_type == kSectionHeaderBlockType)
+  {
+    uint32_t byte_order_magic;
+    std::memcpy(&byte_order_magic, block + 8, 4);
+    if (byte_order_magic == kByteOrderMagicSwapped)
+      m_is_byte_swapped = true;
+    else if (byte_order_magic == kByteOrderMagic)
+      m_is_byte_swapped = false;
+    else
+    {
+      std::cout << "invalid pcapng byte-order magic"
+        << std::endl;
+      return false;
+    }
+  }
+  else
+    block_type = readU32(block);
+
+  block_length = readU32(block + 4);
+  if (block_length < kMinimumBlockLength
+      || block_length % 4 != 0
+      || block_length > kMaximumBlockLength)
+  {
+    std::cout << "malformed pcapng block length "
+      << block_length << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool PcapngFileReader::jumpTo(uint64_t offset)
+{
+  if (lseek(m_fd, static_cast<off_t>(offset), SEEK_SET) < 0)
+    return false;
+  m_window_begin = 0;
+  m_window_end = 0;
+  m_is_eof = false;
+  m_offset = offset;
+  return true;
+}
+
+PcapReaderPosition PcapngFileReader::get_position() const
+{
+  PcapReaderPosition position;
+  position.offset = m_offset;
+  position.section_offset = m_section_offset;
+  position.number_of_interfaces = 
+    static_cast<uint32_t>(m_interfaces.size());
+  position.last_arrival_time_ns = m_last_arrival_time_ns;
+  return position;
+}
+
+bool PcapngFileReader::seek(const PcapReaderPosition& position)
+{
+  if (m_fd < 0 || position.offset < position.section_offset
+      || !jumpTo(position.section_offset))
+    return false;
+
+  /* The interfaces are described at the beginning of a section
+  in practice; so only its first blocks are decoded before
+  jumping to the position. The packets in between, if any, are
+  skipped without being read. */
+  m_interfaces.clear();
+  bool is_section_read = false;
+  while (!is_section_read 
+         || m_interfaces.size() < position.number_of_interfaces)
+  {
+    uint32_t block_type;
+    std::size_t block_length;
+    if (!readBlockHeader(block_type, block_length))
+      return false;
+    const bool is_section_header = 
+      block_type == kSectionHeaderBlockType;
+    /* the position must be in a section with enough
+    interfaces */
+    if (is_section_header == is_section_read)
+      return false;
+    if (!is_section_header 
+        && block_type != kInterfaceDescriptionBlockType)
+    {
+      if (!skip(block_length))
+        return false;
+      continue;
+    }
+    if (!fillWindow(block_length))
+      return false;
+    if (is_section_header ? !decodeSectionHeader(block_length)
+                          : !decodeInterfaceDescription(block_length))
+      return false;
+    is_section_read = true;
+    m_window_begin += block_length;
+    m_offset += block_length;
+  }
+
+  m_last_arrival_time_ns = position.last_arrival_time_ns;
+  return jumpTo(position.offset);
+}
+
+bool PcapngFileReader::nextPacket(Common::PcapPacket& packet)
+{
+  if (m_fd < 0)
+    return false;
+
+  while (true)
+  {
+    uint32_t block_type;
+    std::size_t block_length;
+    if (!readBlockHeader(block_type, block_length))
+      return false;
+
+    switch (block_type)
+    {
+      case kSectionHeaderBlockType:
+      case kInterfaceDescriptionBlockType:
+      case kEnhancedPacketBlockType:
+      case kSimplePacketBlockType:
+        if (!fillWindow(block_length))
+        {
+          std::cout << "the last block of the pcapng file is "
+            "truncated" << std::endl;
+          return false;
+        }
+        break;
+      default:
+        /* Name resolution, statistics, custom blocks etc. are
+        of no interest; do not buffer them. */
+        if (!skip(block_length))
+          return false;
+        continue;
+    }
+
+    /* the window might have been moved by fillWindow */
+    const uint8_t* block = m_window.get() + m_window_begin;
+    bool is_packet_read = false;
+    if (block_type == kSectionHeaderBlockType)
+    {
+      if (!decodeSectionHeader(block_length))
+        return false;
+    }
+    else if (block_type == kInterfaceDescriptionBlockType)
+    {
+      if (!decodeInterfaceDescription(block_length))
+        return false;
+    }
+    else if (block_type == kEnhancedPacketBlockType)
+    {
+      /* block type(4) length(4) interface id(4) timestamp
+      high(4) timestamp low(4) caplen(4) len(4) data... */
+      uint32_t interface_id = block_length >= 32
+                              ? readU32(block + 8)
+                              : m_interfaces.size();
+      uint32_t caplen = block_length >= 32
+                        ? readU32(block + 20) : 0;
+      if (interface_id >= m_interfaces.size()
+          || 28 + pad4(caplen) + 4 > block_length)
+        std::cout << "skipping a malformed enhanced packet block"
+          << std::endl;
+      else
+      {
+        uint64_t timestamp =
+          (static_cast<uint64_t>(readU32(block + 12)) << 32)
+          | readU32(block + 16);
+        fillPacket(packet, block + 28, caplen,
+                   readU32(block + 24),
+                   toNanoseconds(m_interfaces[interface_id],
+                                 timestamp),
+                   static_cast<uint16_t>(interface_id));
+        is_packet_read = true;
+      }
+    }
+    else /* kSimplePacketBlockType */
+    {
+      /* block type(4) length(4) original length(4) data...
+      It belongs to the first interface and carries no
+      timestamp; the time of the previous packet is used. */
+      if (m_interfaces.empty() || block_length < 16)
+        std::cout << "skipping a malformed simple packet block"
+          << std::endl;
+      else
+      {
+        uint32_t len = readU32(block + 8);
+        uint32_t caplen = static_cast<uint32_t>(block_length - 16);
+        if (len < caplen)
+          caplen = len;
+        if (m_interfaces[0].snaplen != 0
+            && m_interfaces[0].snaplen < caplen)
+          caplen = m_interfaces[0].snaplen;
+        fillPacket(packet, block + 12, caplen, len,
+                   m_last_arrival_time_ns, 0);
+        is_packet_read = true;
+      }
+    }
+
+    m_window_begin += block_length;
+    m_offset += block_length;
+    if (is_packet_read)
+      return true;
+  }
+}
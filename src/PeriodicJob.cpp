@@ -9,82 +9,82 @@
  */
 
 #include "PeriodicJob.h"
-#include "common/Constants.h"
-#include "common/PcapPacket.h"
-#include "common/ExternalTime.h"
-#include "common/PcapPacketQueue.h"
 
 #include <iostream>
-#include <chrono>
+#include <utility> // swap
 
 PeriodicJob::PeriodicJob(
-  struct timeval period, 
-  JOBID job_id)
+  Common::Nanoseconds period_ns, 
+  JOBID job_id,
+  JobPayload payload)
+  : m_payload(std::move(payload))
 {
-  m_period = period;
+  m_period_ns = period_ns;
   m_job_id = job_id;
 }
 
-void PeriodicJob::changePeriod(struct timeval period)
+void PeriodicJob::changePeriod(Common::Nanoseconds period_ns)
 {
   std::cout << "period change request for \
    the Job " << m_job_id 
-   << " from an period of " << m_period.tv_sec 
-   << " to "<< period.tv_sec 
-   << " has been received " << std::endl;
+   << " from an period of " << Common::toSeconds(m_period_ns)
+   << " to "<< Common::toSeconds(period_ns)
+   << " seconds has been received " << std::endl;
 
-  m_period = period;
+  /* Not serialized with the cycles (via m_mutex), so that a
+  payload can change the period of its own job. */
+  m_period_ns = period_ns;
 }
 
-void PeriodicJob::run()
+void PeriodicJob::run(const JobCycles& cycles)
 {
-  bool is_there_job_to_do = true;
-  auto start_time   = Common::ExternalTime::getInstance().
-                                            get_current_time().
-                                            tv_sec;
-  auto current_time = start_time; 
-  while(true)
-  {
-    /* If stop function has been called externally, then stop
-    the thread. */
-    if (m_should_stop_running)
-      break;
-
-    if(is_there_job_to_do)
-    {
-      std::cout << "current time for the Job "
-        << m_job_id << " is " << current_time 
-        << " and it is time to do some job " 
-        << "with a period of " << m_period.tv_sec 
-        << " seconds " << std::endl; 
-      
-      doSomeJob();
-      is_there_job_to_do = false;
-    }
-
-    /* Do not hog the CPU, sleep between each time check. */
-    std::this_thread::sleep_for(
-      std::chrono::milliseconds(
-        Common::kPeriodicJobTimeCheckingperiod
-        )
-      ); 
+  std::scoped_lock<std::mutex> lock(m_mutex);
+
+  /* If stop function has been called externally, a cycle
+  which was already scheduled should not do anything. */
+  if (m_should_stop_running)
+    return;
+
+  std::cout << "current time for the Job "
+    << m_job_id << " is " << Common::toSeconds(cycles.first_time_ns)
+    << " and it is time to do some job " 
+    << "with a period of " << Common::toSeconds(cycles.period_ns)
+    << " seconds";
+  if (cycles.number_of_cycles > 1)
+    std::cout << " (catching up " << cycles.number_of_cycles 
+      << " periods)";
+  std::cout << std::endl; 
+  
+  doSomeJob(cycles);
+}
 
-    current_time = Common::ExternalTime::getInstance().
-                                         get_current_time().
-                                         tv_sec;
+bool PeriodicJob::queueCycles(const JobCycles& cycles)
+{
+  std::scoped_lock<std::mutex> lock(m_queue_mutex);
+  m_queued_cycles.push_back(cycles);
+  if (m_is_scheduled)
+    return false;
+  m_is_scheduled = true;
+  return true;
+}
 
-    /* Check if the time specified in our period variable has
-    already passed. If so, execute the next cycle of this
-    periodic job */
-    if(current_time - start_time >= m_period.tv_sec)
+void PeriodicJob::runQueuedCycles()
+{
+  while (true)
+  {
     {
-      is_there_job_to_do = true;
-      start_time = current_time;
-    }    
+      std::scoped_lock<std::mutex> lock(m_queue_mutex);
+      if (m_queued_cycles.empty())
+      {
+        m_is_scheduled = false;
+        return;
+      }
+      std::swap(m_queued_cycles, m_running_cycles);
+    }
+    for (const auto& cycles : m_running_cycles)
+      run(cycles);
+    m_running_cycles.clear();
   }
-
-  std::cout << "Job " << m_job_id
-    << " has been stopped" << std::endl;
 }
 
 void PeriodicJob::stop()
@@ -93,15 +93,23 @@ void PeriodicJob::stop()
     << " received a stop command" << std::endl;
 
   m_should_stop_running = true;
+  std::cout << "Job " << m_job_id
+    << " has been stopped" << std::endl;
 }
 
-const struct timeval& PeriodicJob::get_period()
+struct timeval PeriodicJob::get_period()
 {
-  return m_period;
+  return Common::toTimeval(m_period_ns);
 }
 
-void PeriodicJob::doSomeJob()
+Common::Nanoseconds PeriodicJob::get_period_ns()
 {
-  /* stub code for doing something */
+  return m_period_ns;
 }
 
+void PeriodicJob::doSomeJob(const JobCycles& cycles)
+{
+  /* the jobs without a payload have nothing to do yet */
+  if (m_payload)
+    m_payload(cycles);
+}
\ No newline at end of file
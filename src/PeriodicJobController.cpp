@@ -10,13 +10,12 @@
 
 #include "PeriodicJobController.h"
 #include "common/Constants.h"
+#include "common/ExternalTime.h"
+#include "common/WorkerPool.h"
+#include <algorithm>
 #include <iostream>
-#include <thread>
 #include <random>
-
-#include <boost/uuid/uuid.hpp>
-#include <boost/uuid/uuid_generators.hpp>
-#include <boost/uuid/uuid_io.hpp> // to_string etc.
+#include <utility>
 
 /**
  * @brief An instance of the @ref PeriodicJobController class
@@ -32,8 +31,188 @@ PeriodicJobController*
   g_ptr_periodic_class_controller_instance =
     new PeriodicJobController();
 
+PeriodicJobController::PeriodicJobController(
+  unsigned number_of_shards)
+{
+  if (number_of_shards == 0)
+    number_of_shards = 1;
+  for (unsigned i = 0; i < number_of_shards; i++)
+  {
+    m_shards.push_back(std::make_unique<Shard>());
+    auto* shard = m_shards.back().get();
+    shard->time_subscription = 
+      Common::ExternalTime::getInstance().subscribe(
+        Common::ExternalTime::kNever, 
+        [shard](int64_t) { advanceTimers(*shard); });
+  }
+  /* the default might not fit the handles of this many shards */
+  set_max_number_of_jobs(get_max_number_of_jobs());
+}
+
+PeriodicJobController::~PeriodicJobController()
+{
+  /* no callback is running or will run after this */
+  for (auto& shard : m_shards)
+    Common::ExternalTime::getInstance().unsubscribe(
+      shard->time_subscription);
+  for (auto& shard : m_shards)
+  {
+    std::scoped_lock<std::mutex> lock(shard->mutex);
+    for (auto slot_index : shard->active_slots)
+      shard->slots[slot_index].job_timer.job->stop();
+  }
+}
+
+PeriodicJobController::Shard& PeriodicJobController::getShard(
+  const JOBID& job_id) const
+{
+  return *m_shards[job_id.get_index() % m_shards.size()];
+}
+
+PeriodicJobController::Slot* PeriodicJobController::findSlot(
+  Shard& shard, const JOBID& job_id) const
+{
+  if (job_id.empty())
+    return nullptr;
+  const auto slot_index = job_id.get_index() / m_shards.size();
+  if (slot_index >= shard.slots.size())
+    return nullptr;
+  auto& slot = shard.slots[slot_index];
+  if (slot.active_position == kFreeSlot 
+      || slot.generation != job_id.get_generation())
+    return nullptr;
+  return &slot;
+}
+
+JOBID PeriodicJobController::toJobId(std::size_t shard_index,
+                                     uint32_t slot_index,
+                                     const Slot& slot) const
+{
+  /* a shard never has more slots than the limit of jobs, which
+  keeps this within 32 bits (see set_max_number_of_jobs) */
+  return JOBID(static_cast<uint32_t>(
+                 slot_index * m_shards.size() + shard_index),
+               slot.generation);
+}
+
+uint64_t PeriodicJobController::toTicks(Common::Nanoseconds time_ns)
+{
+  /* times before the epoch are not expected */
+  if (time_ns < 0)
+    return 0;
+  return static_cast<uint64_t>(
+    time_ns / Common::kPeriodicJobTimerTickNanoseconds);
+}
+
+uint64_t PeriodicJobController::toPeriodTicks(
+  Common::Nanoseconds period_ns)
+{
+  constexpr auto kTick = Common::kPeriodicJobTimerTickNanoseconds;
+  if (period_ns <= kTick)
+    return 1;
+  return static_cast<uint64_t>((period_ns + kTick - 1) / kTick);
+}
+
+void PeriodicJobController::runAndReschedule(Shard& shard,
+                                             JobTimer& job_timer,
+                                             uint64_t due_tick,
+                                             uint64_t now)
+{
+  auto job = job_timer.job;
+  const auto period = toPeriodTicks(job->get_period_ns());
+
+  /* Skipping runs a cycle at the current tick and counts the
+  next period from there; catching up keeps the cycles on the
+  grid of their nominal ticks. */
+  uint64_t first_tick = now;
+  uint64_t number_of_cycles = 1;
+  if (job->get_catch_up_mode() 
+      == Common::CatchUpMode::kRunMissedPeriods && due_tick < now)
+  {
+    first_tick = due_tick;
+    number_of_cycles = (now - due_tick) / period + 1;
+    if (number_of_cycles > Common::kMaxNumberOfCatchUpPeriods)
+    {
+      const auto number_of_dropped_cycles = 
+        number_of_cycles - Common::kMaxNumberOfCatchUpPeriods;
+      std::cout << "dropping the oldest " << number_of_dropped_cycles
+        << " missed periods of a job" << std::endl;
+      first_tick += number_of_dropped_cycles * period;
+      number_of_cycles = Common::kMaxNumberOfCatchUpPeriods;
+    }
+  }
+  job_timer.last_run_tick = first_tick 
+                            + (number_of_cycles - 1) * period;
+
+  JobCycles cycles;
+  cycles.first_time_ns = static_cast<Common::Nanoseconds>(first_tick)
+    * Common::kPeriodicJobTimerTickNanoseconds;
+  cycles.period_ns = static_cast<Common::Nanoseconds>(period) 
+    * Common::kPeriodicJobTimerTickNanoseconds;
+  cycles.number_of_cycles = number_of_cycles;
+
+  /* Do not wait its completion; it will be completed when the
+  work is done. The cycles are queued in the job, so a job is
+  a single task of the pool at a time and its cycles run in
+  order whichever worker runs them. */
+  if (job->queueCycles(cycles))
+  {
+    auto task = [job]() { job->runQueuedCycles(); };
+    static_assert(sizeof(task) <= Common::kWorkerPoolTaskInlineSize,
+                  "the task of a job must not be heap allocated");
+    Common::WorkerPool::getInstance().submit(std::move(task));
+  }
+
+  shard.timer_wheel.insert(job_timer, 
+                           job_timer.last_run_tick + period);
+}
+
+void PeriodicJobController::anchorJobs(Shard& shard, uint64_t now)
+{
+  for (auto slot_index : shard.unanchored_slots)
+    runAndReschedule(shard, shard.slots[slot_index].job_timer, 
+                     now, now);
+  shard.unanchored_slots.clear();
+}
+
+void PeriodicJobController::updateTimeSubscription(Shard& shard)
+{
+  uint64_t next_deadline;
+  auto time_ns = Common::ExternalTime::kNever;
+  if (!shard.unanchored_slots.empty())
+    time_ns = Common::ExternalTime::kUnset + 1; // any time set
+  else if (shard.timer_wheel.get_next_deadline(next_deadline))
+    time_ns = static_cast<Common::Nanoseconds>(next_deadline) 
+              * Common::kPeriodicJobTimerTickNanoseconds;
+  Common::ExternalTime::getInstance().reschedule(
+    shard.time_subscription, time_ns);
+}
+
+void PeriodicJobController::advanceTimers(Shard& shard)
+{
+  std::scoped_lock<std::mutex> lock(shard.mutex);
+  auto& external_time = Common::ExternalTime::getInstance();
+  if (!external_time.is_set())
+    return;
+  auto now = toTicks(external_time.get_current_time_ns());
+  shard.timer_wheel.advance(now, 
+    [&shard, now](Common::TimerWheel::Timer& timer)
+    {
+      runAndReschedule(shard, static_cast<JobTimer&>(timer), 
+                       timer.deadline, now);
+    });
+  anchorJobs(shard, now);
+  updateTimeSubscription(shard);
+}
+
 std::vector<JOBID> PeriodicJobController::onNewTime()
 {
+  /* The jobs are normally run by the time subscriptions right
+  on their ticks; this only catches up if a subscription has
+  not fired yet for the current time. */
+  for (auto& shard : m_shards)
+    advanceTimers(*shard);
+
   std::vector<JOBID> newly_added_job_ids;
   /*
    * some_random_tv_sec is used to determine the period value
@@ -50,89 +229,154 @@ std::vector<JOBID> PeriodicJobController::onNewTime()
   std::uniform_int_distribution<int> distribution(1, 5);
   for (auto i = 0; i < m_no_of_jobs_to_add; i++)
   {
-    some_random_tv_sec = distribution(m_generator);
-    struct timeval some_period {some_random_tv_sec, 0};
-    auto job_id = addJob( some_period );
+    {
+      std::scoped_lock<std::mutex> lock(m_mutex);
+      some_random_tv_sec = distribution(m_generator);
+    }
+    auto job_id = addJob( 
+      some_random_tv_sec * Common::kNanosecondsPerSecond );
     if(!job_id.empty())
       newly_added_job_ids.push_back(job_id);  
   }
   return newly_added_job_ids;
 }
 
-JOBID PeriodicJobController::createIdForNewJob()
+JOBID PeriodicJobController::addJob(
+  Common::Nanoseconds period_ns)
 {
-  std::string retVal = ""; /* return value */
-  constexpr unsigned number_of_max_trials_to_find_unique_id = 10;
-  unsigned curr_trial_number = 0;
-  while(true)
-  {
-    /* Implement JOBIDs using boost::uuids::uuid */
-    boost::uuids::uuid uuid = boost::uuids::random_generator()();
-    auto uuid_stringified = boost::uuids::to_string(uuid);
-    if(m_active_jobs.find(uuid_stringified) 
-                          != m_active_jobs.end() )
-    {
-      curr_trial_number++;
-      if (curr_trial_number >= number_of_max_trials_to_find_unique_id)
-        break;
-    }
-    else
-    {
-      retVal = uuid_stringified;
-      break;
-    }  
-  }
-  
-  return retVal;
+  return addJob(period_ns, nullptr);
 }
 
 JOBID PeriodicJobController::addJob(
-  struct timeval period)
+  Common::Nanoseconds period_ns, JobPayload payload)
 {
-  std::scoped_lock<std::mutex> lock(m_mutex);
-  JOBID retVal = "";
-  auto active_jobs_size = m_active_jobs.size();
-  if (active_jobs_size >= 
-      Common::kMaxNumberOfActivePeriodicJobsAllowed)
+  return insertJob(std::make_shared<PeriodicJob>(
+    period_ns, JOBID(), std::move(payload)));
+}
+
+JOBID PeriodicJobController::insertJob(
+  std::shared_ptr<PeriodicJob> periodic_job)
+{
+  /* reserve a place for the job first so that concurrent
+  additions can not exceed the limit together */
+  if (m_number_of_jobs.fetch_add(1) >= get_max_number_of_jobs())
   {
+      m_number_of_jobs--;
       std::cout << "addJob failed, \
         total #of active jobs allowed reached!" << std::endl;
-      return "";
+      return JOBID();
   }
-  retVal = createIdForNewJob();
-  if (retVal.empty() )
+
+  const auto shard_index = m_next_shard_index.fetch_add(
+    1, std::memory_order_relaxed) % m_shards.size();
+  auto& shard = *m_shards[shard_index];
+  JOBID retVal;
   {
-    std::cout << "addJob failed, \
-      could not create a new job id!" << std::endl;
-    return "";
-  }
+    std::scoped_lock<std::mutex> lock(shard.mutex);
+    uint32_t slot_index;
+    if (!shard.free_slots.empty())
+    {
+      slot_index = shard.free_slots.back();
+      shard.free_slots.pop_back();
+    }
+    else
+    {
+      slot_index = static_cast<uint32_t>(shard.slots.size());
+      shard.slots.emplace_back();
+    }
+    auto& slot = shard.slots[slot_index];
+    slot.active_position = 
+      static_cast<uint32_t>(shard.active_slots.size());
+    shard.active_slots.push_back(slot_index);
+    retVal = toJobId(shard_index, slot_index, slot);
 
-  auto periodic_job = std::make_shared <PeriodicJob>
-                                (period, retVal);
-  
-  m_active_jobs.insert(
-    std::make_pair(
-      retVal, periodic_job)
-      );
- 
-  std::cout << "Added a job with ID " << retVal
-    << " and a period of " << period.tv_sec
-    << " seconds" << std::endl;
+    periodic_job->set_job_id(retVal);
+    auto& job_timer = slot.job_timer;
+    job_timer.job = std::move(periodic_job);
 
-  /* Do not wait its completion; it will be completed when the
-  work is done.*/
-  std::thread (&PeriodicJob::run, periodic_job).detach();  
+    std::cout << "Added a job with ID " << retVal
+      << " and a period of " 
+      << Common::toSeconds(job_timer.job->get_period_ns())
+      << " seconds" << std::endl;
+
+    /* The first cycle is run right away like the next ones are
+    run right when their periods pass. Before the external time
+    is set (e.g. a job added while the first packet is being
+    read), it is run at the first time set instead of at the
+    epoch. */
+    auto& external_time = Common::ExternalTime::getInstance();
+    if (external_time.is_set())
+    {
+      const auto now = toTicks(external_time.get_current_time_ns());
+      runAndReschedule(shard, job_timer, now, now);
+    }
+    else
+      shard.unanchored_slots.push_back(slot_index);
+    updateTimeSubscription(shard);
+
+    /* the time might have been set before the subscription was
+    armed for it */
+    if (!shard.unanchored_slots.empty() && external_time.is_set())
+    {
+      anchorJobs(shard, 
+                 toTicks(external_time.get_current_time_ns()));
+      updateTimeSubscription(shard);
+    }
+  }
   return retVal;
 }
 
+void PeriodicJobController::eraseJob(Shard& shard,
+                                     uint32_t slot_index)
+{
+  auto& slot = shard.slots[slot_index];
+  slot.job_timer.job->stop();
+  shard.timer_wheel.remove(slot.job_timer);
+  slot.job_timer.job.reset();
+  shard.unanchored_slots.erase(
+    std::remove(shard.unanchored_slots.begin(),
+                shard.unanchored_slots.end(), slot_index),
+    shard.unanchored_slots.end());
+
+  /* swap with the last active slot to keep active_slots dense */
+  const auto last_slot_index = shard.active_slots.back();
+  shard.active_slots[slot.active_position] = last_slot_index;
+  shard.slots[last_slot_index].active_position = 
+    slot.active_position;
+  shard.active_slots.pop_back();
+
+  slot.active_position = kFreeSlot;
+  /* the handles of the removed job go stale */
+  if (++slot.generation == 0)
+    slot.generation = 1;
+  shard.free_slots.push_back(slot_index);
+  m_number_of_jobs--;
+  /* the subscription of the shard is left armed; firing for
+  a removed job just finds nothing to run */
+}
+
+std::shared_ptr<IPeriodicJob> PeriodicJobController::findJob(
+  const JOBID& job_id) const
+{
+  auto& shard = getShard(job_id);
+  std::scoped_lock<std::mutex> lock(shard.mutex);
+  auto* slot = findSlot(shard, job_id);
+  if (slot == nullptr)
+    return nullptr;
+  return slot->job_timer.job;
+}
+
 bool PeriodicJobController::removeJob(JOBID job_id)
 {
-  std::scoped_lock<std::mutex> lock(m_mutex);
-  if (m_active_jobs.find(job_id) == m_active_jobs.end() )
-    return false; // there is no such job
-  
-  m_active_jobs.at(job_id)->stop();
-  m_active_jobs.erase(job_id);
+  auto& shard = getShard(job_id);
+  {
+    std::scoped_lock<std::mutex> lock(shard.mutex);
+    auto* slot = findSlot(shard, job_id);
+    if (slot == nullptr)
+      return false; // there is no such job
+    
+    eraseJob(shard, job_id.get_index() / m_shards.size());
+  }
   
   std::cout << "Job with ID " << job_id << 
     " has been removed" << std::endl;
@@ -141,22 +385,26 @@ bool PeriodicJobController::removeJob(JOBID job_id)
 
 JOBID PeriodicJobController::removeAnArbitraryJob()
 {
-  std::scoped_lock<std::mutex> lock(m_mutex);
-  std::string retVal = ""; /* Return Value: Deleted job ID*/
-
-  /* If the queue is empty, there is no job to remove since
-  nothing has been removed */
-  if(m_active_jobs.empty())
-    return "";
+  JOBID retVal; /* Return Value: Deleted job ID*/
 
-
-  /* Remove a random element from the container. Since this is
-  an unordered container, removing first element is like
-  removing a random element. */
-  const auto itr = m_active_jobs.begin();
-  retVal = itr->first;
-  itr->second->stop();
-  m_active_jobs.erase(retVal);
+  /* Remove the last added job of the first non-empty shard;
+  like removing a random element. If all of them are empty,
+  there is no job to remove. */
+  for (std::size_t shard_index = 0; shard_index < m_shards.size();
+       shard_index++)
+  {
+    auto& shard = *m_shards[shard_index];
+    std::scoped_lock<std::mutex> lock(shard.mutex);
+    if (shard.active_slots.empty())
+      continue;
+    auto slot_index = shard.active_slots.back();
+    retVal = toJobId(shard_index, slot_index, 
+                     shard.slots[slot_index]);
+    eraseJob(shard, slot_index);
+    break;
+  }
+  if (retVal.empty())
+    return retVal;
   
   std::cout << "Job with ID " << retVal 
   << " has been removed" << std::endl;
@@ -166,26 +414,46 @@ JOBID PeriodicJobController::removeAnArbitraryJob()
 
 bool PeriodicJobController::changePeriod(
   JOBID job_id, 
-  struct timeval period
+  Common::Nanoseconds period_ns
   )
 {
-  std::scoped_lock<std::mutex> lock(m_mutex);
-  if(m_active_jobs.find(job_id) == m_active_jobs.end() )
-    return false; // no such job_id
+  auto& shard = getShard(job_id);
+  {
+    std::scoped_lock<std::mutex> lock(shard.mutex);
+    auto* slot = findSlot(shard, job_id);
+    if (slot == nullptr)
+      return false; // no such job_id
+
+    auto& job_timer = slot->job_timer;
+    job_timer.job->changePeriod(period_ns);
+
+    /* The next cycle is one (new) period after the last one;
+    an unanchored job has no last one, nor a timer yet. */
+    if (job_timer.is_scheduled())
+    {
+      shard.timer_wheel.remove(job_timer);
+      shard.timer_wheel.insert(job_timer, job_timer.last_run_tick 
+                               + toPeriodTicks(period_ns));
+      updateTimeSubscription(shard);
+    }
+  }
 
-  m_active_jobs.at(job_id)->changePeriod(period);
   std::cout << "The period for job with ID " << job_id 
             << " has been successfully changed" << std::endl;
   
   return true;
 }
 
-// const std::unordered_map 
-//   <
-//     JOBID, 
-//     std::shared_ptr<IPeriodicJob> 
-//   >& 
-//   PeriodicJobController::get_active_jobs()
-//   {
-//     return m_active_jobs;
-//   }
\ No newline at end of file
+bool PeriodicJobController::changeCatchUpMode(
+  JOBID job_id, 
+  Common::CatchUpMode catch_up_mode)
+{
+  auto& shard = getShard(job_id);
+  std::scoped_lock<std::mutex> lock(shard.mutex);
+  auto* slot = findSlot(shard, job_id);
+  if (slot == nullptr)
+    return false; // no such job_id
+
+  slot->job_timer.job->set_catch_up_mode(catch_up_mode);
+  return true;
+}
@@ -10,15 +10,26 @@
 
 #include "private/PeriodicJobControllerFriend.h"
 
-const std::unordered_map 
-  <
-    JOBID, 
-    std::shared_ptr<IPeriodicJob> 
-  >& 
+std::size_t PeriodicJobControllerFriend::ActiveJobs::size() const
+{
+  return m_controller->get_number_of_jobs();
+}
+
+PeriodicJobControllerFriend::ActiveJobs::const_iterator
+  PeriodicJobControllerFriend::ActiveJobs::find(
+    const JOBID& job_id) const
+{
+  auto job = m_controller->findJob(job_id);
+  if (job == nullptr)
+    return end();
+  return const_iterator(job_id, std::move(job));
+}
+
+PeriodicJobControllerFriend::ActiveJobs
   PeriodicJobControllerFriend::
     get_active_jobs(
     std::shared_ptr<PeriodicJobController> 
     periodic_job_controller_ptr)
     {
-      return periodic_job_controller_ptr->m_active_jobs;
-    }
\ No newline at end of file
+      return ActiveJobs(std::move(periodic_job_controller_ptr));
+    }
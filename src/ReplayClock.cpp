@@ -0,0 +1,80 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in ReplayClock.h
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "ReplayClock.h"
+#include <cstdlib> // strtod
+#include <thread>
+
+ReplayClock::ReplayClock(Common::ReplayMode mode, double speed)
+  : m_mode(mode), m_speed(speed)
+{
+  if (m_mode == Common::ReplayMode::kRealTime)
+    m_speed = 1.0;
+  /* a non-positive speed would never let a packet be due */
+  if (m_mode == Common::ReplayMode::kScaled && !(m_speed > 0.0))
+    m_mode = Common::ReplayMode::kMaxSpeed;
+}
+
+bool ReplayClock::fromString(const std::string& text,
+                             ReplayClock& replay_clock)
+{
+  if (text == "max")
+  {
+    replay_clock = ReplayClock(Common::ReplayMode::kMaxSpeed);
+    return true;
+  }
+  if (text == "realtime")
+  {
+    replay_clock = ReplayClock(Common::ReplayMode::kRealTime);
+    return true;
+  }
+
+  char* end = nullptr;
+  const double speed = std::strtod(text.c_str(), &end);
+  if (text.empty() || *end != '\0' || !(speed > 0.0))
+    return false;
+  replay_clock = ReplayClock(Common::ReplayMode::kScaled, speed);
+  return true;
+}
+
+std::chrono::nanoseconds ReplayClock::get_time_until_due(
+  int64_t arrival_time_ns)
+{
+  if (m_mode == Common::ReplayMode::kMaxSpeed)
+    return std::chrono::nanoseconds(0);
+
+  const auto now = std::chrono::steady_clock::now();
+  if (!m_is_started)
+  {
+    m_is_started = true;
+    m_first_arrival_time_ns = arrival_time_ns;
+    m_wall_start = now;
+    return std::chrono::nanoseconds(0);
+  }
+
+  const auto capture_offset_ns = 
+    arrival_time_ns - m_first_arrival_time_ns;
+  if (capture_offset_ns <= 0)
+    return std::chrono::nanoseconds(0);
+  const auto due_time = m_wall_start 
+    + std::chrono::nanoseconds(static_cast<int64_t>(
+        static_cast<double>(capture_offset_ns) / m_speed));
+  if (due_time <= now)
+    return std::chrono::nanoseconds(0);
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    due_time - now);
+}
+
+void ReplayClock::waitUntilDue(int64_t arrival_time_ns)
+{
+  const auto time_until_due = get_time_until_due(arrival_time_ns);
+  if (time_until_due.count() > 0)
+    std::this_thread::sleep_for(time_until_due);
+}
@@ -0,0 +1,466 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in TcpReassembler.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "TcpReassembler.h"
+#include <algorithm> // max
+#include <atomic>
+#include <iterator> // prev
+
+namespace
+{
+  constexpr uint8_t kTcpFlagFin = 0x01;
+  constexpr uint8_t kTcpFlagSyn = 0x02;
+  constexpr uint8_t kTcpFlagRst = 0x04;
+
+  /**
+   * @brief The segments further ahead of the next expected
+   * octet than the largest (scaled) TCP window are not
+   * believed.
+   */
+  constexpr int64_t kMaxSequenceDistance = int64_t(1) << 30;
+
+  /**
+   * @brief What a buffered segment costs in the budget besides
+   * its octets (roughly a node of the map and a vector).
+   */
+  constexpr std::size_t kSegmentOverheadOctets = 96;
+
+  std::atomic<std::size_t> g_memory_budget{
+    Common::kTcpReassemblyMemoryBudget};
+  std::atomic<std::size_t> g_number_of_buffered_octets{0};
+
+  inline uint32_t readBigEndianU32(const uint8_t* field)
+  {
+    return (uint32_t(field[0]) << 24) | (uint32_t(field[1]) << 16)
+           | (uint32_t(field[2]) << 8) | field[3];
+  }
+
+  inline std::size_t getCost(std::size_t length)
+  {
+    return length + kSegmentOverheadOctets;
+  }
+}
+
+TcpReassembler::TcpReassembler(
+  ITcpStreamHandler& handler, 
+  Common::TcpOverlapPolicy overlap_policy)
+  : m_handler(handler), m_overlap_policy(overlap_policy) {}
+
+TcpReassembler::~TcpReassembler()
+{
+  g_number_of_buffered_octets.fetch_sub(
+    m_number_of_buffered_octets, std::memory_order_relaxed);
+}
+
+void TcpReassembler::set_memory_budget(std::size_t octets)
+{
+  g_memory_budget.store(octets, std::memory_order_relaxed);
+}
+
+std::size_t TcpReassembler::get_memory_budget()
+{
+  return g_memory_budget.load(std::memory_order_relaxed);
+}
+
+std::size_t TcpReassembler::get_total_number_of_buffered_octets()
+{
+  return g_number_of_buffered_octets.load(
+    std::memory_order_relaxed);
+}
+
+bool TcpReassembler::reserve(const FlowKey& key, std::size_t octets)
+{
+  /* a segment bigger than the whole budget would only flush
+  everything else before being dropped anyway */
+  if (octets > get_memory_budget())
+    return false;
+  while (true)
+  {
+    auto total = g_number_of_buffered_octets.load(
+      std::memory_order_relaxed);
+    if (total + octets <= get_memory_budget())
+    {
+      if (g_number_of_buffered_octets.compare_exchange_weak(
+            total, total + octets, std::memory_order_relaxed))
+        return true;
+      continue;
+    }
+
+    /* Make room by flushing the least recently buffered stream
+    of this reassembler; the stream asking for the room is not
+    flushed under its own feet. The streams of the other
+    reassemblers belong to the other threads. */
+    auto lru_iterator = m_lru.begin();
+    if (lru_iterator != m_lru.end() && *lru_iterator == key)
+      ++lru_iterator;
+    if (lru_iterator == m_lru.end())
+      return false;
+    const FlowKey flushed_key = *lru_iterator;
+    auto& flushed_stream = m_streams.find(flushed_key)->second;
+    flush(flushed_key, flushed_stream);
+    m_number_of_flushed_streams++;
+    if (!checkFin(flushed_key, flushed_stream, 
+                  TcpDirection::kAToB))
+      checkFin(flushed_key, flushed_stream, TcpDirection::kBToA);
+  }
+}
+
+void TcpReassembler::release(Stream& stream, std::size_t octets)
+{
+  stream.number_of_buffered_octets -= octets;
+  m_number_of_buffered_octets -= octets;
+  g_number_of_buffered_octets.fetch_sub(octets,
+                                        std::memory_order_relaxed);
+  if (stream.number_of_buffered_octets == 0 && stream.is_in_lru)
+  {
+    m_lru.erase(stream.lru_position);
+    stream.is_in_lru = false;
+  }
+}
+
+void TcpReassembler::eraseStream(
+  StreamMap::iterator stream_iterator)
+{
+  auto& stream = stream_iterator->second;
+  if (stream.number_of_buffered_octets > 0)
+    release(stream, stream.number_of_buffered_octets);
+  m_streams.erase(stream_iterator);
+}
+
+bool TcpReassembler::buffer(const FlowKey& key, Stream& stream,
+                            HalfStream& half, const Piece& piece)
+{
+  const auto cost = getCost(piece.length);
+  if (!reserve(key, cost))
+    return false;
+  half.segments.emplace(
+    piece.offset,
+    std::vector<uint8_t>(piece.data, piece.data + piece.length));
+  stream.number_of_buffered_octets += cost;
+  m_number_of_buffered_octets += cost;
+
+  /* the most recently buffered stream goes to the back */
+  if (stream.is_in_lru)
+    m_lru.splice(m_lru.end(), m_lru, stream.lru_position);
+  else
+  {
+    stream.lru_position = m_lru.insert(m_lru.end(), key);
+    stream.is_in_lru = true;
+  }
+  return true;
+}
+
+void TcpReassembler::deliver(const FlowKey& key, Stream& stream,
+                             TcpDirection direction,
+                             const uint8_t* data, 
+                             std::size_t length)
+{
+  auto& half = stream.halves[static_cast<int>(direction)];
+  m_handler.onData(key, direction, half.next_offset, data, length);
+  half.next_offset += length;
+  half.next_sequence += static_cast<uint32_t>(length);
+
+  /* the buffered segments the data has made contiguous */
+  auto& segments = half.segments;
+  while (!segments.empty()
+         && segments.begin()->first == half.next_offset)
+  {
+    auto segment = segments.begin();
+    const auto segment_length = segment->second.size();
+    m_handler.onData(key, direction, half.next_offset,
+                     segment->second.data(), segment_length);
+    half.next_offset += segment_length;
+    half.next_sequence += static_cast<uint32_t>(segment_length);
+    segments.erase(segment);
+    release(stream, getCost(segment_length));
+  }
+}
+
+void TcpReassembler::flush(const FlowKey& key, Stream& stream)
+{
+  for (auto direction : {TcpDirection::kAToB, TcpDirection::kBToA})
+  {
+    auto& half = stream.halves[static_cast<int>(direction)];
+    while (!half.segments.empty())
+    {
+      auto segment = half.segments.begin();
+      if (segment->first > half.next_offset)
+      {
+        const auto gap = segment->first - half.next_offset;
+        m_handler.onGap(key, direction, half.next_offset, gap);
+        half.next_offset += gap;
+        half.next_sequence += static_cast<uint32_t>(gap);
+      }
+      /* delivers the segment (and releases it) */
+      const auto segment_data = std::move(segment->second);
+      half.segments.erase(segment);
+      release(stream, getCost(segment_data.size()));
+      m_handler.onData(key, direction, half.next_offset,
+                       segment_data.data(), segment_data.size());
+      half.next_offset += segment_data.size();
+      half.next_sequence +=
+        static_cast<uint32_t>(segment_data.size());
+    }
+  }
+}
+
+void TcpReassembler::resolveOverlaps(const FlowKey& key,
+                                     Stream& stream,
+                                     HalfStream& half,
+                                     const Piece& data,
+                                     std::vector<Piece>& pieces)
+{
+  pieces.clear();
+  const auto start = data.offset;
+  const auto end = data.offset + data.length;
+  auto& segments = half.segments;
+
+  /* the first segment ending after the start */
+  auto segment = segments.upper_bound(start);
+  if (segment != segments.begin())
+  {
+    auto previous = std::prev(segment);
+    if (previous->first + previous->second.size() > start)
+      segment = previous;
+  }
+
+  if (m_overlap_policy == Common::TcpOverlapPolicy::kFirst)
+  {
+    /* only the holes between the buffered segments are filled
+    */
+    auto cursor = start;
+    for (; segment != segments.end() && segment->first < end;
+         ++segment)
+    {
+      if (segment->first > cursor)
+        pieces.push_back({cursor, data.data + (cursor - start),
+                          segment->first - cursor});
+      cursor = std::max<uint64_t>(
+        cursor, segment->first + segment->second.size());
+    }
+    if (cursor < end)
+      pieces.push_back({cursor, data.data + (cursor - start),
+                        end - cursor});
+    return;
+  }
+
+  /* kLast: the buffered segments give way to the new data; the
+  parts of them out of it are kept */
+  while (segment != segments.end() && segment->first < end)
+  {
+    const auto segment_start = segment->first;
+    auto segment_data = std::move(segment->second);
+    segment = segments.erase(segment);
+
+    std::vector<Piece> kept_parts;
+    if (segment_start < start)
+      kept_parts.push_back({segment_start, segment_data.data(),
+                            start - segment_start});
+    const auto segment_end = segment_start + segment_data.size();
+    if (segment_end > end)
+      kept_parts.push_back({end, segment_data.data()
+                                 + (end - segment_start),
+                            segment_end - end});
+
+    /* The parts take over the charge of the segment. Cutting it
+    in two costs an overhead more than the segment did, which
+    has to be reserved; if it does not fit, the part after the
+    new data is given up. */
+    const auto released_cost = getCost(segment_data.size());
+    std::size_t kept_cost = 0;
+    for (const auto& part : kept_parts)
+      kept_cost += getCost(part.length);
+    if (kept_cost > released_cost
+        && !reserve(key, kept_cost - released_cost))
+    {
+      kept_cost -= getCost(kept_parts.back().length);
+      kept_parts.pop_back();
+      m_number_of_dropped_segments++;
+    }
+    if (kept_cost > released_cost)
+    {
+      stream.number_of_buffered_octets += kept_cost - released_cost;
+      m_number_of_buffered_octets += kept_cost - released_cost;
+    }
+    else
+      release(stream, released_cost - kept_cost);
+
+    for (const auto& part : kept_parts)
+      segments.emplace(part.offset, std::vector<uint8_t>(
+        part.data, part.data + part.length));
+  }
+  pieces.push_back(data);
+}
+
+void TcpReassembler::addData(const FlowKey& key, Stream& stream,
+                             TcpDirection direction, uint64_t offset,
+                             const uint8_t* data, 
+                             std::size_t length)
+{
+  auto& half = stream.halves[static_cast<int>(direction)];
+
+  /* the part already delivered is never replaced */
+  if (offset < half.next_offset)
+  {
+    const auto delivered_length = half.next_offset - offset;
+    if (delivered_length >= length)
+      return; // a retransmission
+    data += delivered_length;
+    length -= delivered_length;
+    offset = half.next_offset;
+  }
+
+  /* the usual case: in order and nothing is waiting */
+  if (offset == half.next_offset && half.segments.empty())
+  {
+    deliver(key, stream, direction, data, length);
+    return;
+  }
+
+  std::vector<Piece> pieces;
+  resolveOverlaps(key, stream, half, {offset, data, length},
+                  pieces);
+  /* the parts of the segments kept by kLast might have left
+  the LRU with the segments they were part of */
+  if (stream.number_of_buffered_octets > 0 && !stream.is_in_lru)
+  {
+    stream.lru_position = m_lru.insert(m_lru.end(), key);
+    stream.is_in_lru = true;
+  }
+  /* the pieces are in order, so a piece is contiguous once the
+  ones before it (and the segments between) are delivered */
+  for (const auto& piece : pieces)
+    if (piece.offset == half.next_offset)
+      deliver(key, stream, direction, piece.data, piece.length);
+    else if (!buffer(key, stream, half, piece))
+      m_number_of_dropped_segments++;
+}
+
+bool TcpReassembler::checkFin(const FlowKey& key, Stream& stream,
+                              TcpDirection direction)
+{
+  auto& half = stream.halves[static_cast<int>(direction)];
+  if (half.has_fin && !half.is_closed
+      && half.next_offset >= half.fin_offset)
+  {
+    half.is_closed = true;
+    /* nothing after the FIN is part of the stream */
+    while (!half.segments.empty())
+    {
+      auto segment = half.segments.begin();
+      release(stream, getCost(segment->second.size()));
+      half.segments.erase(segment);
+    }
+  }
+  if (!stream.halves[0].is_closed || !stream.halves[1].is_closed)
+    return false;
+  m_handler.onClose(key, ITcpStreamHandler::CloseReason::kFin);
+  eraseStream(m_streams.find(key));
+  return true;
+}
+
+void TcpReassembler::processSegment(const FlowKey& key,
+                                    TcpDirection direction,
+                                    const uint8_t* data,
+                                    const DecodedPacket& decoded)
+{
+  const uint8_t* tcp_header = data + decoded.l4_offset;
+  const uint32_t sequence = readBigEndianU32(tcp_header + 4);
+  const uint8_t flags = tcp_header[13];
+
+  std::size_t length = decoded.get_payload_length();
+
+  auto stream_iterator = m_streams.find(key);
+  if (stream_iterator == m_streams.end())
+  {
+    /* Only a segment with data, a SYN or a FIN starts tracking
+    a connection; a RST of a connection not tracked has nothing
+    to close and a pure ACK (e.g. the last one of a closed
+    connection) nothing to deliver. */
+    if ((flags & kTcpFlagRst)
+        || (length == 0 && (flags & (kTcpFlagSyn | kTcpFlagFin)) == 0))
+      return;
+    stream_iterator = m_streams.emplace(key, Stream()).first;
+  }
+  auto& stream = stream_iterator->second;
+  if (flags & kTcpFlagRst)
+  {
+    m_handler.onClose(key, ITcpStreamHandler::CloseReason::kReset);
+    eraseStream(stream_iterator);
+    return;
+  }
+
+  auto& half = stream.halves[static_cast<int>(direction)];
+  if (half.is_closed)
+    return;
+
+  /* The SYN takes a sequence number before the first octet. If
+  it was not captured, the stream starts at the first segment
+  seen. */
+  const bool is_syn = (flags & kTcpFlagSyn) != 0;
+  const uint32_t data_sequence = sequence + (is_syn ? 1 : 0);
+  if (!half.is_started)
+  {
+    half.is_started = true;
+    half.next_sequence = data_sequence;
+  }
+
+  /* the offset of the segment relative to the next octet; the
+  sequence numbers wrap around */
+  const auto distance = static_cast<int64_t>(
+    static_cast<int32_t>(data_sequence - half.next_sequence));
+  if (distance > kMaxSequenceDistance)
+  {
+    m_number_of_dropped_segments++;
+    return;
+  }
+  const int64_t offset =
+    static_cast<int64_t>(half.next_offset) + distance;
+  const uint8_t* payload = data + decoded.payload_offset;
+  int64_t end = offset + static_cast<int64_t>(length);
+
+  if (end > static_cast<int64_t>(half.next_offset) && length > 0)
+  {
+    /* before the start of the stream (offset < 0) is trimmed
+    like an already delivered part */
+    const auto start = std::max<int64_t>(offset, 0);
+    const auto skipped_length = 
+      static_cast<std::size_t>(start - offset);
+    addData(key, stream, direction, static_cast<uint64_t>(start),
+            payload + skipped_length, length - skipped_length);
+  }
+
+  if ((flags & kTcpFlagFin) && !half.has_fin)
+  {
+    half.has_fin = true;
+    half.fin_offset = static_cast<uint64_t>(
+      std::max<int64_t>(end, 0));
+  }
+  checkFin(key, stream, direction);
+}
+
+void TcpReassembler::closeStream(const FlowKey& key)
+{
+  auto stream_iterator = m_streams.find(key);
+  if (stream_iterator == m_streams.end())
+    return;
+  flush(key, stream_iterator->second);
+  m_handler.onClose(key, ITcpStreamHandler::CloseReason::kTimeout);
+  eraseStream(stream_iterator);
+}
+
+void TcpReassembler::closeAllStreams()
+{
+  while (!m_streams.empty())
+  {
+    const FlowKey key = m_streams.begin()->first;
+    closeStream(key);
+  }
+}
@@ -0,0 +1,165 @@
+/**
+ * @file
+ *
+ * @brief This file contains the implementations of the methods
+ * declared in common/WorkerPool.h.
+ *
+ * @author Aybars Kerem TAŞKAN
+ *
+ */
+
+#include "common/WorkerPool.h"
+#include <utility>
+
+namespace
+{
+  /**
+   * @brief The pool the current thread is a worker of (if any)
+   * and its index in this pool.
+   */
+  thread_local const Common::WorkerPool* t_worker_pool = nullptr;
+  thread_local std::size_t t_worker_index = 0;
+}
+
+namespace Common
+{
+  WorkerPool& WorkerPool::getInstance()
+  {
+    static WorkerPool singleton_instance(kNumberOfJobWorkers);
+    return singleton_instance;
+  }
+
+  WorkerPool::WorkerPool(unsigned number_of_workers)
+  {
+    if (number_of_workers == 0)
+      number_of_workers = std::thread::hardware_concurrency();
+    /* hardware_concurrency might not be computable */
+    if (number_of_workers == 0)
+      number_of_workers = 1;
+
+    /* all the run queues exist before any worker looks for a
+    task to steal */
+    for (unsigned i = 0; i < number_of_workers; i++)
+      m_workers.push_back(std::make_unique<Worker>());
+    for (std::size_t i = 0; i < m_workers.size(); i++)
+      m_workers[i]->thread = 
+        std::thread(&WorkerPool::runWorker, this, i);
+  }
+
+  WorkerPool::~WorkerPool()
+  {
+    {
+      std::scoped_lock<std::mutex> lock(m_sleep_mutex);
+      m_should_stop_running = true;
+    }
+    m_sleep_condition.notify_all();
+    for (auto& worker : m_workers)
+      worker->thread.join();
+  }
+
+  void WorkerPool::submit(Task task)
+  {
+    std::size_t worker_index;
+    if (t_worker_pool == this)
+      worker_index = t_worker_index;
+    else
+      worker_index = m_next_worker_index.fetch_add(
+        1, std::memory_order_relaxed) % m_workers.size();
+
+    m_number_of_unfinished_tasks++;
+    {
+      auto& worker = *m_workers[worker_index];
+      std::scoped_lock<std::mutex> lock(worker.mutex);
+      /* Counted before the task can be taken (under the lock of
+      its queue), so the count never goes below zero. Either
+      this sees a worker going to sleep or that worker sees the
+      task (both are sequentially consistent), so a task is
+      never left behind while all the workers sleep. */
+      m_number_of_queued_tasks++;
+      worker.tasks.push_back(std::move(task));
+    }
+    if (m_number_of_sleeping_workers.load() > 0)
+    {
+      /* taking the lock makes sure the worker is either still
+      checking for tasks or already waiting */
+      { std::scoped_lock<std::mutex> lock(m_sleep_mutex); }
+      m_sleep_condition.notify_one();
+    }
+  }
+
+  void WorkerPool::waitUntilIdle()
+  {
+    std::unique_lock<std::mutex> lock(m_idle_mutex);
+    m_idle_condition.wait(lock, [this]()
+    {
+      return m_number_of_unfinished_tasks.load() == 0;
+    });
+  }
+
+  bool WorkerPool::takeTask(std::size_t worker_index, Task& task)
+  {
+    {
+      auto& worker = *m_workers[worker_index];
+      std::scoped_lock<std::mutex> lock(worker.mutex);
+      if (!worker.tasks.empty())
+      {
+        task = std::move(worker.tasks.front());
+        worker.tasks.pop_front();
+        m_number_of_queued_tasks--;
+        return true;
+      }
+    }
+
+    for (std::size_t i = 1; i < m_workers.size(); i++)
+    {
+      auto& victim = *m_workers[(worker_index + i) 
+                                % m_workers.size()];
+      std::scoped_lock<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty())
+      {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        m_number_of_queued_tasks--;
+        m_number_of_stolen_tasks.fetch_add(
+          1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void WorkerPool::runWorker(std::size_t worker_index)
+  {
+    t_worker_pool = this;
+    t_worker_index = worker_index;
+
+    while (true)
+    {
+      Task task;
+      if (!takeTask(worker_index, task))
+      {
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_number_of_sleeping_workers++;
+        m_sleep_condition.wait(lock, [this]()
+        {
+          return m_should_stop_running 
+                 || m_number_of_queued_tasks.load() > 0;
+        });
+        m_number_of_sleeping_workers--;
+        /* drain the queues before stopping */
+        if (m_should_stop_running 
+            && m_number_of_queued_tasks.load() == 0)
+          return;
+        continue;
+      }
+
+      task();
+
+      if (--m_number_of_unfinished_tasks == 0)
+      {
+        { std::scoped_lock<std::mutex> lock(m_idle_mutex); }
+        m_idle_condition.notify_all();
+      }
+    }
+  }
+}
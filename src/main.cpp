@@ -10,12 +10,25 @@
  *
  */
 
-#include "PcapPacketQueueWriter.h"
+#include "ClockStage.h"
+#include "FilteringSink.h"
 #include "PacketProcessing.h"
+#include "PcapFileWriter.h"
+#include "PcapPacketQueueWriter.h"
+#include "PcapReaderFactory.h"
+#include "ReplayClock.h"
+#include "PacketDispatcher.h"
 #include "PeriodicJobController.h"
+#include <cmath> // llround
 #include <iostream>
 #include <ctime> // sys/time.h
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 
 int main(int argc, char const *argv[])
@@ -26,25 +39,151 @@ int main(int argc, char const *argv[])
    */
 
   /*
-    Fire up a thread to fill the Singleton PcapPacketQueue
-    instance
+    If a capture file (pcap or pcapng) is given as the first
+    argument, it is opened (after the rest of the arguments are
+    parsed) into this reader declared first so that it outlives
+    every packet pointing into its memory (i.e. until all the
+    threads are joined).
+   */
+  std::unique_ptr<IPcapReader> pcap_reader;
+
+  /*
+    The optional second argument tells how fast to replay the
+    packets: "max" (default), "realtime" or a speed factor such
+    as "4" for four times faster than the capture.
+   */
+  ReplayClock replay_clock;
+  if (argc > 2 && !ReplayClock::fromString(argv[2], replay_clock))
+  {
+    std::cout << "unknown replay mode " << argv[2] 
+      << "; expected max, realtime or a speed factor" 
+      << std::endl;
+    return 1;
+  }
+
+  /*
+    Any further arguments are filter expressions such as
+    "tcp and port 80"; only the packets matching at least one
+    of them are queued. The processed packets are written into
+    a capture file with "-w FILE" (pcapng if FILE ends with
+    .pcapng), split into files of at most "-C MEGABYTES" and/or
+    of "-G SECONDS" of packet time like tcpdump does. Only the
+    packets arriving from "--start SECONDS" until "--end
+    SECONDS" (since the epoch) are read, through the index of
+    the capture file.
+   */
+  std::vector<PacketFilter> packet_filters;
+  std::string output_file_path;
+  uint64_t max_output_file_size = 0;
+  long long output_file_period_seconds = 0;
+  typedef std::numeric_limits<Common::Nanoseconds> TimeLimits;
+  auto start_time_ns = TimeLimits::min();
+  auto end_time_ns = TimeLimits::max();
+  for (int i = 3; i < argc; i++)
+  {
+    const std::string argument = argv[i];
+    if (argument == "-w" || argument == "-C" || argument == "-G"
+        || argument == "--start" || argument == "--end")
+    {
+      if (i + 1 == argc)
+      {
+        std::cout << argument << " needs a value" << std::endl;
+        return 1;
+      }
+      const std::string value = argv[++i];
+      try
+      {
+        if (argument == "-w")
+          output_file_path = value;
+        else if (argument == "-C")
+          max_output_file_size = std::stoull(value) * 1000 * 1000;
+        else if (argument == "-G")
+          output_file_period_seconds = std::stoll(value);
+        else
+          (argument == "--start" ? start_time_ns : end_time_ns) =
+            std::llround(std::stod(value) 
+                         * Common::kNanosecondsPerSecond);
+      }
+      catch (const std::exception&)
+      {
+        std::cout << "invalid " << argument << " value " << value
+          << std::endl;
+        return 1;
+      }
+      continue;
+    }
+    packet_filters.emplace_back();
+    if (!PacketFilter::fromString(argument, packet_filters.back()))
+      return 1;
+  }
+
+  if (argc > 1)
+  {
+    const bool is_time_window = start_time_ns != TimeLimits::min()
+                                || end_time_ns != TimeLimits::max();
+    pcap_reader = is_time_window
+      ? openPcapReader(argv[1], start_time_ns, end_time_ns)
+      : openPcapReader(argv[1]);
+    if (!pcap_reader)
+      return 1;
+  }
+
+  PcapFileWriter packet_output;
+  if (!output_file_path.empty())
+  {
+    packet_output.set_rotation(
+      max_output_file_size,
+      output_file_period_seconds * Common::kNanosecondsPerSecond);
+    if (!packet_output.open(output_file_path))
+      return 1;
+    setPacketOutput(&packet_output);
+  }
+
+  /*
+    Fire up the thread moving the external time (and running
+    the PeriodicJobs) according to the packets processed.
+   */
+  ClockStage::getInstance().start();
+
+  /*
+    Create the pcap processor threads; one per hardware thread
+    by default (see Common::kNumberOfPacketProcessors). The
+    dispatcher keeps every flow on one of them and each keeps
+    processing its own shard until the writer signals the end
+    of stream.
+   */
+  PacketDispatcher packet_dispatcher;
+  packet_dispatcher.start();
+  std::cout << packet_dispatcher.get_number_of_shards()
+    << " packet processor threads are started." << std::endl;
+
+  FilteringSink filtering_sink(packet_dispatcher,
+                               std::move(packet_filters));
+
+  /*
+    Fire up a thread to fill the shards of the dispatcher
+    through the filters.
 
     We have to use a lambda function here since std::thread
     wouldn't know the default parameters of a function passed to
-    itself given the function pointer only. As an alternative we
-    can pass the argument explicitly: std::thread pcap_writer(
-    writeToPcapPacketQueue, 20)
+    itself given the function pointer only.
+
+    Without a capture file, some bogus packets are pushed
+    instead.
    */
   std::thread pcap_writer( 
-    []() { writeToPcapPacketQueue(); } 
+    [&pcap_reader, &filtering_sink, &replay_clock]() 
+    { 
+      if (pcap_reader)
+        writeToPacketSink(filtering_sink, *pcap_reader,
+                          replay_clock);
+      else
+        writeToPacketSink(filtering_sink, 
+                          Common::kMaxNumberOfPacketsToWrite,
+                          replay_clock); 
+    } 
     );
 
-  /* Create some pcap processor threads.
-  */
-  std::thread packet_processor_1 ( processPackets );
-  // std::thread packet_processor_2 ( processPackets );
-  // std::thread packet_processor_3 ( processPackets );
-
   /* Proof of we can add a job from anywhere in the code */
   struct timeval tv = {3, 0};
   auto job_id = g_ptr_periodic_class_controller_instance
@@ -74,9 +213,39 @@ int main(int argc, char const *argv[])
   /* Join all the threads we fired up.
   */
   pcap_writer.join();
-  packet_processor_1.join();
-  // packet_processor_2.join(); 
-  // packet_processor_3.join();
+  packet_dispatcher.join();
+  ClockStage::getInstance().stop();
+
+  for (std::size_t i = 0; i < filtering_sink.get_number_of_filters();
+       i++)
+  {
+    const auto& filter = filtering_sink.get_filter(i);
+    std::cout << "Filter \"" << filter.get_expression()
+      << "\" matched " << filter.get_number_of_matches()
+      << " of " << filter.get_number_of_packets()
+      << " packets." << std::endl;
+  }
+  if (filtering_sink.get_number_of_filters() > 0)
+    std::cout << filtering_sink.get_number_of_passed_packets()
+      << " of " << filtering_sink.get_number_of_packets()
+      << " packets passed the filters." << std::endl;
+
+  /* The processors are done; write what is left buffered. */
+  if (packet_output.is_open())
+  {
+    setPacketOutput(nullptr);
+    packet_output.close();
+    std::cout << packet_output.get_number_of_packets()
+      << " packets (" << packet_output.get_number_of_octets()
+      << " octets) are written into "
+      << packet_output.get_number_of_files() << " file(s)";
+    if (packet_output.get_number_of_stalls() > 0)
+      std::cout << "; the processors waited for the disk "
+        << packet_output.get_number_of_stalls() << " times";
+    std::cout << std::endl;
+    if (!packet_output.is_good())
+      return 1;
+  }
   return 0;
 }
 
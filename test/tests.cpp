@@ -13,7 +13,41 @@
  */
 
 #include "private/PeriodicJobControllerFriend.h"
+#include "PcapFileReader.h"
+#include "PcapngFileReader.h"
+#include "PcapFileWriter.h"
+#include "PcapIndex.h"
+#include "PcapReaderFactory.h"
+#include "common/RingBuffer.h"
+#include "common/LockFreePcapPacketQueue.h"
+#include "common/PacketBufferPool.h"
+#include "FlowHash.h"
+#include "FlowTable.h"
+#include "TcpReassembler.h"
+#include "FilteringSink.h"
+#include "PacketFilter.h"
+#include "PacketDecoder.h"
+#include "PacketDispatcher.h"
+#include "common/TimerWheel.h"
+#include "common/WorkerPool.h"
+#include "common/ExternalTime.h"
+#include "common/InplaceFunction.h"
+#include "ReplayClock.h"
+#include "ClockStage.h"
+#include "PcapPacketQueueWriter.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <climits> // CHAR_BITS
+#include <cstdlib> // mkstemp
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
 
 // #define BOOST_TEST_MAIN
 #define BOOST_TEST_MODULE offline_pcap_packet_processor_test_name
@@ -24,6 +58,148 @@ standalone library compilation
 #include <thread>
 
 
+namespace
+{
+  /**
+   * @brief Append the given 32-bit value to the buffer in host
+   * byte order like a pcap writer on this host would do.
+   */
+  void appendU32(std::vector<uint8_t>& buffer, uint32_t value)
+  {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+  }
+
+  void appendU16(std::vector<uint8_t>& buffer, uint16_t value)
+  {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+  }
+
+  void appendU64(std::vector<uint8_t>& buffer, uint64_t value)
+  {
+    appendU32(buffer, static_cast<uint32_t>(value));
+    appendU32(buffer, static_cast<uint32_t>(value >> 32));
+  }
+
+  /**
+   * @brief Append a pcapng Enhanced Packet Block with the given
+   * payload to the buffer.
+   */
+  void appendEnhancedPacketBlock(std::vector<uint8_t>& buffer,
+                                 uint32_t interface_id,
+                                 uint64_t timestamp,
+                                 std::vector<uint8_t> payload,
+                                 uint32_t len)
+  {
+    uint32_t caplen = payload.size();
+    payload.resize((caplen + 3) & ~3u, 0);
+    uint32_t block_length = 32 + payload.size();
+    appendU32(buffer, 6);
+    appendU32(buffer, block_length);
+    appendU32(buffer, interface_id);
+    appendU32(buffer, static_cast<uint32_t>(timestamp >> 32));
+    appendU32(buffer, static_cast<uint32_t>(timestamp));
+    appendU32(buffer, caplen);
+    appendU32(buffer, len);
+    buffer.insert(buffer.end(), payload.begin(), payload.end());
+    appendU32(buffer, block_length);
+  }
+
+  /**
+   * @brief Write the given bytes into a new temporary file and
+   * return its path.
+   */
+  std::string writeTemporaryFile(const std::vector<uint8_t>& bytes)
+  {
+    char path[] = "/tmp/offline_pcap_packet_processor_XXXXXX";
+    int fd = mkstemp(path);
+    BOOST_REQUIRE(fd >= 0);
+    BOOST_REQUIRE_EQUAL(
+      write(fd, bytes.data(), bytes.size()),
+      static_cast<ssize_t>(bytes.size())
+    );
+    close(fd);
+    return path;
+  }
+
+  /**
+   * @brief Build an Ethernet frame carrying an IPv4 packet
+   * with a TCP/UDP header (ports only) followed by the payload.
+   *
+   * @param protocol 6 for TCP, 17 for UDP etc.
+   * @param fragment_offset_field the flags & fragment offset
+   * field of the IPv4 header.
+   */
+  std::vector<uint8_t> buildIPv4Frame(
+    uint32_t source_address, uint32_t destination_address,
+    uint16_t source_port, uint16_t destination_port,
+    uint8_t protocol, std::vector<uint8_t> payload = {},
+    uint16_t fragment_offset_field = 0)
+  {
+    std::vector<uint8_t> frame(12, 0xaa);
+    frame.insert(frame.end(), {0x08, 0x00});
+    uint16_t total_length = 20 + 8 + payload.size();
+    frame.insert(frame.end(), {
+      0x45, 0, static_cast<uint8_t>(total_length >> 8),
+      static_cast<uint8_t>(total_length), 0, 0,
+      static_cast<uint8_t>(fragment_offset_field >> 8),
+      static_cast<uint8_t>(fragment_offset_field), 64, protocol,
+      0, 0});
+    for (auto address : {source_address, destination_address})
+      for (int shift = 24; shift >= 0; shift -= 8)
+        frame.push_back(static_cast<uint8_t>(address >> shift));
+    for (auto port : {source_port, destination_port})
+      frame.insert(frame.end(), {static_cast<uint8_t>(port >> 8),
+                                 static_cast<uint8_t>(port)});
+    /* rest of an 8-octet UDP header */
+    frame.insert(frame.end(), {0, 0, 0, 0});
+    frame.insert(frame.end(), payload.begin(), payload.end());
+    return frame;
+  }
+
+  /**
+   * @brief Build an Ethernet frame carrying an IPv4 packet
+   * with a 20-octet TCP header followed by the payload.
+   *
+   * @param flags the flags octet of the TCP header (e.g. 0x02
+   * for a SYN).
+   */
+  std::vector<uint8_t> buildTcpFrame(
+    uint32_t source_address, uint32_t destination_address,
+    uint16_t source_port, uint16_t destination_port,
+    uint32_t sequence, uint8_t flags, const std::string& payload)
+  {
+    auto frame = buildIPv4Frame(
+      source_address, destination_address, source_port,
+      destination_port, 6, std::vector<uint8_t>(12 + payload.size()));
+    uint16_t total_length = 20 + 20 + payload.size();
+    frame[14 + 2] = static_cast<uint8_t>(total_length >> 8);
+    frame[14 + 3] = static_cast<uint8_t>(total_length);
+    uint8_t* tcp_header = frame.data() + 14 + 20;
+    for (int i = 0; i < 4; i++)
+      tcp_header[4 + i] = static_cast<uint8_t>(sequence >> (24 - 8 * i));
+    tcp_header[12] = 5 << 4;
+    tcp_header[13] = flags;
+    std::copy(payload.begin(), payload.end(), tcp_header + 20);
+    return frame;
+  }
+
+  /**
+   * @brief Create a pooled packet holding a copy of the frame.
+   */
+  Common::PcapPacket makePacket(const std::vector<uint8_t>& frame,
+                                __time_t second = 1)
+  {
+    auto packet = Common::PcapPacket::allocate(
+      Common::PcapPacket::toNanoseconds({second, 0}), 
+      frame.size(), frame.size());
+    if (!frame.empty())
+      std::memcpy(packet.get_data(), frame.data(), frame.size());
+    return packet;
+  }
+}
+
 BOOST_AUTO_TEST_SUITE( UNIT_TEST_SUITE )
 
 /**
@@ -86,7 +262,7 @@ BOOST_AUTO_TEST_CASE (CONTROLLER_QUEUE_SIZE_TEST)
     2
   );
 
-  ptr_periodic_class_controller_instance->addJob(tv);
+  (void)ptr_periodic_class_controller_instance->addJob(tv);
   BOOST_REQUIRE_EQUAL(
     PeriodicJobControllerFriend::get_active_jobs
   (ptr_periodic_class_controller_instance).size(),
@@ -262,12 +438,12 @@ BOOST_AUTO_TEST_CASE (changePeriod_RETURNVALUE_TEST)
   struct timeval tv = {5, 0};
   BOOST_CHECK( 
     !ptr_periodic_class_controller_instance
-    ->changePeriod("not exist", tv)
+    ->changePeriod(JOBID(12345, 1), tv)
     );
   tv = {3, 1};
   BOOST_CHECK( 
     !ptr_periodic_class_controller_instance
-    ->changePeriod("", tv)
+    ->changePeriod(JOBID(), tv)
     );
 
   /* id1 is an existing job, period change should work */
@@ -309,7 +485,7 @@ BOOST_AUTO_TEST_CASE (changePeriod_BEHAVIOUR_TEST)
   const auto job_itr = active_jobs.find(id1);
 
   /* Check if the added job has the correct period value */
-  const auto& period = job_itr->second->get_period(); 
+  const auto period = job_itr->second->get_period();
   BOOST_REQUIRE_EQUAL(period.tv_sec, tv.tv_sec);
   BOOST_REQUIRE_EQUAL(period.tv_usec, tv.tv_usec);
 
@@ -318,9 +494,2349 @@ BOOST_AUTO_TEST_CASE (changePeriod_BEHAVIOUR_TEST)
   ptr_periodic_class_controller_instance
   ->changePeriod(id1, new_tv);
 
-  /* Check if the period now equals to the new value*/
-  BOOST_REQUIRE_EQUAL(period.tv_sec, new_tv.tv_sec);
-  BOOST_REQUIRE_EQUAL(period.tv_usec, new_tv.tv_usec); 
+  /* Check if the period now equals to the new value; the
+  period is returned by value, so it is read again */
+  const auto new_period = job_itr->second->get_period();
+  BOOST_REQUIRE_EQUAL(new_period.tv_sec, new_tv.tv_sec);
+  BOOST_REQUIRE_EQUAL(new_period.tv_usec, new_tv.tv_usec); 
+}
+
+/**
+ * @brief Checks that PcapFileReader walks the records of a
+ * classic pcap file in place and reports the right timestamps
+ * and lengths.
+ *
+ * A small file with a microsecond resolution global header, two
+ * complete records and a truncated third record is created.
+ * The truncated record must not be returned.
+ *
+ */
+BOOST_AUTO_TEST_CASE (PCAP_FILE_READER_TEST)
+{
+  std::vector<uint8_t> file;
+  appendU32(file, 0xa1b2c3d4);
+  appendU32(file, 2 | (4u << 16)); /* version 2.4 */
+  appendU32(file, 0);              /* thiszone */
+  appendU32(file, 0);              /* sigfigs */
+  appendU32(file, 65535);          /* snaplen */
+  appendU32(file, 1);              /* LINKTYPE_ETHERNET */
+
+  /* first record: 4 octets captured out of 60 */
+  appendU32(file, 100);
+  appendU32(file, 250);
+  appendU32(file, 4);
+  appendU32(file, 60);
+  file.insert(file.end(), {0xde, 0xad, 0xbe, 0xef});
+
+  /* second record: 2 octets */
+  appendU32(file, 101);
+  appendU32(file, 999999);
+  appendU32(file, 2);
+  appendU32(file, 2);
+  file.insert(file.end(), {0x01, 0x02});
+
+  /* truncated record claiming 8 octets while having 1 */
+  appendU32(file, 102);
+  appendU32(file, 0);
+  appendU32(file, 8);
+  appendU32(file, 8);
+  file.push_back(0xff);
+
+  auto path = writeTemporaryFile(file);
+
+  PcapFileReader reader;
+  BOOST_REQUIRE(reader.open(path));
+  BOOST_CHECK_EQUAL(reader.get_link_type(), 1u);
+  BOOST_CHECK_EQUAL(reader.get_snaplen(), 65535u);
+
+  Common::PcapPacket packet;
+  BOOST_REQUIRE(reader.nextPacket(packet));
+  BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_sec, 100);
+  BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_usec, 250);
+  BOOST_CHECK_EQUAL(packet.get_caplen(), 4u);
+  BOOST_CHECK_EQUAL(packet.get_len(), 60u);
+  BOOST_CHECK(packet.get_data_owner() 
+              == Common::PcapPacketDataOwner::kMappedFile);
+  BOOST_CHECK_EQUAL(packet.get_data()[0], 0xde);
+  BOOST_CHECK_EQUAL(packet.get_data()[3], 0xef);
+
+  BOOST_REQUIRE(reader.nextPacket(packet));
+  BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_sec, 101);
+  BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_usec, 999999);
+  BOOST_CHECK_EQUAL(packet.get_caplen(), 2u);
+  BOOST_CHECK_EQUAL(packet.get_data()[1], 0x02);
+
+  BOOST_CHECK(!reader.nextPacket(packet));
+  BOOST_CHECK(!reader.nextPacket(packet));
+
+  /* Rewinding must give the first packet again */
+  reader.rewind();
+  BOOST_REQUIRE(reader.nextPacket(packet));
+  BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_sec, 100);
+
+  /* A file which is not a pcap file must be rejected */
+  auto bogus_path = writeTemporaryFile(
+    std::vector<uint8_t>(32, 0x42));
+  PcapFileReader bogus_reader;
+  BOOST_CHECK(!bogus_reader.open(bogus_path));
+  BOOST_CHECK(!bogus_reader.is_open());
+
+  unlink(path.c_str());
+  unlink(bogus_path.c_str());
+}
+
+/**
+ * @brief Checks that PcapngFileReader decodes the blocks of a
+ * pcapng file and normalizes the timestamps of interfaces with
+ * different resolutions and offsets.
+ *
+ * The same file is read through windows of different sizes so
+ * that blocks spanning the window boundary and blocks larger
+ * than the window are exercised as well.
+ *
+ */
+BOOST_AUTO_TEST_CASE (PCAPNG_FILE_READER_TEST)
+{
+  std::vector<uint8_t> file;
+
+  /* Section Header Block */
+  appendU32(file, 0x0A0D0D0A);
+  appendU32(file, 28);
+  appendU32(file, 0x1A2B3C4D);
+  appendU16(file, 1);
+  appendU16(file, 0);
+  appendU64(file, ~0ULL);
+  appendU32(file, 28);
+
+  /* Interface 0: default (microsecond) resolution */
+  appendU32(file, 1);
+  appendU32(file, 20);
+  appendU16(file, 1);
+  appendU16(file, 0);
+  appendU32(file, 0);
+  appendU32(file, 20);
+
+  /* Interface 1: nanosecond resolution with a 100 seconds
+  offset */
+  appendU32(file, 1);
+  appendU32(file, 44);
+  appendU16(file, 1);
+  appendU16(file, 0);
+  appendU32(file, 0);
+  appendU16(file, 9);
+  appendU16(file, 1);
+  file.insert(file.end(), {9, 0, 0, 0});
+  appendU16(file, 14);
+  appendU16(file, 8);
+  appendU64(file, 100);
+  appendU32(file, 0);
+  appendU32(file, 44);
+
+  /* A block type which is unknown to the reader */
+  appendU32(file, 0x00000BAD);
+  appendU32(file, 16);
+  appendU32(file, 0xffffffff);
+  appendU32(file, 16);
+
+  appendEnhancedPacketBlock(file, 0, 5000123, {1, 2, 3}, 60);
+  appendEnhancedPacketBlock(file, 1, 7000456789ULL, {4, 5}, 2);
+
+  /* Interface 2: binary (2^-10) resolution */
+  appendU32(file, 1);
+  appendU32(file, 28);
+  appendU16(file, 1);
+  appendU16(file, 0);
+  appendU32(file, 0);
+  appendU16(file, 9);
+  appendU16(file, 1);
+  file.insert(file.end(), {0x8a, 0, 0, 0});
+  appendU32(file, 28);
+
+  appendEnhancedPacketBlock(file, 2, 3 * 1024 + 512, 
+                            std::vector<uint8_t>(40, 7), 40);
+
+  /* Simple Packet Block on interface 0 */
+  appendU32(file, 3);
+  appendU32(file, 20);
+  appendU32(file, 4);
+  file.insert(file.end(), {8, 9, 10, 11});
+  appendU32(file, 20);
+
+  auto path = writeTemporaryFile(file);
+
+  for (std::size_t window_size : {16, 48, 1 << 20})
+  {
+    PcapngFileReader reader;
+    BOOST_REQUIRE(reader.open(path, window_size));
+
+    Common::PcapPacket packet;
+    BOOST_REQUIRE(reader.nextPacket(packet));
+    BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_sec, 5);
+    BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_usec, 123);
+    BOOST_CHECK_EQUAL(packet.get_caplen(), 3u);
+    BOOST_CHECK_EQUAL(packet.get_len(), 60u);
+    BOOST_CHECK_EQUAL(packet.get_interface_index(), 0u);
+    BOOST_CHECK_EQUAL(packet.get_data()[2], 3);
+
+    BOOST_REQUIRE(reader.nextPacket(packet));
+    BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_sec, 107);
+    BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_usec, 456);
+    BOOST_CHECK_EQUAL(packet.get_caplen(), 2u);
+    BOOST_CHECK_EQUAL(packet.get_interface_index(), 1u);
+    BOOST_CHECK_EQUAL(packet.get_data()[0], 4);
+
+    BOOST_REQUIRE(reader.nextPacket(packet));
+    BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_sec, 3);
+    BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_usec, 500000);
+    BOOST_CHECK_EQUAL(packet.get_caplen(), 40u);
+    BOOST_CHECK_EQUAL(packet.get_interface_index(), 2u);
+    BOOST_CHECK_EQUAL(packet.get_data()[39], 7);
+
+    /* Simple Packet Blocks reuse the previous timestamp */
+    BOOST_REQUIRE(reader.nextPacket(packet));
+    BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_sec, 3);
+    BOOST_CHECK_EQUAL(packet.get_caplen(), 4u);
+    BOOST_CHECK_EQUAL(packet.get_data()[3], 11);
+
+    BOOST_CHECK(!reader.nextPacket(packet));
+    BOOST_CHECK_EQUAL(reader.get_number_of_interfaces(), 3u);
+  }
+
+  /* A classic pcap file is not a pcapng file */
+  PcapngFileReader reader;
+  std::vector<uint8_t> pcap_file;
+  appendU32(pcap_file, 0xa1b2c3d4);
+  pcap_file.resize(24, 0);
+  auto pcap_path = writeTemporaryFile(pcap_file);
+  BOOST_CHECK(!reader.open(pcap_path));
+
+  unlink(path.c_str());
+  unlink(pcap_path.c_str());
+}
+
+/**
+ * @brief Checks the FIFO order, the capacity rounding and the
+ * full/empty behaviour of the lock-free rings from a single
+ * thread.
+ *
+ */
+BOOST_AUTO_TEST_CASE (RING_BUFFER_BEHAVIOUR_TEST)
+{
+  Common::SpscRingBuffer<unsigned> spsc_ring(5);
+  Common::MpmcRingBuffer<unsigned> mpmc_ring(5);
+  BOOST_REQUIRE_EQUAL(spsc_ring.capacity(), 8u);
+  BOOST_REQUIRE_EQUAL(mpmc_ring.capacity(), 8u);
+
+  /* Go around the rings a few times */
+  for (unsigned lap = 0; lap < 3; lap++)
+  {
+    for (unsigned i = 0; i < 8; i++)
+    {
+      BOOST_CHECK(spsc_ring.tryPush(lap * 8 + i));
+      BOOST_CHECK(mpmc_ring.tryPush(lap * 8 + i));
+    }
+    /* rings are full now */
+    BOOST_CHECK(!spsc_ring.tryPush(1000));
+    BOOST_CHECK(!mpmc_ring.tryPush(1000));
+
+    unsigned value;
+    for (unsigned i = 0; i < 8; i++)
+    {
+      BOOST_REQUIRE(spsc_ring.tryPop(value));
+      BOOST_CHECK_EQUAL(value, lap * 8 + i);
+      BOOST_REQUIRE(mpmc_ring.tryPop(value));
+      BOOST_CHECK_EQUAL(value, lap * 8 + i);
+    }
+    /* rings are empty now */
+    BOOST_CHECK(!spsc_ring.tryPop(value));
+    BOOST_CHECK(!mpmc_ring.tryPop(value));
+  }
+
+  /* An empty lock-free queue gives an empty packet like the
+  Singleton PcapPacketQueue */
+  Common::MpmcPcapPacketQueue queue(4);
+  auto packet = queue.popPacket();
+  BOOST_CHECK(packet.empty());
+  BOOST_CHECK(packet.get_data() == nullptr);
+}
+
+/**
+ * @brief Checks that no element is lost or duplicated when
+ * several producers and consumers use the rings concurrently.
+ *
+ * The ring is kept small so that producers frequently find it
+ * full and consumers frequently find it empty.
+ *
+ */
+BOOST_AUTO_TEST_CASE (RING_BUFFER_CONCURRENCY_TEST)
+{
+  constexpr unsigned number_of_values = 200000;
+
+  /* single producer & single consumer: order must be kept */
+  Common::SpscRingBuffer<unsigned> spsc_ring(64);
+  std::thread spsc_producer([&spsc_ring]()
+  {
+    for (unsigned i = 1; i <= number_of_values; i++)
+      while (!spsc_ring.tryPush(unsigned(i)))
+        std::this_thread::yield();
+  });
+  unsigned expected = 1;
+  bool is_in_order = true;
+  while (expected <= number_of_values)
+  {
+    unsigned value;
+    if (!spsc_ring.tryPop(value))
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    is_in_order = is_in_order && value == expected;
+    expected++;
+  }
+  spsc_producer.join();
+  BOOST_CHECK(is_in_order);
+
+  /* multiple producers & consumers: every value exactly once */
+  constexpr unsigned number_of_threads = 4;
+  Common::MpmcRingBuffer<unsigned> mpmc_ring(64);
+  std::atomic<unsigned long long> sum{0};
+  std::atomic<unsigned> number_of_values_popped{0};
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < number_of_threads; t++)
+  {
+    threads.emplace_back([&mpmc_ring, t]()
+    {
+      for (unsigned i = t + 1; i <= number_of_values;
+           i += number_of_threads)
+        while (!mpmc_ring.tryPush(unsigned(i)))
+          std::this_thread::yield();
+    });
+    threads.emplace_back([&]()
+    {
+      unsigned value;
+      while (number_of_values_popped.load() < number_of_values)
+        if (mpmc_ring.tryPop(value))
+        {
+          sum += value;
+          number_of_values_popped++;
+        }
+        else
+          std::this_thread::yield();
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  BOOST_CHECK_EQUAL(number_of_values_popped.load(), 
+                    number_of_values);
+  BOOST_CHECK_EQUAL(sum.load(),
+    static_cast<unsigned long long>(number_of_values)
+    * (number_of_values + 1) / 2);
+}
+
+/**
+ * @brief Checks that the processors waiting on an empty
+ * lock-free PcapPacketQueue are woken up by pushes and by the
+ * end of stream signal.
+ *
+ * A zero spin budget makes the consumers park right away so
+ * that the parking path is exercised. A tiny capacity makes
+ * the writer wait for room as well.
+ *
+ */
+BOOST_AUTO_TEST_CASE (QUEUE_WAIT_AND_END_OF_STREAM_TEST)
+{
+  constexpr unsigned number_of_packets = 10000;
+  constexpr unsigned number_of_consumers = 3;
+  Common::MpmcPcapPacketQueue queue(4, 0);
+  BOOST_CHECK(!queue.is_closed());
+
+  std::atomic<unsigned> number_of_packets_popped{0};
+  std::atomic<unsigned long long> sum_of_seconds{0};
+  std::vector<std::thread> consumers;
+  for (unsigned i = 0; i < number_of_consumers; i++)
+    consumers.emplace_back([&]()
+    {
+      Common::PcapPacket packet;
+      while (queue.waitAndPopPacket(packet))
+      {
+        number_of_packets_popped++;
+        sum_of_seconds += packet.get_arrival_time().tv_sec;
+      }
+    });
+
+  /* let the consumers park on the empty queue first */
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  for (unsigned i = 1; i <= number_of_packets; i++)
+  {
+    Common::PcapPacket packet(
+      timeval{static_cast<__time_t>(i), 0});
+    queue.pushPacket(std::move(packet));
+  }
+  queue.closeQueue();
+  BOOST_CHECK(queue.is_closed());
+
+  for (auto& consumer : consumers)
+    consumer.join();
+  BOOST_CHECK_EQUAL(number_of_packets_popped.load(),
+                    number_of_packets);
+  BOOST_CHECK_EQUAL(sum_of_seconds.load(),
+    static_cast<unsigned long long>(number_of_packets)
+    * (number_of_packets + 1) / 2);
+
+  /* a closed & drained queue does not block */
+  Common::PcapPacket packet;
+  BOOST_CHECK(!queue.waitAndPopPacket(packet));
+}
+
+/**
+ * @brief Checks the batch push/pop operations of the rings and
+ * the lock-free PcapPacketQueues.
+ *
+ * Batches larger than the free room must be pushed partially
+ * in FIFO order and a batch larger than the capacity of a
+ * queue must still be pushed completely while a processor
+ * drains it concurrently.
+ *
+ */
+BOOST_AUTO_TEST_CASE (BATCH_PUSH_POP_TEST)
+{
+  Common::SpscRingBuffer<unsigned> spsc_ring(8);
+  Common::MpmcRingBuffer<unsigned> mpmc_ring(8);
+  std::vector<unsigned> values = {1, 2, 3, 4, 5, 6};
+  BOOST_CHECK_EQUAL(spsc_ring.tryPushBatch(values.data(), 6), 6u);
+  BOOST_CHECK_EQUAL(mpmc_ring.tryPushBatch(values.data(), 6), 6u);
+  /* only 2 free slots left */
+  values = {7, 8, 9, 10};
+  BOOST_CHECK_EQUAL(spsc_ring.tryPushBatch(values.data(), 4), 2u);
+  BOOST_CHECK_EQUAL(mpmc_ring.tryPushBatch(values.data(), 4), 2u);
+  BOOST_CHECK_EQUAL(spsc_ring.tryPushBatch(values.data(), 4), 0u);
+  BOOST_CHECK_EQUAL(mpmc_ring.tryPushBatch(values.data(), 4), 0u);
+
+  std::vector<unsigned> popped(16);
+  BOOST_REQUIRE_EQUAL(spsc_ring.tryPopBatch(popped.data(), 5), 5u);
+  BOOST_CHECK_EQUAL(popped[0], 1u);
+  BOOST_CHECK_EQUAL(popped[4], 5u);
+  BOOST_REQUIRE_EQUAL(spsc_ring.tryPopBatch(popped.data(), 16), 3u);
+  BOOST_CHECK_EQUAL(popped[2], 8u);
+  BOOST_CHECK_EQUAL(spsc_ring.tryPopBatch(popped.data(), 16), 0u);
+
+  BOOST_REQUIRE_EQUAL(mpmc_ring.tryPopBatch(popped.data(), 16), 8u);
+  for (unsigned i = 0; i < 8; i++)
+    BOOST_CHECK_EQUAL(popped[i], i + 1);
+  BOOST_CHECK_EQUAL(mpmc_ring.tryPopBatch(popped.data(), 16), 0u);
+
+  /* A batch larger than the queue while a processor drains it */
+  constexpr unsigned number_of_packets = 1000;
+  for (auto is_spsc : {true, false})
+  {
+    std::unique_ptr<Common::IPcapPacketQueue> queue;
+    if (is_spsc)
+      queue = std::make_unique<Common::SpscPcapPacketQueue>(16, 0);
+    else
+      queue = std::make_unique<Common::MpmcPcapPacketQueue>(16, 0);
+
+    std::vector<__time_t> seconds_popped;
+    std::thread processor([&]()
+    {
+      std::vector<Common::PcapPacket> packets(7);
+      while (auto count = queue->waitAndPopPackets(
+                            packets.data(), packets.size()))
+        for (std::size_t i = 0; i < count; i++)
+          seconds_popped.push_back(packets[i].get_arrival_time().tv_sec);
+    });
+
+    std::vector<Common::PcapPacket> packets(number_of_packets);
+    for (unsigned i = 0; i < number_of_packets; i++)
+      packets[i].set_arrival_time({static_cast<__time_t>(i), 0});
+    queue->pushPackets(packets.data(), packets.size());
+    queue->closeQueue();
+    processor.join();
+
+    BOOST_REQUIRE_EQUAL(seconds_popped.size(), number_of_packets);
+    for (unsigned i = 0; i < number_of_packets; i++)
+      BOOST_CHECK_EQUAL(seconds_popped[i], i);
+  }
+}
+
+/**
+ * @brief Check that a PcapPacket releases its data by itself
+ * according to the owner of the data and that moving a packet
+ * leaves the source empty.
+ */
+BOOST_AUTO_TEST_CASE (PCAP_PACKET_OWNERSHIP_TEST)
+{
+  BOOST_CHECK_EQUAL(sizeof(Common::PcapPacket), 32u);
+
+  Common::PcapPacket empty_packet;
+  BOOST_CHECK(empty_packet.empty());
+  BOOST_CHECK_EQUAL(empty_packet.get_caplen(), 0u);
+
+  /* Nanoseconds are kept; the timeval view truncates them */
+  auto packet = Common::PcapPacket::allocate(
+    1500000000123456789LL, 60, 1514, 3);
+  BOOST_CHECK(!packet.empty());
+  BOOST_CHECK(packet.get_data_owner() 
+              == Common::PcapPacketDataOwner::kPool);
+  BOOST_CHECK_EQUAL(packet.get_arrival_time_ns(), 
+                    1500000000123456789LL);
+  BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_sec, 1500000000);
+  BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_usec, 123456);
+  BOOST_CHECK_EQUAL(packet.get_interface_index(), 3u);
+  const uint8_t* data = packet.get_data();
+
+  Common::PcapPacket moved_packet(std::move(packet));
+  BOOST_CHECK(moved_packet.get_data() == data);
+  BOOST_CHECK_EQUAL(moved_packet.get_caplen(), 60u);
+  BOOST_CHECK_EQUAL(moved_packet.get_len(), 1514u);
+  BOOST_CHECK(packet.get_data() == nullptr);
+  BOOST_CHECK(packet.get_data_owner()
+              == Common::PcapPacketDataOwner::kNone);
+
+  /* The pooled buffer is given back when the packet is
+  dropped, so it is the next one to be allocated */
+  moved_packet.reset();
+  BOOST_CHECK(moved_packet.empty());
+  {
+    auto dropped_packet = Common::PcapPacket::allocate(0, 60, 60);
+    BOOST_CHECK(dropped_packet.get_data() == data);
+  }
+  auto reused_packet = Common::PcapPacket::allocate(0, 60, 60);
+  BOOST_CHECK(reused_packet.get_data() == data);
+
+  /* Assigning over a packet releases its old data */
+  reused_packet = Common::PcapPacket(
+    0, new uint8_t[8](), 8, 8, Common::PcapPacketDataOwner::kHeap);
+  BOOST_CHECK(Common::PcapPacket::allocate(0, 60, 60).get_data() 
+              == data);
+
+  /* Mapped data is never freed by the packet */
+  uint8_t mapped_data[4] = {1, 2, 3, 4};
+  {
+    Common::PcapPacket mapped_packet(
+      0, mapped_data, 4, 4, Common::PcapPacketDataOwner::kMappedFile);
+  }
+  BOOST_CHECK_EQUAL(mapped_data[3], 4);
+}
+
+/**
+ * @brief Check the size classes of the PacketBufferPool and
+ * that the freed buffers are reused, including the ones freed
+ * on another thread.
+ */
+BOOST_AUTO_TEST_CASE (PACKET_BUFFER_POOL_TEST)
+{
+  auto& pool = Common::PacketBufferPool::getInstance();
+
+  /* The smallest class large enough is picked */
+  auto* small_buffer = pool.allocate(64);
+  auto* jumbo_buffer = pool.allocate(9000);
+  BOOST_CHECK_EQUAL(pool.get_capacity(small_buffer), 128);
+  BOOST_CHECK_EQUAL(pool.get_capacity(jumbo_buffer), 9216);
+  BOOST_CHECK(reinterpret_cast<uintptr_t>(small_buffer) % 16 == 0);
+  std::memset(jumbo_buffer, 0xab, 9000);
+
+  /* A buffer freed on the same thread is the next one given */
+  pool.deallocate(small_buffer);
+  BOOST_CHECK(pool.allocate(100) == small_buffer);
+  pool.deallocate(small_buffer);
+  pool.deallocate(jumbo_buffer);
+
+  /* Larger than every size class */
+  auto* huge_buffer = pool.allocate(100000);
+  BOOST_CHECK_EQUAL(pool.get_capacity(huge_buffer), 100000);
+  std::memset(huge_buffer, 0xcd, 100000);
+  pool.deallocate(huge_buffer);
+  pool.deallocate(nullptr);
+
+  /* Buffers allocated here and freed by another thread come
+  back to this thread once its free list runs dry */
+  constexpr unsigned number_of_buffers = 1000;
+  std::vector<uint8_t*> buffers;
+  for (unsigned i = 0; i < number_of_buffers; i++)
+    buffers.push_back(pool.allocate(2000));
+  std::thread processor([&]()
+  {
+    for (auto* buffer : buffers)
+      pool.deallocate(buffer);
+  });
+  processor.join();
+
+  std::vector<uint8_t*> reused_buffers;
+  for (unsigned i = 0; i < 4 * number_of_buffers; i++)
+    reused_buffers.push_back(pool.allocate(2000));
+  std::sort(buffers.begin(), buffers.end());
+  unsigned number_of_reused_buffers = 0;
+  for (auto* buffer : reused_buffers)
+    if (std::binary_search(buffers.begin(), buffers.end(), buffer))
+      number_of_reused_buffers++;
+  BOOST_CHECK_EQUAL(number_of_reused_buffers, number_of_buffers);
+  for (auto* buffer : reused_buffers)
+    pool.deallocate(buffer);
+  BOOST_CHECK(pool.get_number_of_reserved_octets() > 0);
+}
+
+/**
+ * @brief Checks that the 5-tuple hash is symmetric and that the
+ * PacketDispatcher keeps the packets of a flow on one shard in
+ * their arrival order.
+ */
+BOOST_AUTO_TEST_CASE (FLOW_AFFINITY_DISPATCH_TEST)
+{
+  auto forward = makePacket(
+    buildIPv4Frame(0x0a000001, 0x0a000002, 1234, 80, 6));
+  auto backward = makePacket(
+    buildIPv4Frame(0x0a000002, 0x0a000001, 80, 1234, 6));
+  auto other_port = makePacket(
+    buildIPv4Frame(0x0a000001, 0x0a000002, 1235, 80, 6));
+  auto other_protocol = makePacket(
+    buildIPv4Frame(0x0a000001, 0x0a000002, 1234, 80, 17));
+  BOOST_CHECK_EQUAL(hashFiveTuple(forward), hashFiveTuple(backward));
+  BOOST_CHECK(hashFiveTuple(forward) != hashFiveTuple(other_port));
+  BOOST_CHECK(hashFiveTuple(forward) 
+              != hashFiveTuple(other_protocol));
+
+  /* Non-first fragments carry no ports; all the fragments of a
+  datagram are hashed without the ports */
+  auto fragment = makePacket(
+    buildIPv4Frame(0x0a000001, 0x0a000002, 1, 2, 17, {}, 0x00b9));
+  auto first_fragment = makePacket(
+    buildIPv4Frame(0x0a000001, 0x0a000002, 53, 53, 17, {}, 0x2000));
+  BOOST_CHECK_EQUAL(hashFiveTuple(fragment), 
+                    hashFiveTuple(first_fragment));
+
+  /* Frames which are not IP all go to the same shard */
+  std::vector<uint8_t> arp_frame(42, 0);
+  arp_frame[12] = 0x08;
+  arp_frame[13] = 0x06;
+  BOOST_CHECK_EQUAL(hashFiveTuple(makePacket(arp_frame)), 0u);
+  BOOST_CHECK_EQUAL(hashFiveTuple(Common::PcapPacket()), 0u);
+
+  /* 64 flows each with 10 packets, interleaved, pushed in
+  batches; every packet carries its sequence number within its
+  flow as its arrival second */
+  constexpr unsigned number_of_flows = 64;
+  constexpr unsigned number_of_packets_per_flow = 10;
+  PacketDispatcher dispatcher(4);
+  BOOST_REQUIRE_EQUAL(dispatcher.get_number_of_shards(), 4u);
+  std::vector<Common::PcapPacket> packets;
+  for (unsigned sequence = 0; sequence < number_of_packets_per_flow;
+       sequence++)
+    for (unsigned flow = 0; flow < number_of_flows; flow++)
+    {
+      /* alternate the direction of the packets of a flow */
+      bool is_forward = (sequence + flow) % 2 == 0;
+      uint16_t client_port = 10000 + flow;
+      packets.push_back(makePacket(
+        is_forward
+        ? buildIPv4Frame(0xc0a80001, 0x08080808, client_port, 443, 6)
+        : buildIPv4Frame(0x08080808, 0xc0a80001, 443, client_port, 6),
+        sequence));
+    }
+  for (std::size_t i = 0; i < packets.size(); i += 100)
+    dispatcher.pushPackets(
+      packets.data() + i, std::min<std::size_t>(100, 
+                                                packets.size() - i));
+  dispatcher.closeQueue();
+
+  std::vector<int> shard_of_flow(number_of_flows, -1);
+  std::vector<unsigned> next_sequence(number_of_flows, 0);
+  unsigned number_of_used_shards = 0;
+  for (std::size_t shard = 0; shard < 4; shard++)
+  {
+    Common::PcapPacket packet;
+    bool is_used = false;
+    while (dispatcher.get_shard(shard).waitAndPopPacket(packet))
+    {
+      is_used = true;
+      /* the client port is the one which is not 443 */
+      const uint8_t* ports = packet.get_data() + 34;
+      uint16_t source_port = (ports[0] << 8) | ports[1];
+      uint16_t destination_port = (ports[2] << 8) | ports[3];
+      unsigned flow = (source_port == 443 ? destination_port 
+                                          : source_port) - 10000;
+      BOOST_REQUIRE(flow < number_of_flows);
+      if (shard_of_flow[flow] == -1)
+        shard_of_flow[flow] = shard;
+      BOOST_CHECK_EQUAL(shard_of_flow[flow], shard);
+      BOOST_CHECK_EQUAL(packet.get_arrival_time().tv_sec, 
+                        next_sequence[flow]);
+      next_sequence[flow]++;
+    }
+    if (is_used)
+      number_of_used_shards++;
+  }
+  for (auto sequence : next_sequence)
+    BOOST_CHECK_EQUAL(sequence, number_of_packets_per_flow);
+  /* 64 flows are expected to spread over all the shards */
+  BOOST_CHECK_EQUAL(number_of_used_shards, 4u);
+}
+
+/**
+ * @brief Checks that the decoder finds the L2-L4 headers of
+ * tagged IPv4 and IPv6 (with extension headers) frames and
+ * stops at the last complete header of truncated frames.
+ */
+BOOST_AUTO_TEST_CASE (PACKET_DECODER_TEST)
+{
+  /* QinQ + 802.1Q + IPv4 + TCP with 5 octets of payload and
+  2 octets of Ethernet padding */
+  std::vector<uint8_t> frame(12, 0xaa);
+  frame.insert(frame.end(), {0x88, 0xa8, 0x00, 0x64, 
+                             0x81, 0x00, 0x00, 0xc8, 0x08, 0x00});
+  frame.insert(frame.end(), {0x45, 0, 0, 45, 0, 0, 0x40, 0, 64, 6, 
+                             0, 0, 10, 0, 0, 1, 10, 0, 0, 2});
+  std::vector<uint8_t> tcp_header(20, 0);
+  tcp_header[0] = 0x04; tcp_header[1] = 0xd2; // 1234
+  tcp_header[3] = 80;
+  tcp_header[12] = 5 << 4;
+  frame.insert(frame.end(), tcp_header.begin(), tcp_header.end());
+  frame.insert(frame.end(), {'h', 'e', 'l', 'l', 'o', 0, 0});
+
+  DecodedPacket decoded;
+  BOOST_REQUIRE(decodePacket(frame.data(), frame.size(), decoded));
+  BOOST_CHECK_EQUAL(decoded.number_of_vlan_tags, 2);
+  BOOST_CHECK_EQUAL(decoded.vlan_id, 100);
+  BOOST_CHECK(decoded.has(DecodedPacket::kIPv4));
+  BOOST_CHECK(decoded.has(DecodedPacket::kTcp));
+  BOOST_CHECK_EQUAL(decoded.l3_offset, 22);
+  BOOST_CHECK_EQUAL(decoded.l4_offset, 42);
+  BOOST_CHECK_EQUAL(decoded.payload_offset, 62);
+  BOOST_CHECK_EQUAL(decoded.get_payload_length(), 5u);
+  BOOST_CHECK_EQUAL(decoded.get_source_port(frame.data()), 1234);
+  BOOST_CHECK_EQUAL(decoded.get_destination_port(frame.data()), 80);
+  BOOST_CHECK_EQUAL(decoded.flags, 0);
+
+  /* the TCP header does not fit */
+  BOOST_REQUIRE(decodePacket(frame.data(), 50, decoded));
+  BOOST_CHECK(!decoded.has(DecodedPacket::kTcp));
+  BOOST_CHECK(decoded.is(DecodedPacket::kTruncated));
+  BOOST_CHECK_EQUAL(decoded.l4_offset, 42);
+  BOOST_CHECK(!decodePacket(frame.data(), 13, decoded));
+
+  /* IPv6 + hop-by-hop options + first fragment + UDP */
+  std::vector<uint8_t> ipv6_frame(12, 0xaa);
+  ipv6_frame.insert(ipv6_frame.end(), {0x86, 0xdd});
+  std::vector<uint8_t> ipv6_header(40, 0);
+  ipv6_header[0] = 0x60;
+  ipv6_header[5] = 8 + 8 + 8 + 3;
+  ipv6_header[6] = 0; // hop-by-hop options
+  ipv6_header[23] = 1;
+  ipv6_header[39] = 2;
+  ipv6_frame.insert(ipv6_frame.end(), ipv6_header.begin(), 
+                    ipv6_header.end());
+  ipv6_frame.insert(ipv6_frame.end(), {44, 0, 1, 4, 0, 0, 0, 0});
+  ipv6_frame.insert(ipv6_frame.end(), {17, 0, 0, 1, 0, 0, 0, 7});
+  ipv6_frame.insert(ipv6_frame.end(), {0, 53, 0, 53, 0, 11, 0, 0, 
+                                       1, 2, 3});
+  BOOST_REQUIRE(decodePacket(ipv6_frame.data(), ipv6_frame.size(),
+                             decoded));
+  BOOST_CHECK(decoded.has(DecodedPacket::kIPv6));
+  BOOST_CHECK(decoded.has(DecodedPacket::kUdp));
+  BOOST_CHECK(decoded.is(DecodedPacket::kFragment));
+  BOOST_CHECK_EQUAL(decoded.protocol, 17);
+  BOOST_CHECK_EQUAL(decoded.l4_offset, 14 + 40 + 16);
+  BOOST_CHECK_EQUAL(decoded.get_payload_length(), 3u);
+  BOOST_CHECK_EQUAL(decoded.get_address_length(), 16u);
+  BOOST_CHECK_EQUAL(
+    decoded.get_destination_address(ipv6_frame.data())[15], 2);
+
+  /* a non-first fragment has no transport header */
+  ipv6_frame[14 + 40 + 8 + 2] = 0x01;
+  BOOST_REQUIRE(decodePacket(ipv6_frame.data(), ipv6_frame.size(),
+                             decoded));
+  BOOST_CHECK(!decoded.has(DecodedPacket::kUdp));
+  BOOST_CHECK(!decoded.has_l4_offset());
+  BOOST_CHECK_EQUAL(decoded.protocol, 17);
+}
+
+/**
+ * @brief Checks that decoding a burst (by the scalar loop and,
+ * if the CPU supports it, by the vectorized kernel) gives the
+ * same result as decoding its packets one by one, including
+ * the truncated and unusual frames.
+ */
+BOOST_AUTO_TEST_CASE (BATCH_DECODER_TEST)
+{
+  std::vector<std::vector<uint8_t>> frames;
+  frames.push_back(buildIPv4Frame(0x0a000001, 0x0a000002, 53, 53, 
+                                  17, {1, 2, 3}));
+  /* TCP with options and 2 octets of Ethernet padding */
+  auto tcp_frame = buildIPv4Frame(0x0a000001, 0x0a000002, 1234, 80,
+                                  6, std::vector<uint8_t>(20, 0));
+  tcp_frame[14 + 2] = 0;
+  tcp_frame[14 + 3] = 20 + 24;
+  tcp_frame[14 + 20 + 12] = 6 << 4;
+  tcp_frame.insert(tcp_frame.end(), {0, 0});
+  frames.push_back(tcp_frame);
+  /* IPv4 options, a fragment and an ether type which is not IP */
+  auto options_frame = buildIPv4Frame(0x0a000001, 0x0a000002, 1, 2, 
+                                      17);
+  options_frame[14] = 0x46;
+  options_frame.insert(options_frame.begin() + 34, {1, 1, 1, 0});
+  options_frame[14 + 3] += 4;
+  frames.push_back(options_frame);
+  frames.push_back(buildIPv4Frame(0x0a000001, 0x0a000002, 1, 2, 17,
+                                  {}, 0x2000));
+  auto arp_frame = std::vector<uint8_t>(42, 0);
+  arp_frame[12] = 0x08;
+  arp_frame[13] = 0x06;
+  frames.push_back(arp_frame);
+  /* VLAN tagged */
+  auto tagged_frame = buildIPv4Frame(0x0a000001, 0x0a000002, 1, 2, 
+                                     17);
+  tagged_frame.insert(tagged_frame.begin() + 12, 
+                      {0x81, 0x00, 0x00, 0x05});
+  frames.push_back(tagged_frame);
+  /* IPv6 + UDP */
+  std::vector<uint8_t> ipv6_frame(12, 0xaa);
+  ipv6_frame.insert(ipv6_frame.end(), {0x86, 0xdd, 0x60, 0, 0, 0, 
+                                       0, 10, 17, 64});
+  ipv6_frame.insert(ipv6_frame.end(), 32, 0x11);
+  ipv6_frame.insert(ipv6_frame.end(), {0, 53, 0, 53, 0, 10, 0, 0, 
+                                       7, 7});
+  frames.push_back(ipv6_frame);
+
+  /* every prefix of every frame, so that each check against
+  the captured length is exercised */
+  std::vector<Common::PcapPacket> packets;
+  for (const auto& frame : frames)
+    for (std::size_t caplen = 0; caplen <= frame.size(); caplen++)
+      packets.push_back(makePacket(std::vector<uint8_t>(
+        frame.begin(), frame.begin() + caplen)));
+  packets.emplace_back();
+
+  auto check_same = [](const DecodedPacket& decoded, 
+                       const DecodedPacket& one)
+  {
+    BOOST_CHECK_EQUAL(decoded.ether_type, one.ether_type);
+    BOOST_CHECK_EQUAL(decoded.l3_offset, one.l3_offset);
+    BOOST_CHECK_EQUAL(decoded.l4_offset, one.l4_offset);
+    BOOST_CHECK_EQUAL(decoded.payload_offset, one.payload_offset);
+    BOOST_CHECK_EQUAL(decoded.payload_end, one.payload_end);
+    BOOST_CHECK_EQUAL(decoded.vlan_id, one.vlan_id);
+    BOOST_CHECK_EQUAL(decoded.protocol, one.protocol);
+    BOOST_CHECK_EQUAL(decoded.layers, one.layers);
+    BOOST_CHECK_EQUAL(decoded.flags, one.flags);
+  };
+  std::vector<DecodedPacket> batch(packets.size());
+  decodePackets(packets.data(), packets.size(), batch.data());
+  std::vector<DecodedPacket> vectorized_batch(packets.size());
+  const bool is_vectorized = decodePacketsVectorized(
+    packets.data(), packets.size(), vectorized_batch.data());
+  unsigned number_of_tcp_packets = 0;
+  for (std::size_t i = 0; i < packets.size(); i++)
+  {
+    DecodedPacket one;
+    decodePacket(packets[i], one);
+    check_same(batch[i], one);
+    if (is_vectorized)
+      check_same(vectorized_batch[i], one);
+    if (one.has(DecodedPacket::kTcp))
+    {
+      number_of_tcp_packets++;
+      BOOST_CHECK_EQUAL(one.payload_offset, 14 + 20 + 24);
+      BOOST_CHECK_EQUAL(one.get_payload_length(), 0u);
+    }
+  }
+  /* the prefixes with the complete TCP header and options */
+  BOOST_CHECK_EQUAL(number_of_tcp_packets, 
+                    tcp_frame.size() - (14 + 20 + 24) + 1);
+}
+
+/**
+ * @brief Checks that the FlowTable counts both directions of a
+ * flow together, drops the new flows while it is full, evicts
+ * the idle flows and keeps finding the flows while they come
+ * and go.
+ */
+BOOST_AUTO_TEST_CASE (FLOW_TABLE_TEST)
+{
+  constexpr Common::Nanoseconds kSecond = 
+    Common::kNanosecondsPerSecond;
+  FlowTable flow_table(100);
+  BOOST_CHECK_EQUAL(flow_table.get_capacity() % 
+                    FlowTable::kGroupSize, 0u);
+
+  auto updateFrame = [&flow_table](const std::vector<uint8_t>& frame,
+                                   __time_t second)
+  {
+    auto packet = makePacket(frame, second);
+    DecodedPacket decoded;
+    decodePacket(packet, decoded);
+    return flow_table.update(packet, decoded);
+  };
+  auto forward = buildIPv4Frame(0x0a000001, 0x0a000002, 1234, 80, 6);
+  auto backward = buildIPv4Frame(0x0a000002, 0x0a000001, 80, 1234, 
+                                 6, {1, 2, 3, 4});
+  updateFrame(forward, 1);
+  auto* flow = updateFrame(backward, 3);
+  BOOST_REQUIRE(flow != nullptr);
+  BOOST_CHECK_EQUAL(flow_table.size(), 1u);
+  BOOST_CHECK_EQUAL(flow->number_of_packets, 2u);
+  BOOST_CHECK_EQUAL(flow->number_of_octets, 
+                    forward.size() + backward.size());
+  BOOST_CHECK_EQUAL(flow->first_seen_ns, 1 * kSecond);
+  BOOST_CHECK_EQUAL(flow->get_last_seen_ns(), 3 * kSecond);
+  /* IPv4-mapped, the smaller address first */
+  BOOST_CHECK_EQUAL(flow->key.address_a[10], 0xff);
+  BOOST_CHECK_EQUAL(flow->key.address_a[15], 1);
+  BOOST_CHECK_EQUAL(flow->key.port_a, 1234);
+
+  /* a fragment is a flow of its own without the ports */
+  auto* fragment_flow = updateFrame(
+    buildIPv4Frame(0x0a000001, 0x0a000002, 1234, 80, 6, {}, 0x2000),
+    4);
+  BOOST_REQUIRE(fragment_flow != nullptr);
+  BOOST_CHECK_EQUAL(fragment_flow->key.port_a, 0);
+  BOOST_CHECK_EQUAL(flow_table.size(), 2u);
+
+  /* a non-IP frame is not a flow */
+  std::vector<uint8_t> arp_frame(60, 0);
+  arp_frame[12] = 0x08; arp_frame[13] = 0x06;
+  BOOST_CHECK(updateFrame(arp_frame, 4) == nullptr);
+
+  /* fill the table; the flows over the limit are dropped */
+  auto makeKey = [](uint32_t flow_index)
+  {
+    FlowKey key;
+    std::memcpy(key.address_a, &flow_index, sizeof(flow_index));
+    key.port_b = 443;
+    key.protocol = 17;
+    return key;
+  };
+  for (uint32_t i = 0; i < 100; i++)
+    flow_table.update(makeKey(i), (10 + i % 2) * kSecond, 100);
+  BOOST_CHECK_EQUAL(flow_table.size(), 100u);
+  BOOST_CHECK_EQUAL(flow_table.get_number_of_dropped_flows(), 2u);
+  BOOST_CHECK(flow_table.find(makeKey(97)) != nullptr);
+  BOOST_CHECK(flow_table.find(makeKey(98)) == nullptr);
+
+  /* the flows idle for 5 seconds at 15.5 seconds: the first 2
+  flows and the flows last seen at 10 seconds */
+  std::size_t number_of_evicted_octets = 0;
+  auto number_of_evicted_flows = flow_table.evictIdleFlows(
+    15 * kSecond + kSecond / 2, 5 * kSecond, 
+    flow_table.get_capacity(),
+    [&number_of_evicted_octets](const FlowEntry& entry)
+    {
+      number_of_evicted_octets += entry.number_of_octets;
+    });
+  BOOST_CHECK_EQUAL(number_of_evicted_flows, 2u + 49u);
+  BOOST_CHECK_EQUAL(flow_table.size(), 100u - 51u);
+  BOOST_CHECK(flow_table.find(makeKey(0)) == nullptr);
+  BOOST_CHECK(flow_table.find(makeKey(1)) != nullptr);
+
+  /* Churn the flows over the table many times its capacity;
+  the deleted slots are cleaned up as needed. */
+  for (uint32_t i = 1000; i < 100000; i++)
+  {
+    BOOST_REQUIRE(flow_table.update(makeKey(i), i, 1) != nullptr);
+    BOOST_REQUIRE(flow_table.erase(makeKey(i - 1) ) 
+                  || i == 1000);
+  }
+  BOOST_CHECK_EQUAL(flow_table.size(), 100u - 51u + 1u);
+  for (uint32_t i = 1; i < 98; i += 2)
+    BOOST_CHECK(flow_table.find(makeKey(i)) != nullptr);
+  BOOST_CHECK(flow_table.find(makeKey(99999)) != nullptr);
+
+  /* Churn a full table: its groups fill up, so the erased
+  flows leave deleted slots behind and it is rebuilt (in
+  place) every few flows. */
+  FlowTable full_table(112);
+  BOOST_REQUIRE_EQUAL(full_table.get_capacity(), 128u);
+  for (uint32_t i = 0; i < 112; i++)
+    BOOST_REQUIRE(full_table.update(makeKey(i), 0, 1) != nullptr);
+  for (uint32_t i = 112; i < 20000; i++)
+  {
+    BOOST_REQUIRE(full_table.erase(makeKey(i - 112)));
+    BOOST_REQUIRE(full_table.update(makeKey(i), i, 1) != nullptr);
+  }
+  BOOST_CHECK_EQUAL(full_table.size(), 112u);
+  for (uint32_t i = 20000 - 112; i < 20000; i++)
+    BOOST_REQUIRE(full_table.find(makeKey(i)) != nullptr);
+  BOOST_CHECK(full_table.find(makeKey(20000 - 113)) == nullptr);
+}
+
+/**
+ * @brief Checks that the TcpReassembler delivers the streams in
+ * order (in place when the segments come in order), resolves
+ * the overlaps by its policy within the memory budget, closes
+ * the connections on FIN and RST (once) and flushes the least
+ * recently buffered streams when the budget runs out.
+ */
+BOOST_AUTO_TEST_CASE (TCP_REASSEMBLY_TEST)
+{
+  /* collects the streams; the gaps are filled with '?' */
+  struct StreamCollector : public ITcpStreamHandler
+  {
+    std::map<std::pair<uint16_t, int>, std::string> streams;
+    std::vector<CloseReason> close_reasons;
+    const uint8_t* packet_begin = nullptr;
+    const uint8_t* packet_end = nullptr;
+    unsigned number_of_in_place_deliveries = 0;
+
+    std::string& get_stream(uint16_t server_port, int direction)
+    {
+      return streams[std::make_pair(server_port, direction)];
+    }
+
+    void onData(const FlowKey& key, TcpDirection direction,
+                uint64_t offset, const uint8_t* data,
+                std::size_t length) override
+    {
+      auto& stream = get_stream(key.port_b, 
+                                static_cast<int>(direction));
+      BOOST_CHECK_EQUAL(offset, stream.size());
+      stream.append(reinterpret_cast<const char*>(data), length);
+      if (data >= packet_begin && data < packet_end)
+        number_of_in_place_deliveries++;
+    }
+    void onGap(const FlowKey& key, TcpDirection direction,
+               uint64_t offset, uint64_t length) override
+    {
+      auto& stream = get_stream(key.port_b, 
+                                static_cast<int>(direction));
+      BOOST_CHECK_EQUAL(offset, stream.size());
+      stream.append(length, '?');
+    }
+    void onClose(const FlowKey&, CloseReason reason) override
+    {
+      close_reasons.push_back(reason);
+    }
+  };
+
+  constexpr uint32_t kClient = 0x0a000001;
+  constexpr uint32_t kServer = 0x0a000002;
+  constexpr uint8_t kFin = 0x01, kSyn = 0x02, kRst = 0x04;
+  auto feed = [](TcpReassembler& reassembler, 
+                 StreamCollector& collector, uint16_t server_port,
+                 bool is_from_client, uint32_t sequence, 
+                 uint8_t flags, const std::string& payload)
+  {
+    auto frame = is_from_client
+      ? buildTcpFrame(kClient, kServer, 40000, server_port, 
+                      sequence, flags, payload)
+      : buildTcpFrame(kServer, kClient, server_port, 40000, 
+                      sequence, flags, payload);
+    DecodedPacket decoded;
+    BOOST_REQUIRE(decodePacket(frame.data(), frame.size(), 
+                               decoded));
+    BOOST_REQUIRE(decoded.has(DecodedPacket::kTcp));
+    FlowKey key;
+    bool is_from_b = false;
+    BOOST_REQUIRE(makeFlowKey(frame.data(), frame.size(), decoded,
+                              key, &is_from_b));
+    collector.packet_begin = frame.data();
+    collector.packet_end = frame.data() + frame.size();
+    reassembler.processSegment(
+      key, is_from_b ? TcpDirection::kBToA : TcpDirection::kAToB,
+      frame.data(), decoded);
+  };
+  const auto kAToB = static_cast<int>(TcpDirection::kAToB);
+  const auto kBToA = static_cast<int>(TcpDirection::kBToA);
+
+  {
+    /* handshake, the client's data out of order (with a
+    retransmission) and a wrapping sequence number, FINs */
+    StreamCollector collector;
+    TcpReassembler reassembler(collector);
+    const uint32_t client_isn = 0xfffffff0;
+    feed(reassembler, collector, 80, true, client_isn, kSyn, "");
+    feed(reassembler, collector, 80, false, 1000, kSyn | 0x10, "");
+    feed(reassembler, collector, 80, true, client_isn + 1, 0, 
+         "GET / HTTP/1.1\r\n");
+    feed(reassembler, collector, 80, true, client_isn + 21, 0, 
+         "World");
+    feed(reassembler, collector, 80, true, client_isn + 17, 0, 
+         "Host");
+    feed(reassembler, collector, 80, true, client_isn + 1, 0, 
+         "GET / HTTP/1.1\r\n");
+    BOOST_CHECK_EQUAL(reassembler.get_number_of_buffered_octets(), 
+                      0u);
+    feed(reassembler, collector, 80, false, 1001, kFin, "200 OK");
+    feed(reassembler, collector, 80, true, client_isn + 26, kFin, 
+         "");
+    /* the client is the "a" side (the smaller address) */
+    BOOST_CHECK_EQUAL(collector.get_stream(80, kAToB), 
+                      "GET / HTTP/1.1\r\nHostWorld");
+    BOOST_CHECK_EQUAL(collector.get_stream(80, kBToA), "200 OK");
+    /* all but the 2 segments buffered out of order */
+    BOOST_CHECK_EQUAL(collector.number_of_in_place_deliveries, 3u);
+    BOOST_REQUIRE_EQUAL(collector.close_reasons.size(), 1u);
+    BOOST_CHECK(collector.close_reasons[0] 
+                == ITcpStreamHandler::CloseReason::kFin);
+    BOOST_CHECK_EQUAL(reassembler.get_number_of_streams(), 0u);
+
+    /* the last ACK of the closed connection does not bring it
+    back (to be closed once more when it goes idle) */
+    feed(reassembler, collector, 80, true, client_isn + 27, 0x10, 
+         "");
+    BOOST_CHECK_EQUAL(reassembler.get_number_of_streams(), 0u);
+    reassembler.closeAllStreams();
+    BOOST_CHECK_EQUAL(collector.close_reasons.size(), 1u);
+
+    /* a RST closes at once */
+    feed(reassembler, collector, 81, true, 5, 0, "abc");
+    feed(reassembler, collector, 81, false, 9, kRst, "");
+    BOOST_CHECK(collector.close_reasons.back() 
+                == ITcpStreamHandler::CloseReason::kReset);
+    BOOST_CHECK_EQUAL(reassembler.get_number_of_streams(), 0u);
+  }
+
+  /* a hole, "BBBB" buffered at 4 and "XXXXXX" overlapping it at
+  2; then "012" fills the hole, overlapping "XXXXXX" too */
+  for (auto policy : {Common::TcpOverlapPolicy::kFirst, 
+                      Common::TcpOverlapPolicy::kLast})
+  {
+    StreamCollector collector;
+    TcpReassembler reassembler(collector, policy);
+    feed(reassembler, collector, 80, true, 100, kSyn, "");
+    feed(reassembler, collector, 80, true, 105, 0, "BBBB");
+    feed(reassembler, collector, 80, true, 103, 0, "XXXXXX");
+    feed(reassembler, collector, 80, true, 101, 0, "012");
+    BOOST_CHECK_EQUAL(collector.get_stream(80, kAToB),
+                      policy == Common::TcpOverlapPolicy::kFirst 
+                      ? "01XXBBBB" : "012XXXXX");
+    BOOST_CHECK_EQUAL(reassembler.get_number_of_buffered_octets(), 
+                      0u);
+  }
+
+  {
+    /* a budget of about 2 segments: buffering a third flushes
+    the least recently buffered stream */
+    const auto memory_budget = TcpReassembler::get_memory_budget();
+    TcpReassembler::set_memory_budget(2 * (1000 + 96) + 500);
+    StreamCollector collector;
+    TcpReassembler reassembler(collector);
+    const std::string segment(1000, 's');
+    for (uint16_t port : {80, 81})
+    {
+      feed(reassembler, collector, port, true, 0, kSyn, "");
+      feed(reassembler, collector, port, true, 11, 0, segment);
+    }
+    feed(reassembler, collector, 82, true, 0, kSyn, "");
+    feed(reassembler, collector, 82, true, 11, 0, segment);
+    BOOST_CHECK_EQUAL(reassembler.get_number_of_flushed_streams(), 
+                      1u);
+    BOOST_CHECK_EQUAL(collector.get_stream(80, kAToB), 
+                      std::string(10, '?') + segment);
+    BOOST_CHECK(collector.get_stream(81, kAToB).empty());
+
+    /* one stream can not take more than the budget */
+    feed(reassembler, collector, 82, true, 2000, 0, segment);
+    feed(reassembler, collector, 82, true, 4000, 0, segment);
+    BOOST_CHECK_EQUAL(reassembler.get_number_of_dropped_segments(),
+                      1u);
+    BOOST_CHECK(TcpReassembler::get_total_number_of_buffered_octets()
+                <= TcpReassembler::get_memory_budget());
+
+    /* what is left is delivered on close */
+    reassembler.closeAllStreams();
+    BOOST_CHECK_EQUAL(reassembler.get_number_of_buffered_octets(), 
+                      0u);
+    BOOST_CHECK_EQUAL(collector.get_stream(81, kAToB), 
+                      std::string(10, '?') + segment);
+    BOOST_CHECK_EQUAL(collector.close_reasons.size(), 3u);
+    TcpReassembler::set_memory_budget(memory_budget);
+  }
+
+  {
+    /* kLast cutting a buffered segment in two costs an overhead
+    more; out of budget, the part after the new data goes */
+    const auto memory_budget = TcpReassembler::get_memory_budget();
+    TcpReassembler::set_memory_budget(160);
+    StreamCollector collector;
+    TcpReassembler reassembler(collector, 
+                               Common::TcpOverlapPolicy::kLast);
+    feed(reassembler, collector, 80, true, 100, kSyn, "");
+    feed(reassembler, collector, 80, true, 111, 0, "AAAAAAAAAA");
+    feed(reassembler, collector, 80, true, 114, 0, "xx");
+    BOOST_CHECK(TcpReassembler::get_total_number_of_buffered_octets()
+                <= TcpReassembler::get_memory_budget());
+    BOOST_CHECK_EQUAL(reassembler.get_number_of_buffered_octets(),
+                      3u + 96u);
+    reassembler.closeAllStreams();
+    BOOST_CHECK_EQUAL(collector.get_stream(80, kAToB),
+                      std::string(10, '?') + "AAA");
+    TcpReassembler::set_memory_budget(memory_budget);
+  }
+  BOOST_CHECK_EQUAL(
+    TcpReassembler::get_total_number_of_buffered_octets(), 0u);
+}
+
+/**
+ * @brief Checks that the filter expressions are compiled with
+ * the tcpdump precedence, match the UDP, TCP, IPv6, VLAN and
+ * ARP frames as expected, reject the syntax errors, and that a
+ * FilteringSink only passes (and counts) the packets matching
+ * one of its filters.
+ */
+BOOST_AUTO_TEST_CASE (PACKET_FILTER_TEST)
+{
+  std::vector<std::vector<uint8_t>> frames;
+  /* 0: UDP 10.0.0.1:5353 -> 10.0.1.2:53 */
+  frames.push_back(buildIPv4Frame(0x0a000001, 0x0a000102, 5353, 53,
+                                  17));
+  /* 1: TCP 192.168.1.7:40000 -> 10.0.0.9:80 */
+  frames.push_back(buildTcpFrame(0xc0a80107, 0x0a000009, 40000, 80,
+                                 1, 0x02, ""));
+  /* 2: ICMP 10.0.0.1 -> 10.0.0.2 */
+  frames.push_back(buildIPv4Frame(0x0a000001, 0x0a000002, 0, 0, 1));
+  /* 3: VLAN 5 tagged UDP 10.0.0.1:1 -> 10.0.0.2:8080 */
+  frames.push_back(buildIPv4Frame(0x0a000001, 0x0a000002, 1, 8080,
+                                  17));
+  frames.back().insert(frames.back().begin() + 12,
+                       {0x81, 0x00, 0x00, 0x05});
+  /* 4: ARP */
+  frames.emplace_back(42, 0);
+  frames.back()[12] = 0x08;
+  frames.back()[13] = 0x06;
+  /* 5: IPv6 UDP 2001:db8::1:53 -> 2001:db8::2:53 */
+  std::vector<uint8_t> ipv6_frame(12, 0xaa);
+  ipv6_frame.insert(ipv6_frame.end(), {0x86, 0xdd, 0x60, 0, 0, 0,
+                                       0, 8, 17, 64});
+  for (uint8_t last_octet : {1, 2})
+  {
+    ipv6_frame.insert(ipv6_frame.end(), {0x20, 0x01, 0x0d, 0xb8});
+    ipv6_frame.insert(ipv6_frame.end(), 11, 0);
+    ipv6_frame.push_back(last_octet);
+  }
+  ipv6_frame.insert(ipv6_frame.end(), {0, 53, 0, 53, 0, 8, 0, 0});
+  frames.push_back(ipv6_frame);
+
+  std::vector<DecodedPacket> decoded(frames.size());
+  for (std::size_t i = 0; i < frames.size(); i++)
+    BOOST_REQUIRE(decodePacket(frames[i].data(), frames[i].size(),
+                               decoded[i]));
+
+  /* the indexes of the frames matching each expression */
+  const std::vector<std::pair<std::string, std::string>> cases = {
+    {"", "012345"},
+    {"udp", "035"},
+    {"tcp and dst port 80", "1"},
+    {"port 53 || portrange 8000-8100", "035"},
+    {"src port 53", "5"},
+    {"host 10.0.0.1", "023"},
+    {"dst net 10.0.0.0/24", "123"},
+    {"net 10.0.0.0/23", "0123"},
+    {"src net 192.168.0.0/16 or ip6", "15"},
+    {"host 2001:db8::2", "5"},
+    {"net 2001:db8::/32 and not dst host 2001:db8::2", ""},
+    {"icmp", "2"},
+    {"ip proto 17", "03"},
+    {"ip6 proto 17", "5"},
+    {"arp or vlan 5", "34"},
+    {"vlan and not vlan 6", "3"},
+    {"not (udp or tcp)", "24"},
+    {"! udp and ! arp", "12"},
+    /* "and" binds tighter than "or" */
+    {"arp or icmp and host 10.0.0.1", "24"},
+    {"(arp or icmp) and host 10.0.0.1", "2"},
+  };
+  for (const auto& test_case : cases)
+  {
+    PacketFilter filter;
+    BOOST_REQUIRE(PacketFilter::fromString(test_case.first, filter));
+    std::string matching_frames;
+    for (std::size_t i = 0; i < frames.size(); i++)
+      if (filter.matches(frames[i].data(), frames[i].size(),
+                         decoded[i]))
+        matching_frames += static_cast<char>('0' + i);
+    BOOST_CHECK_MESSAGE(matching_frames == test_case.second,
+                        test_case.first << " matched "
+                        << matching_frames);
+    BOOST_CHECK_EQUAL(filter.get_number_of_packets(), frames.size());
+    BOOST_CHECK_EQUAL(filter.get_number_of_matches(),
+                      test_case.second.size());
+  }
+
+  /* a truncated frame does not match its ports */
+  PacketFilter port_filter;
+  BOOST_REQUIRE(PacketFilter::fromString("port 53", port_filter));
+  DecodedPacket truncated;
+  BOOST_REQUIRE(decodePacket(frames[0].data(), 14 + 20 + 2,
+                             truncated));
+  BOOST_CHECK(!port_filter.evaluate(frames[0].data(), 14 + 20 + 2,
+                                    truncated));
+
+  /* an invalid expression leaves the filter unchanged */
+  for (const char* expression :
+       {"tcp and", "port", "port 70000", "host 10.0.0.256",
+        "net 10.0.0.0", "net 10.0.0.0/33", "(udp", "udp)",
+        "portrange 90-80", "foo", "udp tcp", "& udp"})
+  {
+    BOOST_CHECK_MESSAGE(
+      !PacketFilter::fromString(expression, port_filter),
+      expression);
+    BOOST_CHECK_EQUAL(port_filter.get_expression(), "port 53");
+  }
+
+  /* the sink passes the packets matching any filter, in order;
+  every filter counts every packet */
+  std::vector<PacketFilter> filters(2);
+  BOOST_REQUIRE(PacketFilter::fromString("arp", filters[0]));
+  BOOST_REQUIRE(PacketFilter::fromString("udp", filters[1]));
+  Common::MpmcPcapPacketQueue queue(64);
+  FilteringSink filtering_sink(queue, std::move(filters));
+  /* more than a burst of the decoder */
+  std::vector<Common::PcapPacket> packets;
+  for (int round = 0; round < 10; round++)
+    for (std::size_t i = 0; i < frames.size(); i++)
+      packets.push_back(makePacket(frames[i], i));
+  filtering_sink.pushPackets(packets.data(), packets.size());
+  filtering_sink.pushPacket(makePacket(frames[1]));
+  filtering_sink.pushPacket(makePacket(frames[4], 42));
+  filtering_sink.closeQueue();
+
+  BOOST_CHECK_EQUAL(filtering_sink.get_number_of_packets(), 62u);
+  BOOST_CHECK_EQUAL(filtering_sink.get_number_of_passed_packets(),
+                    41u);
+  BOOST_CHECK_EQUAL(filtering_sink.get_filter(0)
+                      .get_number_of_matches(), 11u);
+  BOOST_CHECK_EQUAL(filtering_sink.get_filter(1)
+                      .get_number_of_packets(), 62u);
+  std::string seconds;
+  Common::PcapPacket packet;
+  while (queue.waitAndPopPacket(packet))
+    seconds += std::to_string(packet.get_arrival_time().tv_sec)
+               + " ";
+  std::string expected_seconds;
+  for (int round = 0; round < 10; round++)
+    expected_seconds += "0 3 4 5 ";
+  BOOST_CHECK_EQUAL(seconds, expected_seconds + "42 ");
+
+  /* a dispatcher behind the sink hashes the flows from the
+  decoded headers onto the shards hashFiveTuple picks */
+  std::vector<PacketFilter> udp_filters(1);
+  BOOST_REQUIRE(PacketFilter::fromString("udp", udp_filters[0]));
+  PacketDispatcher dispatcher(4);
+  FilteringSink dispatching_sink(dispatcher, std::move(udp_filters));
+  packets.clear();
+  for (uint16_t port = 0; port < 100; port++)
+    packets.push_back(makePacket(buildIPv4Frame(
+      0x0a000001, 0x0a000002, 1000 + port, 53, 
+      port % 4 == 0 ? 6 : 17)));
+  dispatching_sink.pushPackets(packets.data(), packets.size());
+  dispatching_sink.pushPacket(makePacket(
+    buildIPv4Frame(0x0a000002, 0x0a000001, 53, 1001, 17)));
+  dispatching_sink.closeQueue();
+  std::size_t number_of_dispatched_packets = 0;
+  for (std::size_t shard = 0; shard < 4; shard++)
+    while (dispatcher.get_shard(shard).waitAndPopPacket(packet))
+    {
+      number_of_dispatched_packets++;
+      BOOST_CHECK_EQUAL(hashFiveTuple(packet) % 4, shard);
+    }
+  BOOST_CHECK_EQUAL(number_of_dispatched_packets, 76u);
+}
+
+/**
+ * @brief Checks that the packets written by a PcapFileWriter,
+ * spanning several of its buffers, read back the same from the
+ * pcap and pcapng files, and that the output is split into
+ * several files by size and by the time of the packets.
+ */
+BOOST_AUTO_TEST_CASE (PCAP_FILE_WRITER_TEST)
+{
+  char directory[] = "/tmp/offline_pcap_packet_processor_XXXXXX";
+  BOOST_REQUIRE(mkdtemp(directory) != nullptr);
+
+  /* more than a buffer of the writer, with odd sizes */
+  std::vector<std::vector<uint8_t>> frames;
+  for (int i = 0; i < 3000; i++)
+    frames.push_back(buildIPv4Frame(0x0a000001, 0x0a000002, i, 80,
+                                    17, std::vector<uint8_t>(
+                                      1 + i % 1457, i)));
+
+  for (auto format : {PcapFileWriter::Format::kPcap,
+                      PcapFileWriter::Format::kPcapng})
+  {
+    const auto path = std::string(directory) + "/out"
+      + (format == PcapFileWriter::Format::kPcap ? ".pcap"
+                                                 : ".pcapng");
+    PcapFileWriter writer;
+    BOOST_REQUIRE(writer.open(path, format));
+    for (std::size_t i = 0; i < frames.size(); i++)
+    {
+      auto packet = Common::PcapPacket::allocate(
+        1700000000LL * Common::kNanosecondsPerSecond + i * 1001,
+        frames[i].size(), frames[i].size() + 4);
+      std::memcpy(packet.get_data(), frames[i].data(),
+                  frames[i].size());
+      writer.writePacket(packet);
+    }
+    writer.close();
+    BOOST_CHECK(writer.is_good());
+    BOOST_CHECK_EQUAL(writer.get_number_of_packets(), frames.size());
+    BOOST_CHECK_EQUAL(writer.get_number_of_files(), 1u);
+    BOOST_CHECK_EQUAL(writer.get_file_path(0), path);
+
+    auto reader = openPcapReader(path);
+    BOOST_REQUIRE(reader);
+    Common::PcapPacket packet;
+    std::size_t number_of_packets = 0;
+    while (reader->nextPacket(packet))
+    {
+      const auto& frame = frames[number_of_packets];
+      BOOST_REQUIRE_EQUAL(packet.get_caplen(), frame.size());
+      BOOST_CHECK_EQUAL(packet.get_len(), frame.size() + 4);
+      BOOST_CHECK_EQUAL(packet.get_arrival_time_ns(),
+                        1700000000LL * Common::kNanosecondsPerSecond
+                        + number_of_packets * 1001);
+      BOOST_CHECK(std::memcmp(packet.get_data(), frame.data(),
+                              frame.size()) == 0);
+      number_of_packets++;
+    }
+    BOOST_CHECK_EQUAL(number_of_packets, frames.size());
+    unlink(path.c_str());
+  }
+
+  {
+    /* 2 records of 1016 octets fit a file of 2100 octets with
+    its header; a new file every 10 seconds of packet time too */
+    const auto path = std::string(directory) + "/rotated.pcap";
+    PcapFileWriter writer;
+    writer.set_rotation(2100, 10 * Common::kNanosecondsPerSecond);
+    BOOST_REQUIRE(writer.open(path));
+    const std::vector<uint8_t> frame(1000, 0xab);
+    for (__time_t second : {15, 16, 21, 22, 23, 24, 25, 38})
+      writer.writePacket(makePacket(frame, second));
+    writer.close();
+    BOOST_CHECK_EQUAL(writer.get_number_of_files(), 5u);
+    BOOST_CHECK_EQUAL(writer.get_file_path(1),
+                      std::string(directory) + "/rotated_00001.pcap");
+    std::string seconds;
+    for (uint64_t i = 0; i < writer.get_number_of_files(); i++)
+    {
+      const auto file_path = writer.get_file_path(i);
+      auto reader = openPcapReader(file_path);
+      BOOST_REQUIRE(reader);
+      Common::PcapPacket packet;
+      while (reader->nextPacket(packet))
+        seconds += std::to_string(packet.get_arrival_time().tv_sec)
+                   + " ";
+      seconds += "| ";
+      unlink(file_path.c_str());
+    }
+    BOOST_CHECK_EQUAL(seconds,
+                      "15 16 | 21 22 | 23 24 | 25 | 38 | ");
+  }
+
+  {
+    /* Several threads write at once, each into a buffer of its
+    own: no packet is lost and those of a thread stay in order.
+    The time of a packet is its thread * 1 ms + its index. */
+    const auto path = std::string(directory) + "/threads.pcapng";
+    PcapFileWriter writer;
+    BOOST_REQUIRE(writer.open(path));
+    constexpr int number_of_threads = 4;
+    constexpr int number_of_packets_per_thread = 5000;
+    const auto frame = buildIPv4Frame(0x0a000001, 0x0a000002, 1, 2,
+                                      17, std::vector<uint8_t>(600));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < number_of_threads; t++)
+      threads.emplace_back([&, t]()
+      {
+        for (int i = 0; i < number_of_packets_per_thread; i++)
+        {
+          auto packet = Common::PcapPacket::allocate(
+            t * Common::kNanosecondsPerMillisecond + i,
+            frame.size(), frame.size());
+          std::memcpy(packet.get_data(), frame.data(),
+                      frame.size());
+          writer.writePacket(packet);
+        }
+      });
+    for (auto& thread : threads)
+      thread.join();
+    writer.close();
+    BOOST_CHECK(writer.is_good());
+    BOOST_CHECK_EQUAL(writer.get_number_of_packets(),
+      static_cast<uint64_t>(number_of_threads 
+                            * number_of_packets_per_thread));
+
+    auto reader = openPcapReader(path);
+    BOOST_REQUIRE(reader);
+    std::vector<int> number_of_packets(number_of_threads, 0);
+    Common::PcapPacket packet;
+    while (reader->nextPacket(packet))
+    {
+      const auto time_ns = packet.get_arrival_time_ns();
+      const auto t = static_cast<int>(
+        time_ns / Common::kNanosecondsPerMillisecond);
+      BOOST_REQUIRE(t >= 0 && t < number_of_threads);
+      BOOST_REQUIRE_EQUAL(time_ns % Common::kNanosecondsPerMillisecond,
+                          number_of_packets[t]);
+      number_of_packets[t]++;
+    }
+    for (int t = 0; t < number_of_threads; t++)
+      BOOST_CHECK_EQUAL(number_of_packets[t],
+                        number_of_packets_per_thread);
+    unlink(path.c_str());
+  }
+
+  /* a file which can not be created */
+  PcapFileWriter writer;
+  BOOST_CHECK(!writer.open(std::string(directory) + "/none/x.pcap"));
+  rmdir(directory);
+}
+
+/**
+ * @brief Checks that a PcapIndex finds where to start and stop
+ * reading a pcap or pcapng capture for a time window, even when
+ * the capture is not sorted by time, that the time window
+ * readers return exactly the packets of the window, and that
+ * a stale index is rebuilt.
+ */
+BOOST_AUTO_TEST_CASE (PCAP_INDEX_TEST)
+{
+  char directory[] = "/tmp/offline_pcap_packet_processor_XXXXXX";
+  BOOST_REQUIRE(mkdtemp(directory) != nullptr);
+  const Common::Nanoseconds kBase = 
+    1700000000LL * Common::kNanosecondsPerSecond;
+  const auto kMillisecond = Common::kNanosecondsPerMillisecond;
+
+  /* packet #i arrives at i ms, but #60 straggles in at 5 ms */
+  auto writeCapture = [&](const std::string& path,
+                          std::size_t number_of_packets)
+  {
+    PcapFileWriter writer;
+    BOOST_REQUIRE(writer.open(path));
+    const auto frame = buildIPv4Frame(0x0a000001, 0x0a000002, 1, 2,
+                                      17);
+    for (std::size_t i = 0; i < number_of_packets; i++)
+    {
+      auto packet = Common::PcapPacket::allocate(
+        kBase + (i == 60 ? 5 : i) * kMillisecond, frame.size(),
+        frame.size());
+      std::memcpy(packet.get_data(), frame.data(), frame.size());
+      writer.writePacket(packet);
+    }
+    writer.close();
+  };
+  auto readWindow = [&](PcapTimeWindowReader& reader)
+  {
+    std::string milliseconds;
+    Common::PcapPacket packet;
+    while (reader.nextPacket(packet))
+      milliseconds += std::to_string(
+        (packet.get_arrival_time_ns() - kBase) / kMillisecond) + " ";
+    return milliseconds;
+  };
+
+  for (const char* extension : {".pcap", ".pcapng"})
+  {
+    const auto path = std::string(directory) + "/capture" 
+                      + extension;
+    const auto index_path = PcapIndex::getIndexPath(path);
+    writeCapture(path, 100);
+    BOOST_REQUIRE(PcapIndex::build(path, index_path, 8));
+    PcapIndex index;
+    BOOST_REQUIRE(index.open(index_path, path));
+    BOOST_CHECK_EQUAL(index.get_number_of_packets(), 100u);
+    BOOST_REQUIRE_EQUAL(index.get_number_of_checkpoints(), 13u);
+    BOOST_CHECK_EQUAL(index.get_checkpoint(12).packet_number, 96u);
+
+    /* from #16 (every packet before it is before 20 ms) to #64
+    (the straggler is before it) */
+    BOOST_CHECK_EQUAL(index.findStart(kBase + 20 * kMillisecond),
+                      &index.get_checkpoint(2));
+    BOOST_CHECK_EQUAL(index.findEnd(kBase + 30 * kMillisecond),
+                      &index.get_checkpoint(8));
+    BOOST_CHECK_EQUAL(index.findEnd(kBase + 100 * kMillisecond),
+                      nullptr);
+    {
+      PcapTimeWindowReader reader(openPcapReader(path), index,
+                                  kBase + 20 * kMillisecond,
+                                  kBase + 30 * kMillisecond);
+      BOOST_CHECK_EQUAL(readWindow(reader),
+                        "20 21 22 23 24 25 26 27 28 29 ");
+      BOOST_CHECK_EQUAL(reader.get_number_of_skipped_packets(), 
+                        4u + 34u);
+    }
+    {
+      PcapTimeWindowReader reader(openPcapReader(path), index,
+                                  kBase + 3 * kMillisecond,
+                                  kBase + 8 * kMillisecond);
+      BOOST_CHECK_EQUAL(readWindow(reader), "3 4 5 6 7 5 ");
+    }
+    {
+      PcapTimeWindowReader reader(openPcapReader(path), index,
+                                  kBase + 95 * kMillisecond,
+                                  kBase + 1000 * kMillisecond);
+      BOOST_CHECK_EQUAL(readWindow(reader), "95 96 97 98 99 ");
+      BOOST_CHECK_EQUAL(reader.get_number_of_skipped_packets(), 7u);
+    }
+
+    /* the index of a changed capture is not used but rebuilt */
+    index.close();
+    writeCapture(path, 101);
+    BOOST_CHECK(!index.open(index_path, path));
+    auto reader = openPcapReader(path, kBase + 100 * kMillisecond,
+                                 kBase + 101 * kMillisecond);
+    BOOST_REQUIRE(reader);
+    Common::PcapPacket packet;
+    BOOST_REQUIRE(reader->nextPacket(packet));
+    BOOST_CHECK_EQUAL(packet.get_arrival_time_ns(),
+                      kBase + 100 * kMillisecond);
+    BOOST_CHECK(!reader->nextPacket(packet));
+    BOOST_REQUIRE(index.open(index_path, path));
+    BOOST_CHECK_EQUAL(index.get_number_of_packets(), 101u);
+    index.close();
+
+    unlink(path.c_str());
+    unlink(index_path.c_str());
+  }
+  rmdir(directory);
+}
+
+/**
+ * @brief Checks that the TimerWheel expires the timers in the
+ * order of their deadlines, only when their deadlines are
+ * reached, including the timers far enough to be cascaded down
+ * from the higher levels.
+ */
+BOOST_AUTO_TEST_CASE (TIMER_WHEEL_TEST)
+{
+  Common::TimerWheel timer_wheel;
+  timer_wheel.reset(1000);
+
+  const std::vector<uint64_t> deadlines = {
+    1001, 1063, 1064, 1065, 5000, 5000, 70000, 1ULL << 40, 1000};
+  std::vector<Common::TimerWheel::Timer> timers(deadlines.size());
+  for (std::size_t i = 0; i < timers.size(); i++)
+    timer_wheel.insert(timers[i], deadlines[i]);
+  BOOST_CHECK_EQUAL(timer_wheel.size(), timers.size());
+
+  Common::TimerWheel::Timer removed_timer;
+  timer_wheel.insert(removed_timer, 1500);
+  timer_wheel.remove(removed_timer);
+  BOOST_CHECK(!removed_timer.is_scheduled());
+  /* removing twice is harmless */
+  timer_wheel.remove(removed_timer);
+
+  std::vector<uint64_t> expired_deadlines;
+  auto on_expired = [&](Common::TimerWheel::Timer& timer)
+  {
+    BOOST_CHECK(!timer.is_scheduled());
+    expired_deadlines.push_back(timer.deadline);
+  };
+
+  /* an already passed deadline expires on the next advance */
+  timer_wheel.advance(1000, on_expired);
+  BOOST_REQUIRE_EQUAL(expired_deadlines.size(), 1u);
+
+  timer_wheel.advance(1064, on_expired);
+  BOOST_CHECK_EQUAL(expired_deadlines.size(), 4u);
+  uint64_t next_deadline = 0;
+  BOOST_REQUIRE(timer_wheel.get_next_deadline(next_deadline));
+  BOOST_CHECK(next_deadline <= 1065);
+
+  timer_wheel.advance(4999, on_expired);
+  BOOST_CHECK_EQUAL(expired_deadlines.size(), 5u);
+  timer_wheel.advance(100000, on_expired);
+  BOOST_CHECK_EQUAL(expired_deadlines.size(), 8u);
+  timer_wheel.advance(1ULL << 41, on_expired);
+  BOOST_REQUIRE_EQUAL(expired_deadlines.size(), deadlines.size());
+  BOOST_CHECK(std::is_sorted(expired_deadlines.begin(),
+                             expired_deadlines.end()));
+  BOOST_CHECK_EQUAL(timer_wheel.size(), 0u);
+  BOOST_CHECK(!timer_wheel.get_next_deadline(next_deadline));
+
+  /* A periodic timer inserted again from on_expired expires
+  once per period */
+  Common::TimerWheel::Timer periodic_timer;
+  unsigned number_of_expirations = 0;
+  const uint64_t start = timer_wheel.get_current_tick();
+  timer_wheel.insert(periodic_timer, start + 100);
+  timer_wheel.advance(start + 1000, 
+    [&](Common::TimerWheel::Timer& timer)
+    {
+      number_of_expirations++;
+      timer_wheel.insert(timer, timer.deadline + 100);
+    });
+  BOOST_CHECK_EQUAL(number_of_expirations, 10u);
+  BOOST_CHECK_EQUAL(periodic_timer.deadline, start + 1100);
+}
+
+/**
+ * @brief Checks that a controller can hold many more jobs than
+ * it could when each job had a thread of its own, and that the
+ * cycles handed to the WorkerPool all finish.
+ */
+BOOST_AUTO_TEST_CASE (MANY_PERIODIC_JOBS_TEST)
+{
+  auto ptr_periodic_class_controller_instance =
+   std::make_shared<PeriodicJobController>();
+
+  constexpr unsigned number_of_jobs = 2000;
+  std::vector<JOBID> job_ids;
+  for (unsigned i = 0; i < number_of_jobs; i++)
+  {
+    struct timeval tv = {static_cast<__time_t>(1 + i % 7), 0};
+    job_ids.push_back(
+      ptr_periodic_class_controller_instance->addJob(tv));
+    BOOST_REQUIRE( !job_ids.back().empty() );
+  }
+  BOOST_CHECK_EQUAL(
+    PeriodicJobControllerFriend::get_active_jobs
+      (ptr_periodic_class_controller_instance).size(),
+    number_of_jobs
+  );
+
+  for (auto& job_id : job_ids)
+    BOOST_CHECK(
+      ptr_periodic_class_controller_instance->removeJob(job_id));
+  BOOST_CHECK(
+    PeriodicJobControllerFriend::get_active_jobs
+      (ptr_periodic_class_controller_instance).empty());
+
+  /* the first cycles of the jobs were handed to the workers */
+  Common::WorkerPool::getInstance().waitUntilIdle();
+  BOOST_CHECK(
+    Common::WorkerPool::getInstance().get_number_of_workers() > 0);
+}
+
+/**
+ * @brief Checks that the jobs can be added, changed and
+ * removed from many threads at once and that the job limit can
+ * be changed at runtime.
+ */
+BOOST_AUTO_TEST_CASE (SHARDED_JOB_TABLE_TEST)
+{
+  auto ptr_periodic_class_controller_instance =
+   std::make_shared<PeriodicJobController>(8);
+  BOOST_CHECK_EQUAL(
+    ptr_periodic_class_controller_instance->get_number_of_shards(),
+    8u);
+
+  constexpr unsigned number_of_threads = 4;
+  constexpr unsigned number_of_jobs_per_thread = 500;
+  std::atomic<unsigned> number_of_failures(0);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < number_of_threads; t++)
+    threads.emplace_back([&]()
+    {
+      std::vector<JOBID> job_ids;
+      for (unsigned i = 0; i < number_of_jobs_per_thread; i++)
+      {
+        struct timeval tv = {static_cast<__time_t>(1 + i % 5), 0};
+        auto job_id = 
+          ptr_periodic_class_controller_instance->addJob(tv);
+        if (job_id.empty())
+          number_of_failures++;
+        job_ids.push_back(job_id);
+      }
+      for (unsigned i = 0; i < job_ids.size(); i++)
+      {
+        struct timeval tv = {2, 500};
+        if (!ptr_periodic_class_controller_instance
+               ->changePeriod(job_ids[i], tv))
+          number_of_failures++;
+        /* remove every other job */
+        if (i % 2 == 0 
+            && !ptr_periodic_class_controller_instance
+                  ->removeJob(job_ids[i]))
+          number_of_failures++;
+      }
+    });
+  for (auto& thread : threads)
+    thread.join();
+  BOOST_CHECK_EQUAL(number_of_failures.load(), 0u);
+
+  const auto& active_jobs = 
+    PeriodicJobControllerFriend::get_active_jobs
+      (ptr_periodic_class_controller_instance);
+  const std::size_t number_of_jobs = 
+    number_of_threads * number_of_jobs_per_thread / 2;
+  BOOST_CHECK_EQUAL(active_jobs.size(), number_of_jobs);
+
+  /* the limit is checked at runtime */
+  ptr_periodic_class_controller_instance->set_max_number_of_jobs(
+    number_of_jobs);
+  struct timeval tv = {1, 0};
+  BOOST_CHECK(
+    ptr_periodic_class_controller_instance->addJob(tv).empty());
+  ptr_periodic_class_controller_instance->set_max_number_of_jobs(
+    number_of_jobs + 1);
+  auto job_id = ptr_periodic_class_controller_instance->addJob(tv);
+  BOOST_REQUIRE(!job_id.empty());
+  BOOST_CHECK(active_jobs.find(job_id) != active_jobs.end());
+  BOOST_CHECK(
+    ptr_periodic_class_controller_instance->addJob(tv).empty());
+
+  /* the indices of the handles must fit in 32 bits */
+  ptr_periodic_class_controller_instance->set_max_number_of_jobs(
+    SIZE_MAX);
+  BOOST_CHECK_EQUAL(
+    ptr_periodic_class_controller_instance->get_max_number_of_jobs(),
+    UINT32_MAX / 8u);
+
+  while (!ptr_periodic_class_controller_instance
+            ->removeAnArbitraryJob().empty()) {}
+  BOOST_CHECK(active_jobs.empty());
+  BOOST_CHECK(active_jobs.find(job_id) == active_jobs.end());
+  Common::WorkerPool::getInstance().waitUntilIdle();
+}
+
+/**
+ * @brief Checks that the handle of a removed job goes stale
+ * even when its slot is reused by a new job.
+ */
+BOOST_AUTO_TEST_CASE (JOB_HANDLE_TEST)
+{
+  BOOST_CHECK(JOBID().empty());
+  BOOST_CHECK(JOBID().to_string().empty());
+  BOOST_CHECK_EQUAL(JOBID(7, 3).to_string(), "7.3");
+  BOOST_CHECK_EQUAL(sizeof(JOBID), 8u);
+
+  /* a single shard so that the slot is reused */
+  auto ptr_periodic_class_controller_instance =
+   std::make_shared<PeriodicJobController>(1);
+  struct timeval tv = {2, 0};
+  auto id1 = ptr_periodic_class_controller_instance->addJob(tv);
+  BOOST_REQUIRE(!id1.empty());
+  BOOST_CHECK(ptr_periodic_class_controller_instance->removeJob(id1));
+
+  auto id2 = ptr_periodic_class_controller_instance->addJob(tv);
+  BOOST_REQUIRE(!id2.empty());
+  BOOST_CHECK_EQUAL(id2.get_index(), id1.get_index());
+  BOOST_CHECK(id2 != id1);
+
+  /* the stale handle does not reach the new job */
+  BOOST_CHECK(
+    !ptr_periodic_class_controller_instance->changePeriod(id1, tv));
+  BOOST_CHECK(!ptr_periodic_class_controller_instance->removeJob(id1));
+  const auto& active_jobs = 
+    PeriodicJobControllerFriend::get_active_jobs
+      (ptr_periodic_class_controller_instance);
+  BOOST_CHECK(active_jobs.find(id1) == active_jobs.end());
+  BOOST_CHECK(active_jobs.find(id2) != active_jobs.end());
+
+  /* an index beyond the table is not a job either */
+  BOOST_CHECK(!ptr_periodic_class_controller_instance->removeJob(
+    JOBID(id2.get_index() + 1000, id2.get_generation())));
+
+  BOOST_CHECK(
+    ptr_periodic_class_controller_instance->removeAnArbitraryJob() 
+    == id2);
+  BOOST_CHECK(active_jobs.empty());
+}
+
+/**
+ * @brief Checks that the jobs added before the external time
+ * is set run their first cycles at the first time set, rather
+ * than catching up the periods since the epoch.
+ *
+ * @note Runs before the tests setting the external time.
+ */
+BOOST_AUTO_TEST_CASE (UNSET_TIME_JOB_TEST)
+{
+  auto& external_time = Common::ExternalTime::getInstance();
+  BOOST_REQUIRE(!external_time.is_set());
+
+  auto ptr_periodic_class_controller_instance =
+   std::make_shared<PeriodicJobController>();
+  const auto period_ns = 10 * Common::kNanosecondsPerMillisecond;
+  std::vector<Common::Nanoseconds> cycle_times;
+  auto id1 = ptr_periodic_class_controller_instance->addJob(
+    period_ns,
+    [&cycle_times](Common::Nanoseconds cycle_time_ns)
+    {
+      cycle_times.push_back(cycle_time_ns);
+    });
+  std::vector<Common::Nanoseconds> changed_cycle_times;
+  auto id2 = ptr_periodic_class_controller_instance->addJob(
+    period_ns,
+    [&changed_cycle_times](Common::Nanoseconds cycle_time_ns)
+    {
+      changed_cycle_times.push_back(cycle_time_ns);
+    });
+  auto id3 = ptr_periodic_class_controller_instance->addJob(
+    period_ns);
+  BOOST_CHECK(ptr_periodic_class_controller_instance->changePeriod(
+    id2, 2 * period_ns));
+  BOOST_CHECK(ptr_periodic_class_controller_instance->removeJob(id3));
+  Common::WorkerPool::getInstance().waitUntilIdle();
+  BOOST_CHECK(cycle_times.empty());
+  BOOST_CHECK(changed_cycle_times.empty());
+
+  const Common::Nanoseconds base = Common::kNanosecondsPerSecond;
+  external_time.set_current_time_ns(base);
+  Common::WorkerPool::getInstance().waitUntilIdle();
+  BOOST_REQUIRE_EQUAL(cycle_times.size(), 1u);
+  BOOST_CHECK_EQUAL(cycle_times[0], base);
+  BOOST_REQUIRE_EQUAL(changed_cycle_times.size(), 1u);
+  BOOST_CHECK_EQUAL(changed_cycle_times[0], base);
+
+  external_time.set_current_time_ns(base + 2 * period_ns);
+  Common::WorkerPool::getInstance().waitUntilIdle();
+  BOOST_REQUIRE_EQUAL(cycle_times.size(), 3u);
+  BOOST_CHECK_EQUAL(cycle_times[2], base + 2 * period_ns);
+  BOOST_REQUIRE_EQUAL(changed_cycle_times.size(), 2u);
+  BOOST_CHECK_EQUAL(changed_cycle_times[1], base + 2 * period_ns);
+
+  for (auto id : {id1, id2})
+    BOOST_CHECK(ptr_periodic_class_controller_instance->removeJob(id));
+}
+
+/**
+ * @brief Checks that the small payloads are stored inline,
+ * the large ones on the heap, and that the jobs run their
+ * payloads in their cycles.
+ */
+BOOST_AUTO_TEST_CASE (JOB_PAYLOAD_TEST)
+{
+  typedef Common::InplaceFunction<int(int), 32> SmallFunction;
+  int base = 10;
+  SmallFunction small([&base](int x) { return base + x; });
+  BOOST_CHECK(small.is_inline());
+  BOOST_CHECK_EQUAL(small(5), 15);
+
+  std::array<int, 32> numbers;
+  numbers.fill(1);
+  SmallFunction large([numbers](int x) { return numbers[0] + x; });
+  BOOST_CHECK(!large.is_inline());
+  BOOST_CHECK_EQUAL(large(5), 6);
+
+  /* move-only callables are fine; moving empties the source */
+  auto pointer = std::make_unique<int>(7);
+  SmallFunction move_only(
+    [pointer = std::move(pointer)](int x) { return *pointer * x; });
+  SmallFunction moved(std::move(move_only));
+  BOOST_CHECK(!move_only);
+  BOOST_CHECK_EQUAL(moved(2), 14);
+  moved = std::move(large);
+  BOOST_CHECK_EQUAL(moved(1), 2);
+  moved.reset();
+  BOOST_CHECK(!moved);
+
+  /* the first cycle of a job is run when it is added */
+  auto& external_time = Common::ExternalTime::getInstance();
+  external_time.set_current_time_ns(
+    external_time.get_current_time_ns() 
+    + 10 * Common::kNanosecondsPerSecond);
+  auto ptr_periodic_class_controller_instance =
+   std::make_shared<PeriodicJobController>();
+  std::atomic<unsigned> number_of_payload_runs(0);
+  struct timeval tv = {4, 0};
+  auto id1 = ptr_periodic_class_controller_instance->addJob(tv,
+    [&number_of_payload_runs]() { number_of_payload_runs++; });
+  BOOST_REQUIRE(!id1.empty());
+
+  struct Counter
+  {
+    std::atomic<unsigned>* number_of_runs;
+    void operator()() { (*number_of_runs) += 10; }
+  };
+  auto id2 = ptr_periodic_class_controller_instance->addTypedJob(
+    tv, Counter{&number_of_payload_runs});
+  BOOST_REQUIRE(!id2.empty());
+
+  Common::WorkerPool::getInstance().waitUntilIdle();
+  BOOST_CHECK_EQUAL(number_of_payload_runs.load(), 11u);
+  BOOST_CHECK(ptr_periodic_class_controller_instance->removeJob(id1));
+  BOOST_CHECK(ptr_periodic_class_controller_instance->removeJob(id2));
+}
+
+/**
+ * @brief Checks that the replay clock paces the packets of a
+ * capture file by their inter-arrival gaps in the scaled mode
+ * and does not sleep in the max-speed mode.
+ */
+BOOST_AUTO_TEST_CASE (REPLAY_PACING_TEST)
+{
+  ReplayClock replay_clock;
+  BOOST_CHECK(ReplayClock::fromString("realtime", replay_clock));
+  BOOST_CHECK(replay_clock.get_mode() 
+              == Common::ReplayMode::kRealTime);
+  BOOST_CHECK(ReplayClock::fromString("2.5", replay_clock));
+  BOOST_CHECK(replay_clock.get_mode() 
+              == Common::ReplayMode::kScaled);
+  BOOST_CHECK_EQUAL(replay_clock.get_speed(), 2.5);
+  BOOST_CHECK(!ReplayClock::fromString("fast", replay_clock));
+  BOOST_CHECK(!ReplayClock::fromString("-1", replay_clock));
+  BOOST_CHECK(ReplayClock::fromString("max", replay_clock));
+  BOOST_CHECK_EQUAL(
+    replay_clock.get_time_until_due(1000000000000LL).count(), 0);
+
+  /* 4 packets one second apart: 30 ms at 100 times the speed */
+  std::vector<uint8_t> file;
+  appendU32(file, 0xa1b2c3d4);
+  appendU32(file, 2 | (4u << 16));
+  appendU32(file, 0);
+  appendU32(file, 0);
+  appendU32(file, 65535);
+  appendU32(file, 1);
+  for (uint32_t second = 100; second < 104; second++)
+  {
+    appendU32(file, second);
+    appendU32(file, 0);
+    appendU32(file, 1);
+    appendU32(file, 1);
+    file.push_back(0x42);
+  }
+  auto path = writeTemporaryFile(file);
+
+  for (auto speed : {100.0, 0.0})
+  {
+    PcapFileReader reader;
+    BOOST_REQUIRE(reader.open(path));
+    Common::MpmcPcapPacketQueue queue(16, 0);
+    /* a speed of 0 falls back to the max speed */
+    const auto start = std::chrono::steady_clock::now();
+    writeToPacketSink(queue, reader, 
+      ReplayClock(Common::ReplayMode::kScaled, speed));
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (speed > 0)
+      BOOST_CHECK(elapsed >= std::chrono::milliseconds(29));
+
+    std::array<Common::PcapPacket, 8> packets;
+    BOOST_CHECK_EQUAL(
+      queue.popPackets(packets.data(), packets.size()), 4u);
+    BOOST_CHECK_EQUAL(packets[3].get_arrival_time().tv_sec, 103);
+  }
+  unlink(path.c_str());
+}
+
+/**
+ * @brief Checks that a job with a sub-second period is run by
+ * the external time at its period (and not once per second).
+ */
+BOOST_AUTO_TEST_CASE (SUB_SECOND_PERIOD_TEST)
+{
+  auto& external_time = Common::ExternalTime::getInstance();
+  const Common::Nanoseconds base = 
+    external_time.get_current_time_ns() 
+    + 10 * Common::kNanosecondsPerSecond;
+  external_time.set_current_time_ns(base);
+
+  auto ptr_periodic_class_controller_instance =
+   std::make_shared<PeriodicJobController>();
+  std::atomic<unsigned> number_of_runs(0);
+  auto id = ptr_periodic_class_controller_instance->addJob(
+    10 * Common::kNanosecondsPerMillisecond,
+    [&number_of_runs]() { number_of_runs++; });
+  BOOST_REQUIRE(!id.empty());
+
+  /* the first cycle when added, then one per 10 ms */
+  for (int millisecond = 1; millisecond <= 100; millisecond++)
+    external_time.set_current_time_ns(
+      base + millisecond * Common::kNanosecondsPerMillisecond);
+  Common::WorkerPool::getInstance().waitUntilIdle();
+  BOOST_CHECK_EQUAL(number_of_runs.load(), 11u);
+
+  BOOST_CHECK(ptr_periodic_class_controller_instance->changePeriod(
+    id, 5 * Common::kNanosecondsPerMillisecond));
+  for (int millisecond = 101; millisecond <= 120; millisecond++)
+    external_time.set_current_time_ns(
+      base + millisecond * Common::kNanosecondsPerMillisecond);
+  Common::WorkerPool::getInstance().waitUntilIdle();
+  BOOST_CHECK_EQUAL(number_of_runs.load(), 15u);
+  BOOST_CHECK(ptr_periodic_class_controller_instance->removeJob(id));
+}
+
+/**
+ * @brief Checks that the periods the external time jumps over
+ * are run with their nominal times (one by one or as a batch)
+ * unless the job skips them.
+ */
+BOOST_AUTO_TEST_CASE (CATCH_UP_TEST)
+{
+  auto& external_time = Common::ExternalTime::getInstance();
+  const Common::Nanoseconds base = 
+    (external_time.get_current_time_ns() 
+     / Common::kNanosecondsPerSecond + 10) 
+    * Common::kNanosecondsPerSecond;
+  external_time.set_current_time_ns(base);
+
+  auto ptr_periodic_class_controller_instance =
+   std::make_shared<PeriodicJobController>();
+  const auto period_ns = 10 * Common::kNanosecondsPerMillisecond;
+  std::vector<Common::Nanoseconds> cycle_times;
+  auto id1 = ptr_periodic_class_controller_instance->addTypedJob(
+    period_ns, 
+    [&cycle_times](Common::Nanoseconds cycle_time_ns)
+    {
+      cycle_times.push_back(cycle_time_ns);
+    });
+  std::vector<JobCycles> batches;
+  auto id2 = ptr_periodic_class_controller_instance->addTypedJob(
+    period_ns, 
+    [&batches](const JobCycles& cycles) 
+    { 
+      batches.push_back(cycles); 
+    });
+  std::vector<Common::Nanoseconds> skipping_cycle_times;
+  auto id3 = ptr_periodic_class_controller_instance->addJob(
+    period_ns,
+    [&skipping_cycle_times](Common::Nanoseconds cycle_time_ns)
+    {
+      skipping_cycle_times.push_back(cycle_time_ns);
+    });
+  BOOST_REQUIRE(ptr_periodic_class_controller_instance->
+    changeCatchUpMode(id3, Common::CatchUpMode::kSkipMissedPeriods));
+  std::vector<Common::Nanoseconds> payload_cycle_times;
+  auto id4 = ptr_periodic_class_controller_instance->addJob(
+    period_ns,
+    [&payload_cycle_times](Common::Nanoseconds cycle_time_ns)
+    {
+      payload_cycle_times.push_back(cycle_time_ns);
+    });
+
+  /* a gap of 5.5 periods */
+  external_time.set_current_time_ns(
+    base + 55 * Common::kNanosecondsPerMillisecond);
+  Common::WorkerPool::getInstance().waitUntilIdle();
+
+  BOOST_REQUIRE_EQUAL(cycle_times.size(), 6u);
+  for (std::size_t i = 0; i < cycle_times.size(); i++)
+    BOOST_CHECK_EQUAL(cycle_times[i], 
+      base + static_cast<Common::Nanoseconds>(i) * period_ns);
+
+  BOOST_REQUIRE_EQUAL(batches.size(), 2u);
+  BOOST_CHECK_EQUAL(batches[1].first_time_ns, base + period_ns);
+  BOOST_CHECK_EQUAL(batches[1].period_ns, period_ns);
+  BOOST_CHECK_EQUAL(batches[1].number_of_cycles, 5u);
+  BOOST_CHECK(payload_cycle_times == cycle_times);
+  BOOST_REQUIRE_EQUAL(skipping_cycle_times.size(), 2u);
+  BOOST_CHECK_EQUAL(skipping_cycle_times[0], base);
+  BOOST_CHECK_EQUAL(skipping_cycle_times[1], 
+    base + 55 * Common::kNanosecondsPerMillisecond);
+
+  /* the catching up jobs stay on their grid */
+  external_time.set_current_time_ns(
+    base + 60 * Common::kNanosecondsPerMillisecond);
+  Common::WorkerPool::getInstance().waitUntilIdle();
+  BOOST_REQUIRE_EQUAL(cycle_times.size(), 7u);
+  BOOST_CHECK_EQUAL(cycle_times.back(), base + 6 * period_ns);
+  BOOST_CHECK(payload_cycle_times == cycle_times);
+  BOOST_CHECK_EQUAL(skipping_cycle_times.size(), 2u);
+
+  for (auto id : {id1, id2, id3, id4})
+    BOOST_CHECK(ptr_periodic_class_controller_instance->removeJob(id));
+}
+
+/**
+ * @brief Checks that the cycles of a job handed over on many
+ * consecutive ticks (some of them catching up) run in the
+ * order of their nominal times, each exactly once.
+ */
+BOOST_AUTO_TEST_CASE (CYCLE_ORDER_TEST)
+{
+  auto& external_time = Common::ExternalTime::getInstance();
+  const Common::Nanoseconds base = 
+    (external_time.get_current_time_ns() 
+     / Common::kNanosecondsPerSecond + 10) 
+    * Common::kNanosecondsPerSecond;
+  external_time.set_current_time_ns(base);
+
+  auto ptr_periodic_class_controller_instance =
+   std::make_shared<PeriodicJobController>();
+  const auto period_ns = 10 * Common::kNanosecondsPerMillisecond;
+  std::vector<Common::Nanoseconds> cycle_times;
+  auto id = ptr_periodic_class_controller_instance->addTypedJob(
+    period_ns, 
+    [&cycle_times](Common::Nanoseconds cycle_time_ns)
+    {
+      /* slower than the ticks, so cycles of the job pile up
+      while it runs */
+      std::this_thread::sleep_for(std::chrono::microseconds(10));
+      cycle_times.push_back(cycle_time_ns);
+    });
+  BOOST_REQUIRE(!id.empty());
+
+  /* a period per tick, with a jump of 3 periods every 100 */
+  constexpr int number_of_ticks = 2000;
+  int number_of_periods = 0;
+  for (int tick = 1; tick <= number_of_ticks; tick++)
+  {
+    number_of_periods += tick % 100 == 0 ? 3 : 1;
+    external_time.set_current_time_ns(
+      base + number_of_periods * period_ns);
+  }
+  Common::WorkerPool::getInstance().waitUntilIdle();
+
+  BOOST_REQUIRE_EQUAL(cycle_times.size(), 
+                      static_cast<std::size_t>(number_of_periods) + 1);
+  for (std::size_t i = 0; i < cycle_times.size(); i++)
+    BOOST_REQUIRE_EQUAL(cycle_times[i], 
+      base + static_cast<Common::Nanoseconds>(i) * period_ns);
+  for (std::size_t i = 1; i < cycle_times.size(); i++)
+    BOOST_REQUIRE(cycle_times[i - 1] < cycle_times[i]);
+
+  BOOST_CHECK(ptr_periodic_class_controller_instance->removeJob(id));
+}
+
+/**
+ * @brief Checks that the clock stage moves the external time
+ * to the newest time published by several processors and keeps
+ * them within the allowed skew.
+ */
+BOOST_AUTO_TEST_CASE (CLOCK_STAGE_TEST)
+{
+  auto& external_time = Common::ExternalTime::getInstance();
+  auto& clock_stage = ClockStage::getInstance();
+  const Common::Nanoseconds base = 
+    external_time.get_current_time_ns() 
+    + 10 * Common::kNanosecondsPerSecond;
+
+  clock_stage.start();
+  BOOST_CHECK(clock_stage.is_running());
+  std::atomic<unsigned> number_of_skew_violations(0);
+  std::vector<std::thread> processors;
+  for (int processor_index = 0; processor_index < 4; 
+       processor_index++)
+    processors.emplace_back(
+      [&, processor_index]()
+      {
+        for (int step = 0; step < 1000; step++)
+        {
+          auto time_ns = base + (step * 4 + processor_index) 
+                         * Common::kNanosecondsPerMillisecond;
+          clock_stage.publish(time_ns);
+          if (external_time.get_current_time_ns() 
+              < time_ns - Common::kClockStageMaxSkewNanoseconds)
+            number_of_skew_violations++;
+        }
+      });
+  for (auto& processor : processors)
+    processor.join();
+  clock_stage.stop();
+  BOOST_CHECK(!clock_stage.is_running());
+
+  const auto last_time_ns = 
+    base + 3999 * Common::kNanosecondsPerMillisecond;
+  BOOST_CHECK_EQUAL(clock_stage.get_published_time_ns(), 
+                    last_time_ns);
+  BOOST_CHECK_EQUAL(external_time.get_current_time_ns(), 
+                    last_time_ns);
+  BOOST_CHECK_EQUAL(number_of_skew_violations.load(), 0u);
+}
+
+/**
+ * @brief Checks that the subscriptions to the external time
+ * fire once when the time crosses them and that the waiters
+ * are woken by the thread moving the time.
+ */
+BOOST_AUTO_TEST_CASE (EXTERNAL_TIME_SUBSCRIPTION_TEST)
+{
+  auto& external_time = Common::ExternalTime::getInstance();
+  /* The clock is shared by the whole program and never goes
+  backwards, so work relative to its current value. */
+  const int64_t base = external_time.get_current_time_ns()
+                       + 10 * 1000000000LL;
+  BOOST_CHECK(external_time.set_current_time_ns(base));
+  BOOST_CHECK(!external_time.set_current_time_ns(base - 1));
+  BOOST_CHECK_EQUAL(external_time.get_current_time_ns(), base);
+  BOOST_CHECK_EQUAL(external_time.get_current_time().tv_sec,
+                    base / 1000000000);
+
+  std::vector<int64_t> crossing_times;
+  auto id = external_time.subscribe(base + 1000,
+    [&](int64_t current_time_ns) 
+    { 
+      crossing_times.push_back(current_time_ns);
+    });
+  external_time.set_current_time_ns(base + 500);
+  BOOST_CHECK(crossing_times.empty());
+  external_time.set_current_time_ns(base + 1200);
+  BOOST_REQUIRE_EQUAL(crossing_times.size(), 1u);
+  BOOST_CHECK_EQUAL(crossing_times[0], base + 1200);
+
+  /* fired once, then disarmed */
+  external_time.set_current_time_ns(base + 2000);
+  BOOST_CHECK_EQUAL(crossing_times.size(), 1u);
+
+  /* a time already reached fires on the next update */
+  BOOST_CHECK(external_time.reschedule(id, base + 1500));
+  BOOST_CHECK_EQUAL(crossing_times.size(), 1u);
+  external_time.set_current_time_ns(base + 2001);
+  BOOST_CHECK_EQUAL(crossing_times.size(), 2u);
+
+  BOOST_CHECK(external_time.reschedule(id, base + 3000));
+  BOOST_CHECK(external_time.unsubscribe(id));
+  BOOST_CHECK(!external_time.unsubscribe(id));
+  BOOST_CHECK(!external_time.reschedule(id, base + 3000));
+  external_time.set_current_time_ns(base + 4000);
+  BOOST_CHECK_EQUAL(crossing_times.size(), 2u);
+
+  /* waiting for a time which is not reached times out */
+  BOOST_CHECK(!external_time.waitUntil(
+    base + 5000, std::chrono::milliseconds(10)));
+  BOOST_CHECK(external_time.waitUntil(base + 4000));
+
+  /* a waiter is woken by the thread moving the time */
+  std::atomic<bool> is_woken(false);
+  std::thread waiter([&]()
+  {
+    is_woken = external_time.waitUntil(base + 6000);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  external_time.set_current_time_ns(base + 5999);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  BOOST_CHECK(!is_woken);
+  external_time.set_current_time_ns(base + 6000);
+  waiter.join();
+  BOOST_CHECK(is_woken);
+}
+
+/**
+ * @brief Checks that the tasks queued to a single worker are
+ * stolen by the idle ones, that every task runs once and that
+ * a worker runs its own tasks first-in first-out.
+ */
+BOOST_AUTO_TEST_CASE (WORK_STEALING_TEST)
+{
+  std::atomic<unsigned> number_of_runs(0);
+  {
+    Common::WorkerPool worker_pool(4);
+    BOOST_CHECK_EQUAL(worker_pool.get_number_of_workers(), 4u);
+
+    /* Tasks submitted by a worker go to its own queue, so the
+    others can only get them by stealing. */
+    constexpr unsigned number_of_tasks = 64;
+    worker_pool.submit([&]()
+    {
+      for (unsigned i = 0; i < number_of_tasks; i++)
+        worker_pool.submit([&]()
+        {
+          std::this_thread::sleep_for(
+            std::chrono::milliseconds(1));
+          number_of_runs++;
+        });
+    });
+    worker_pool.waitUntilIdle();
+    BOOST_CHECK_EQUAL(number_of_runs.load(), number_of_tasks);
+    BOOST_CHECK(worker_pool.get_number_of_stolen_tasks() > 0);
+
+    /* the tasks submitted from outside are spread */
+    for (unsigned i = 0; i < number_of_tasks; i++)
+      worker_pool.submit([&]() { number_of_runs++; });
+  }
+  /* the destructor runs the remaining tasks */
+  BOOST_CHECK_EQUAL(number_of_runs.load(), 128u);
+
+  /* a worker runs its own queue in the order of submission */
+  std::vector<unsigned> order;
+  {
+    Common::WorkerPool worker_pool(1);
+    worker_pool.submit([&]()
+    {
+      for (unsigned i = 0; i < 16; i++)
+        worker_pool.submit([&order, i]() { order.push_back(i); });
+    });
+    worker_pool.waitUntilIdle();
+  }
+  BOOST_REQUIRE_EQUAL(order.size(), 16u);
+  for (unsigned i = 0; i < order.size(); i++)
+    BOOST_CHECK_EQUAL(order[i], i);
+
+  /* a task holding a job is queued without a heap allocation */
+  auto job = std::make_shared<unsigned>(0);
+  Common::WorkerPool::Task task([job]() { (*job)++; });
+  BOOST_CHECK(task.is_inline());
 }
 
 /**